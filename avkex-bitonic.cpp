@@ -0,0 +1,142 @@
+#include "avkex-kernels.h"
+
+#include <array>
+
+using namespace avkex;
+
+namespace {
+
+// mirrors Params of shaders/bitonic.comp
+struct BitonicParams {
+  VkDeviceAddress keys;
+  VkDeviceAddress values;
+  uint32_t n;
+  uint32_t k;
+  uint32_t j;
+  uint32_t pad0;
+};
+static_assert(sizeof(BitonicParams) == 32);
+
+uint32_t constexpr KEY_TYPE_COUNT = 3;
+// the largest tile the device allows, more steps stay on chip
+uint32_t constexpr PREFERRED_TILE_SIZE = 1024;
+
+uint32_t floorPowerOfTwo(uint32_t x) {
+  uint32_t result = 1;
+  while (result <= x / 2) {
+    result <<= 1;
+  }
+  return result;
+}
+
+}
+
+namespace avkex {
+
+// ------------------------------------------------------------------------------
+// BitonicSortImpl
+// ------------------------------------------------------------------------------
+class BitonicSortImpl {
+ public:
+  BitonicSortImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines);
+
+  bool valid() const { return m_valid; }
+  uint32_t tileSize() const { return m_tileSize; }
+
+  void sort(VulkanDevice const& dev, VkCommandBuffer commandBuffer, ESortKey keyType, uint32_t n, VkDeviceAddress keys,
+    VkDeviceAddress values) const;
+
+ private:
+  bool m_valid = false;
+  uint32_t m_tileSize = 0;
+  // [key type][values]
+  std::array<std::array<ComputeKernel, 2>, KEY_TYPE_COUNT> m_localSort;
+  std::array<std::array<ComputeKernel, 2>, KEY_TYPE_COUNT> m_localMerge;
+  std::array<std::array<ComputeKernel, 2>, KEY_TYPE_COUNT> m_global;
+};
+
+BitonicSortImpl::BitonicSortImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines) {
+  VulkanDeviceProfile const& profile = dev.profile();
+  VkSubgroupFeatureFlags const required = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_SHUFFLE_BIT;
+  if (!(profile.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) || (profile.subgroupSupportedOperations & required) != required) {
+    LOG_ERR << "BitonicSort needs subgroup shuffles in compute shaders" LOG_RST << std::endl;
+    return;
+  }
+  // power of two tiles made of full subgroups
+  m_tileSize = floorPowerOfTwo(chooseWorkgroupSize(profile, PREFERRED_TILE_SIZE));
+  if (m_tileSize < profile.subgroupSize) {
+    LOG_ERR << "BitonicSort: no power of two workgroup size holds a subgroup of " << profile.subgroupSize << LOG_RST << std::endl;
+    return;
+  }
+
+  std::vector<ComputeKernelDesc> descs;
+  descs.reserve(3 * 2 * KEY_TYPE_COUNT);
+  for (uint32_t keyType = 0; keyType < KEY_TYPE_COUNT; ++keyType) {
+    for (uint32_t hasValues = 0; hasValues < 2; ++hasValues) {
+      std::vector<uint32_t> const specialization{m_tileSize, keyType, hasValues};
+      descs.push_back({&m_localSort[keyType][hasValues], "bitonic_local_sort", sizeof(BitonicParams), specialization});
+      descs.push_back({&m_localMerge[keyType][hasValues], "bitonic_local_merge", sizeof(BitonicParams), specialization});
+      descs.push_back({&m_global[keyType][hasValues], "bitonic_global", sizeof(BitonicParams), specialization});
+    }
+  }
+  m_valid = createComputeKernels(dev, shaders, pipelineCache, descs, pipelines);
+}
+
+void BitonicSortImpl::sort(VulkanDevice const& dev, VkCommandBuffer commandBuffer, ESortKey keyType, uint32_t n, VkDeviceAddress keys,
+  VkDeviceAddress values) const {
+  assert(m_valid);
+  assert(n <= (1U << 31));
+  assert(static_cast<uint32_t>(keyType) < KEY_TYPE_COUNT);
+  if (n < 2) {
+    return;
+  }
+  VulkanDeviceProfile const& profile = dev.profile();
+  uint32_t const type = static_cast<uint32_t>(keyType);
+  bool const hasValues = values != 0;
+  uint32_t const tileGroups = chooseGroupCount(profile, n, m_tileSize, UINT32_MAX);
+  BitonicParams params{keys, values, n, 0, 0, 0};
+  m_localSort[type][hasValues].dispatch(commandBuffer, params, tileGroups);
+
+  // 64-bit: the last block size may be 2^31
+  uint64_t const paddedSize = uint64_t{floorPowerOfTwo(n)} < n ? uint64_t{floorPowerOfTwo(n)} * 2 : n;
+  for (uint64_t k = uint64_t{m_tileSize} * 2; k <= paddedSize; k <<= 1) {
+    params.k = static_cast<uint32_t>(k);
+    for (uint64_t j = k / 2; j >= m_tileSize; j >>= 1) {
+      params.j = static_cast<uint32_t>(j);
+      computeBarrier(dev, commandBuffer);
+      m_global[type][hasValues].dispatch(commandBuffer, params, chooseGroupCount(profile, n / 2 + j, m_tileSize, UINT32_MAX));
+    }
+    computeBarrier(dev, commandBuffer);
+    m_localMerge[type][hasValues].dispatch(commandBuffer, params, tileGroups);
+  }
+}
+
+// ------------------------------------------------------------------------------
+// BitonicSort
+// ------------------------------------------------------------------------------
+
+BitonicSort::BitonicSort(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines)
+ : m_impl(std::make_unique<BitonicSortImpl>(*dev, *shaders, pipelineCache, pipelines)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+BitonicSort::~BitonicSort() noexcept {
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+BitonicSort::operator bool() const {
+  return m_impl->valid();
+}
+
+uint32_t BitonicSort::tileSize() const {
+  return m_impl->tileSize();
+}
+
+void BitonicSort::sort(VkCommandBuffer commandBuffer, ESortKey keyType, uint32_t n, VkDeviceAddress keys, VkDeviceAddress values) {
+  m_impl->sort(*m_dev, commandBuffer, keyType, n, keys, values);
+}
+
+}
@@ -0,0 +1,227 @@
+#include "avkex-kernels.h"
+
+#include <array>
+#include <limits>
+
+using namespace avkex;
+
+namespace {
+
+// mirrors Params of shaders/blas1.comp
+struct Blas1Params {
+  VkDeviceAddress x;
+  VkDeviceAddress y;
+  VkDeviceAddress partials;
+  float alpha;
+  uint32_t n;
+};
+static_assert(sizeof(Blas1Params) == 32);
+
+enum EElementwise : uint32_t { Axpy = 0, Scal, Copy, Swap, ELEMENTWISE_COUNT };
+enum EReduction : uint32_t { Dot = 0, Nrm2, Asum, REDUCTION_COUNT };
+
+// grid caps, grid-stride loops cover the rest. Reductions keep the partials
+// small enough for a single finishing workgroup
+uint32_t constexpr ELEMENTWISE_MAX_GROUPS = 8192;
+uint32_t constexpr REDUCTION_MAX_GROUPS = 1024;
+// vec4 elements per invocation before the grid caps kick in
+uint32_t constexpr ITEMS_PER_INVOCATION = 4;
+// axpy size the workgroup size is tuned on, large enough to be bandwidth bound
+uint32_t constexpr TUNING_ELEMENTS = 1U << 22;
+
+bool isVec4Aligned(VkDeviceAddress address) { return address % 16 == 0; }
+
+}
+
+namespace avkex {
+
+// ------------------------------------------------------------------------------
+// Blas1Impl
+// ------------------------------------------------------------------------------
+class Blas1Impl {
+ public:
+  Blas1Impl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines,
+    KernelTuner* tuner);
+  void cleanup(VulkanDevice& dev) noexcept;
+
+  bool valid() const { return m_valid; }
+  uint32_t workgroupSize() const { return m_workgroupSize; }
+
+  void elementwise(VulkanDevice const& dev, VkCommandBuffer commandBuffer, EElementwise op, uint32_t n, float alpha,
+    VkDeviceAddress x, VkDeviceAddress y) const;
+  void reduce(VulkanDevice const& dev, VkCommandBuffer commandBuffer, EReduction op, uint32_t n,
+    VkDeviceAddress x, VkDeviceAddress y, VkDeviceAddress result) const;
+
+ private:
+  // 0 if nothing could be timed
+  static uint32_t tuneWorkgroupSize(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, KernelTuner& tuner);
+
+  bool m_valid = false;
+  uint32_t m_workgroupSize = 0;
+  // [op][vec4]
+  std::array<std::array<ComputeKernel, 2>, ELEMENTWISE_COUNT> m_elementwise;
+  std::array<std::array<ComputeKernel, 2>, REDUCTION_COUNT> m_reductions;
+  // [sqrt]
+  std::array<ComputeKernel, 2> m_finish;
+  DeviceBuffer m_partials;
+};
+
+Blas1Impl::Blas1Impl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines,
+  KernelTuner* tuner) {
+  VulkanDeviceProfile const& profile = dev.profile();
+  VkSubgroupFeatureFlags const required = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+  if (!(profile.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) || (profile.subgroupSupportedOperations & required) != required) {
+    LOG_ERR << "Blas1 needs subgroup arithmetic in compute shaders" LOG_RST << std::endl;
+    return;
+  }
+  m_workgroupSize = tuner ? tuneWorkgroupSize(dev, shaders, pipelineCache, *tuner) : 0;
+  if (m_workgroupSize == 0) {
+    m_workgroupSize = chooseWorkgroupSize(profile);
+  }
+
+  static std::string_view constexpr elementwiseNames[ELEMENTWISE_COUNT] = {"blas1_axpy", "blas1_scal", "blas1_copy", "blas1_swap"};
+  static std::string_view constexpr reductionNames[REDUCTION_COUNT] = {"blas1_dot", "blas1_nrm2", "blas1_asum"};
+  std::vector<ComputeKernelDesc> descs;
+  descs.reserve(2 * (ELEMENTWISE_COUNT + REDUCTION_COUNT + 1));
+  for (uint32_t vec4 = 0; vec4 < 2; ++vec4) {
+    uint32_t const vectorWidth = vec4 ? 4 : 1;
+    for (uint32_t op = 0; op < ELEMENTWISE_COUNT; ++op) {
+      descs.push_back({&m_elementwise[op][vec4], elementwiseNames[op], sizeof(Blas1Params), {m_workgroupSize, vectorWidth, 0}});
+    }
+    for (uint32_t op = 0; op < REDUCTION_COUNT; ++op) {
+      descs.push_back({&m_reductions[op][vec4], reductionNames[op], sizeof(Blas1Params), {m_workgroupSize, vectorWidth, 0}});
+    }
+    descs.push_back({&m_finish[vec4], "blas1_finish", sizeof(Blas1Params), {m_workgroupSize, 1, vec4}});
+  }
+  if (!createComputeKernels(dev, shaders, pipelineCache, descs, pipelines)) {
+    return;
+  }
+
+  m_partials = createDeviceBuffer(dev, REDUCTION_MAX_GROUPS * sizeof(float));
+  m_valid = static_cast<bool>(m_partials);
+}
+
+uint32_t Blas1Impl::tuneWorkgroupSize(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, KernelTuner& tuner) {
+  VulkanDeviceProfile const& profile = dev.profile();
+  // contents don't matter for the timing
+  DeviceBuffer x = createDeviceBuffer(dev, TUNING_ELEMENTS * sizeof(float));
+  DeviceBuffer y = createDeviceBuffer(dev, TUNING_ELEMENTS * sizeof(float));
+  VkPushConstantRange range{};
+  range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  range.size = sizeof(Blas1Params);
+  VkPipelineLayout const layout = createPipelineLayout(dev, 0, nullptr, 1, &range);
+
+  TuningSpace space;
+  space.kernel = "blas1_axpy";
+  space.shader = shaders.findShader("blas1_axpy");
+  space.layout = layout;
+  // the vec4 path, the one large aligned vectors take
+  space.parameters = {{"workgroupSize", 0, {64, 128, 256, 512, 1024}}, {"vectorWidth", 1, {4}}};
+  space.isValid = [&profile](std::vector<uint32_t> const& values) {
+    return chooseWorkgroupSize(profile, values[0]) == values[0];
+  };
+  space.record = [&](VkCommandBuffer commandBuffer, std::vector<uint32_t> const& values) {
+    uint32_t const groupCount = chooseGroupCount(profile, TUNING_ELEMENTS, values[0] * ITEMS_PER_INVOCATION, ELEMENTWISE_MAX_GROUPS);
+    Blas1Params const params{x.address, y.address, 0, 1e-3f, TUNING_ELEMENTS};
+    dev.api()->vkCmdPushConstants(commandBuffer, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(params), &params);
+    dev.api()->vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+  };
+  TuningResult result;
+  if (x && y && space.shader) {
+    result = tuner.tune(space, pipelineCache);
+  }
+
+  dev.api()->vkDestroyPipelineLayout(dev.device(), layout, nullptr);
+  destroyDeviceBuffer(dev, x);
+  destroyDeviceBuffer(dev, y);
+  return result.values.empty() ? 0 : result.values[0];
+}
+
+void Blas1Impl::cleanup(VulkanDevice& dev) noexcept {
+  destroyDeviceBuffer(dev, m_partials);
+}
+
+void Blas1Impl::elementwise(VulkanDevice const& dev, VkCommandBuffer commandBuffer, EElementwise op, uint32_t n, float alpha,
+  VkDeviceAddress x, VkDeviceAddress y) const {
+  assert(m_valid);
+  if (n == 0) {
+    return;
+  }
+  bool const vec4 = isVec4Aligned(x) && (op == Scal || isVec4Aligned(y));
+  uint32_t const groupCount = chooseGroupCount(dev.profile(), n, m_workgroupSize * ITEMS_PER_INVOCATION, ELEMENTWISE_MAX_GROUPS);
+  assert(n <= std::numeric_limits<uint32_t>::max() - groupCount * m_workgroupSize && "grid-stride index would wrap");
+  Blas1Params const params{x, y, 0, alpha, n};
+  m_elementwise[op][vec4].dispatch(commandBuffer, params, groupCount);
+}
+
+void Blas1Impl::reduce(VulkanDevice const& dev, VkCommandBuffer commandBuffer, EReduction op, uint32_t n,
+  VkDeviceAddress x, VkDeviceAddress y, VkDeviceAddress result) const {
+  assert(m_valid);
+  bool const vec4 = isVec4Aligned(x) && (op != Dot || isVec4Aligned(y));
+  uint32_t const groupCount = chooseGroupCount(dev.profile(), n, m_workgroupSize * ITEMS_PER_INVOCATION, REDUCTION_MAX_GROUPS);
+  assert(n <= std::numeric_limits<uint32_t>::max() - groupCount * m_workgroupSize && "grid-stride index would wrap");
+
+  // the previous reduction may still read the partials
+  computeBarrier(dev, commandBuffer);
+  Blas1Params const params{x, y, m_partials.address, 0.f, n};
+  m_reductions[op][vec4].dispatch(commandBuffer, params, groupCount);
+  computeBarrier(dev, commandBuffer);
+  Blas1Params const finishParams{m_partials.address, result, 0, 0.f, groupCount};
+  m_finish[op == Nrm2].dispatch(commandBuffer, finishParams, 1);
+}
+
+// ------------------------------------------------------------------------------
+// Blas1
+// ------------------------------------------------------------------------------
+
+Blas1::Blas1(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines,
+  KernelTuner* tuner)
+ : m_impl(std::make_unique<Blas1Impl>(*dev, *shaders, pipelineCache, pipelines, tuner)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+Blas1::~Blas1() noexcept {
+  m_impl->cleanup(*m_dev);
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+Blas1::operator bool() const {
+  return m_impl->valid();
+}
+
+uint32_t Blas1::workgroupSize() const {
+  return m_impl->workgroupSize();
+}
+
+void Blas1::axpy(VkCommandBuffer commandBuffer, uint32_t n, float alpha, VkDeviceAddress x, VkDeviceAddress y) {
+  m_impl->elementwise(*m_dev, commandBuffer, Axpy, n, alpha, x, y);
+}
+
+void Blas1::scal(VkCommandBuffer commandBuffer, uint32_t n, float alpha, VkDeviceAddress x) {
+  m_impl->elementwise(*m_dev, commandBuffer, Scal, n, alpha, x, 0);
+}
+
+void Blas1::copy(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress x, VkDeviceAddress y) {
+  m_impl->elementwise(*m_dev, commandBuffer, Copy, n, 0.f, x, y);
+}
+
+void Blas1::swap(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress x, VkDeviceAddress y) {
+  m_impl->elementwise(*m_dev, commandBuffer, Swap, n, 0.f, x, y);
+}
+
+void Blas1::dot(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress x, VkDeviceAddress y, VkDeviceAddress result) {
+  m_impl->reduce(*m_dev, commandBuffer, Dot, n, x, y, result);
+}
+
+void Blas1::nrm2(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress x, VkDeviceAddress result) {
+  m_impl->reduce(*m_dev, commandBuffer, Nrm2, n, x, 0, result);
+}
+
+void Blas1::asum(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress x, VkDeviceAddress result) {
+  m_impl->reduce(*m_dev, commandBuffer, Asum, n, x, 0, result);
+}
+
+}
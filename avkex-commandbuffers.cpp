@@ -81,7 +81,7 @@ VkCommandBuffer VulkanCommandBufferManagerImpl::getCommandBufferInternal(VulkanD
 
   // Determine Queue Specifics
   uint32_t queueFamilyIndex = (queueType == EQueueType::Graphics) ? dev.graphicsQueueFamilyIndex() : dev.computeQueueFamilyIndex();
-  VkSemaphore timelineSemaphore = (queueType == EQueueType::Compute) ? dev.graphicsTimelineSemaphore() : dev.computeTimelineSemaphore();
+  VkSemaphore timelineSemaphore = (queueType == EQueueType::Compute) ? dev.computeTimelineSemaphore() : dev.graphicsTimelineSemaphore();
 
   // get thread local storage
   auto* poolsVector = getThreadLocalPools(dev);
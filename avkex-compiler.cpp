@@ -0,0 +1,342 @@
+#include "avkex.h"
+
+#include <glslang/Public/ResourceLimits.h>
+#include <glslang/Public/ShaderLang.h>
+#include <glslang/SPIRV/GlslangToSpv.h>
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+using namespace avkex;
+
+namespace {
+
+// ---- Cache file ----
+// [CacheHeader][key bytes][SPIR-V words], the key is compared on load so a
+// hash collision is a miss, never a wrong shader
+struct CacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t keySize;
+  uint32_t wordCount;
+};
+inline constexpr uint32_t CACHE_MAGIC = 0x434B5641; // "AVKC"
+inline constexpr uint32_t CACHE_VERSION = 1;
+inline constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+uint64_t fnv1a64(std::string_view bytes) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (char c : bytes) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+void appendField(std::string& key, std::string_view field) {
+  uint32_t const size = static_cast<uint32_t>(field.size());
+  key.append(reinterpret_cast<char const*>(&size), sizeof(size));
+  key.append(field);
+}
+
+std::optional<EShLanguage> toGlslangStage(VkShaderStageFlagBits stage) {
+  switch (stage) {
+    case VK_SHADER_STAGE_VERTEX_BIT: return EShLangVertex;
+    case VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT: return EShLangTessControl;
+    case VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT: return EShLangTessEvaluation;
+    case VK_SHADER_STAGE_GEOMETRY_BIT: return EShLangGeometry;
+    case VK_SHADER_STAGE_FRAGMENT_BIT: return EShLangFragment;
+    case VK_SHADER_STAGE_COMPUTE_BIT: return EShLangCompute;
+    default: return std::nullopt;
+  }
+}
+
+// lowest Vulkan version accepting the SPIR-V version
+EShTargetClientVersion toVulkanClient(uint32_t spirvVersion) {
+  if (spirvVersion <= 0x00010000) return EShTargetVulkan_1_0;
+  if (spirvVersion <= 0x00010300) return EShTargetVulkan_1_1;
+  if (spirvVersion <= 0x00010500) return EShTargetVulkan_1_2;
+  return EShTargetVulkan_1_3;
+}
+
+}
+
+namespace avkex {
+
+// ------------------------------------------------------------------------------
+// ShaderCompilerImpl
+// ------------------------------------------------------------------------------
+class ShaderCompilerImpl {
+ public:
+  ShaderCompilerImpl(std::filesystem::path cacheDirectory, uint32_t threadCount, uint32_t spirvVersion);
+  ~ShaderCompilerImpl() noexcept;
+
+  void enqueue(ShaderSource&& source, std::function<void(std::vector<uint32_t>&&)>&& onDone);
+  uint64_t cacheHits() const { return m_cacheHits.load(std::memory_order_relaxed); }
+  uint64_t cacheMisses() const { return m_cacheMisses.load(std::memory_order_relaxed); }
+
+ private:
+  struct Job {
+    ShaderSource source;
+    std::function<void(std::vector<uint32_t>&&)> onDone;
+  };
+
+  void workerLoop();
+  std::vector<uint32_t> compileCached(ShaderSource const& source);
+  std::vector<uint32_t> compileGlslang(ShaderSource const& source) const;
+  std::string cacheKey(ShaderSource const& source) const;
+  std::filesystem::path cachePath(std::string const& key) const;
+  std::vector<uint32_t> loadCached(std::string const& key) const;
+  void storeCached(std::string const& key, std::vector<uint32_t> const& code) const;
+
+  std::filesystem::path m_cacheDirectory;
+  uint32_t m_spirvVersion;
+  std::string m_compilerVersion;
+  uint32_t m_tempTag; // tells temporary cache files of processes apart
+  mutable std::atomic<uint32_t> m_tempCounter = 0;
+  std::atomic<uint64_t> m_cacheHits = 0;
+  std::atomic<uint64_t> m_cacheMisses = 0;
+
+  std::vector<std::thread> m_workers;
+  std::mutex m_jobsMtx;
+  std::condition_variable m_jobsCv;
+  std::deque<Job> m_jobs;
+  bool m_stopping = false;
+};
+
+ShaderCompilerImpl::ShaderCompilerImpl(std::filesystem::path cacheDirectory, uint32_t threadCount, uint32_t spirvVersion)
+ : m_cacheDirectory(std::move(cacheDirectory)), m_spirvVersion(spirvVersion), m_tempTag(std::random_device{}()) {
+  // reference counted by glslang, paired with FinalizeProcess
+  glslang::InitializeProcess();
+  glslang::Version const version = glslang::GetVersion();
+  m_compilerVersion = std::to_string(version.major) + "." + std::to_string(version.minor) + "." +
+    std::to_string(version.patch) + (version.flavor ? version.flavor : "");
+
+  if (!m_cacheDirectory.empty()) {
+    std::error_code ec;
+    std::filesystem::create_directories(m_cacheDirectory, ec);
+    if (ec) {
+      LOG_ERR << "Couldn't create shader cache " << m_cacheDirectory.string() << ", disk cache disabled" LOG_RST << std::endl;
+      m_cacheDirectory.clear();
+    }
+  }
+
+  if (threadCount == 0) {
+    threadCount = std::max(1U, std::thread::hardware_concurrency());
+  }
+  m_workers.reserve(threadCount);
+  for (uint32_t i = 0; i < threadCount; ++i) {
+    m_workers.emplace_back([this]() { workerLoop(); });
+  }
+}
+
+ShaderCompilerImpl::~ShaderCompilerImpl() noexcept {
+  {
+    std::lock_guard lock{m_jobsMtx};
+    m_stopping = true;
+  }
+  m_jobsCv.notify_all();
+  for (std::thread& worker : m_workers) {
+    worker.join();
+  }
+  glslang::FinalizeProcess();
+}
+
+void ShaderCompilerImpl::enqueue(ShaderSource&& source, std::function<void(std::vector<uint32_t>&&)>&& onDone) {
+  {
+    std::lock_guard lock{m_jobsMtx};
+    m_jobs.push_back({std::move(source), std::move(onDone)});
+  }
+  m_jobsCv.notify_one();
+}
+
+void ShaderCompilerImpl::workerLoop() {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock lock{m_jobsMtx};
+      // drain the queue before stopping
+      m_jobsCv.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+      if (m_jobs.empty())
+        return;
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+    job.onDone(compileCached(job.source));
+  }
+}
+
+std::vector<uint32_t> ShaderCompilerImpl::compileCached(ShaderSource const& source) {
+  if (m_cacheDirectory.empty()) {
+    m_cacheMisses.fetch_add(1, std::memory_order_relaxed);
+    return compileGlslang(source);
+  }
+  std::string const key = cacheKey(source);
+  if (std::vector<uint32_t> cached = loadCached(key); !cached.empty()) {
+    m_cacheHits.fetch_add(1, std::memory_order_relaxed);
+    return cached;
+  }
+  m_cacheMisses.fetch_add(1, std::memory_order_relaxed);
+  std::vector<uint32_t> code = compileGlslang(source);
+  if (!code.empty()) {
+    storeCached(key, code);
+  }
+  return code;
+}
+
+std::vector<uint32_t> ShaderCompilerImpl::compileGlslang(ShaderSource const& source) const {
+  std::optional<EShLanguage> const stage = toGlslangStage(source.stage);
+  if (!stage) {
+    LOG_ERR << "Unsupported shader stage " << source.stage << LOG_RST << std::endl;
+    return {};
+  }
+  bool const isHlsl = source.language == EShaderLanguage::Hlsl;
+
+  std::string preamble;
+  for (auto const& [name, value] : source.defines) {
+    preamble.append("#define ").append(name).append(" ").append(value).append("\n");
+  }
+
+  glslang::TShader shader{*stage};
+  char const* code = source.code.c_str();
+  shader.setStrings(&code, 1);
+  shader.setPreamble(preamble.c_str());
+  if (isHlsl) {
+    shader.setEntryPoint(source.entryPoint.c_str());
+    shader.setSourceEntryPoint(source.entryPoint.c_str());
+  } else if (source.entryPoint != "main") {
+    // GLSL source always starts at main(), only the SPIR-V name changes
+    shader.setEntryPoint(source.entryPoint.c_str());
+  }
+  shader.setEnvInput(isHlsl ? EShSourceHlsl : EShSourceGlsl, *stage, EShClientVulkan, 100);
+  shader.setEnvClient(EShClientVulkan, toVulkanClient(m_spirvVersion));
+  shader.setEnvTarget(EShTargetSpv, static_cast<EShTargetLanguageVersion>(m_spirvVersion));
+
+  EShMessages const messages = static_cast<EShMessages>(EShMsgSpvRules | EShMsgVulkanRules | (isHlsl ? EShMsgReadHlsl : EShMsgDefault));
+  if (!shader.parse(GetDefaultResources(), 450, false, messages)) {
+    LOG_ERR << "Shader compilation failed:\n" << shader.getInfoLog() << LOG_RST << std::endl;
+    return {};
+  }
+  glslang::TProgram program;
+  program.addShader(&shader);
+  if (!program.link(messages)) {
+    LOG_ERR << "Shader link failed:\n" << program.getInfoLog() << LOG_RST << std::endl;
+    return {};
+  }
+
+  std::vector<uint32_t> spirv;
+  glslang::SpvOptions options{};
+  glslang::GlslangToSpv(*program.getIntermediate(*stage), spirv, &options);
+  return spirv;
+}
+
+std::string ShaderCompilerImpl::cacheKey(ShaderSource const& source) const {
+  // length prefixed so that field boundaries can't alias
+  std::string key;
+  key.reserve(source.code.size() + 128);
+  appendField(key, m_compilerVersion);
+  appendField(key, std::to_string(m_spirvVersion));
+  appendField(key, std::to_string(static_cast<uint32_t>(source.language)));
+  appendField(key, std::to_string(static_cast<uint32_t>(source.stage)));
+  appendField(key, source.entryPoint);
+  for (auto const& [name, value] : source.defines) {
+    appendField(key, name);
+    appendField(key, value);
+  }
+  appendField(key, source.code);
+  return key;
+}
+
+std::filesystem::path ShaderCompilerImpl::cachePath(std::string const& key) const {
+  char name[24];
+  std::snprintf(name, sizeof(name), "%016llx.spv", static_cast<unsigned long long>(fnv1a64(key)));
+  return m_cacheDirectory / name;
+}
+
+std::vector<uint32_t> ShaderCompilerImpl::loadCached(std::string const& key) const {
+  std::ifstream file{cachePath(key), std::ios::binary};
+  if (!file) {
+    return {};
+  }
+  CacheHeader header{};
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!file || header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.keySize != key.size()) {
+    return {};
+  }
+  std::string storedKey(header.keySize, '\0');
+  file.read(storedKey.data(), header.keySize);
+  if (!file || storedKey != key) {
+    return {};
+  }
+  // a truncated or corrupt entry is a miss: the word count must match the
+  // rest of the file before anything is allocated
+  std::streampos const codeStart = file.tellg();
+  file.seekg(0, std::ios::end);
+  std::streamoff const remaining = file.tellg() - codeStart;
+  file.seekg(codeStart);
+  if (!file || header.wordCount == 0 || remaining != static_cast<std::streamoff>(header.wordCount * sizeof(uint32_t))) {
+    return {};
+  }
+  std::vector<uint32_t> code(header.wordCount);
+  file.read(reinterpret_cast<char*>(code.data()), code.size() * sizeof(uint32_t));
+  if (!file || code[0] != SPIRV_MAGIC) {
+    return {};
+  }
+  return code;
+}
+
+void ShaderCompilerImpl::storeCached(std::string const& key, std::vector<uint32_t> const& code) const {
+  // write aside then rename, readers in this or other processes never see a
+  // partial file
+  std::filesystem::path const path = cachePath(key);
+  std::filesystem::path temp = path;
+  temp += ".tmp" + std::to_string(m_tempTag) + "-" + std::to_string(m_tempCounter.fetch_add(1, std::memory_order_relaxed));
+  {
+    std::ofstream file{temp, std::ios::binary | std::ios::trunc};
+    CacheHeader const header{CACHE_MAGIC, CACHE_VERSION, static_cast<uint32_t>(key.size()), static_cast<uint32_t>(code.size())};
+    file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    file.write(key.data(), static_cast<std::streamsize>(key.size()));
+    file.write(reinterpret_cast<char const*>(code.data()), static_cast<std::streamsize>(code.size() * sizeof(uint32_t)));
+    if (!file) {
+      LOG_ERR << "Couldn't write shader cache entry " << temp.string() << LOG_RST << std::endl;
+      return;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temp, path, ec);
+  if (ec) {
+    std::filesystem::remove(temp, ec);
+  }
+}
+
+// ------------------------------------------------------------------------------
+// ShaderCompiler
+// ------------------------------------------------------------------------------
+
+ShaderCompiler::ShaderCompiler(std::filesystem::path cacheDirectory, uint32_t threadCount, uint32_t spirvVersion)
+ : m_impl(std::make_unique<ShaderCompilerImpl>(std::move(cacheDirectory), threadCount, spirvVersion)) {}
+
+ShaderCompiler::~ShaderCompiler() noexcept = default;
+
+std::future<std::vector<uint32_t>> ShaderCompiler::compile(ShaderSource source) {
+  auto promise = std::make_shared<std::promise<std::vector<uint32_t>>>();
+  std::future<std::vector<uint32_t>> result = promise->get_future();
+  compile(std::move(source), [promise](std::vector<uint32_t>&& code) { promise->set_value(std::move(code)); });
+  return result;
+}
+
+void ShaderCompiler::compile(ShaderSource source, std::function<void(std::vector<uint32_t>&& code)> onDone) {
+  m_impl->enqueue(std::move(source), std::move(onDone));
+}
+
+uint64_t ShaderCompiler::cacheHits() const { return m_impl->cacheHits(); }
+uint64_t ShaderCompiler::cacheMisses() const { return m_impl->cacheMisses(); }
+
+}
@@ -3,7 +3,6 @@
 #include <cassert>
 #include <utility>
 #include <set>
-#include <thread>
 
 using namespace avkex;
 
@@ -22,6 +21,8 @@ VulkanDevice::VulkanDevice(VulkanDevice&& that) noexcept
    m_device(std::exchange(that.m_device, VK_NULL_HANDLE)),
    m_table(std::exchange(that.m_table, nullptr)),
    m_allocator(std::exchange(that.m_allocator, VK_NULL_HANDLE)),
+   m_optionalExtensions(std::exchange(that.m_optionalExtensions, EVulkanOptionalExtensionSupport{})),
+   m_profile(std::exchange(that.m_profile, VulkanDeviceProfile{})),
    m_graphicsQueue(std::exchange(that.m_graphicsQueue, VK_NULL_HANDLE)),
    m_graphicsQueueFamilyIndex(std::exchange(that.m_graphicsQueueFamilyIndex, -1U)),
    m_graphicsTimelineSemaphore(std::exchange(that.m_graphicsTimelineSemaphore, VK_NULL_HANDLE)),
@@ -46,6 +47,8 @@ VulkanDevice& VulkanDevice::operator=(VulkanDevice&& that) noexcept {
     m_device = std::exchange(that.m_device, VK_NULL_HANDLE);
     m_table = std::exchange(that.m_table, nullptr);
     m_allocator = std::exchange(that.m_allocator, nullptr);
+    m_optionalExtensions = std::exchange(that.m_optionalExtensions, EVulkanOptionalExtensionSupport{});
+    m_profile = std::exchange(that.m_profile, VulkanDeviceProfile{});
     m_graphicsQueue = std::exchange(that.m_graphicsQueue, VK_NULL_HANDLE);
     m_graphicsQueueFamilyIndex = std::exchange(that.m_graphicsQueueFamilyIndex, -1U);
     m_graphicsTimelineSemaphore = std::exchange(that.m_graphicsTimelineSemaphore, VK_NULL_HANDLE);
@@ -64,8 +67,12 @@ void VulkanDevice::acquire() {
 }
 
 void VulkanDevice::release() { 
-  int const previous = m_refCount.fetch_sub(1, std::memory_order_relaxed);
-  assert(previous >= 0);
+  int const previous = m_refCount.fetch_sub(1, std::memory_order_release);
+  assert(previous > 0);
+  if (previous == 1) {
+    // someone may be parked in waitForZero
+    atomicNotifyAll(m_refCount);
+  }
 }
 
 VulkanDevice::VulkanDevice(VkInstance instance, VulkanDeviceInfo const& devInfo) 
@@ -91,6 +98,40 @@ VulkanDevice::VulkanDevice(VkInstance instance, VulkanDeviceInfo const& devInfo)
   features.pNext = &vulkanMemoryModelFeatures;
   handleRequiredDeviceFeatures(features, false);
 
+  VkPhysicalDeviceMaintenance5FeaturesKHR maintenance5Features{};
+  maintenance5Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_5_FEATURES_KHR;
+  maintenance5Features.maintenance5 = VK_TRUE;
+  if (devInfo.queryResult.hasMaintenance5Ext()) {
+    maintenance5Features.pNext = features.pNext;
+    features.pNext = &maintenance5Features;
+  }
+  VkPhysicalDevice16BitStorageFeatures storage16BitFeatures{};
+  storage16BitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES;
+  storage16BitFeatures.storageBuffer16BitAccess = VK_TRUE;
+  VkPhysicalDeviceShaderFloat16Int8FeaturesKHR float16Int8Features{};
+  float16Int8Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_FLOAT16_INT8_FEATURES_KHR;
+  float16Int8Features.shaderFloat16 = VK_TRUE;
+  if (devInfo.queryResult.hasFloat16Ext()) {
+    float16Int8Features.pNext = features.pNext;
+    storage16BitFeatures.pNext = &float16Int8Features;
+    features.pNext = &storage16BitFeatures;
+  }
+  VkPhysicalDeviceCooperativeMatrixFeaturesKHR cooperativeMatrixFeatures{};
+  cooperativeMatrixFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_COOPERATIVE_MATRIX_FEATURES_KHR;
+  cooperativeMatrixFeatures.cooperativeMatrix = VK_TRUE;
+  if (devInfo.queryResult.hasCooperativeMatrixExt()) {
+    cooperativeMatrixFeatures.pNext = features.pNext;
+    features.pNext = &cooperativeMatrixFeatures;
+  }
+  VkPhysicalDeviceShaderAtomicInt64FeaturesKHR atomicInt64Features{};
+  atomicInt64Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_INT64_FEATURES_KHR;
+  atomicInt64Features.shaderBufferInt64Atomics = VK_TRUE;
+  if (devInfo.queryResult.hasInt64AtomicsExt()) {
+    features.features.shaderInt64 = VK_TRUE;
+    atomicInt64Features.pNext = features.pNext;
+    features.pNext = &atomicInt64Features;
+  }
+
   // extensions
   std::vector<char const*> extensions = getVulkanMinimalRequiredDeviceExtensions();
   if (devInfo.queryResult.hasMemoryBudgetExt()) {
@@ -99,6 +140,24 @@ VulkanDevice::VulkanDevice(VkInstance instance, VulkanDeviceInfo const& devInfo)
   if (devInfo.queryResult.hasDedicatedAllocationExt()) {
     extensions.push_back(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME);
   }
+  if (devInfo.queryResult.hasMaintenance5Ext()) {
+    extensions.push_back(VK_KHR_MAINTENANCE_5_EXTENSION_NAME);
+    extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+    extensions.push_back(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME);
+    extensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+  }
+  if (devInfo.queryResult.hasFloat16Ext()) {
+    extensions.push_back(VK_KHR_16BIT_STORAGE_EXTENSION_NAME);
+    extensions.push_back(VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME);
+  }
+  if (devInfo.queryResult.hasCooperativeMatrixExt()) {
+    extensions.push_back(VK_KHR_COOPERATIVE_MATRIX_EXTENSION_NAME);
+  }
+  if (devInfo.queryResult.hasInt64AtomicsExt()) {
+    extensions.push_back(VK_KHR_SHADER_ATOMIC_INT64_EXTENSION_NAME);
+  }
+  m_optionalExtensions = devInfo.queryResult.optionalExtensions;
+  m_profile = captureDeviceProfile(m_physicalDevice, devInfo.queryResult.computeQueueFamilyIndex);
 
   // queues (TODO more generic? maybe?)
   float queuePriority = 1.f;
@@ -189,8 +248,10 @@ void cleanupDevice(VulkanDevice& device) {
 }
 
 void waitForZero(std::atomic_int& counter) {
-  while (counter.load(std::memory_order_relaxed)) {
-    std::this_thread::yield();
+  SpinWait spin;
+  for (int value = counter.load(std::memory_order_acquire); value != 0; value = counter.load(std::memory_order_acquire)) {
+    if (!spin.spinOnce())
+      atomicWait(counter, value);
   }
 }
 
@@ -203,7 +264,7 @@ VmaAllocator createVmaAllocator(
   allocatorCreateInfo.instance = instance;
   allocatorCreateInfo.vulkanApiVersion = vulkanApiVersion;
 
-  // no internal mutexes, we'll sync allocations ourselves
+  // no internal mutexes, we'll sync allocations ourselves (VulkanDevice::lockAllocator)
   allocatorCreateInfo.flags |= VMA_ALLOCATOR_CREATE_EXTERNALLY_SYNCHRONIZED_BIT;
 
   // buffer device address is a required extension. allows usage VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT. VkMemory backing it will have VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT automatically added by the library
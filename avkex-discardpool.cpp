@@ -2,7 +2,11 @@
 
 #include <algorithm>
 #include <atomic>
+#include <array>
+#include <chrono>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 #include <thread>
 #include <shared_mutex>
 #include <unordered_map>
@@ -28,134 +32,488 @@ struct PendingImage {
   uint64_t readyValue;
 };
 
+struct PendingRecycleBuffer {
+  PendingRecycleBuffer(VkBuffer _buffer, VmaAllocation _alloc, uint64_t _readyValue, VkDeviceSize _size, VkBufferUsageFlags _usage)
+  : resource(_buffer), alloc(_alloc), readyValue(_readyValue), size(_size), usage(_usage) {}
+
+  VkBuffer resource;
+  VmaAllocation alloc;
+  uint64_t readyValue;
+  VkDeviceSize size;
+  VkBufferUsageFlags usage;
+};
+
+struct PendingObject {
+  PendingObject(uint64_t _handleBits, uint64_t _readyValue, EVulkanObjectType _type)
+  : resource(_handleBits), readyValue(_readyValue), type(_type) {}
+
+  uint64_t resource;
+  uint64_t readyValue;
+  EVulkanObjectType type;
+};
+
 namespace avkex {
 
 // ------------------------------------------------------------------------------
-// SemaphoreContent
+// DeferredDeletionTable
 // ------------------------------------------------------------------------------
 
-// TODO: Setter for compaction threshold (manage latency spikes)
-class SemaphoreContent {
+// Structure of arrays, one table per object type: a compact readyValue column,
+// scanned for ready rows, and a handle column, destroyed in a tight loop with
+// the type dispatch hoisted out of it.
+// - rows come from several producer lanes, hence aren't sorted by readyValue:
+//   a collect scans the whole column, destroys every ready row and compacts the
+//   pending ones in place, in the same pass
+// - each table caches its smallest pending readyValue, such that collects which
+//   can't destroy anything skip the scan
+// - single consumer: protected by a try-lock, like SegmentedMpscQueue
+class DeferredDeletionTable {
  private:
-  template <typename T>
-  struct VectorOffset {
-    explicit VectorOffset(uint32_t cap) : atomVec(cap), start(0) {}
-
-    AtomicVector<T> atomVec;
-    size_t start;
+  static size_t constexpr COLUMN_CAPACITY = 256;
+  static size_t constexpr TYPE_COUNT = static_cast<size_t>(EVulkanObjectType::Count);
+
+  struct TypeTable {
+    TypeTable() {
+      readyValues.reserve(COLUMN_CAPACITY);
+      handles.reserve(COLUMN_CAPACITY);
+    }
+
+    std::vector<uint64_t> readyValues;
+    std::vector<uint64_t> handles;
+    uint64_t minPending = UINT64_MAX;
   };
 
  public:
-  SemaphoreContent(uint32_t _minCap, uint compactionThreshold, uint32_t _maxCap) 
-   : m_buffers(_minCap), m_images(_minCap), 
-     m_maxCap(_maxCap), m_compactionThreshold(compactionThreshold) {
-    assert(m_compactionThreshold <= m_maxCap);
+  DeferredDeletionTable() { m_readyHandles.reserve(COLUMN_CAPACITY); }
+  DeferredDeletionTable(DeferredDeletionTable const&) = delete;
+  DeferredDeletionTable& operator=(DeferredDeletionTable const&) = delete;
+  // Unchecked move semantics: no consumer must be active on either side
+  DeferredDeletionTable(DeferredDeletionTable&& that) noexcept
+   : m_tables(std::move(that.m_tables)), m_readyHandles(std::move(that.m_readyHandles)) {}
+  DeferredDeletionTable& operator=(DeferredDeletionTable&& that) noexcept {
+    m_tables = std::move(that.m_tables);
+    m_readyHandles = std::move(that.m_readyHandles);
+    return *this;
   }
-  SemaphoreContent(SemaphoreContent const&) = delete;
-  SemaphoreContent(SemaphoreContent &&) noexcept = default;
-  SemaphoreContent& operator=(SemaphoreContent const&) = delete;
-  SemaphoreContent& operator=(SemaphoreContent &&) noexcept = default;
 
+  bool tryLock() { return !m_busy.test_and_set(std::memory_order_acquire); }
+  void unlock() { m_busy.clear(std::memory_order_release); }
 
-  // TODO: if atomics are mutable this can be made const
-  bool allEmpty() {
-    bool result = false;
+  // requires lock
+  void append(PendingObject const& object) {
+    TypeTable& table = m_tables[static_cast<size_t>(object.type)];
+    table.readyValues.push_back(object.readyValue);
+    table.handles.push_back(object.resource);
+    table.minPending = std::min(table.minPending, object.readyValue);
+  }
 
-    m_buffers.atomVec.readDo([&result](std::vector<PendingBuffer> const& vec) {
-      result |= vec.empty();
-    });
-    if (result) return true;
+  // requires lock. returns the smallest readyValue still pending, or UINT64_MAX
+  uint64_t collect(VulkanDevice& dev, uint64_t readyValue) {
+    uint64_t minPending = UINT64_MAX;
+    for (size_t type = 0; type < TYPE_COUNT; ++type) {
+      TypeTable& table = m_tables[type];
+      if (table.minPending > readyValue) {
+        minPending = std::min(minPending, table.minPending);
+        continue;
+      }
+      m_readyHandles.clear();
+      uint64_t tableMinPending = UINT64_MAX;
+      size_t kept = 0;
+      for (size_t row = 0; row < table.readyValues.size(); ++row) {
+        uint64_t const rowValue = table.readyValues[row];
+        if (rowValue <= readyValue) {
+          m_readyHandles.push_back(table.handles[row]);
+          continue;
+        }
+        tableMinPending = std::min(tableMinPending, rowValue);
+        table.readyValues[kept] = rowValue;
+        table.handles[kept] = table.handles[row];
+        ++kept;
+      }
+      table.readyValues.resize(kept);
+      table.handles.resize(kept);
+      table.minPending = tableMinPending;
+      minPending = std::min(minPending, tableMinPending);
+      destroyBatch(dev, static_cast<EVulkanObjectType>(type), m_readyHandles);
+    }
+    return minPending;
+  }
 
-    m_images.atomVec.readDo([&result](std::vector<PendingImage> const& vec) {
-      result |= vec.empty();
+  // requires lock
+  bool empty() const {
+    return std::all_of(m_tables.cbegin(), m_tables.cend(), [](TypeTable const& table) {
+      return table.readyValues.empty();
     });
-    if (result) return true;
-    // ...
+  }
 
-    return false;
+ private:
+  template <typename H>
+  static inline void destroyAll(void (VKAPI_PTR *pfnDestroy)(VkDevice, H, VkAllocationCallbacks const*), VkDevice device, std::vector<uint64_t> const& handles) {
+    for (uint64_t const handle : handles) {
+      pfnDestroy(device, vkHandleFromBits<H>(handle), nullptr);
+    }
   }
 
-  void setCompactThreshold(uint32_t newVal) {
-    m_compactionThreshold = newVal;
-    assert(m_compactionThreshold <= m_maxCap);
+  static void destroyBatch(VulkanDevice& dev, EVulkanObjectType type, std::vector<uint64_t> const& handles) {
+    VolkDeviceTable const& api = *dev.api();
+    VkDevice const device = dev.device();
+    switch (type) {
+      case EVulkanObjectType::Pipeline: destroyAll(api.vkDestroyPipeline, device, handles); break;
+      case EVulkanObjectType::PipelineLayout: destroyAll(api.vkDestroyPipelineLayout, device, handles); break;
+      case EVulkanObjectType::PipelineCache: destroyAll(api.vkDestroyPipelineCache, device, handles); break;
+      case EVulkanObjectType::DescriptorSetLayout: destroyAll(api.vkDestroyDescriptorSetLayout, device, handles); break;
+      case EVulkanObjectType::DescriptorPool: destroyAll(api.vkDestroyDescriptorPool, device, handles); break;
+      case EVulkanObjectType::ShaderModule: destroyAll(api.vkDestroyShaderModule, device, handles); break;
+      case EVulkanObjectType::Event: destroyAll(api.vkDestroyEvent, device, handles); break;
+      case EVulkanObjectType::ImageView: destroyAll(api.vkDestroyImageView, device, handles); break;
+      case EVulkanObjectType::BufferView: destroyAll(api.vkDestroyBufferView, device, handles); break;
+      case EVulkanObjectType::Sampler: destroyAll(api.vkDestroySampler, device, handles); break;
+      case EVulkanObjectType::QueryPool: destroyAll(api.vkDestroyQueryPool, device, handles); break;
+      case EVulkanObjectType::Count: assert(false); break;
+    }
   }
 
-  // TODO: method recycle buffer, recyle image (need to store more metadata, different vectors)
-  bool discardBuffer(VkBuffer buffer, VmaAllocation alloc, uint64_t readyValue) {
-    return discardStuff<PendingBuffer>(m_buffers.atomVec, m_maxCap, buffer, alloc, readyValue);
+  std::array<TypeTable, TYPE_COUNT> m_tables;
+  std::vector<uint64_t> m_readyHandles; // scratch of collect
+  std::atomic_flag m_busy = ATOMIC_FLAG_INIT;
+};
+
+// ------------------------------------------------------------------------------
+// BufferRecycler
+// ------------------------------------------------------------------------------
+
+// Free lists of retired buffers, one per power of two size class, grouped in
+// buckets by (usage, memory properties). Free lists are used as stacks, hence
+// - acquire pops the most recently retired buffer
+// - each free list is sorted by generation, so idle trimming erases a prefix
+// Note: VMA calls hold VulkanDevice::lockAllocator, taken after m_mtx
+class BufferRecycler {
+ private:
+  static uint32_t constexpr SIZE_CLASS_COUNT = 64;
+  static uint32_t constexpr BUCKETS_CAPACITY = 16;
+
+  struct FreeBuffer {
+    VkBuffer buffer;
+    VmaAllocation alloc;
+    VkDeviceSize size;
+    uint64_t generation; // value of m_generation when it was recycled
+  };
+
+  struct Bucket {
+    VkBufferUsageFlags usage;
+    VkMemoryPropertyFlags memFlags;
+    std::array<std::vector<FreeBuffer>, SIZE_CLASS_COUNT> classes;
+  };
+
+ public:
+  static VkDeviceSize constexpr DEFAULT_HIGH_WATER_BYTES = static_cast<VkDeviceSize>(256) << 20;
+  static uint32_t constexpr DEFAULT_MAX_IDLE_COLLECTS = 64;
+
+  BufferRecycler() { m_buckets.reserve(BUCKETS_CAPACITY); }
+
+  void setLimits(VkDeviceSize highWaterBytes, uint32_t maxIdleCollects) {
+    std::lock_guard lock{m_mtx};
+    m_highWaterBytes = highWaterBytes;
+    m_maxIdleCollects = maxIdleCollects;
   }
-  bool discardImage(VkImage image, VmaAllocation alloc, uint64_t readyValue) {
-    return discardStuff<PendingImage>(m_images.atomVec, m_maxCap, image, alloc, readyValue);
+
+  VkBuffer acquire(VulkanDevice& dev, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memFlags, VmaAllocation* outAlloc) {
+    assert(size > 0 && outAlloc);
+    uint32_t const sizeClass = log2Ceil(size);
+    assert(sizeClass < SIZE_CLASS_COUNT);
+    std::lock_guard lock{m_mtx};
+
+    // 1. free list hit. Recycled memory can have more property flags than requested
+    for (Bucket& bucket : m_buckets) {
+      if (bucket.usage != usage || (bucket.memFlags & memFlags) != memFlags)
+        continue;
+      std::vector<FreeBuffer>& freeList = bucket.classes[sizeClass];
+      if (freeList.empty())
+        continue;
+      FreeBuffer const freeBuffer = freeList.back();
+      freeList.pop_back();
+      m_bytes -= freeBuffer.size;
+      *outAlloc = freeBuffer.alloc;
+      return freeBuffer.buffer;
+    }
+
+    // 2. miss, create a buffer with the whole class size, such that it's reusable
+    VkBufferCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    createInfo.size = static_cast<VkDeviceSize>(1) << sizeClass;
+    createInfo.usage = usage;
+    createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    VmaAllocationCreateInfo allocCreateInfo{};
+    allocCreateInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
+    allocCreateInfo.requiredFlags = memFlags;
+    if (memFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+      allocCreateInfo.flags |= VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    auto const createBuffer = [&]() {
+      auto const allocatorLock = dev.lockAllocator();
+      return vmaCreateBuffer(dev.allocator(), &createInfo, &allocCreateInfo, &buffer, outAlloc, nullptr);
+    };
+    VkResult res = createBuffer();
+    if (res == VK_ERROR_OUT_OF_DEVICE_MEMORY || res == VK_ERROR_OUT_OF_HOST_MEMORY) {
+      // give back as much of the same kind of memory as needed and retry once
+      if (releaseLocked(dev, createInfo.size, memFlags))
+        res = createBuffer();
+      if (res == VK_ERROR_OUT_OF_DEVICE_MEMORY || res == VK_ERROR_OUT_OF_HOST_MEMORY) {
+        *outAlloc = VK_NULL_HANDLE;
+        return VK_NULL_HANDLE;
+      }
+    }
+    AVK_VK_RST(res);
+    return buffer;
   }
 
-  // TODO reuse?
-  void collect(VulkanDevice& dev, uint64_t readyValue) {
-    collectVec(m_images, readyValue, m_compactionThreshold, [&dev](VkImage image, VmaAllocation alloc) {
-      vmaDestroyImage(dev.allocator(), image, alloc);
-    });
-    collectVec(m_buffers, readyValue, m_compactionThreshold, [&dev](VkBuffer buffer, VmaAllocation alloc) {
+  // called once the buffer's timeline value is reached
+  void recycle(VulkanDevice& dev, VkBuffer buffer, VmaAllocation alloc, VkDeviceSize size, VkBufferUsageFlags usage) {
+    assert(size > 0);
+    // a buffer of size s can serve every request of class floor(log2(s))
+    uint32_t const sizeClass = log2Floor(size);
+    assert(sizeClass < SIZE_CLASS_COUNT);
+    std::lock_guard lock{m_mtx};
+    auto allocatorLock = dev.lockAllocator();
+    if (m_bytes + size > m_highWaterBytes) {
       vmaDestroyBuffer(dev.allocator(), buffer, alloc);
+      return;
+    }
+
+    VkMemoryPropertyFlags memFlags = 0;
+    vmaGetAllocationMemoryProperties(dev.allocator(), alloc, &memFlags);
+    // acquire promises mapped host visible memory: unmapped external allocations can't serve it
+    if (memFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+      VmaAllocationInfo allocInfo{};
+      vmaGetAllocationInfo(dev.allocator(), alloc, &allocInfo);
+      if (!allocInfo.pMappedData) {
+        vmaDestroyBuffer(dev.allocator(), buffer, alloc);
+        return;
+      }
+    }
+    allocatorLock.unlock();
+    auto it = std::find_if(m_buckets.begin(), m_buckets.end(), [usage, memFlags](Bucket const& bucket) {
+      return bucket.usage == usage && bucket.memFlags == memFlags;
     });
-    // ...
+    if (it == m_buckets.end()) {
+      it = m_buckets.emplace(m_buckets.end());
+      it->usage = usage;
+      it->memFlags = memFlags;
+    }
+    it->classes[sizeClass].push_back({buffer, alloc, size, m_generation});
+    m_bytes += size;
+  }
+
+  // to be called once per collect. destroys buffers idle for more than m_maxIdleCollects
+  void trimIdle(VulkanDevice& dev) {
+    std::lock_guard lock{m_mtx};
+    ++m_generation;
+    if (m_bytes == 0)
+      return;
+    auto const allocatorLock = dev.lockAllocator();
+    for (Bucket& bucket : m_buckets) {
+      for (std::vector<FreeBuffer>& freeList : bucket.classes) {
+        auto const firstAlive = std::find_if(freeList.begin(), freeList.end(), [this](FreeBuffer const& f) {
+          return f.generation + m_maxIdleCollects >= m_generation;
+        });
+        for (auto it = freeList.begin(); it != firstAlive; ++it) {
+          vmaDestroyBuffer(dev.allocator(), it->buffer, it->alloc);
+          m_bytes -= it->size;
+        }
+        freeList.erase(freeList.begin(), firstAlive);
+      }
+    }
+  }
+
+  void releaseAll(VulkanDevice& dev) {
+    std::lock_guard lock{m_mtx};
+    releaseAllLocked(dev);
   }
 
  private:
-  // Note: T&& is a Forwarding Reference only if you don't specify it.
-  template <typename T, typename... Args> // TODO enable_if constructible_from
-  static inline bool discardStuff(AtomicVector<T>& atomVec, uint32_t maxCap, Args&&... args) {
-    std::vector<T>& vec = atomVec.acquireWrite();
-    bool const result = vectorEmplaceWithGrowthLimit(vec, maxCap, std::forward<Args>(args)...);
-    atomVec.releaseWrite();
+  // destroys buffers whose memory has memFlags, largest and oldest first, until
+  // bytes are freed. Returns false if none was destroyed
+  bool releaseLocked(VulkanDevice& dev, VkDeviceSize bytes, VkMemoryPropertyFlags memFlags) {
+    VkDeviceSize freed = 0;
+    auto const allocatorLock = dev.lockAllocator();
+    for (uint32_t sizeClass = SIZE_CLASS_COUNT; sizeClass-- > 0 && freed < bytes;) {
+      for (Bucket& bucket : m_buckets) {
+        if ((bucket.memFlags & memFlags) != memFlags)
+          continue;
+        std::vector<FreeBuffer>& freeList = bucket.classes[sizeClass];
+        auto it = freeList.begin();
+        for (; it != freeList.end() && freed < bytes; ++it) {
+          vmaDestroyBuffer(dev.allocator(), it->buffer, it->alloc);
+          freed += it->size;
+        }
+        freeList.erase(freeList.begin(), it);
+        if (freed >= bytes)
+          break;
+      }
+    }
+    m_bytes -= freed;
+    return freed > 0;
+  }
+
+  void releaseAllLocked(VulkanDevice& dev) {
+    auto const allocatorLock = dev.lockAllocator();
+    for (Bucket& bucket : m_buckets) {
+      for (std::vector<FreeBuffer>& freeList : bucket.classes) {
+        for (FreeBuffer const& f : freeList) {
+          vmaDestroyBuffer(dev.allocator(), f.buffer, f.alloc);
+        }
+        freeList.clear();
+      }
+    }
+    m_bytes = 0;
+  }
+
+  std::vector<Bucket> m_buckets;
+  VkDeviceSize m_bytes = 0;
+  VkDeviceSize m_highWaterBytes = DEFAULT_HIGH_WATER_BYTES;
+  uint64_t m_generation = 0;
+  uint32_t m_maxIdleCollects = DEFAULT_MAX_IDLE_COLLECTS;
+  std::mutex m_mtx;
+};
+
+// ------------------------------------------------------------------------------
+// SemaphoreContent
+// ------------------------------------------------------------------------------
+
+// One segmented MPSC queue per resource kind. Discarding never blocks nor fails,
+// collecting frees whole chunks (see SegmentedMpscQueue)
+class SemaphoreContent {
+ public:
+  SemaphoreContent() = default;
+  SemaphoreContent(SemaphoreContent const&) = delete;
+  SemaphoreContent(SemaphoreContent &&) noexcept = default;
+  SemaphoreContent& operator=(SemaphoreContent const&) = delete;
+  SemaphoreContent& operator=(SemaphoreContent &&) noexcept = default;
+
+  // conservative: false while someone else is collecting
+  bool allEmpty() {
+    if (!m_buffers.empty() || !m_images.empty() || !m_recycleBuffers.empty() || !m_objects.empty())
+      return false;
+    if (!m_objectTable.tryLock())
+      return false;
+    bool const result = m_objectTable.empty();
+    m_objectTable.unlock();
     return result;
   }
 
-  template <typename T, typename F> // TODO ensure it has "readyValue" member (std::declval)
-  static inline void collectVec(VectorOffset<T>& v, uint64_t readyValue, uint32_t compactThreshold, F&& discard) {
+  // TODO: method recyle image (need to store more metadata, different vectors)
+  void discardBuffer(VkBuffer buffer, VmaAllocation alloc, uint64_t readyValue) {
+    m_buffers.push(buffer, alloc, readyValue);
+  }
+  void discardImage(VkImage image, VmaAllocation alloc, uint64_t readyValue) {
+    m_images.push(image, alloc, readyValue);
+  }
+  void recycleBuffer(VkBuffer buffer, VmaAllocation alloc, uint64_t readyValue, VkDeviceSize size, VkBufferUsageFlags usage) {
+    m_recycleBuffers.push(buffer, alloc, readyValue, size, usage);
+  }
+  void discardObject(EVulkanObjectType type, uint64_t handleBits, uint64_t readyValue) {
+    m_objects.push(handleBits, readyValue, type);
+  }
+
+  static uint64_t constexpr NO_PENDING = UINT64_MAX;
+
+  // returns the smallest timeline value still pending (among the ones seen), or NO_PENDING.
+  // readyValue itself if another thread was collecting part of it: collect again
+  uint64_t collect(VulkanDevice& dev, uint64_t readyValue, BufferRecycler& recycler) {
+    uint64_t minPending = NO_PENDING;
+    collectQueue(m_images, readyValue, minPending, [&dev](PendingImage const& p) {
+      auto const allocatorLock = dev.lockAllocator();
+      vmaDestroyImage(dev.allocator(), p.resource, p.alloc);
+    });
+    collectQueue(m_buffers, readyValue, minPending, [&dev](PendingBuffer const& p) {
+      auto const allocatorLock = dev.lockAllocator();
+      vmaDestroyBuffer(dev.allocator(), p.resource, p.alloc);
+    });
+    collectQueue(m_recycleBuffers, readyValue, minPending, [&dev, &recycler](PendingRecycleBuffer const& p) {
+      recycler.recycle(dev, p.resource, p.alloc, p.size, p.usage);
+    });
+    // ...
+
+    // everything else: drain the queue into the table, then destroy by type
+    if (m_objectTable.tryLock()) {
+      bool const drained = m_objects.consumeWhile([this](PendingObject const& p) {
+        m_objectTable.append(p);
+        return true;
+      });
+      minPending = std::min(minPending, m_objectTable.collect(dev, readyValue));
+      m_objectTable.unlock();
+      if (!drained)
+        minPending = std::min(minPending, readyValue);
+    } else {
+      minPending = std::min(minPending, readyValue);
+    }
+    return minPending;
+  }
+
+ private:
+  template <typename T>
+  using DiscardQueue = SegmentedMpscQueue<T>;
+
+  template <typename T, typename F>
+  static inline void collectQueue(DiscardQueue<T>& queue, uint64_t readyValue, uint64_t& minPending, F&& discard) {
     static_assert(
       std::is_standard_layout_v<T> 
       && std::is_same_v<decltype(std::declval<T>().readyValue), uint64_t>
       && sizeof(decltype(std::declval<T>().resource)) == 8); // size of a vulkan handle
 
-    v.atomVec.writeDo([&discard, compactThreshold, readyValue, &start = v.start](std::vector<T>& pending) {
-      assert(pending.empty() || pending.back().readyValue <= readyValue);
-      // exploit the fact that timeline values are strictly increasing
-      while (start < pending.size() && pending[start].readyValue <= readyValue) {
-        if constexpr (std::is_same_v<decltype(std::declval<T>().alloc), VmaAllocation>) {
-          discard(pending[start].resource, pending[start].alloc);
-        } else {
-          discard(pending[start].resource);
-        }
-        ++start;
-      }
-
-      if (start > compactThreshold) {
-        pending.erase(pending.begin(), pending.begin() + start);
-        start = 0;
+    // exploit the fact that timeline values are increasing for each producer thread
+    bool const consumed = queue.consumeWhile([&discard, &minPending, readyValue](T const& pending) {
+      if (pending.readyValue > readyValue) {
+        minPending = std::min(minPending, pending.readyValue);
+        return false;
       }
+      discard(pending);
+      return true;
     });
+    // busy: what it holds is unknown, report it as ready to be collected again
+    if (!consumed)
+      minPending = std::min(minPending, readyValue);
   }
 
   // the buffers. Add more as needed (VkRenderPass, VkFramebuffer, ...)
   // are (VkDescriptorSet, VkDescriptorPool) needed?
-  VectorOffset<PendingBuffer> m_buffers;
-  VectorOffset<PendingImage> m_images;
-
-  uint32_t m_maxCap;
-  uint32_t m_compactionThreshold;
+  DiscardQueue<PendingBuffer> m_buffers;
+  DiscardQueue<PendingImage> m_images;
+  DiscardQueue<PendingRecycleBuffer> m_recycleBuffers;
+  DiscardQueue<PendingObject> m_objects;
+  DeferredDeletionTable m_objectTable;
 };
 
 // ------------------------------------------------------------------------------
 // VulkanDiscardPoolImpl
 // ------------------------------------------------------------------------------
 
+// Background collector (optional)
+// - each pass collects every semaphore, then waits (wait-any) for the first
+//   semaphore to reach its smallest pending value, with a timeout
+// - passes are at least `minInterval` apart, such that destruction work is
+//   rate limited and confined to the collector thread
+// - a semaphore another thread was collecting stays in the wait set with an
+//   already reached value, such that the next pass retries it
+// - when nothing is pending, it sleeps until the next discard or `idleTimeout`.
+//   Discards bump m_discardSeq then notify if m_collectorIdle, the collector
+//   sets m_collectorIdle then checks m_discardSeq: no wake up is missed
+// - m_collectorWaitMtx is held for the whole pass (wait included), such that
+//   unregistering a semaphore can guarantee it's not being waited on anymore
 class VulkanDiscardPoolImpl {
  private:
   static uint32_t constexpr MAP_CAPACITY = 64;
+  using Clock = std::chrono::steady_clock;
  public:
   VulkanDiscardPoolImpl();
   void cleanup(VulkanDevice& dev) noexcept;
 
-  bool registerTimelineSemaphore(VkSemaphore sem, uint32_t minCap, uint32_t threshold, uint32_t maxCap);
+  void startCollectorThread(VulkanDevice& dev, std::chrono::microseconds minInterval, std::chrono::milliseconds idleTimeout);
+  void stopCollectorThread();
+
+  bool registerTimelineSemaphore(VkSemaphore sem);
   bool unregisterTimelineSemaphore(VulkanDevice& dev, VkSemaphore sem);
 
   void collect(VulkanDevice& dev);
@@ -165,9 +523,37 @@ class VulkanDiscardPoolImpl {
   bool discardImage(VkSemaphore sem, uint64_t readyValue, VkImage image, VmaAllocation alloc);
   // ...
 
+  bool discardObject(VkSemaphore sem, uint64_t readyValue, EVulkanObjectType type, uint64_t handleBits);
+
+  bool recycleBuffer(VkSemaphore sem, uint64_t readyValue, VkBuffer buffer, VmaAllocation alloc, VkDeviceSize size, VkBufferUsageFlags usage);
+  VkBuffer acquireBuffer(VulkanDevice& dev, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memFlags, VmaAllocation* outAlloc) {
+    return m_recycler.acquire(dev, size, usage, memFlags, outAlloc);
+  }
+  void setRecycleLimits(VkDeviceSize highWaterBytes, uint32_t maxIdleCollects) { m_recycler.setLimits(highWaterBytes, maxIdleCollects); }
+  void trimRecycledBuffers(VulkanDevice& dev) { m_recycler.releaseAll(dev); }
+
  private:
+  void collectorLoop(VulkanDevice& dev, std::chrono::microseconds minInterval, std::chrono::milliseconds idleTimeout);
+  void wakeCollector() {
+    m_discardSeq.fetch_add(1, std::memory_order_seq_cst);
+    if (m_collectorIdle.load(std::memory_order_seq_cst)) {
+      std::lock_guard lock{m_collectorMtx};
+      m_collectorCv.notify_one();
+    }
+  }
+
   std::unordered_map<VkSemaphore, SemaphoreContent> m_map;
   std::shared_mutex m_mapMtx;
+  BufferRecycler m_recycler;
+
+  // background collector
+  std::thread m_collector;
+  std::atomic<bool> m_collectorRunning = false;
+  std::atomic<bool> m_collectorIdle = false;
+  std::atomic<uint64_t> m_discardSeq = 0;
+  std::mutex m_collectorMtx;
+  std::condition_variable m_collectorCv;
+  std::mutex m_collectorWaitMtx;
 };
 
 VulkanDiscardPoolImpl::VulkanDiscardPoolImpl() {
@@ -175,6 +561,7 @@ VulkanDiscardPoolImpl::VulkanDiscardPoolImpl() {
 }
 
 void VulkanDiscardPoolImpl::cleanup(VulkanDevice& dev) noexcept {
+  stopCollectorThread();
   auto const checkMapEmpty = [this]() -> bool {
     std::shared_lock rLock{m_mapMtx};
     return m_map.empty();
@@ -182,9 +569,10 @@ void VulkanDiscardPoolImpl::cleanup(VulkanDevice& dev) noexcept {
   while (!checkMapEmpty()) {
     unregisterTimelineSemaphore(dev, m_map.begin()->first);
   }
+  m_recycler.releaseAll(dev);
 }
 
-bool VulkanDiscardPoolImpl::registerTimelineSemaphore(VkSemaphore sem, uint32_t minCap, uint32_t threshold, uint32_t maxCap) {
+bool VulkanDiscardPoolImpl::registerTimelineSemaphore(VkSemaphore sem) {
   { // if already exists, do nothing and return false
     std::shared_lock rLock{m_mapMtx};
     if (m_map.find(sem) != m_map.cend())
@@ -192,7 +580,7 @@ bool VulkanDiscardPoolImpl::registerTimelineSemaphore(VkSemaphore sem, uint32_t
   }
   std::lock_guard wLock{m_mapMtx};
   // else try to insert and construct it
-  auto [it, wasInserted] = m_map.try_emplace(sem, minCap, threshold, maxCap);
+  auto [it, wasInserted] = m_map.try_emplace(sem);
   return wasInserted;
 }
 
@@ -213,31 +601,131 @@ bool VulkanDiscardPoolImpl::unregisterTimelineSemaphore(VulkanDevice& dev, VkSem
   m_map.erase(it);
   wLock.unlock();
 
-  // collect until empty
-  while (!semContent.allEmpty()) {
+  // ensure the collector is not waiting on the semaphore anymore
+  { std::lock_guard waitLock{m_collectorWaitMtx}; }
+
+  // collect until empty, blocking on the smallest pending value instead of polling
+  while (true) {
     uint64_t value = 0;
-    AVK_VK_RST(dev.api()->vkGetSemaphoreCounterValue(dev.device(), sem, &value));
-    semContent.collect(dev, value);
+    AVK_VK_RST(dev.api()->vkGetSemaphoreCounterValueKHR(dev.device(), sem, &value));
+    uint64_t const pending = semContent.collect(dev, value, m_recycler);
+    if (pending == SemaphoreContent::NO_PENDING)
+      break;
+    if (pending <= value) {
+      // another thread is collecting it
+      std::this_thread::yield();
+      continue;
+    }
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &sem;
+    waitInfo.pValues = &pending;
+    AVK_VK_RST(dev.api()->vkWaitSemaphoresKHR(dev.device(), &waitInfo, UINT64_MAX));
   }
+  assert(semContent.allEmpty());
 
   return true;
 }
 
+void VulkanDiscardPoolImpl::startCollectorThread(VulkanDevice& dev, std::chrono::microseconds minInterval, std::chrono::milliseconds idleTimeout) {
+  if (m_collectorRunning.exchange(true, std::memory_order_acq_rel))
+    return; // already running
+  m_collector = std::thread([this, &dev, minInterval, idleTimeout]() {
+    collectorLoop(dev, minInterval, idleTimeout);
+  });
+}
+
+void VulkanDiscardPoolImpl::stopCollectorThread() {
+  {
+    std::lock_guard lock{m_collectorMtx};
+    if (!m_collectorRunning.exchange(false, std::memory_order_acq_rel))
+      return;
+  }
+  m_collectorCv.notify_one();
+  if (m_collector.joinable())
+    m_collector.join();
+}
+
+void VulkanDiscardPoolImpl::collectorLoop(VulkanDevice& dev, std::chrono::microseconds minInterval, std::chrono::milliseconds idleTimeout) {
+  std::vector<VkSemaphore> waitSemaphores;
+  std::vector<uint64_t> waitValues;
+  waitSemaphores.reserve(MAP_CAPACITY);
+  waitValues.reserve(MAP_CAPACITY);
+  uint64_t const idleTimeoutNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(idleTimeout).count());
+
+  Clock::time_point nextPass = Clock::now();
+  Clock::time_point nextTrim = nextPass + idleTimeout;
+  while (m_collectorRunning.load(std::memory_order_acquire)) {
+    std::this_thread::sleep_until(nextPass);
+    nextPass = Clock::now() + minInterval;
+
+    uint64_t const discardSeq = m_discardSeq.load(std::memory_order_seq_cst);
+    std::unique_lock waitLock{m_collectorWaitMtx};
+    waitSemaphores.clear();
+    waitValues.clear();
+    {
+      std::shared_lock rLock{m_mapMtx};
+      for (auto& [sem, content] : m_map) {
+        uint64_t value = 0;
+        AVK_VK_RST(dev.api()->vkGetSemaphoreCounterValueKHR(dev.device(), sem, &value));
+        if (uint64_t const pending = content.collect(dev, value, m_recycler); pending != SemaphoreContent::NO_PENDING) {
+          waitSemaphores.push_back(sem);
+          waitValues.push_back(pending);
+        }
+      }
+    }
+    // idle trimming counts collects, hence give it a wall clock cadence here
+    if (Clock::now() >= nextTrim) {
+      m_recycler.trimIdle(dev);
+      nextTrim = Clock::now() + idleTimeout;
+    }
+
+    if (waitSemaphores.empty()) {
+      waitLock.unlock();
+      std::unique_lock lock{m_collectorMtx};
+      if (!m_collectorRunning.load(std::memory_order_acquire))
+        break;
+      m_collectorIdle.store(true, std::memory_order_seq_cst);
+      // woken up by discards made since this pass started
+      m_collectorCv.wait_for(lock, idleTimeout, [this, discardSeq]() {
+        return !m_collectorRunning.load(std::memory_order_acquire) || m_discardSeq.load(std::memory_order_seq_cst) != discardSeq;
+      });
+      m_collectorIdle.store(false, std::memory_order_relaxed);
+      continue;
+    }
+
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.flags = VK_SEMAPHORE_WAIT_ANY_BIT;
+    waitInfo.semaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    waitInfo.pSemaphores = waitSemaphores.data();
+    waitInfo.pValues = waitValues.data();
+    VkResult const res = dev.api()->vkWaitSemaphoresKHR(dev.device(), &waitInfo, idleTimeoutNs);
+    if (res != VK_TIMEOUT)
+      AVK_VK_RST(res);
+  }
+}
+
 void VulkanDiscardPoolImpl::collect(VulkanDevice& dev) {
-  std::shared_lock rLock{m_mapMtx};
-  for (auto& [sem, content] : m_map) {
-    uint64_t value = 0;
-    AVK_VK_RST(dev.api()->vkGetSemaphoreCounterValue(dev.device(), sem, &value));
-    content.collect(dev, value);
+  {
+    std::shared_lock rLock{m_mapMtx};
+    for (auto& [sem, content] : m_map) {
+      uint64_t value = 0;
+      AVK_VK_RST(dev.api()->vkGetSemaphoreCounterValueKHR(dev.device(), sem, &value));
+      content.collect(dev, value, m_recycler);
+    }
   }
+  m_recycler.trimIdle(dev);
 }
 
 void VulkanDiscardPoolImpl::collectSemaphore(VulkanDevice& dev, VkSemaphore sem) {
   std::shared_lock rLock{m_mapMtx};
   if (auto it = m_map.find(sem); it != m_map.end()) {
     uint64_t value = 0;
-    AVK_VK_RST(dev.api()->vkGetSemaphoreCounterValue(dev.device(), sem, &value));
-    it->second.collect(dev, value);
+    AVK_VK_RST(dev.api()->vkGetSemaphoreCounterValueKHR(dev.device(), sem, &value));
+    it->second.collect(dev, value, m_recycler);
   }
 }
 
@@ -246,7 +734,9 @@ bool VulkanDiscardPoolImpl::discardBuffer(VkSemaphore sem, uint64_t readyValue,
   auto it = m_map.find(sem);
   if (it == m_map.end()) return false;
 
-  return it->second.discardBuffer(buffer, alloc, readyValue);
+  it->second.discardBuffer(buffer, alloc, readyValue);
+  wakeCollector();
+  return true;
 }
 
 bool VulkanDiscardPoolImpl::discardImage(VkSemaphore sem, uint64_t readyValue, VkImage image, VmaAllocation alloc) {
@@ -254,7 +744,30 @@ bool VulkanDiscardPoolImpl::discardImage(VkSemaphore sem, uint64_t readyValue, V
   auto it = m_map.find(sem);
   if (it == m_map.end()) return false;
 
-  return it->second.discardImage(image, alloc, readyValue);
+  it->second.discardImage(image, alloc, readyValue);
+  wakeCollector();
+  return true;
+}
+
+bool VulkanDiscardPoolImpl::discardObject(VkSemaphore sem, uint64_t readyValue, EVulkanObjectType type, uint64_t handleBits) {
+  assert(type < EVulkanObjectType::Count);
+  std::shared_lock rLock{m_mapMtx};
+  auto it = m_map.find(sem);
+  if (it == m_map.end()) return false;
+
+  it->second.discardObject(type, handleBits, readyValue);
+  wakeCollector();
+  return true;
+}
+
+bool VulkanDiscardPoolImpl::recycleBuffer(VkSemaphore sem, uint64_t readyValue, VkBuffer buffer, VmaAllocation alloc, VkDeviceSize size, VkBufferUsageFlags usage) {
+  std::shared_lock rLock{m_mapMtx};
+  auto it = m_map.find(sem);
+  if (it == m_map.end()) return false;
+
+  it->second.recycleBuffer(buffer, alloc, readyValue, size, usage);
+  wakeCollector();
+  return true;
 }
 
 // ------------------------------------------------------------------------------
@@ -270,8 +783,8 @@ VulkanDiscardPool::~VulkanDiscardPool() noexcept {
   m_impl->cleanup(*m_dev);
 }
 
-bool VulkanDiscardPool::registerTimelineSemaphore(VkSemaphore sem, uint32_t minResCap, uint32_t compactionThreshold, uint32_t maxResCap) {
-  return m_impl->registerTimelineSemaphore(sem, minResCap, compactionThreshold, maxResCap);
+bool VulkanDiscardPool::registerTimelineSemaphore(VkSemaphore sem) {
+  return m_impl->registerTimelineSemaphore(sem);
 }
 
 bool VulkanDiscardPool::unregisterTimelineSemaphore(VkSemaphore sem) {
@@ -297,5 +810,36 @@ bool VulkanDiscardPool::discardImage(VkSemaphore sem, uint64_t readyValue, VkIma
   return m_impl->discardImage(sem, readyValue, image, alloc);
 }
 
+bool VulkanDiscardPool::discardObject(VkSemaphore sem, uint64_t readyValue, EVulkanObjectType type, uint64_t handleBits) {
+  return m_impl->discardObject(sem, readyValue, type, handleBits);
+}
+
+bool VulkanDiscardPool::recycleBuffer(VkSemaphore sem, uint64_t readyValue, VkBuffer buffer, VmaAllocation alloc, VkDeviceSize size, VkBufferUsageFlags usage) {
+  return m_impl->recycleBuffer(sem, readyValue, buffer, alloc, size, usage);
+}
+
+VkBuffer VulkanDiscardPool::acquireBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memFlags, VmaAllocation* outAlloc) {
+  assert(m_dev);
+  return m_impl->acquireBuffer(*m_dev, size, usage, memFlags, outAlloc);
+}
+
+void VulkanDiscardPool::setRecycleLimits(VkDeviceSize highWaterBytes, uint32_t maxIdleCollects) {
+  m_impl->setRecycleLimits(highWaterBytes, maxIdleCollects);
+}
+
+void VulkanDiscardPool::startCollectorThread(std::chrono::microseconds minInterval, std::chrono::milliseconds idleTimeout) {
+  assert(m_dev);
+  m_impl->startCollectorThread(*m_dev, minInterval, idleTimeout);
+}
+
+void VulkanDiscardPool::stopCollectorThread() {
+  m_impl->stopCollectorThread();
+}
+
+void VulkanDiscardPool::trimRecycledBuffers() {
+  assert(m_dev);
+  m_impl->trimRecycledBuffers(*m_dev);
+}
+
 }
 
@@ -0,0 +1,412 @@
+#include "avkex-kernels.h"
+
+#include <cmath>
+
+using namespace avkex;
+
+namespace {
+
+// mirrors Params of shaders/fft.comp
+struct FftParams {
+  VkDeviceAddress src;
+  VkDeviceAddress dst;
+  VkDeviceAddress twiddles;
+  uint32_t n;
+  uint32_t radices;
+  uint32_t passCount;
+  uint32_t ns;
+  uint32_t twiddleStride;
+  uint32_t postTwiddle;
+  uint32_t signalCount;
+  uint32_t signalsPerGroup;
+  uint32_t srcInner;
+  uint32_t srcInnerStride;
+  uint32_t srcOuterStride;
+  uint32_t srcElementStride;
+  uint32_t dstInner;
+  uint32_t dstInnerStride;
+  uint32_t dstOuterStride;
+  uint32_t dstElementStride;
+  uint32_t inverse;
+  uint32_t pad0;
+};
+static_assert(sizeof(FftParams) == 96);
+
+// points of each shared buffer, bounded for occupancy
+uint32_t constexpr MAX_SHARED_POINTS = 4096;
+// radices of a shared step, 4 bits each
+uint32_t constexpr MAX_SHARED_PASSES = 8;
+
+enum class EFftBuffer : uint8_t { Src = 0, Dst, Scratch };
+
+// signal s, point e at (s / inner) * outerStride + (s % inner) * innerStride + e * elementStride
+struct FftLayout {
+  uint32_t inner;
+  uint32_t innerStride;
+  uint32_t outerStride;
+  uint32_t elementStride;
+};
+
+FftLayout contiguous(uint32_t n) {
+  return {1, 0, n, 1};
+}
+
+// 8 while it divides, then 4 or 2 for the rest of the power of 2, then 3, 5
+// and 7: few passes, the cheap butterflies first
+std::vector<uint32_t> radixPasses(uint32_t n) {
+  assert(Fft::supportedSize(n));
+  std::vector<uint32_t> radices;
+  for (; n % 8 == 0; n /= 8) {
+    radices.push_back(8);
+  }
+  for (uint32_t const radix : {4U, 2U, 3U, 5U, 7U}) {
+    for (; n % radix == 0; n /= radix) {
+      radices.push_back(radix);
+    }
+  }
+  return radices;
+}
+
+// exp(-2 pi i t / n), rounded from double
+std::vector<float> twiddleFactors(uint32_t n) {
+  double const pi = std::acos(-1.0);
+  std::vector<float> twiddles(size_t{n} * 2);
+  for (uint32_t t = 0; t < n; ++t) {
+    double const angle = -2.0 * pi * t / n;
+    twiddles[size_t{t} * 2] = static_cast<float>(std::cos(angle));
+    twiddles[size_t{t} * 2 + 1] = static_cast<float>(std::sin(angle));
+  }
+  return twiddles;
+}
+
+}
+
+namespace avkex {
+
+struct FftStep {
+  FftParams params; // without addresses and direction
+  EFftBuffer src;
+  EFftBuffer dst;
+  bool shared;
+  bool columnTwiddles;
+  uint32_t groupCount;
+};
+
+// ------------------------------------------------------------------------------
+// FftPlan
+// ------------------------------------------------------------------------------
+
+FftPlan::FftPlan() noexcept = default;
+
+FftPlan::FftPlan(FftPlan&& that) noexcept
+ : m_dev(std::exchange(that.m_dev, nullptr)),
+   m_rows(that.m_rows),
+   m_columns(that.m_columns),
+   m_batch(that.m_batch),
+   m_steps(std::move(that.m_steps)),
+   m_rowTwiddles(std::exchange(that.m_rowTwiddles, {})),
+   m_columnTwiddles(std::exchange(that.m_columnTwiddles, {})),
+   m_scratch(std::exchange(that.m_scratch, {})) {}
+
+FftPlan& FftPlan::operator=(FftPlan&& that) noexcept {
+  if (this != &that) {
+    reset();
+    m_dev = std::exchange(that.m_dev, nullptr);
+    m_rows = that.m_rows;
+    m_columns = that.m_columns;
+    m_batch = that.m_batch;
+    m_steps = std::move(that.m_steps);
+    m_rowTwiddles = std::exchange(that.m_rowTwiddles, {});
+    m_columnTwiddles = std::exchange(that.m_columnTwiddles, {});
+    m_scratch = std::exchange(that.m_scratch, {});
+  }
+  return *this;
+}
+
+FftPlan::~FftPlan() noexcept {
+  reset();
+}
+
+uint32_t FftPlan::dispatchCount() const {
+  return static_cast<uint32_t>(m_steps.size());
+}
+
+void FftPlan::reset() noexcept {
+  m_steps.clear();
+  if (!m_dev) {
+    return;
+  }
+  for (DeviceBuffer* buffer : {&m_rowTwiddles, &m_columnTwiddles, &m_scratch}) {
+    if (*buffer) {
+      destroyDeviceBuffer(*m_dev, *buffer);
+    }
+  }
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+// ------------------------------------------------------------------------------
+// FftImpl
+// ------------------------------------------------------------------------------
+class FftImpl {
+ public:
+  FftImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines);
+
+  bool valid() const { return m_valid; }
+  uint32_t maxSharedSize() const { return m_sharedPoints; }
+
+  FftPlan plan(VulkanDevice& dev, ComputeStream& stream, uint32_t rows, uint32_t columns, uint32_t batch) const;
+  void transform(VulkanDevice const& dev, VkCommandBuffer commandBuffer, FftPlan const& plan, EFftDirection direction, VkDeviceAddress src,
+    VkDeviceAddress dst) const;
+
+ private:
+  // count transforms of size n from src to dst, twiddles of the plan's size
+  // N read at n * twiddleStride / N steps, times twiddles[(s % postTwiddle) * e]
+  FftStep sharedStep(VulkanDeviceProfile const& profile, uint32_t n, uint32_t twiddleStride, uint32_t postTwiddle, uint32_t count,
+    FftLayout const& src, FftLayout const& dst) const;
+  // count contiguous transforms of size n from src to dst, returns whether
+  // they use the scratch buffer
+  bool addSteps(VulkanDeviceProfile const& profile, std::vector<FftStep>& steps, uint32_t n, uint32_t count) const;
+  // n1 of the most balanced n = n1 * n2 with both in shared memory, 0 if none
+  uint32_t fourStepSplit(uint32_t n) const;
+
+  bool m_valid = false;
+  uint32_t m_workgroupSize = 0;
+  uint32_t m_sharedPoints = 0;
+  ComputeKernel m_shared;
+  ComputeKernel m_global;
+};
+
+FftImpl::FftImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines) {
+  VulkanDeviceProfile const& profile = dev.profile();
+  m_workgroupSize = chooseWorkgroupSize(profile);
+  // two buffers of (re, im)
+  m_sharedPoints = std::min<uint32_t>(MAX_SHARED_POINTS, static_cast<uint32_t>(profile.maxComputeSharedMemorySize / (4 * sizeof(float))));
+  m_valid = createComputeKernels(dev, shaders, pipelineCache, {
+    {&m_shared, "fft_shared", sizeof(FftParams), {m_workgroupSize, m_sharedPoints}},
+    {&m_global, "fft_global", sizeof(FftParams), {m_workgroupSize}},
+  }, pipelines);
+}
+
+FftStep FftImpl::sharedStep(VulkanDeviceProfile const& profile, uint32_t n, uint32_t twiddleStride, uint32_t postTwiddle,
+  uint32_t count, FftLayout const& src, FftLayout const& dst) const {
+  assert(n <= m_sharedPoints);
+  std::vector<uint32_t> const radices = radixPasses(n);
+  assert(radices.size() <= MAX_SHARED_PASSES);
+  uint32_t const signalsPerGroup = m_sharedPoints / n;
+
+  FftStep step{};
+  step.shared = true;
+  step.params.n = n;
+  for (size_t i = 0; i < radices.size(); ++i) {
+    step.params.radices |= radices[i] << (4 * i);
+  }
+  step.params.passCount = static_cast<uint32_t>(radices.size());
+  step.params.twiddleStride = twiddleStride;
+  step.params.postTwiddle = postTwiddle;
+  step.params.signalCount = count;
+  step.params.signalsPerGroup = signalsPerGroup;
+  step.params.srcInner = src.inner;
+  step.params.srcInnerStride = src.innerStride;
+  step.params.srcOuterStride = src.outerStride;
+  step.params.srcElementStride = src.elementStride;
+  step.params.dstInner = dst.inner;
+  step.params.dstInnerStride = dst.innerStride;
+  step.params.dstOuterStride = dst.outerStride;
+  step.params.dstElementStride = dst.elementStride;
+  step.groupCount = chooseGroupCount(profile, count, signalsPerGroup, profile.maxComputeWorkGroupCount[0]);
+  return step;
+}
+
+uint32_t FftImpl::fourStepSplit(uint32_t n) const {
+  uint32_t best = 0;
+  for (uint32_t n1 = 2; n1 <= m_sharedPoints; ++n1) {
+    if (n % n1 == 0 && n / n1 <= m_sharedPoints && (best == 0 || std::max(n1, n / n1) < std::max(best, n / best))) {
+      best = n1;
+    }
+  }
+  return best;
+}
+
+bool FftImpl::addSteps(VulkanDeviceProfile const& profile, std::vector<FftStep>& steps, uint32_t n, uint32_t count) const {
+  if (n <= m_sharedPoints) {
+    steps.push_back(sharedStep(profile, n, 1, 0, count, contiguous(n), contiguous(n)));
+    steps.back().src = EFftBuffer::Src;
+    steps.back().dst = EFftBuffer::Dst;
+    return false;
+  }
+
+  if (uint32_t const n1 = fourStepSplit(n); n1 != 0) {
+    // signal as an n1 x n2 matrix: transforms of its columns i2, times
+    // exp(-2 pi i i2 k1 / n), stored transposed, then transforms of the
+    // columns k1 of that n2 x n1 matrix land in place
+    uint32_t const n2 = n / n1;
+    steps.push_back(sharedStep(profile, n1, n2, n2, count * n2, {n2, 1, n, n2}, {n2, n1, n, 1}));
+    steps.back().src = EFftBuffer::Src;
+    steps.back().dst = EFftBuffer::Scratch;
+    steps.push_back(sharedStep(profile, n2, n1, 0, count * n1, {n1, 1, n, n1}, {n1, 1, n, n1}));
+    steps.back().src = EFftBuffer::Scratch;
+    steps.back().dst = EFftBuffer::Dst;
+    return true;
+  }
+
+  // a global pass per radix, an even count alternating scratch and dst so
+  // src is only read, by the first: in place transforms work. Radix 1
+  // copies
+  std::vector<uint32_t> radices = radixPasses(n);
+  if (radices.size() % 2 != 0) {
+    radices.insert(radices.begin(), 1);
+  }
+  uint32_t ns = 1;
+  for (size_t i = 0; i < radices.size(); ++i) {
+    FftStep step{};
+    step.shared = false;
+    step.src = i == 0 ? EFftBuffer::Src : (i % 2 == 1 ? EFftBuffer::Scratch : EFftBuffer::Dst);
+    step.dst = i % 2 == 0 ? EFftBuffer::Scratch : EFftBuffer::Dst;
+    step.params.n = n;
+    step.params.radices = radices[i];
+    step.params.passCount = 1;
+    step.params.ns = ns;
+    step.params.twiddleStride = 1;
+    step.params.signalCount = count;
+    step.params.srcInner = step.params.dstInner = 1;
+    step.params.srcOuterStride = step.params.dstOuterStride = n;
+    step.params.srcElementStride = step.params.dstElementStride = 1;
+    step.groupCount = chooseGroupCount(profile, uint64_t{count} * (n / radices[i]), m_workgroupSize, profile.maxComputeWorkGroupCount[0]);
+    steps.push_back(step);
+    ns *= radices[i];
+  }
+  return true;
+}
+
+FftPlan FftImpl::plan(VulkanDevice& dev, ComputeStream& stream, uint32_t rows, uint32_t columns, uint32_t batch) const {
+  assert(m_valid);
+  if (!Fft::supportedSize(rows) || !Fft::supportedSize(columns)) {
+    LOG_ERR << "Fft: sizes must be products of 2, 3, 5 and 7" LOG_RST << std::endl;
+    return FftPlan{};
+  }
+  // 32-bit point indices in the kernels
+  uint64_t const points = uint64_t{rows} * columns * batch;
+  if (points == 0 || points > UINT32_MAX) {
+    LOG_ERR << "Fft: empty or more than 2^32 points" LOG_RST << std::endl;
+    return FftPlan{};
+  }
+  if (rows > m_sharedPoints) {
+    LOG_ERR << "Fft: 2D columns must fit shared memory" LOG_RST << std::endl;
+    return FftPlan{};
+  }
+  VulkanDeviceProfile const& profile = dev.profile();
+
+  FftPlan result;
+  dev.acquire();
+  result.m_dev = &dev;
+  result.m_rows = rows;
+  result.m_columns = columns;
+  result.m_batch = batch;
+  bool const useScratch = addSteps(profile, result.m_steps, columns, rows * batch);
+  if (rows > 1) {
+    // columns in place in dst, adjacent invocations on adjacent columns
+    FftLayout const layout{columns, 1, rows * columns, columns};
+    result.m_steps.push_back(sharedStep(profile, rows, 1, 0, columns * batch, layout, layout));
+    result.m_steps.back().src = EFftBuffer::Dst;
+    result.m_steps.back().dst = EFftBuffer::Dst;
+    result.m_steps.back().columnTwiddles = true;
+  }
+
+  auto const upload = [&dev, &stream](DeviceBuffer& buffer, std::vector<float> const& data) {
+    buffer = createDeviceBuffer(dev, data.size() * sizeof(float));
+    if (buffer) {
+      stream.upload(buffer, data.data(), data.size() * sizeof(float));
+    }
+    return static_cast<bool>(buffer);
+  };
+  bool ok = upload(result.m_rowTwiddles, twiddleFactors(columns));
+  if (ok && rows > 1) {
+    ok = upload(result.m_columnTwiddles, twiddleFactors(rows));
+  }
+  if (ok && useScratch) {
+    result.m_scratch = createDeviceBuffer(dev, points * 2 * sizeof(float));
+    ok = static_cast<bool>(result.m_scratch);
+  }
+  if (!ok) {
+    LOG_ERR << "Fft: couldn't allocate the plan" LOG_RST << std::endl;
+    return FftPlan{};
+  }
+  return result;
+}
+
+void FftImpl::transform(VulkanDevice const& dev, VkCommandBuffer commandBuffer, FftPlan const& plan, EFftDirection direction,
+  VkDeviceAddress src, VkDeviceAddress dst) const {
+  assert(m_valid && plan);
+  assert(src % (2 * sizeof(float)) == 0 && dst % (2 * sizeof(float)) == 0);
+  auto const address = [&plan, src, dst](EFftBuffer buffer) {
+    switch (buffer) {
+    case EFftBuffer::Src: return src;
+    case EFftBuffer::Dst: return dst;
+    default: return plan.m_scratch.address;
+    }
+  };
+  for (size_t i = 0; i < plan.m_steps.size(); ++i) {
+    FftStep const& step = plan.m_steps[i];
+    if (i > 0) {
+      computeBarrier(dev, commandBuffer);
+    }
+    FftParams params = step.params;
+    params.src = address(step.src);
+    params.dst = address(step.dst);
+    params.twiddles = step.columnTwiddles ? plan.m_columnTwiddles.address : plan.m_rowTwiddles.address;
+    params.inverse = direction == EFftDirection::Inverse ? 1 : 0;
+    (step.shared ? m_shared : m_global).dispatch(commandBuffer, params, step.groupCount);
+  }
+}
+
+// ------------------------------------------------------------------------------
+// Fft
+// ------------------------------------------------------------------------------
+
+Fft::Fft(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines)
+ : m_impl(std::make_unique<FftImpl>(*dev, *shaders, pipelineCache, pipelines)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+Fft::~Fft() noexcept {
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+Fft::operator bool() const {
+  return m_impl->valid();
+}
+
+uint32_t Fft::maxSharedSize() const {
+  return m_impl->maxSharedSize();
+}
+
+bool Fft::supportedSize(uint32_t n) {
+  if (n == 0) {
+    return false;
+  }
+  for (uint32_t const prime : {2U, 3U, 5U, 7U}) {
+    while (n % prime == 0) {
+      n /= prime;
+    }
+  }
+  return n == 1;
+}
+
+FftPlan Fft::plan(ComputeStream& stream, uint32_t n, uint32_t batch) const {
+  return m_impl->plan(*m_dev, stream, 1, n, batch);
+}
+
+FftPlan Fft::plan2d(ComputeStream& stream, uint32_t rows, uint32_t columns, uint32_t batch) const {
+  return m_impl->plan(*m_dev, stream, rows, columns, batch);
+}
+
+void Fft::transform(VkCommandBuffer commandBuffer, FftPlan const& plan, EFftDirection direction, VkDeviceAddress src,
+  VkDeviceAddress dst) {
+  m_impl->transform(*m_dev, commandBuffer, plan, direction, src, dst);
+}
+
+}
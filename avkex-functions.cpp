@@ -56,6 +56,14 @@ std::vector<char const*> getVulkanOptionalDeviceExtensions() {
   optionalExtensions.reserve(64);
   optionalExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
   optionalExtensions.push_back(VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME);
+  optionalExtensions.push_back(VK_KHR_MAINTENANCE_5_EXTENSION_NAME);
+  optionalExtensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+  optionalExtensions.push_back(VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME);
+  optionalExtensions.push_back(VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME);
+  optionalExtensions.push_back(VK_KHR_16BIT_STORAGE_EXTENSION_NAME);
+  optionalExtensions.push_back(VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME);
+  optionalExtensions.push_back(VK_KHR_COOPERATIVE_MATRIX_EXTENSION_NAME);
+  optionalExtensions.push_back(VK_KHR_SHADER_ATOMIC_INT64_EXTENSION_NAME);
   return optionalExtensions;
 }
 
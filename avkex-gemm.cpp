@@ -0,0 +1,228 @@
+#include "avkex-kernels.h"
+
+#include <array>
+
+using namespace avkex;
+
+namespace {
+
+// mirrors Params of shaders/gemm.comp and shaders/gemm_coopmat.comp
+struct GemmParams {
+  VkDeviceAddress a;
+  VkDeviceAddress b;
+  VkDeviceAddress c;
+  uint32_t m;
+  uint32_t n;
+  uint32_t k;
+  uint32_t lda;
+  uint32_t ldb;
+  uint32_t ldc;
+  uint32_t strideA;
+  uint32_t strideB;
+  uint32_t strideC;
+  float alpha;
+  float beta;
+  uint32_t pad0;
+};
+static_assert(sizeof(GemmParams) == 72);
+
+uint32_t constexpr TYPE_COUNT = 2;
+// gemm_coopmat.comp: subgroups per workgroup in each dimension, 2 x 2
+// matrices per subgroup, CM_K steps per shared memory tile
+uint32_t constexpr COOPMAT_SUBGROUPS = 2;
+uint32_t constexpr COOPMAT_MATRICES = 2;
+uint32_t constexpr COOPMAT_STEPS_K = 2;
+// preferred cooperative matrix shape
+uint32_t constexpr COOPMAT_PREFERRED_SIZE = 16;
+
+uint32_t elementSize(EGemmType type) {
+  return type == EGemmType::Float16 ? 2 : 4;
+}
+
+}
+
+namespace avkex {
+
+// ------------------------------------------------------------------------------
+// GemmImpl
+// ------------------------------------------------------------------------------
+class GemmImpl {
+ public:
+  GemmImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines, GemmTiling const& tiling);
+
+  bool valid() const { return m_valid; }
+  bool supports(EGemmType type) const { return type == EGemmType::Float32 || m_hasFloat16; }
+  bool usesCooperativeMatrix() const { return m_hasCooperativeMatrix; }
+
+  void gemm(VulkanDevice const& dev, VkCommandBuffer commandBuffer, EGemmType type, GemmParams const& params, uint32_t batchCount) const;
+
+ private:
+  // a f16 x f16 + f32 subgroup shape fitting shared memory, false if none
+  bool chooseCooperativeMatrixShape(VulkanDevice const& dev);
+
+  bool m_valid = false;
+  bool m_hasFloat16 = false;
+  bool m_hasCooperativeMatrix = false;
+  GemmTiling m_tiling;
+  std::array<uint32_t, 3> m_coopmatShape{}; // M, N, K
+  // [type][vec4]
+  std::array<std::array<ComputeKernel, 2>, TYPE_COUNT> m_tiled;
+  // [vec4]
+  std::array<ComputeKernel, 2> m_coopmat;
+};
+
+GemmImpl::GemmImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines, GemmTiling const& tiling)
+ : m_tiling(tiling) {
+  VulkanDeviceProfile const& profile = dev.profile();
+  uint32_t const workgroupSize = (tiling.tileM / std::max(1U, tiling.threadM)) * (tiling.tileN / std::max(1U, tiling.threadN));
+  if (tiling.threadM == 0 || tiling.threadN == 0 || tiling.tileM % tiling.threadM != 0 || tiling.tileN % tiling.threadN != 0 ||
+      tiling.tileK == 0 || tiling.tileK % 4 != 0 || tiling.tileN % 4 != 0 || workgroupSize == 0 ||
+      workgroupSize > std::min(profile.maxComputeWorkGroupInvocations, profile.maxComputeWorkGroupSize[0]) ||
+      tiling.tileK * (tiling.tileM + tiling.tileN) * sizeof(float) > profile.maxComputeSharedMemorySize) {
+    LOG_ERR << "Gemm: tiling " << tiling.tileM << 'x' << tiling.tileN << 'x' << tiling.tileK << " by " << tiling.threadM << 'x'
+            << tiling.threadN << " doesn't fit the device" << LOG_RST << std::endl;
+    return;
+  }
+  m_hasFloat16 = dev.hasFloat16();
+  m_hasCooperativeMatrix = dev.hasCooperativeMatrix() && chooseCooperativeMatrixShape(dev);
+
+  std::array<std::string_view, TYPE_COUNT> constexpr entries{"gemm_f32", "gemm_f16"};
+  std::vector<ComputeKernelDesc> descs;
+  descs.reserve(2 * TYPE_COUNT + 2);
+  for (uint32_t type = 0; type < TYPE_COUNT; ++type) {
+    if (!supports(static_cast<EGemmType>(type))) {
+      continue;
+    }
+    for (uint32_t vec4 = 0; vec4 < 2; ++vec4) {
+      descs.push_back({&m_tiled[type][vec4], entries[type], sizeof(GemmParams),
+        {workgroupSize, tiling.tileM, tiling.tileN, tiling.tileK, tiling.threadM, tiling.threadN, vec4}});
+    }
+  }
+  if (m_hasCooperativeMatrix) {
+    // a subgroup per block at the default subgroup size. The shader spreads
+    // the blocks over whatever subgroups it actually gets
+    uint32_t const coopmatWorkgroupSize = COOPMAT_SUBGROUPS * COOPMAT_SUBGROUPS * profile.subgroupSize;
+    for (uint32_t vec4 = 0; vec4 < 2; ++vec4) {
+      descs.push_back({&m_coopmat[vec4], "gemm_coopmat_f16", sizeof(GemmParams),
+        {coopmatWorkgroupSize, m_coopmatShape[0], m_coopmatShape[1], m_coopmatShape[2], COOPMAT_SUBGROUPS, COOPMAT_SUBGROUPS,
+         COOPMAT_STEPS_K, vec4}});
+    }
+  }
+  m_valid = createComputeKernels(dev, shaders, pipelineCache, descs, pipelines);
+}
+
+bool GemmImpl::chooseCooperativeMatrixShape(VulkanDevice const& dev) {
+  VulkanDeviceProfile const& profile = dev.profile();
+  uint32_t count = 0;
+  if (vkGetPhysicalDeviceCooperativeMatrixPropertiesKHR(dev.physicalDevice(), &count, nullptr) != VK_SUCCESS) {
+    return false;
+  }
+  std::vector<VkCooperativeMatrixPropertiesKHR> properties(count);
+  for (VkCooperativeMatrixPropertiesKHR& property : properties) {
+    property = {};
+    property.sType = VK_STRUCTURE_TYPE_COOPERATIVE_MATRIX_PROPERTIES_KHR;
+  }
+  if (vkGetPhysicalDeviceCooperativeMatrixPropertiesKHR(dev.physicalDevice(), &count, properties.data()) != VK_SUCCESS) {
+    return false;
+  }
+  uint32_t const workgroupSize = COOPMAT_SUBGROUPS * COOPMAT_SUBGROUPS * profile.subgroupSize;
+  bool found = false;
+  for (VkCooperativeMatrixPropertiesKHR const& property : properties) {
+    if (property.AType != VK_COMPONENT_TYPE_FLOAT16_KHR || property.BType != VK_COMPONENT_TYPE_FLOAT16_KHR ||
+        property.CType != VK_COMPONENT_TYPE_FLOAT32_KHR || property.ResultType != VK_COMPONENT_TYPE_FLOAT32_KHR ||
+        property.scope != VK_SCOPE_SUBGROUP_KHR || property.saturatingAccumulation) {
+      continue;
+    }
+    // f16 A and B tiles, f32 C tile
+    uint32_t const tileM = COOPMAT_SUBGROUPS * COOPMAT_MATRICES * property.MSize;
+    uint32_t const tileN = COOPMAT_SUBGROUPS * COOPMAT_MATRICES * property.NSize;
+    uint32_t const tileK = COOPMAT_STEPS_K * property.KSize;
+    uint64_t const sharedSize = uint64_t{tileK} * (tileM + tileN) * 2 + uint64_t{tileM} * tileN * 4;
+    if (sharedSize > profile.maxComputeSharedMemorySize || workgroupSize > profile.maxComputeWorkGroupInvocations ||
+        tileK % 4 != 0 || tileN % 4 != 0) {
+      continue;
+    }
+    bool const preferred = property.MSize == COOPMAT_PREFERRED_SIZE && property.NSize == COOPMAT_PREFERRED_SIZE &&
+                           property.KSize == COOPMAT_PREFERRED_SIZE;
+    if (!found || preferred) {
+      m_coopmatShape = {property.MSize, property.NSize, property.KSize};
+      found = true;
+    }
+    if (preferred) {
+      break;
+    }
+  }
+  return found;
+}
+
+void GemmImpl::gemm(VulkanDevice const& dev, VkCommandBuffer commandBuffer, EGemmType type, GemmParams const& params,
+  uint32_t batchCount) const {
+  assert(m_valid && supports(type));
+  VulkanDeviceProfile const& profile = dev.profile();
+  if (params.m == 0 || params.n == 0 || batchCount == 0) {
+    return;
+  }
+  uint32_t const size = elementSize(type);
+  // 32-bit element indices within a matrix, 32-bit byte strides
+  assert(uint64_t{params.m} * params.lda <= UINT32_MAX && uint64_t{params.k} * params.ldb <= UINT32_MAX &&
+         uint64_t{params.m} * params.ldc <= UINT32_MAX);
+  assert(uint64_t{params.strideA} * size <= UINT32_MAX && uint64_t{params.strideB} * size <= UINT32_MAX &&
+         uint64_t{params.strideC} * sizeof(float) <= UINT32_MAX);
+  assert(batchCount <= profile.maxComputeWorkGroupCount[2]);
+  // 4-wide loads when every row of A and B starts on a 4 element boundary
+  uint32_t const vectorBytes = 4 * size;
+  bool const vec4 = params.lda % 4 == 0 && params.ldb % 4 == 0 && params.strideA % 4 == 0 && params.strideB % 4 == 0 &&
+                    params.a % vectorBytes == 0 && params.b % vectorBytes == 0;
+
+  bool const coopmat = type == EGemmType::Float16 && m_hasCooperativeMatrix;
+  uint32_t const tileM = coopmat ? COOPMAT_SUBGROUPS * COOPMAT_MATRICES * m_coopmatShape[0] : m_tiling.tileM;
+  uint32_t const tileN = coopmat ? COOPMAT_SUBGROUPS * COOPMAT_MATRICES * m_coopmatShape[1] : m_tiling.tileN;
+  uint32_t const groupCountX = (params.n + tileN - 1) / tileN;
+  uint32_t const groupCountY = (params.m + tileM - 1) / tileM;
+  assert(groupCountX <= profile.maxComputeWorkGroupCount[0] && groupCountY <= profile.maxComputeWorkGroupCount[1]);
+  ComputeKernel const& kernel = coopmat ? m_coopmat[vec4] : m_tiled[static_cast<uint32_t>(type)][vec4];
+  kernel.dispatch(commandBuffer, params, groupCountX, groupCountY, batchCount);
+}
+
+// ------------------------------------------------------------------------------
+// Gemm
+// ------------------------------------------------------------------------------
+
+Gemm::Gemm(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache, GemmTiling const& tiling, VulkanComputePipelines* pipelines)
+ : m_impl(std::make_unique<GemmImpl>(*dev, *shaders, pipelineCache, pipelines, tiling)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+Gemm::~Gemm() noexcept {
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+Gemm::operator bool() const {
+  return m_impl->valid();
+}
+
+bool Gemm::supports(EGemmType type) const {
+  return m_impl->supports(type);
+}
+
+bool Gemm::usesCooperativeMatrix() const {
+  return m_impl->usesCooperativeMatrix();
+}
+
+void Gemm::gemm(VkCommandBuffer commandBuffer, EGemmType type, uint32_t m, uint32_t n, uint32_t k, float alpha, VkDeviceAddress a,
+  uint32_t lda, VkDeviceAddress b, uint32_t ldb, float beta, VkDeviceAddress c, uint32_t ldc) {
+  GemmParams const params{a, b, c, m, n, k, lda, ldb, ldc, 0, 0, 0, alpha, beta, 0};
+  m_impl->gemm(*m_dev, commandBuffer, type, params, 1);
+}
+
+void Gemm::gemmStridedBatched(VkCommandBuffer commandBuffer, EGemmType type, uint32_t m, uint32_t n, uint32_t k, float alpha,
+  VkDeviceAddress a, uint32_t lda, uint32_t strideA, VkDeviceAddress b, uint32_t ldb, uint32_t strideB, float beta, VkDeviceAddress c,
+  uint32_t ldc, uint32_t strideC, uint32_t batchCount) {
+  GemmParams const params{a, b, c, m, n, k, lda, ldb, ldc, strideA, strideB, strideC, alpha, beta, 0};
+  m_impl->gemm(*m_dev, commandBuffer, type, params, batchCount);
+}
+
+}
@@ -0,0 +1,184 @@
+#include "avkex-kernels.h"
+
+#include <array>
+#include <cmath>
+
+using namespace avkex;
+
+namespace {
+
+// mirrors Params of shaders/hashtable.comp
+struct HashTableParams {
+  VkDeviceAddress tableKeys;
+  VkDeviceAddress tableValues;
+  VkDeviceAddress counters;
+  VkDeviceAddress keys;
+  VkDeviceAddress values;
+  VkDeviceAddress results;
+  uint32_t n;
+  uint32_t capacityMask;
+};
+static_assert(sizeof(HashTableParams) == 56);
+
+// OP of the kernels
+enum : uint32_t { OP_INSERT = 0, OP_LOOKUP, OP_SUM, OP_COUNT, OP_KINDS };
+// 32-bit slot indices
+uint64_t constexpr MAX_CAPACITY = uint64_t{1} << 31;
+
+uint64_t ceilPowerOfTwo(uint64_t x) {
+  uint64_t result = 1;
+  while (result < x) {
+    result <<= 1;
+  }
+  return result;
+}
+
+}
+
+namespace avkex {
+
+// ------------------------------------------------------------------------------
+// HashTableImpl
+// ------------------------------------------------------------------------------
+class HashTableImpl {
+ public:
+  HashTableImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines, EHashKey keyType, uint32_t maxKeys,
+    float loadFactor);
+  void cleanup(VulkanDevice& dev) noexcept;
+
+  bool valid() const { return m_valid; }
+  EHashKey keyType() const { return m_keyType; }
+  uint32_t capacity() const { return m_capacity; }
+  DeviceBuffer const& counters() const { return m_counters; }
+
+  void clear(VulkanDevice const& dev, VkCommandBuffer commandBuffer) const;
+  void run(VulkanDevice const& dev, VkCommandBuffer commandBuffer, uint32_t op, uint32_t n, VkDeviceAddress keys, VkDeviceAddress values,
+    VkDeviceAddress results) const;
+
+ private:
+  bool m_valid = false;
+  EHashKey m_keyType = EHashKey::Uint32;
+  uint32_t m_workgroupSize = 0;
+  uint32_t m_capacity = 0;
+  DeviceBuffer m_keys;
+  DeviceBuffer m_values;
+  DeviceBuffer m_counters;
+  std::array<ComputeKernel, OP_KINDS> m_kernels;
+};
+
+HashTableImpl::HashTableImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines, EHashKey keyType,
+  uint32_t maxKeys, float loadFactor)
+ : m_keyType(keyType) {
+  if (keyType == EHashKey::Uint64 && !dev.hasInt64Atomics()) {
+    LOG_ERR << "HashTable: 64-bit keys need VK_KHR_shader_atomic_int64 and shaderInt64" LOG_RST << std::endl;
+    return;
+  }
+  if (!(loadFactor > 0.f && loadFactor <= 1.f)) {
+    LOG_ERR << "HashTable: the load factor must be in (0, 1]" LOG_RST << std::endl;
+    return;
+  }
+  uint64_t const capacity = ceilPowerOfTwo(std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(maxKeys / double{loadFactor}))));
+  if (capacity > MAX_CAPACITY) {
+    LOG_ERR << "HashTable: more than 2^31 slots" LOG_RST << std::endl;
+    return;
+  }
+  m_capacity = static_cast<uint32_t>(capacity);
+  size_t const keySize = keyType == EHashKey::Uint64 ? sizeof(uint64_t) : sizeof(uint32_t);
+  m_keys = createDeviceBuffer(dev, capacity * keySize);
+  m_values = createDeviceBuffer(dev, capacity * sizeof(uint32_t));
+  m_counters = createDeviceBuffer(dev, 2 * sizeof(uint32_t));
+  if (!m_keys || !m_values || !m_counters) {
+    LOG_ERR << "HashTable: couldn't allocate the table" LOG_RST << std::endl;
+    return;
+  }
+
+  m_workgroupSize = chooseWorkgroupSize(dev.profile());
+  char const* const kernel = keyType == EHashKey::Uint64 ? "hash_table_64" : "hash_table_32";
+  std::vector<ComputeKernelDesc> descs;
+  for (uint32_t op = 0; op < OP_KINDS; ++op) {
+    descs.push_back({&m_kernels[op], kernel, sizeof(HashTableParams), {m_workgroupSize, op}});
+  }
+  m_valid = createComputeKernels(dev, shaders, pipelineCache, descs, pipelines);
+}
+
+void HashTableImpl::cleanup(VulkanDevice& dev) noexcept {
+  for (DeviceBuffer* buffer : {&m_keys, &m_values, &m_counters}) {
+    if (*buffer) {
+      destroyDeviceBuffer(dev, *buffer);
+    }
+  }
+}
+
+void HashTableImpl::clear(VulkanDevice const& dev, VkCommandBuffer commandBuffer) const {
+  assert(m_valid);
+  // all ones keys are free slots
+  dev.api()->vkCmdFillBuffer(commandBuffer, m_keys.buffer, 0, VK_WHOLE_SIZE, UINT32_MAX);
+  dev.api()->vkCmdFillBuffer(commandBuffer, m_values.buffer, 0, VK_WHOLE_SIZE, 0);
+  dev.api()->vkCmdFillBuffer(commandBuffer, m_counters.buffer, 0, VK_WHOLE_SIZE, 0);
+}
+
+void HashTableImpl::run(VulkanDevice const& dev, VkCommandBuffer commandBuffer, uint32_t op, uint32_t n, VkDeviceAddress keys,
+  VkDeviceAddress values, VkDeviceAddress results) const {
+  assert(m_valid);
+  assert(keys % (m_keyType == EHashKey::Uint64 ? sizeof(uint64_t) : sizeof(uint32_t)) == 0);
+  if (n == 0) {
+    return;
+  }
+  VulkanDeviceProfile const& profile = dev.profile();
+  HashTableParams const params{m_keys.address, m_values.address, m_counters.address, keys, values, results, n, m_capacity - 1};
+  // the grid-stride loop covers what the group count limit leaves out
+  m_kernels[op].dispatch(commandBuffer, params, chooseGroupCount(profile, n, m_workgroupSize, profile.maxComputeWorkGroupCount[0]));
+}
+
+// ------------------------------------------------------------------------------
+// HashTable
+// ------------------------------------------------------------------------------
+
+HashTable::HashTable(VulkanDevice* dev, VulkanShaderRegistry const* shaders, EHashKey keyType, uint32_t maxKeys, float loadFactor,
+  VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines)
+ : m_impl(std::make_unique<HashTableImpl>(*dev, *shaders, pipelineCache, pipelines, keyType, maxKeys, loadFactor)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+HashTable::~HashTable() noexcept {
+  m_impl->cleanup(*m_dev);
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+HashTable::operator bool() const {
+  return m_impl->valid();
+}
+
+EHashKey HashTable::keyType() const {
+  return m_impl->keyType();
+}
+
+uint32_t HashTable::capacity() const {
+  return m_impl->capacity();
+}
+
+DeviceBuffer const& HashTable::counters() const {
+  return m_impl->counters();
+}
+
+void HashTable::clear(VkCommandBuffer commandBuffer) {
+  m_impl->clear(*m_dev, commandBuffer);
+}
+
+void HashTable::insert(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress keys, VkDeviceAddress values) {
+  m_impl->run(*m_dev, commandBuffer, OP_INSERT, n, keys, values, 0);
+}
+
+void HashTable::lookup(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress keys, VkDeviceAddress results) const {
+  m_impl->run(*m_dev, commandBuffer, OP_LOOKUP, n, keys, 0, results);
+}
+
+void HashTable::insertAggregate(VkCommandBuffer commandBuffer, EHashAggregate aggregate, uint32_t n, VkDeviceAddress keys,
+  VkDeviceAddress values) {
+  m_impl->run(*m_dev, commandBuffer, aggregate == EHashAggregate::Sum ? OP_SUM : OP_COUNT, n, keys, values, 0);
+}
+
+}
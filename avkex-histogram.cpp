@@ -0,0 +1,172 @@
+#include "avkex-kernels.h"
+
+#include <array>
+
+using namespace avkex;
+
+namespace {
+
+// mirrors Params of shaders/histogram.comp
+struct HistogramParams {
+  VkDeviceAddress src;
+  VkDeviceAddress segmentOffsets;
+  VkDeviceAddress dst;
+  uint32_t n;
+  uint32_t segmentCount;
+  uint32_t groupsPerSegment;
+  uint32_t binCount;
+  float rangeMin;
+  float rangeScale;
+  uint32_t shift;
+  uint32_t clampOutliers;
+};
+static_assert(sizeof(HistogramParams) == 56);
+
+uint32_t constexpr INPUT_COUNT = 4;
+uint32_t constexpr BINNING_COUNT = 3;
+// shared bins for up to SMALL_SHARED_BINS, as many as fit, or global atomics
+enum : uint32_t { BINS_SMALL = 0, BINS_LARGE, BINS_GLOBAL, BINS_COUNT };
+// words of shared memory of the small kernels, light enough for occupancy
+uint32_t constexpr SMALL_SHARED_BINS = 2048;
+// words per invocation before a segment gets another workgroup
+uint32_t constexpr ITEMS_PER_INVOCATION = 16;
+// elements per shared bin before a segment gets another workgroup, which
+// costs a merge of every bin
+uint32_t constexpr ELEMENTS_PER_MERGED_BIN = 4;
+uint32_t constexpr MAX_GROUPS_PER_SEGMENT = 1024;
+
+uint32_t elementBits(EHistogramInput input) {
+  switch (input) {
+  case EHistogramInput::Uint8: return 8;
+  case EHistogramInput::Uint16: return 16;
+  default: return 32;
+  }
+}
+
+}
+
+namespace avkex {
+
+// ------------------------------------------------------------------------------
+// HistogramImpl
+// ------------------------------------------------------------------------------
+class HistogramImpl {
+ public:
+  HistogramImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines);
+
+  bool valid() const { return m_valid; }
+  uint32_t maxSharedBins() const { return m_sharedBins[BINS_LARGE]; }
+
+  void histogram(VulkanDevice const& dev, VkCommandBuffer commandBuffer, EHistogramInput input, HistogramBinning const& binning,
+    uint32_t binCount, uint32_t n, VkDeviceAddress src, VkDeviceAddress segmentOffsets, uint32_t segmentCount, VkDeviceAddress dst) const;
+
+ private:
+  bool m_valid = false;
+  uint32_t m_workgroupSize = 0;
+  // shared memory words, per privatization
+  std::array<uint32_t, BINS_COUNT> m_sharedBins{};
+  // [input][binning][privatization]
+  std::array<std::array<std::array<ComputeKernel, BINS_COUNT>, BINNING_COUNT>, INPUT_COUNT> m_kernels;
+};
+
+HistogramImpl::HistogramImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines) {
+  VulkanDeviceProfile const& profile = dev.profile();
+  m_workgroupSize = chooseWorkgroupSize(profile);
+  uint32_t const sharedWords = static_cast<uint32_t>(profile.maxComputeSharedMemorySize / sizeof(uint32_t));
+  m_sharedBins = {std::min(SMALL_SHARED_BINS, sharedWords), sharedWords, 1};
+
+  std::vector<ComputeKernelDesc> descs;
+  descs.reserve(INPUT_COUNT * BINNING_COUNT * BINS_COUNT);
+  for (uint32_t input = 0; input < INPUT_COUNT; ++input) {
+    uint32_t const isFloat = static_cast<EHistogramInput>(input) == EHistogramInput::Float32 ? 1 : 0;
+    for (uint32_t binning = 0; binning < BINNING_COUNT; ++binning) {
+      for (uint32_t bins = 0; bins < BINS_COUNT; ++bins) {
+        descs.push_back({&m_kernels[input][binning][bins], "histogram", sizeof(HistogramParams),
+          {m_workgroupSize, elementBits(static_cast<EHistogramInput>(input)), isFloat, binning, m_sharedBins[bins],
+           bins == BINS_GLOBAL ? 1U : 0U}});
+      }
+    }
+  }
+  m_valid = createComputeKernels(dev, shaders, pipelineCache, descs, pipelines);
+}
+
+void HistogramImpl::histogram(VulkanDevice const& dev, VkCommandBuffer commandBuffer, EHistogramInput input,
+  HistogramBinning const& binning, uint32_t binCount, uint32_t n, VkDeviceAddress src, VkDeviceAddress segmentOffsets,
+  uint32_t segmentCount, VkDeviceAddress dst) const {
+  assert(m_valid);
+  assert(binCount > 0 && uint64_t{binCount} * segmentCount <= UINT32_MAX);
+  assert(binning.function != EHistogramBinning::Bits || (binCount & (binCount - 1)) == 0);
+  assert(binning.function != EHistogramBinning::Range || binning.max > binning.min);
+  assert(src % sizeof(uint32_t) == 0 && n <= UINT32_MAX - 4);
+  if (segmentCount == 0) {
+    return;
+  }
+  VulkanDeviceProfile const& profile = dev.profile();
+  uint32_t const bins = binCount <= m_sharedBins[BINS_SMALL] ? BINS_SMALL : binCount <= m_sharedBins[BINS_LARGE] ? BINS_LARGE : BINS_GLOBAL;
+
+  uint32_t const perWord = 32 / elementBits(input);
+  uint64_t const perSegment = (uint64_t{n} + segmentCount - 1) / segmentCount;
+  uint64_t const wordsPerSegment = (perSegment + perWord - 1) / perWord;
+  uint64_t const wordsPerGroup = uint64_t{m_workgroupSize} * ITEMS_PER_INVOCATION;
+  uint64_t groups = (wordsPerSegment + wordsPerGroup - 1) / wordsPerGroup;
+  if (bins != BINS_GLOBAL) {
+    groups = std::min<uint64_t>(groups, perSegment / (uint64_t{ELEMENTS_PER_MERGED_BIN} * binCount));
+  }
+  uint32_t const groupsPerSegment = static_cast<uint32_t>(std::clamp<uint64_t>(groups, 1, MAX_GROUPS_PER_SEGMENT));
+
+  HistogramParams params{};
+  params.src = src;
+  params.segmentOffsets = segmentOffsets;
+  params.dst = dst;
+  params.n = n;
+  params.segmentCount = segmentCount;
+  params.groupsPerSegment = groupsPerSegment;
+  params.binCount = binCount;
+  params.rangeMin = binning.min;
+  params.rangeScale = static_cast<float>(binCount) / (binning.max - binning.min);
+  params.shift = binning.shift;
+  params.clampOutliers = binning.clampOutliers ? 1 : 0;
+
+  uint64_t const totalGroups = uint64_t{groupsPerSegment} * segmentCount;
+  uint32_t const groupCountX = static_cast<uint32_t>(std::min<uint64_t>(totalGroups, profile.maxComputeWorkGroupCount[0]));
+  uint32_t const groupCountY = static_cast<uint32_t>((totalGroups + groupCountX - 1) / groupCountX);
+  assert(groupCountY <= profile.maxComputeWorkGroupCount[1]);
+  m_kernels[static_cast<uint32_t>(input)][static_cast<uint32_t>(binning.function)][bins].dispatch(commandBuffer, params, groupCountX,
+    groupCountY);
+}
+
+// ------------------------------------------------------------------------------
+// Histogram
+// ------------------------------------------------------------------------------
+
+Histogram::Histogram(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines)
+ : m_impl(std::make_unique<HistogramImpl>(*dev, *shaders, pipelineCache, pipelines)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+Histogram::~Histogram() noexcept {
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+Histogram::operator bool() const {
+  return m_impl->valid();
+}
+
+uint32_t Histogram::maxSharedBins() const {
+  return m_impl->maxSharedBins();
+}
+
+void Histogram::histogram(VkCommandBuffer commandBuffer, EHistogramInput input, HistogramBinning const& binning, uint32_t binCount,
+  uint32_t n, VkDeviceAddress src, VkDeviceAddress dst) {
+  m_impl->histogram(*m_dev, commandBuffer, input, binning, binCount, n, src, 0, 1, dst);
+}
+
+void Histogram::histogramSegments(VkCommandBuffer commandBuffer, EHistogramInput input, HistogramBinning const& binning,
+  uint32_t binCount, uint32_t n, VkDeviceAddress src, VkDeviceAddress segmentOffsets, uint32_t segmentCount, VkDeviceAddress dst) {
+  m_impl->histogram(*m_dev, commandBuffer, input, binning, binCount, n, src, segmentOffsets, segmentCount, dst);
+}
+
+}
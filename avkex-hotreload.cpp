@@ -0,0 +1,230 @@
+#include "avkex.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+using namespace avkex;
+
+namespace {
+
+enum class EReloadKind { None, Spirv, Glsl, Hlsl };
+
+// <name>[.*].spv or <name>.comp|.glsl|.hlsl, name is up to the first '.'
+EReloadKind reloadKind(std::string_view fileName, std::string_view& outName) {
+  size_t const firstDot = fileName.find('.');
+  size_t const lastDot = fileName.rfind('.');
+  if (firstDot == 0 || firstDot == std::string_view::npos) {
+    return EReloadKind::None;
+  }
+  outName = fileName.substr(0, firstDot);
+  std::string_view const extension = fileName.substr(lastDot + 1);
+  if (extension == "spv") return EReloadKind::Spirv;
+  if (extension == "comp" || extension == "glsl") return EReloadKind::Glsl;
+  if (extension == "hlsl") return EReloadKind::Hlsl;
+  return EReloadKind::None;
+}
+
+std::string readFile(std::filesystem::path const& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return {};
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+}
+
+namespace avkex {
+
+// ------------------------------------------------------------------------------
+// ShaderWatcherImpl
+// ------------------------------------------------------------------------------
+class ShaderWatcherImpl {
+ public:
+  ShaderWatcherImpl(VulkanShaderRegistry* shaders, std::filesystem::path directory, ShaderCompiler* compiler, std::function<void(ShaderHandle)> onReloaded);
+  ~ShaderWatcherImpl() noexcept;
+
+  bool isWatching() const { return m_watcher.has_value(); }
+  void addPack(ShaderPack const& pack);
+
+ private:
+  // a registered shader compiled from a watched file
+  struct Variant {
+    std::string name;
+    std::vector<std::pair<std::string, std::string>> defines;
+  };
+
+  void watchLoop();
+  void reload(std::string_view fileName);
+
+  VulkanShaderRegistry* m_shaders;
+  std::filesystem::path m_directory;
+  ShaderCompiler* m_compiler;
+  std::function<void(ShaderHandle)> m_onReloaded;
+
+  // by file name, filled by addPack()
+  std::mutex m_variantsMtx;
+  std::unordered_map<std::string, std::vector<Variant>> m_variants;
+
+  std::optional<os::DirectoryWatcher> m_watcher;
+  std::atomic<bool> m_running = false;
+  std::thread m_thread;
+};
+
+ShaderWatcherImpl::ShaderWatcherImpl(VulkanShaderRegistry* shaders, std::filesystem::path directory, ShaderCompiler* compiler, std::function<void(ShaderHandle)> onReloaded)
+ : m_shaders(shaders), m_directory(std::move(directory)), m_compiler(compiler), m_onReloaded(std::move(onReloaded)) {
+  m_watcher = os::DirectoryWatcher::open(m_directory);
+  if (!m_watcher) {
+    LOG_ERR << "Can't watch " << m_directory.string() << ", shader hot reload disabled" LOG_RST << std::endl;
+    return;
+  }
+  m_running.store(true, std::memory_order_release);
+  m_thread = std::thread([this]() { watchLoop(); });
+}
+
+ShaderWatcherImpl::~ShaderWatcherImpl() noexcept {
+  if (!m_running.exchange(false, std::memory_order_acq_rel)) {
+    return;
+  }
+  m_watcher->interrupt();
+  m_thread.join();
+}
+
+void ShaderWatcherImpl::watchLoop() {
+  // the timeout only bounds a missed interrupt
+  static constexpr std::chrono::milliseconds POLL_TIMEOUT{500};
+  while (m_running.load(std::memory_order_acquire)) {
+    std::vector<std::string> names = m_watcher->wait(POLL_TIMEOUT);
+    // editors often write twice in a row, reload once per batch
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    for (std::string const& name : names) {
+      if (!m_running.load(std::memory_order_acquire))
+        break;
+      reload(name);
+    }
+  }
+}
+
+void ShaderWatcherImpl::addPack(ShaderPack const& pack) {
+  std::lock_guard lock{m_variantsMtx};
+  for (uint32_t i = 0; i < pack.shaderCount(); ++i) {
+    std::filesystem::path const source{pack.shaderSource(i)};
+    if (source.empty()) {
+      continue;
+    }
+    std::vector<Variant>& variants = m_variants[source.filename().string()];
+    std::string_view const name = pack.shaderName(i);
+    auto const it = std::find_if(variants.begin(), variants.end(), [name](Variant const& variant) { return variant.name == name; });
+    Variant& variant = it != variants.end() ? *it : variants.emplace_back();
+    variant.name = name;
+    variant.defines = pack.shaderDefines(i);
+  }
+}
+
+void ShaderWatcherImpl::reload(std::string_view fileName) {
+  std::string_view defaultName;
+  EReloadKind const kind = reloadKind(fileName, defaultName);
+  if (kind == EReloadKind::None) {
+    return;
+  }
+  // pack variants of the file, else the shader named after it
+  std::vector<Variant> variants;
+  {
+    std::lock_guard lock{m_variantsMtx};
+    if (auto const it = m_variants.find(std::string(fileName)); it != m_variants.end()) {
+      variants = it->second;
+    }
+  }
+  if (variants.empty()) {
+    variants.push_back({std::string(defaultName), {}});
+  }
+  std::vector<ShaderHandle> handles;
+  handles.reserve(variants.size());
+  for (Variant const& variant : variants) {
+    handles.push_back(m_shaders->findShader(variant.name));
+  }
+  if (std::none_of(handles.begin(), handles.end(), [](ShaderHandle handle) { return bool(handle); })) {
+    return;
+  }
+  if (kind != EReloadKind::Spirv && !m_compiler) {
+    return;
+  }
+  std::string const content = readFile(m_directory / fileName);
+  if (content.empty()) {
+    return;
+  }
+
+  std::vector<std::vector<uint32_t>> codes(variants.size());
+  if (kind == EReloadKind::Spirv) {
+    if (content.size() % sizeof(uint32_t) != 0) {
+      LOG_ERR << fileName << " is not SPIR-V" LOG_RST << std::endl;
+      return;
+    }
+    for (size_t i = 0; i < variants.size(); ++i) {
+      if (handles[i]) {
+        codes[i].resize(content.size() / sizeof(uint32_t));
+        std::memcpy(codes[i].data(), content.data(), content.size());
+      }
+    }
+  } else {
+    // compiled in parallel on the compiler workers, this thread only waits
+    std::vector<std::future<std::vector<uint32_t>>> compiled(variants.size());
+    for (size_t i = 0; i < variants.size(); ++i) {
+      if (!handles[i]) {
+        continue;
+      }
+      ShaderSource source;
+      source.language = kind == EReloadKind::Hlsl ? EShaderLanguage::Hlsl : EShaderLanguage::Glsl;
+      source.code = content;
+      source.defines = variants[i].defines;
+      compiled[i] = m_compiler->compile(std::move(source));
+    }
+    for (size_t i = 0; i < variants.size(); ++i) {
+      if (compiled[i].valid()) {
+        codes[i] = compiled[i].get();
+      }
+    }
+  }
+
+  for (size_t i = 0; i < variants.size(); ++i) {
+    if (codes[i].empty()) {
+      continue;
+    }
+    std::string const& name = variants[i].name;
+    if (!m_shaders->replaceShader(handles[i], std::move(codes[i]))) {
+      LOG_ERR << "Reload of " << name << " failed, keeping the previous shader" LOG_RST << std::endl;
+      continue;
+    }
+    LOG_LOG << "Reloaded shader " << name << " from " << fileName << std::endl;
+    if (m_onReloaded) {
+      m_onReloaded(handles[i]);
+    }
+  }
+}
+
+// ------------------------------------------------------------------------------
+// ShaderWatcher
+// ------------------------------------------------------------------------------
+
+ShaderWatcher::ShaderWatcher(VulkanShaderRegistry* shaders, std::filesystem::path directory, ShaderCompiler* compiler,
+  std::function<void(ShaderHandle)> onReloaded)
+ : m_impl(std::make_unique<ShaderWatcherImpl>(shaders, std::move(directory), compiler, std::move(onReloaded))) {}
+
+ShaderWatcher::~ShaderWatcher() noexcept = default;
+
+bool ShaderWatcher::isWatching() const {
+  return m_impl->isWatching();
+}
+
+void ShaderWatcher::addPack(ShaderPack const& pack) {
+  m_impl->addPack(pack);
+}
+
+}
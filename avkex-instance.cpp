@@ -277,8 +277,7 @@ VkBool32 VKAPI_PTR debugUtilsMessengerCallbackEXT(
 VulkanPhysicalDeviceQueryResult checkEligibleDevice(VkInstance instance, VkPhysicalDevice physicalDevice) {
   VulkanPhysicalDeviceQueryResult result{};
   int32_t theScore = 1;
-  // properties
-  // - probably I'll be needing subgroup information
+  // properties (subgroups and limits are in VulkanDeviceProfile, captured by the device)
   VkPhysicalDeviceProperties2 props{};
   props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
   vkGetPhysicalDeviceProperties2(physicalDevice, &props);
@@ -363,6 +362,10 @@ VulkanPhysicalDeviceQueryResult checkEligibleDevice(VkInstance instance, VkPhysi
 
   std::vector<char const*> requiredExtensions = getVulkanMinimalRequiredDeviceExtensions();
   std::vector<char const*> optionalExtensions = getVulkanOptionalDeviceExtensions();
+  uint32_t maintenance5ExtCount = 0; // maintenance5 and its dependencies
+  uint32_t float16ExtCount = 0; // 16-bit storage and float16 arithmetic
+  bool hasCooperativeMatrixExt = false;
+  bool hasAtomicInt64Ext = false;
   for (VkExtensionProperties const& ext : devExtProps) {
     auto const strCompareExtensions = [&ext](char const* name){ return strcmp(name, ext.extensionName) == 0; };
     auto it = std::find_if(requiredExtensions.begin(), requiredExtensions.end(), strCompareExtensions);
@@ -378,6 +381,18 @@ VulkanPhysicalDeviceQueryResult checkEligibleDevice(VkInstance instance, VkPhysi
       } else if (strcmp(*optIt, VK_KHR_DEDICATED_ALLOCATION_EXTENSION_NAME) == 0) {
         result.optionalExtensions |= EVulkanOptionalExtensionSupport::DedicatedAllocation;
         theScore += 100;
+      } else if (strcmp(*optIt, VK_KHR_MAINTENANCE_5_EXTENSION_NAME) == 0 ||
+                 strcmp(*optIt, VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME) == 0 ||
+                 strcmp(*optIt, VK_KHR_DEPTH_STENCIL_RESOLVE_EXTENSION_NAME) == 0 ||
+                 strcmp(*optIt, VK_KHR_CREATE_RENDERPASS_2_EXTENSION_NAME) == 0) {
+        ++maintenance5ExtCount;
+      } else if (strcmp(*optIt, VK_KHR_16BIT_STORAGE_EXTENSION_NAME) == 0 ||
+                 strcmp(*optIt, VK_KHR_SHADER_FLOAT16_INT8_EXTENSION_NAME) == 0) {
+        ++float16ExtCount;
+      } else if (strcmp(*optIt, VK_KHR_COOPERATIVE_MATRIX_EXTENSION_NAME) == 0) {
+        hasCooperativeMatrixExt = true;
+      } else if (strcmp(*optIt, VK_KHR_SHADER_ATOMIC_INT64_EXTENSION_NAME) == 0) {
+        hasAtomicInt64Ext = true;
       }
       optionalExtensions.erase(optIt);
     }
@@ -412,16 +427,65 @@ VulkanPhysicalDeviceQueryResult checkEligibleDevice(VkInstance instance, VkPhysi
   vulkanMemoryModelFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_MEMORY_MODEL_FEATURES;
   VkPhysicalDevicePortabilitySubsetFeaturesKHR portabilitySubsetFeatures{};
   portabilitySubsetFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PORTABILITY_SUBSET_FEATURES_KHR;
+  VkPhysicalDeviceMaintenance5FeaturesKHR maintenance5Features{};
+  maintenance5Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_5_FEATURES_KHR;
+  VkPhysicalDevice16BitStorageFeatures storage16BitFeatures{};
+  storage16BitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES;
+  VkPhysicalDeviceShaderFloat16Int8FeaturesKHR float16Int8Features{};
+  float16Int8Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_FLOAT16_INT8_FEATURES_KHR;
+  VkPhysicalDeviceCooperativeMatrixFeaturesKHR cooperativeMatrixFeatures{};
+  cooperativeMatrixFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_COOPERATIVE_MATRIX_FEATURES_KHR;
+  VkPhysicalDeviceShaderAtomicInt64FeaturesKHR atomicInt64Features{};
+  atomicInt64Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_INT64_FEATURES_KHR;
 
   vulkanMemoryModelFeatures.pNext = &portabilitySubsetFeatures;
   uniformBufferStandardLayoutFeatures.pNext = &vulkanMemoryModelFeatures;
   bufferDeviceAddressFeatures.pNext = &uniformBufferStandardLayoutFeatures;
   timelineFeatures.pNext = &bufferDeviceAddressFeatures;
   features.pNext = &timelineFeatures;
+  if (maintenance5ExtCount == 4) {
+    // optional: only chained when the extension exists
+    maintenance5Features.pNext = features.pNext;
+    features.pNext = &maintenance5Features;
+  }
+  if (float16ExtCount == 2) {
+    float16Int8Features.pNext = features.pNext;
+    storage16BitFeatures.pNext = &float16Int8Features;
+    features.pNext = &storage16BitFeatures;
+  }
+  if (hasCooperativeMatrixExt) {
+    cooperativeMatrixFeatures.pNext = features.pNext;
+    features.pNext = &cooperativeMatrixFeatures;
+  }
+  if (hasAtomicInt64Ext) {
+    atomicInt64Features.pNext = features.pNext;
+    features.pNext = &atomicInt64Features;
+  }
 
   vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
   if (!handleRequiredDeviceFeatures(features, true)) 
     return result;
+  if (maintenance5Features.maintenance5) {
+    result.optionalExtensions |= EVulkanOptionalExtensionSupport::Maintenance5;
+  }
+  if (storage16BitFeatures.storageBuffer16BitAccess && float16Int8Features.shaderFloat16) {
+    result.optionalExtensions |= EVulkanOptionalExtensionSupport::Float16;
+  }
+  // the f16 matrices of the kernels need float16 arithmetic, in compute shaders
+  if (cooperativeMatrixFeatures.cooperativeMatrix && result.hasFloat16Ext()) {
+    VkPhysicalDeviceCooperativeMatrixPropertiesKHR cooperativeMatrixProps{};
+    cooperativeMatrixProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_COOPERATIVE_MATRIX_PROPERTIES_KHR;
+    VkPhysicalDeviceProperties2 cooperativeMatrixProps2{};
+    cooperativeMatrixProps2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    cooperativeMatrixProps2.pNext = &cooperativeMatrixProps;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &cooperativeMatrixProps2);
+    if (cooperativeMatrixProps.cooperativeMatrixSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) {
+      result.optionalExtensions |= EVulkanOptionalExtensionSupport::CooperativeMatrix;
+    }
+  }
+  if (atomicInt64Features.shaderBufferInt64Atomics && features.features.shaderInt64) {
+    result.optionalExtensions |= EVulkanOptionalExtensionSupport::Int64Atomics;
+  }
 
   result.score = theScore;
 
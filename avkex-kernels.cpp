@@ -0,0 +1,529 @@
+#include "avkex-kernels.h"
+
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+using namespace avkex;
+
+namespace {
+
+// writes of everything recorded before, host reads after the submission wait
+void hostReadBarrier(VulkanDevice const& dev, VkCommandBuffer commandBuffer) {
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  dev.api()->vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+    0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+}
+
+namespace avkex {
+
+// ---- DeviceBuffer ----
+
+DeviceBuffer createDeviceBuffer(VulkanDevice& dev, VkDeviceSize size, EBufferLocation location) {
+  VkBufferCreateInfo bufferCreateInfo{};
+  bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferCreateInfo.size = std::max<VkDeviceSize>(size, sizeof(uint32_t));
+  bufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+    VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT |
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+    VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+    VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+
+  VmaAllocationCreateInfo allocCreateInfo{};
+  switch (location) {
+    case EBufferLocation::Device:
+      allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+      break;
+    case EBufferLocation::HostUpload:
+      allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+      allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+      break;
+    case EBufferLocation::HostReadback:
+      allocCreateInfo.usage = VMA_MEMORY_USAGE_AUTO;
+      allocCreateInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+      break;
+  }
+
+  DeviceBuffer result;
+  VmaAllocationInfo allocInfo{};
+  VkResult const res = [&]() {
+    auto const lock = dev.lockAllocator();
+    return vmaCreateBuffer(dev.allocator(), &bufferCreateInfo, &allocCreateInfo, &result.buffer, &result.allocation, &allocInfo);
+  }();
+  if (res != VK_SUCCESS) {
+    LOG_ERR << "Couldn't allocate a " << size << " bytes buffer: " << res << LOG_RST << std::endl;
+    return {};
+  }
+  VkBufferDeviceAddressInfo addressInfo{};
+  addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+  addressInfo.buffer = result.buffer;
+  // Vulkan 1.1 instance, the populated function is the KHR one
+  result.address = dev.api()->vkGetBufferDeviceAddressKHR(dev.device(), &addressInfo);
+  result.size = size;
+  result.mapped = allocInfo.pMappedData;
+  return result;
+}
+
+void destroyDeviceBuffer(VulkanDevice& dev, DeviceBuffer& buffer) {
+  if (buffer.buffer != VK_NULL_HANDLE) {
+    auto const lock = dev.lockAllocator();
+    vmaDestroyBuffer(dev.allocator(), buffer.buffer, buffer.allocation);
+  }
+  buffer = {};
+}
+
+void computeBarrier(VulkanDevice const& dev, VkCommandBuffer commandBuffer) {
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+    VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  dev.api()->vkCmdPipelineBarrier(commandBuffer,
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+    VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+    0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+// ---- ComputeKernel ----
+
+ComputeKernel::ComputeKernel(ComputeKernel&& that) noexcept
+ : m_dev(std::exchange(that.m_dev, nullptr)),
+   m_layout(std::exchange(that.m_layout, VK_NULL_HANDLE)),
+   m_pipeline(std::exchange(that.m_pipeline, VK_NULL_HANDLE)),
+   m_pipelines(std::exchange(that.m_pipelines, nullptr)),
+   m_id(std::exchange(that.m_id, VulkanComputePipelines::INVALID_ID)),
+   m_pushConstantSize(std::exchange(that.m_pushConstantSize, 0)) {}
+
+ComputeKernel& ComputeKernel::operator=(ComputeKernel&& that) noexcept {
+  if (this != &that) {
+    reset();
+    m_dev = std::exchange(that.m_dev, nullptr);
+    m_layout = std::exchange(that.m_layout, VK_NULL_HANDLE);
+    m_pipeline = std::exchange(that.m_pipeline, VK_NULL_HANDLE);
+    m_pipelines = std::exchange(that.m_pipelines, nullptr);
+    m_id = std::exchange(that.m_id, VulkanComputePipelines::INVALID_ID);
+    m_pushConstantSize = std::exchange(that.m_pushConstantSize, 0);
+  }
+  return *this;
+}
+
+ComputeKernel::~ComputeKernel() noexcept {
+  reset();
+}
+
+void ComputeKernel::reset() noexcept {
+  // the owner waited for the commands using the kernel
+  if (m_pipelines) {
+    m_pipelines->remove(m_id);
+  }
+  if (m_dev) {
+    m_dev->api()->vkDestroyPipeline(m_dev->device(), m_pipeline, nullptr);
+    m_dev->api()->vkDestroyPipelineLayout(m_dev->device(), m_layout, nullptr);
+  }
+  m_dev = nullptr;
+  m_layout = VK_NULL_HANDLE;
+  m_pipeline = VK_NULL_HANDLE;
+  m_pipelines = nullptr;
+  m_id = VulkanComputePipelines::INVALID_ID;
+  m_pushConstantSize = 0;
+}
+
+void ComputeKernel::bind(VkCommandBuffer commandBuffer, void const* params) const {
+  m_dev->api()->vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline());
+  if (m_pushConstantSize > 0) {
+    m_dev->api()->vkCmdPushConstants(commandBuffer, m_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, m_pushConstantSize, params);
+  }
+}
+
+bool createComputeKernels(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache,
+  std::vector<ComputeKernelDesc> const& descs, VulkanComputePipelines* pipelines) {
+  std::vector<ComputePipelineRequest> requests(descs.size());
+  std::vector<VkPipelineLayout> layouts(descs.size(), VK_NULL_HANDLE);
+  auto const destroyLayouts = [&]() {
+    for (VkPipelineLayout layout : layouts) {
+      dev.api()->vkDestroyPipelineLayout(dev.device(), layout, nullptr);
+    }
+  };
+
+  for (size_t i = 0; i < descs.size(); ++i) {
+    ComputeKernelDesc const& desc = descs[i];
+    ComputePipelineRequest& request = requests[i];
+    request.shader = shaders.findShader(desc.name);
+    if (!request.shader) {
+      LOG_ERR << "Kernel " << desc.name << " is missing from the shader pack" LOG_RST << std::endl;
+      destroyLayouts();
+      return false;
+    }
+    VkPushConstantRange range{};
+    range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    range.size = desc.pushConstantSize;
+    layouts[i] = createPipelineLayout(dev, 0, nullptr, desc.pushConstantSize > 0 ? 1 : 0, &range);
+    request.layout = layouts[i];
+    request.specializationEntries.resize(desc.specialization.size());
+    request.specializationData.resize(desc.specialization.size() * sizeof(uint32_t));
+    for (uint32_t id = 0; id < desc.specialization.size(); ++id) {
+      VkSpecializationMapEntry& entry = request.specializationEntries[id];
+      entry.constantID = id;
+      entry.offset = id * static_cast<uint32_t>(sizeof(uint32_t));
+      entry.size = sizeof(uint32_t);
+      std::memcpy(request.specializationData.data() + entry.offset, &desc.specialization[id], sizeof(uint32_t));
+    }
+  }
+
+  std::vector<ComputePipelineResult> const results = createComputePipelines(dev, shaders, pipelineCache, requests);
+  bool ok = true;
+  for (size_t i = 0; i < results.size(); ++i) {
+    if (results[i].pipeline == VK_NULL_HANDLE) {
+      LOG_ERR << "Couldn't create the pipeline of kernel " << descs[i].name << ": " << results[i].result << LOG_RST << std::endl;
+      ok = false;
+    }
+  }
+  if (!ok) {
+    for (ComputePipelineResult const& result : results) {
+      dev.api()->vkDestroyPipeline(dev.device(), result.pipeline, nullptr);
+    }
+    destroyLayouts();
+    return false;
+  }
+
+  // ownership of the pipelines moves to pipelines, including on failure
+  std::vector<uint32_t> ids(descs.size(), VulkanComputePipelines::INVALID_ID);
+  if (pipelines) {
+    for (size_t i = 0; i < descs.size(); ++i) {
+      ids[i] = pipelines->add(std::move(requests[i]), results[i].pipeline);
+      if (ids[i] == VulkanComputePipelines::INVALID_ID) {
+        LOG_ERR << "No room for the pipeline of kernel " << descs[i].name << LOG_RST << std::endl;
+        for (size_t j = 0; j < i; ++j) {
+          pipelines->remove(ids[j]);
+        }
+        for (size_t j = i + 1; j < descs.size(); ++j) {
+          dev.api()->vkDestroyPipeline(dev.device(), results[j].pipeline, nullptr);
+        }
+        destroyLayouts();
+        return false;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < descs.size(); ++i) {
+    ComputeKernel& kernel = *descs[i].kernel;
+    kernel.reset();
+    kernel.m_dev = &dev;
+    kernel.m_layout = layouts[i];
+    if (pipelines) {
+      kernel.m_pipelines = pipelines;
+      kernel.m_id = ids[i];
+    } else {
+      kernel.m_pipeline = results[i].pipeline;
+    }
+    kernel.m_pushConstantSize = descs[i].pushConstantSize;
+  }
+  return true;
+}
+
+// ------------------------------------------------------------------------------
+// ComputeStreamImpl
+// ------------------------------------------------------------------------------
+class ComputeStreamImpl {
+ public:
+  ComputeStreamImpl(VulkanDevice& dev, VulkanCommandBufferManager* commandBuffers, VulkanComputePipelines const* pipelines);
+  void cleanup(VulkanDevice& dev) noexcept;
+
+  VkCommandBuffer commandBuffer(VulkanDevice& dev);
+  void upload(VulkanDevice& dev, DeviceBuffer const& dst, void const* data, VkDeviceSize size, VkDeviceSize dstOffset);
+  void download(VulkanDevice& dev, DeviceBuffer const& src, void* data, VkDeviceSize size, VkDeviceSize srcOffset);
+  void timestamp(VulkanDevice& dev, uint32_t slot);
+  uint64_t submit(VulkanDevice& dev);
+  uint64_t recordingValue() const { return m_submittedValue + 1; }
+  void wait(VulkanDevice& dev);
+  double elapsedNanoseconds(uint32_t fromSlot, uint32_t toSlot) const;
+
+ private:
+  struct Download {
+    VmaAllocation allocation; // mapped source, staging or the buffer itself
+    uint8_t const* source;
+    VkDeviceSize offset; // within allocation
+    void* data;
+    VkDeviceSize size;
+  };
+  // resources of the recording, then of the submissions not waited yet
+  struct Pending {
+    std::vector<DeviceBuffer> staging;
+    std::vector<Download> downloads;
+  };
+
+  VulkanCommandBufferManager* m_commandBuffers;
+  VulkanComputePipelines const* m_pipelines;
+  VkCommandBuffer m_recording = VK_NULL_HANDLE;
+  uint64_t m_submittedValue;
+  uint64_t m_waitedValue;
+  Pending m_recordingPending;
+  Pending m_submittedPending;
+
+  VkQueryPool m_queryPool = VK_NULL_HANDLE; // null without compute timestamps
+  double m_timestampPeriod;
+  uint64_t m_timestampMask;
+  uint64_t m_recordingSlots = 0; // bit per slot written
+  uint64_t m_submittedSlots = 0;
+  uint64_t m_validSlots = 0;
+  std::array<uint64_t, ComputeStream::TIMESTAMP_SLOTS> m_timestamps{};
+};
+
+ComputeStreamImpl::ComputeStreamImpl(VulkanDevice& dev, VulkanCommandBufferManager* commandBuffers, VulkanComputePipelines const* pipelines)
+ : m_commandBuffers(commandBuffers), m_pipelines(pipelines), m_timestampPeriod(dev.profile().timestampPeriod) {
+  static_assert(ComputeStream::TIMESTAMP_SLOTS <= 64, "slots are tracked in a 64-bit mask");
+  // the Vulkan 1.1 instance populates the KHR entry point
+  AVK_VK_RST(dev.api()->vkGetSemaphoreCounterValueKHR(dev.device(), dev.computeTimelineSemaphore(), &m_submittedValue));
+  m_waitedValue = m_submittedValue;
+
+  uint32_t const validBits = dev.profile().computeTimestampValidBits;
+  m_timestampMask = validBits >= 64 ? ~0ULL : (1ULL << validBits) - 1;
+  if (validBits > 0) {
+    VkQueryPoolCreateInfo queryInfo{};
+    queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryInfo.queryCount = ComputeStream::TIMESTAMP_SLOTS;
+    AVK_VK_RST(dev.api()->vkCreateQueryPool(dev.device(), &queryInfo, nullptr, &m_queryPool));
+  }
+}
+
+void ComputeStreamImpl::cleanup(VulkanDevice& dev) noexcept {
+  if (m_recording != VK_NULL_HANDLE) {
+    // never submitted, the manager resets it on reuse
+    dev.api()->vkEndCommandBuffer(m_recording);
+    m_recording = VK_NULL_HANDLE;
+  }
+  wait(dev);
+  for (DeviceBuffer& staging : m_recordingPending.staging) {
+    destroyDeviceBuffer(dev, staging);
+  }
+  if (m_queryPool != VK_NULL_HANDLE) {
+    dev.api()->vkDestroyQueryPool(dev.device(), m_queryPool, nullptr);
+  }
+}
+
+VkCommandBuffer ComputeStreamImpl::commandBuffer(VulkanDevice& dev) {
+  if (m_recording != VK_NULL_HANDLE) {
+    return m_recording;
+  }
+  m_recording = m_commandBuffers->getThreadLocalComputeCommandBufferForTimeline(m_submittedValue + 1);
+  if (m_recording == VK_NULL_HANDLE) {
+    LOG_ERR << "No compute command buffer available" LOG_RST << std::endl;
+    std::abort();
+  }
+  // before any kernel of the recording binds: a rebuild() from now on
+  // retires the pipelines it replaces past this submission
+  if (m_pipelines) {
+    m_pipelines->use(m_submittedValue + 1);
+  }
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  AVK_VK_RST(dev.api()->vkBeginCommandBuffer(m_recording, &beginInfo));
+  if (m_queryPool != VK_NULL_HANDLE) {
+    dev.api()->vkCmdResetQueryPool(m_recording, m_queryPool, 0, ComputeStream::TIMESTAMP_SLOTS);
+  }
+  m_recordingSlots = 0;
+  return m_recording;
+}
+
+void ComputeStreamImpl::upload(VulkanDevice& dev, DeviceBuffer const& dst, void const* data, VkDeviceSize size, VkDeviceSize dstOffset) {
+  assert(dstOffset + size <= dst.size);
+  if (dst.mapped) {
+    // host writes are made visible by the submission
+    std::memcpy(static_cast<uint8_t*>(dst.mapped) + dstOffset, data, size);
+    auto const lock = dev.lockAllocator();
+    AVK_VK_RST(vmaFlushAllocation(dev.allocator(), dst.allocation, dstOffset, size));
+    return;
+  }
+  DeviceBuffer staging = createDeviceBuffer(dev, size, EBufferLocation::HostUpload);
+  if (!staging) {
+    std::abort();
+  }
+  std::memcpy(staging.mapped, data, size);
+  {
+    auto const lock = dev.lockAllocator();
+    AVK_VK_RST(vmaFlushAllocation(dev.allocator(), staging.allocation, 0, size));
+  }
+
+  VkCommandBuffer const commandBuffer = this->commandBuffer(dev);
+  // previous commands may still read or write the destination
+  computeBarrier(dev, commandBuffer);
+  VkBufferCopy region{};
+  region.dstOffset = dstOffset;
+  region.size = size;
+  dev.api()->vkCmdCopyBuffer(commandBuffer, staging.buffer, dst.buffer, 1, &region);
+  computeBarrier(dev, commandBuffer);
+  m_recordingPending.staging.push_back(staging);
+}
+
+void ComputeStreamImpl::download(VulkanDevice& dev, DeviceBuffer const& src, void* data, VkDeviceSize size, VkDeviceSize srcOffset) {
+  assert(srcOffset + size <= src.size);
+  VkCommandBuffer const commandBuffer = this->commandBuffer(dev);
+  if (src.mapped) {
+    hostReadBarrier(dev, commandBuffer);
+    m_recordingPending.downloads.push_back({src.allocation, static_cast<uint8_t const*>(src.mapped), srcOffset, data, size});
+    return;
+  }
+  DeviceBuffer staging = createDeviceBuffer(dev, size, EBufferLocation::HostReadback);
+  if (!staging) {
+    std::abort();
+  }
+  computeBarrier(dev, commandBuffer);
+  VkBufferCopy region{};
+  region.srcOffset = srcOffset;
+  region.size = size;
+  dev.api()->vkCmdCopyBuffer(commandBuffer, src.buffer, staging.buffer, 1, &region);
+  hostReadBarrier(dev, commandBuffer);
+  m_recordingPending.downloads.push_back({staging.allocation, static_cast<uint8_t const*>(staging.mapped), 0, data, size});
+  m_recordingPending.staging.push_back(staging);
+}
+
+void ComputeStreamImpl::timestamp(VulkanDevice& dev, uint32_t slot) {
+  assert(slot < ComputeStream::TIMESTAMP_SLOTS);
+  VkCommandBuffer const commandBuffer = this->commandBuffer(dev);
+  if (m_queryPool == VK_NULL_HANDLE) {
+    return;
+  }
+  // written once all previous commands finished
+  dev.api()->vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_queryPool, slot);
+  m_recordingSlots |= 1ULL << slot;
+}
+
+uint64_t ComputeStreamImpl::submit(VulkanDevice& dev) {
+  VkCommandBuffer const commandBuffer = this->commandBuffer(dev);
+  AVK_VK_RST(dev.api()->vkEndCommandBuffer(commandBuffer));
+
+  VkSemaphore const signalSemaphore = dev.computeTimelineSemaphore();
+  uint64_t const signalValue = m_submittedValue + 1;
+  VkTimelineSemaphoreSubmitInfo semaphoreSubmitInfo{};
+  semaphoreSubmitInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  semaphoreSubmitInfo.signalSemaphoreValueCount = 1;
+  semaphoreSubmitInfo.pSignalSemaphoreValues = &signalValue;
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.pNext = &semaphoreSubmitInfo;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &signalSemaphore;
+  AVK_VK_RST(dev.api()->vkQueueSubmit(dev.computeQueue(), 1, &submitInfo, VK_NULL_HANDLE));
+
+  m_recording = VK_NULL_HANDLE;
+  m_submittedValue = signalValue;
+  m_submittedSlots = m_recordingSlots;
+  m_recordingSlots = 0;
+  auto const append = [](auto& to, auto& from) {
+    to.insert(to.end(), from.begin(), from.end());
+    from.clear();
+  };
+  append(m_submittedPending.staging, m_recordingPending.staging);
+  append(m_submittedPending.downloads, m_recordingPending.downloads);
+  return signalValue;
+}
+
+void ComputeStreamImpl::wait(VulkanDevice& dev) {
+  if (m_waitedValue == m_submittedValue) {
+    return;
+  }
+  VkSemaphore const semaphore = dev.computeTimelineSemaphore();
+  VkSemaphoreWaitInfo waitInfo{};
+  waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &semaphore;
+  waitInfo.pValues = &m_submittedValue;
+  AVK_VK_RST(dev.api()->vkWaitSemaphoresKHR(dev.device(), &waitInfo, UINT64_MAX));
+  m_waitedValue = m_submittedValue;
+
+  for (Download const& download : m_submittedPending.downloads) {
+    {
+      auto const lock = dev.lockAllocator();
+      AVK_VK_RST(vmaInvalidateAllocation(dev.allocator(), download.allocation, download.offset, download.size));
+    }
+    std::memcpy(download.data, download.source + download.offset, download.size);
+  }
+  m_submittedPending.downloads.clear();
+  for (DeviceBuffer& staging : m_submittedPending.staging) {
+    destroyDeviceBuffer(dev, staging);
+  }
+  m_submittedPending.staging.clear();
+
+  m_validSlots = 0;
+  for (uint32_t slot = 0; slot < ComputeStream::TIMESTAMP_SLOTS; ++slot) {
+    if (!(m_submittedSlots & (1ULL << slot)))
+      continue;
+    VkResult const res = dev.api()->vkGetQueryPoolResults(dev.device(), m_queryPool, slot, 1, sizeof(uint64_t), &m_timestamps[slot],
+      sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if (res == VK_SUCCESS) {
+      m_validSlots |= 1ULL << slot;
+    }
+  }
+}
+
+double ComputeStreamImpl::elapsedNanoseconds(uint32_t fromSlot, uint32_t toSlot) const {
+  assert(fromSlot < ComputeStream::TIMESTAMP_SLOTS && toSlot < ComputeStream::TIMESTAMP_SLOTS);
+  if (!(m_validSlots & (1ULL << fromSlot)) || !(m_validSlots & (1ULL << toSlot))) {
+    return 0;
+  }
+  // masked difference handles a counter wrapping in between
+  uint64_t const ticks = (m_timestamps[toSlot] - m_timestamps[fromSlot]) & m_timestampMask;
+  return static_cast<double>(ticks) * m_timestampPeriod;
+}
+
+// ------------------------------------------------------------------------------
+// ComputeStream
+// ------------------------------------------------------------------------------
+
+ComputeStream::ComputeStream(VulkanDevice* dev, VulkanCommandBufferManager* commandBuffers, VulkanComputePipelines const* pipelines)
+ : m_impl(std::make_unique<ComputeStreamImpl>(*dev, commandBuffers, pipelines)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+ComputeStream::~ComputeStream() noexcept {
+  m_impl->cleanup(*m_dev);
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+VkCommandBuffer ComputeStream::commandBuffer() {
+  return m_impl->commandBuffer(*m_dev);
+}
+
+void ComputeStream::upload(DeviceBuffer const& dst, void const* data, VkDeviceSize size, VkDeviceSize dstOffset) {
+  m_impl->upload(*m_dev, dst, data, size, dstOffset);
+}
+
+void ComputeStream::download(DeviceBuffer const& src, void* data, VkDeviceSize size, VkDeviceSize srcOffset) {
+  m_impl->download(*m_dev, src, data, size, srcOffset);
+}
+
+void ComputeStream::timestamp(uint32_t slot) {
+  m_impl->timestamp(*m_dev, slot);
+}
+
+uint64_t ComputeStream::submit() {
+  return m_impl->submit(*m_dev);
+}
+
+uint64_t ComputeStream::recordingValue() const {
+  return m_impl->recordingValue();
+}
+
+void ComputeStream::wait() {
+  m_impl->wait(*m_dev);
+}
+
+double ComputeStream::elapsedNanoseconds(uint32_t fromSlot, uint32_t toSlot) const {
+  return m_impl->elapsedNanoseconds(fromSlot, toSlot);
+}
+
+}
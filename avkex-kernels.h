@@ -0,0 +1,848 @@
+#pragma once
+
+#include "avkex.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <type_traits>
+
+// Compute kernel library
+// - kernels live in the shader pack (AVKEX_KERNELS in CMakeLists.txt), one
+//   pack entry per compile time variant of a GLSL source in shaders/
+// - no descriptor sets: buffers are passed as device addresses
+//   (VK_KHR_buffer_device_address, required by VulkanDevice) in push
+//   constants, declared as uvec2 on the GLSL side (GL_EXT_buffer_reference_uvec2)
+// - specialization constant 0 is the workgroup size (local_size_x_id = 0),
+//   launch shapes are picked from the device profile
+// - operations record into a caller command buffer, like a stream in CUDA
+//   libraries. Multi pass operations barrier between their own passes, the
+//   caller barriers (computeBarrier) before consuming a result
+// - for hot reload, give the kernel classes a VulkanComputePipelines rebuilt
+//   by a ShaderWatcher on the pack (ShaderWatcher::addPack), see ComputeKernel
+namespace avkex {
+
+// ------------------------------------------------------------------------------
+// DeviceBuffer
+// ------------------------------------------------------------------------------
+
+// Storage buffer usable through its device address, as a transfer source and
+// destination and as an indirect dispatch argument buffer
+enum class EBufferLocation : uint8_t {
+  Device,      // device local, not mapped
+  HostUpload,  // mapped, written sequentially by the host (BAR/unified memory when available)
+  HostReadback // mapped, cached, read by the host
+};
+struct DeviceBuffer {
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VmaAllocation allocation = VK_NULL_HANDLE;
+  VkDeviceAddress address = 0;
+  VkDeviceSize size = 0;
+  void* mapped = nullptr; // set for host locations
+
+  explicit operator bool() const { return buffer != VK_NULL_HANDLE; }
+};
+// empty buffer on failure
+DeviceBuffer createDeviceBuffer(VulkanDevice& dev, VkDeviceSize size, EBufferLocation location = EBufferLocation::Device);
+void destroyDeviceBuffer(VulkanDevice& dev, DeviceBuffer& buffer);
+
+// compute and transfer writes before, compute, transfer and indirect reads after
+void computeBarrier(VulkanDevice const& dev, VkCommandBuffer commandBuffer);
+
+// ------------------------------------------------------------------------------
+// Launch Shapes
+// ------------------------------------------------------------------------------
+
+// largest multiple of the subgroup size not above preferred and the device limits
+inline uint32_t chooseWorkgroupSize(VulkanDeviceProfile const& profile, uint32_t preferred = 256) {
+  uint32_t const limit = std::min({preferred, profile.maxComputeWorkGroupInvocations, profile.maxComputeWorkGroupSize[0]});
+  uint32_t const subgroupSize = std::max(1U, profile.subgroupSize);
+  return limit >= subgroupSize ? limit - limit % subgroupSize : limit;
+}
+
+// workgroups to cover items with itemsPerGroup each, at least 1 and at most
+// maxGroups (grid-stride loops cover the rest)
+inline uint32_t chooseGroupCount(VulkanDeviceProfile const& profile, uint64_t items, uint32_t itemsPerGroup, uint32_t maxGroups) {
+  uint64_t const groups = (items + itemsPerGroup - 1) / itemsPerGroup;
+  uint32_t const cap = std::min(maxGroups, profile.maxComputeWorkGroupCount[0]);
+  return static_cast<uint32_t>(std::clamp<uint64_t>(groups, 1, cap));
+}
+
+// ------------------------------------------------------------------------------
+// ComputeKernel
+// ------------------------------------------------------------------------------
+
+// One pipeline of a pack kernel with its push constant only layout.
+// specialization[i] is the 32-bit value of constant_id i.
+// Kernels created on a VulkanComputePipelines follow its rebuild() (eg from
+// a ShaderWatcher onReloaded) and bind through get(id, 0): record them into a
+// ComputeStream given the VulkanComputePipelines, or call use() with the
+// timeline value of the submission before recording them. The
+// VulkanComputePipelines must outlive the kernel
+struct ComputeKernelDesc;
+class ComputeKernel {
+ public:
+  ComputeKernel() = default;
+  ComputeKernel(ComputeKernel const&) = delete;
+  ComputeKernel(ComputeKernel&& that) noexcept;
+  ComputeKernel& operator=(ComputeKernel const&) = delete;
+  ComputeKernel& operator=(ComputeKernel&& that) noexcept;
+  ~ComputeKernel() noexcept;
+
+  explicit operator bool() const { return m_pipeline != VK_NULL_HANDLE || m_pipelines != nullptr; }
+  VkPipeline pipeline() const { return m_pipelines ? m_pipelines->get(m_id, 0) : m_pipeline; }
+  VkPipelineLayout layout() const { return m_layout; }
+
+  template <typename P>
+  void dispatch(VkCommandBuffer commandBuffer, P const& params, uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1) const {
+    static_assert(std::is_trivially_copyable_v<P>);
+    assert(sizeof(P) == m_pushConstantSize);
+    bind(commandBuffer, &params);
+    m_dev->api()->vkCmdDispatch(commandBuffer, groupCountX, groupCountY, groupCountZ);
+  }
+  // group counts read from a VkDispatchIndirectCommand at offset of buffer
+  template <typename P>
+  void dispatchIndirect(VkCommandBuffer commandBuffer, P const& params, VkBuffer buffer, VkDeviceSize offset) const {
+    static_assert(std::is_trivially_copyable_v<P>);
+    assert(sizeof(P) == m_pushConstantSize);
+    bind(commandBuffer, &params);
+    m_dev->api()->vkCmdDispatchIndirect(commandBuffer, buffer, offset);
+  }
+
+ private:
+  friend bool createComputeKernels(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache,
+    std::vector<ComputeKernelDesc> const& descs, VulkanComputePipelines* pipelines);
+  void bind(VkCommandBuffer commandBuffer, void const* params) const;
+  void reset() noexcept;
+
+  VulkanDevice* m_dev = nullptr;
+  VkPipelineLayout m_layout = VK_NULL_HANDLE;
+  VkPipeline m_pipeline = VK_NULL_HANDLE; // unless on m_pipelines
+  VulkanComputePipelines* m_pipelines = nullptr;
+  uint32_t m_id = VulkanComputePipelines::INVALID_ID;
+  uint32_t m_pushConstantSize = 0;
+};
+
+struct ComputeKernelDesc {
+  ComputeKernel* kernel;
+  std::string_view name; // pack entry
+  uint32_t pushConstantSize;
+  std::vector<uint32_t> specialization;
+};
+// all pipelines are created in parallel (createComputePipelines), then handed
+// to pipelines if given. On failure, logged, no kernel is created
+bool createComputeKernels(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache,
+  std::vector<ComputeKernelDesc> const& descs, VulkanComputePipelines* pipelines = nullptr);
+
+// ------------------------------------------------------------------------------
+// ComputeStream
+// ------------------------------------------------------------------------------
+
+// Recording and submission helper for setup code, tests and benchmarks:
+// records into command buffers of the manager (so stay on the thread which
+// created it), submits to the compute queue signaling the compute timeline,
+// and stages host transfers. Assumes it is the only one signaling the
+// compute timeline. Given the VulkanComputePipelines of its kernels (on the
+// compute timeline), each recording marks its value in use before it begins
+class ComputeStreamImpl;
+class ComputeStream {
+ public:
+  static constexpr uint32_t TIMESTAMP_SLOTS = 64;
+
+  ComputeStream(VulkanDevice* dev, VulkanCommandBufferManager* commandBuffers, VulkanComputePipelines const* pipelines = nullptr);
+  ComputeStream(ComputeStream const&) = delete;
+  ComputeStream(ComputeStream &&) noexcept = delete;
+  ComputeStream& operator=(ComputeStream const&) = delete;
+  ComputeStream& operator=(ComputeStream &&) noexcept = delete;
+  // waits for the last submission
+  ~ComputeStream() noexcept;
+
+  // command buffer being recorded, begun on first use after a submit
+  VkCommandBuffer commandBuffer();
+  void barrier() { computeBarrier(*m_dev, commandBuffer()); }
+  // mapped buffers are written right away, others through a staging copy
+  // recorded in the stream. Either way visible to commands recorded after
+  void upload(DeviceBuffer const& dst, void const* data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+  // copies the buffer content at this point of the recording into data once
+  // wait() returns
+  void download(DeviceBuffer const& src, void* data, VkDeviceSize size, VkDeviceSize srcOffset = 0);
+  // device time once all previously recorded commands completed
+  void timestamp(uint32_t slot);
+
+  // returns the compute timeline value signaled by the submission
+  uint64_t submit();
+  // compute timeline value the next submit() signals
+  uint64_t recordingValue() const;
+  // waits for the last submission, completes its downloads, reads its timestamps
+  void wait();
+  uint64_t submitAndWait() {
+    uint64_t const value = submit();
+    wait();
+    return value;
+  }
+  // between two timestamps of the last waited submission, 0 if either is missing
+  double elapsedNanoseconds(uint32_t fromSlot, uint32_t toSlot) const;
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<ComputeStreamImpl> m_impl;
+};
+
+// ------------------------------------------------------------------------------
+// Blas1
+// ------------------------------------------------------------------------------
+
+// BLAS level-1 over f32 vectors in device memory. n < 2^32 minus one grid of
+// invocations (the grid-stride index is 32-bit)
+// - elementwise operations take vec4 paths when both addresses are 16-byte
+//   aligned, a scalar loop handles the tail
+// - dot/nrm2/asum reduce per subgroup (subgroupAdd), then per workgroup in
+//   shared memory into per workgroup partials, then a second single
+//   workgroup pass writes the float at result: deterministic for a given n
+//   and device. nrm2 doesn't rescale, |x| must stay below ~1e19
+// - reductions share one scratch buffer, they serialize against each other
+// - given a KernelTuner, the workgroup size is the one tuned for axpy on this
+//   device (see KernelTuner::tune, the first run sweeps), else chosen from the
+//   profile
+class Blas1Impl;
+class Blas1 {
+ public:
+  Blas1(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+    VulkanComputePipelines* pipelines = nullptr, KernelTuner* tuner = nullptr);
+  Blas1(Blas1 const&) = delete;
+  Blas1(Blas1 &&) noexcept = delete;
+  Blas1& operator=(Blas1 const&) = delete;
+  Blas1& operator=(Blas1 &&) noexcept = delete;
+  ~Blas1() noexcept;
+
+  // false if the kernels are missing or the device lacks subgroup arithmetic
+  explicit operator bool() const;
+  uint32_t workgroupSize() const;
+
+  // y = alpha * x + y
+  void axpy(VkCommandBuffer commandBuffer, uint32_t n, float alpha, VkDeviceAddress x, VkDeviceAddress y);
+  // x = alpha * x
+  void scal(VkCommandBuffer commandBuffer, uint32_t n, float alpha, VkDeviceAddress x);
+  // y = x
+  void copy(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress x, VkDeviceAddress y);
+  // x <-> y
+  void swap(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress x, VkDeviceAddress y);
+  // *result = sum x[i] * y[i]
+  void dot(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress x, VkDeviceAddress y, VkDeviceAddress result);
+  // *result = sqrt(sum x[i]^2)
+  void nrm2(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress x, VkDeviceAddress result);
+  // *result = sum |x[i]|
+  void asum(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress x, VkDeviceAddress result);
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<Blas1Impl> m_impl;
+};
+
+// ------------------------------------------------------------------------------
+// BitonicSort
+// ------------------------------------------------------------------------------
+
+// interpretation of sort keys. Floats order -NaN < -inf < ... < -0 < +0 < ...
+// < +inf < +NaN. 64-bit keys are (low, high) 32-bit word pairs
+enum class ESortKey : uint8_t { Uint32 = 0, Int32, Float32, Uint64, Int64, Float64 };
+
+// In place ascending sort of n <= 2^31 32-bit keys, optionally moving 32-bit
+// values along. Not stable. Data oblivious, O(n log^2 n) compare-exchanges
+// - tiles of workgroup size keys sort in one dispatch: subgroupShuffleXor
+//   for partners within a subgroup, shared memory above
+// - larger blocks merge with one global memory dispatch per step while
+//   partners are in different tiles, then one tile dispatch for the rest:
+//   about log2(n / tile)^2 / 2 dispatches, each one barriered
+class BitonicSortImpl;
+class BitonicSort {
+ public:
+  BitonicSort(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+    VulkanComputePipelines* pipelines = nullptr);
+  BitonicSort(BitonicSort const&) = delete;
+  BitonicSort(BitonicSort &&) noexcept = delete;
+  BitonicSort& operator=(BitonicSort const&) = delete;
+  BitonicSort& operator=(BitonicSort &&) noexcept = delete;
+  ~BitonicSort() noexcept;
+
+  // false if the kernels are missing or the device lacks subgroup shuffles
+  explicit operator bool() const;
+  uint32_t tileSize() const;
+
+  // values: 0 for a key only sort
+  void sort(VkCommandBuffer commandBuffer, ESortKey keyType, uint32_t n, VkDeviceAddress keys, VkDeviceAddress values = 0);
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<BitonicSortImpl> m_impl;
+};
+
+// ------------------------------------------------------------------------------
+// PrefixScan
+// ------------------------------------------------------------------------------
+
+enum class EScanType : uint8_t { Uint32 = 0, Float32 };
+// associative and commutative operators, bitwise ones on Uint32 only. One
+// more is a case in the combine/identity/subgroup functions of scan.comp
+enum class EScanOp : uint8_t { Add = 0, Min, Max, Mul, BitAnd, BitOr, BitXor };
+
+// written by compaction: the selected count, then a dispatch covering it
+struct CompactionCount {
+  uint32_t count;
+  VkDispatchIndirectCommand dispatch; // {ceil(count / itemsPerGroup), 1, 1}
+};
+static_assert(sizeof(CompactionCount) == 16);
+
+// Single pass scans with decoupled look-back: each element is read and
+// written once, tiles resolve their prefix from their predecessors' published
+// aggregates while the scan is running
+// - scratch: device buffer of scratchSize(n) bytes, zeroed by each call
+//   (vkCmdFillBuffer) and busy until the call completes
+// - in place scans are fine, compaction output must not alias its inputs
+// - f32 results may differ in the last bits between runs: tiles combine
+//   whichever of their predecessors' values are published first
+class PrefixScanImpl;
+class PrefixScan {
+ public:
+  PrefixScan(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+    VulkanComputePipelines* pipelines = nullptr);
+  PrefixScan(PrefixScan const&) = delete;
+  PrefixScan(PrefixScan &&) noexcept = delete;
+  PrefixScan& operator=(PrefixScan const&) = delete;
+  PrefixScan& operator=(PrefixScan &&) noexcept = delete;
+  ~PrefixScan() noexcept;
+
+  // false if the kernels are missing or the device lacks subgroup arithmetic
+  // and ballot
+  explicit operator bool() const;
+  uint32_t tileSize() const;
+  VkDeviceSize scratchSize(uint32_t n) const;
+
+  // dst[i] = src[0] op ... op src[i]
+  void inclusiveScan(VkCommandBuffer commandBuffer, EScanType type, EScanOp op, uint32_t n, VkDeviceAddress src, VkDeviceAddress dst,
+    DeviceBuffer const& scratch);
+  // dst[i] = identity op src[0] op ... op src[i - 1]
+  void exclusiveScan(VkCommandBuffer commandBuffer, EScanType type, EScanOp op, uint32_t n, VkDeviceAddress src, VkDeviceAddress dst,
+    DeviceBuffer const& scratch);
+  // dst[0, count) = the 32-bit values whose flag is nonzero, in order. count
+  // holds a CompactionCount whose dispatch covers count items per itemsPerGroup
+  void compact(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress values, VkDeviceAddress flags, VkDeviceAddress dst,
+    VkDeviceAddress count, uint32_t itemsPerGroup, DeviceBuffer const& scratch);
+  // compact, and the rejected values fill dst[count, n) in reverse order
+  void partition(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress values, VkDeviceAddress flags, VkDeviceAddress dst,
+    VkDeviceAddress count, uint32_t itemsPerGroup, DeviceBuffer const& scratch);
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<PrefixScanImpl> m_impl;
+};
+
+// ------------------------------------------------------------------------------
+// RadixSort
+// ------------------------------------------------------------------------------
+
+// Stable LSD radix sort of n < 2^31 32- or 64-bit keys, optionally moving
+// 32-bit values along. Each pass over a digit is three dispatches: per tile
+// digit histograms, their exclusive scan (PrefixScan), and the scatter of the
+// tiles to the scanned positions
+// - digits are 8 bits (4 where shared memory is short, radixBits()), so 32-bit
+//   keys take 4 passes and 64-bit ones 8
+// - within a subgroup, equal digits are ranked with ballots: one shared atomic
+//   per distinct digit in histograms, stable ranks in scatters
+// - scratch: device buffer of at least scratchSize() bytes holding the ping
+//   pong copies, histograms and scan state, so repeated sorts of up to a size
+//   allocate nothing. Busy until the sort completes
+// - segmented sorts order each [segmentOffsets[s], segmentOffsets[s + 1]) on
+//   its own: extra passes sort on the segment id, stably, after the keys
+class RadixSortImpl;
+class RadixSort {
+ public:
+  RadixSort(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+    VulkanComputePipelines* pipelines = nullptr);
+  RadixSort(RadixSort const&) = delete;
+  RadixSort(RadixSort &&) noexcept = delete;
+  RadixSort& operator=(RadixSort const&) = delete;
+  RadixSort& operator=(RadixSort &&) noexcept = delete;
+  ~RadixSort() noexcept;
+
+  // false if the kernels are missing or the device lacks subgroup ballot
+  explicit operator bool() const;
+  uint32_t radixBits() const;
+  uint32_t tileSize() const;
+  VkDeviceSize scratchSize(uint32_t n, ESortKey keyType, bool withValues, uint32_t segmentCount = 1) const;
+
+  // values: 0 for a key only sort
+  void sort(VkCommandBuffer commandBuffer, ESortKey keyType, uint32_t n, VkDeviceAddress keys, VkDeviceAddress values,
+    DeviceBuffer const& scratch);
+  // segmentOffsets: segmentCount + 1 ascending 32-bit offsets, the first 0
+  // and the last n
+  void sortSegments(VkCommandBuffer commandBuffer, ESortKey keyType, uint32_t n, VkDeviceAddress keys, VkDeviceAddress values,
+    VkDeviceAddress segmentOffsets, uint32_t segmentCount, DeviceBuffer const& scratch);
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<RadixSortImpl> m_impl;
+};
+
+// ------------------------------------------------------------------------------
+// Reduction
+// ------------------------------------------------------------------------------
+
+enum class EReduceType : uint8_t { Uint32 = 0, Int32, Float32 };
+// arg ops find the first extremum. NaNs give unspecified results
+enum class EReduceOp : uint8_t { Sum = 0, Min, Max, ArgMin, ArgMax };
+// both are deterministic: partials always combine in the same order
+// - SinglePass: the last workgroup of a segment reduces the partials
+// - TwoPass: a second dispatch does, no device scope atomics
+enum class EReduceMode : uint8_t { SinglePass = 0, TwoPass };
+
+// written per segment. Sums wrap (integers)
+struct ReductionResult {
+  uint32_t bits;  // of the value, as the EReduceType. The identity for empty segments
+  uint32_t index; // arg ops: within the segment, REDUCTION_NO_INDEX if empty
+  template <typename T>
+  T value() const {
+    static_assert(sizeof(T) == sizeof(uint32_t));
+    T result;
+    std::memcpy(&result, &bits, sizeof(T));
+    return result;
+  }
+};
+static_assert(sizeof(ReductionResult) == 8);
+inline uint32_t constexpr REDUCTION_NO_INDEX = UINT32_MAX;
+
+// Batched reductions of 32-bit values into one ReductionResult per segment,
+// so only those bytes need a download. Per segment, workgroups reduce per
+// invocation, subgroup (subgroup arithmetic) and workgroup (shared memory)
+// into partials combined by one workgroup
+// - n / segmentCount sizes the workgroups per segment: many small segments
+//   get one workgroup each and no partials, one large segment up to 1024
+// - scratch: device buffer of scratchSize() bytes (0 when there are no
+//   partials), busy until the call completes
+class ReductionImpl;
+class Reduction {
+ public:
+  Reduction(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+    VulkanComputePipelines* pipelines = nullptr);
+  Reduction(Reduction const&) = delete;
+  Reduction(Reduction &&) noexcept = delete;
+  Reduction& operator=(Reduction const&) = delete;
+  Reduction& operator=(Reduction &&) noexcept = delete;
+  ~Reduction() noexcept;
+
+  // false if the kernels are missing or the device lacks subgroup arithmetic
+  explicit operator bool() const;
+  VkDeviceSize scratchSize(uint32_t n, uint32_t segmentCount = 1) const;
+
+  // dst: one ReductionResult of src[0, n)
+  void reduce(VkCommandBuffer commandBuffer, EReduceType type, EReduceOp op, EReduceMode mode, uint32_t n, VkDeviceAddress src,
+    VkDeviceAddress dst, DeviceBuffer const& scratch);
+  // dst: segmentCount ReductionResults of src[segmentOffsets[s], segmentOffsets[s + 1]).
+  // segmentOffsets: segmentCount + 1 ascending 32-bit offsets, the last n
+  void reduceSegments(VkCommandBuffer commandBuffer, EReduceType type, EReduceOp op, EReduceMode mode, uint32_t n, VkDeviceAddress src,
+    VkDeviceAddress segmentOffsets, uint32_t segmentCount, VkDeviceAddress dst, DeviceBuffer const& scratch);
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<ReductionImpl> m_impl;
+};
+
+// ------------------------------------------------------------------------------
+// Gemm
+// ------------------------------------------------------------------------------
+// element type of A and B, C is f32 either way
+enum class EGemmType : uint8_t { Float32 = 0, Float16 };
+
+// workgroup tile of C, K slice staged in shared memory per step and register
+// block of C per invocation: tileM / threadM * tileN / threadN invocations.
+// tileK and tileN are multiples of 4
+struct GemmTiling {
+  uint32_t tileM = 64;
+  uint32_t tileN = 64;
+  uint32_t tileK = 16;
+  uint32_t threadM = 4;
+  uint32_t threadN = 4;
+};
+
+// C = alpha * A * B + beta * C for row major m x k A, k x n B and m x n C with
+// leading dimensions (elements between rows) lda, ldb, ldc. Shared memory
+// tiling with register blocking and 4-wide loads when rows and addresses are
+// aligned. f16 needs Float16 support (16-bit storage and arithmetic), and
+// runs on cooperative matrices when the device has them.
+// beta 0 doesn't read C. Batches are matrices strideA/B/C elements apart
+class GemmImpl;
+class Gemm {
+ public:
+  Gemm(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+    GemmTiling const& tiling = {}, VulkanComputePipelines* pipelines = nullptr);
+  Gemm(Gemm const&) = delete;
+  Gemm(Gemm &&) noexcept = delete;
+  Gemm& operator=(Gemm const&) = delete;
+  Gemm& operator=(Gemm &&) noexcept = delete;
+  ~Gemm() noexcept;
+
+  // false if the kernels are missing or the tiling doesn't fit the device
+  explicit operator bool() const;
+  bool supports(EGemmType type) const;
+  // f16 runs on VK_KHR_cooperative_matrix
+  bool usesCooperativeMatrix() const;
+
+  void gemm(VkCommandBuffer commandBuffer, EGemmType type, uint32_t m, uint32_t n, uint32_t k, float alpha, VkDeviceAddress a,
+    uint32_t lda, VkDeviceAddress b, uint32_t ldb, float beta, VkDeviceAddress c, uint32_t ldc);
+  // batchCount <= maxComputeWorkGroupCount[2]
+  void gemmStridedBatched(VkCommandBuffer commandBuffer, EGemmType type, uint32_t m, uint32_t n, uint32_t k, float alpha,
+    VkDeviceAddress a, uint32_t lda, uint32_t strideA, VkDeviceAddress b, uint32_t ldb, uint32_t strideB, float beta, VkDeviceAddress c,
+    uint32_t ldc, uint32_t strideC, uint32_t batchCount);
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<GemmImpl> m_impl;
+};
+
+// ------------------------------------------------------------------------------
+// BatchedSolver
+// ------------------------------------------------------------------------------
+enum class ETriangle : uint8_t { Lower = 0, Upper };
+
+// Factorizations and solves of many small dense f32 matrices, n in [1, 32],
+// all of one size per call. Matrices are row major and interleaved: element
+// e (row * columns + column) of matrix b is at e * batchStride + b, with
+// batchStride >= batchCount. Permutations, right hand sides (n x nrhs) and
+// the factors in place use the same layout and batchStride.
+// One invocation per row keeps it in registers, workgroups own several
+// matrices and exchange pivots and solutions through shared memory
+// - info: one uint32 per matrix (0 address: none), 0 or the 1-based step
+//   where a zero pivot or a non positive diagonal was met. The factors of
+//   such a matrix are unspecified
+class BatchedSolverImpl;
+class BatchedSolver {
+ public:
+  static constexpr uint32_t MAX_SIZE = 32;
+
+  BatchedSolver(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+    VulkanComputePipelines* pipelines = nullptr);
+  BatchedSolver(BatchedSolver const&) = delete;
+  BatchedSolver(BatchedSolver &&) noexcept = delete;
+  BatchedSolver& operator=(BatchedSolver const&) = delete;
+  BatchedSolver& operator=(BatchedSolver &&) noexcept = delete;
+  ~BatchedSolver() noexcept;
+
+  // false if the kernels are missing
+  explicit operator bool() const;
+
+  // P A = L U with partial pivoting: unit L below the diagonal and U in a,
+  // permutation[k] (uint32) the row of A that became row k
+  void factorLu(VkCommandBuffer commandBuffer, uint32_t n, uint32_t batchCount, uint32_t batchStride, VkDeviceAddress a,
+    VkDeviceAddress permutation, VkDeviceAddress info);
+  // A = L L^T of symmetric positive definite A: L in the lower part of a,
+  // which is the only part read. The upper part is left as is
+  void factorCholesky(VkCommandBuffer commandBuffer, uint32_t n, uint32_t batchCount, uint32_t batchStride, VkDeviceAddress a,
+    VkDeviceAddress info);
+
+  // b = A^-1 b from factorLu
+  void solveLu(VkCommandBuffer commandBuffer, uint32_t n, uint32_t nrhs, uint32_t batchCount, uint32_t batchStride, VkDeviceAddress a,
+    VkDeviceAddress permutation, VkDeviceAddress b);
+  // b = A^-1 b from factorCholesky
+  void solveCholesky(VkCommandBuffer commandBuffer, uint32_t n, uint32_t nrhs, uint32_t batchCount, uint32_t batchStride,
+    VkDeviceAddress a, VkDeviceAddress b);
+  // b = T^-1 b with T the triangle of a, its diagonal taken as ones when
+  // unitDiagonal. The other triangle isn't read
+  void solveTriangular(VkCommandBuffer commandBuffer, ETriangle triangle, bool unitDiagonal, uint32_t n, uint32_t nrhs,
+    uint32_t batchCount, uint32_t batchStride, VkDeviceAddress a, VkDeviceAddress b);
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<BatchedSolverImpl> m_impl;
+};
+
+// ------------------------------------------------------------------------------
+// Histogram
+// ------------------------------------------------------------------------------
+// u8 and u16 are packed, segment offsets count elements
+enum class EHistogramInput : uint8_t { Uint8 = 0, Uint16, Uint32, Float32 };
+// - Direct: the value is the bin, f32 rounded down
+// - Range: [min, max) split into binCount equal bins, integers as f32
+// - Bits: (bits >> shift) & (binCount - 1) of the raw value, binCount a power of 2
+enum class EHistogramBinning : uint8_t { Direct = 0, Range, Bits };
+
+struct HistogramBinning {
+  EHistogramBinning function = EHistogramBinning::Direct;
+  float min = 0.f; // Range
+  float max = 1.f;
+  uint32_t shift = 0; // Bits
+  // values past the bins count in the first or last bin instead of being
+  // dropped. NaNs are always dropped
+  bool clampOutliers = false;
+};
+
+// Batched histograms with privatized bins: workgroups count in shared
+// memory with atomics, one copy of the bins per subgroup when they fit,
+// then add their non zero bins to dst with global atomics. Bin counts past
+// maxSharedBins() count on dst directly
+// - dst: segmentCount x binCount uint32 counts, added to: clear it first
+//   for a fresh histogram
+// - src: 4-byte aligned and readable for histogramSourceBytes(input, n):
+//   u8 and u16 are read as whole 32-bit words, up to the 4-byte boundary
+//   after element n. The bytes past element n are ignored
+inline VkDeviceSize histogramSourceBytes(EHistogramInput input, uint32_t n) {
+  uint32_t const elementSize = input == EHistogramInput::Uint8 ? 1 : input == EHistogramInput::Uint16 ? 2 : 4;
+  return (VkDeviceSize{n} * elementSize + 3) & ~VkDeviceSize{3};
+}
+
+class HistogramImpl;
+class Histogram {
+ public:
+  Histogram(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+    VulkanComputePipelines* pipelines = nullptr);
+  Histogram(Histogram const&) = delete;
+  Histogram(Histogram &&) noexcept = delete;
+  Histogram& operator=(Histogram const&) = delete;
+  Histogram& operator=(Histogram &&) noexcept = delete;
+  ~Histogram() noexcept;
+
+  // false if the kernels are missing
+  explicit operator bool() const;
+  uint32_t maxSharedBins() const;
+
+  // dst: binCount counts of src[0, n)
+  void histogram(VkCommandBuffer commandBuffer, EHistogramInput input, HistogramBinning const& binning, uint32_t binCount, uint32_t n,
+    VkDeviceAddress src, VkDeviceAddress dst);
+  // dst: binCount counts per segment of src[segmentOffsets[s], segmentOffsets[s + 1]).
+  // segmentOffsets: segmentCount + 1 ascending 32-bit offsets, the last n
+  void histogramSegments(VkCommandBuffer commandBuffer, EHistogramInput input, HistogramBinning const& binning, uint32_t binCount,
+    uint32_t n, VkDeviceAddress src, VkDeviceAddress segmentOffsets, uint32_t segmentCount, VkDeviceAddress dst);
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<HistogramImpl> m_impl;
+};
+
+// ------------------------------------------------------------------------------
+// Spmv
+// ------------------------------------------------------------------------------
+// host side f32 sparse matrices, 32-bit indices
+struct CsrMatrix {
+  uint32_t rows = 0;
+  uint32_t columns = 0;
+  std::vector<uint32_t> rowOffsets; // rows + 1, the last the non zero count
+  std::vector<uint32_t> columnIndices;
+  std::vector<float> values;
+};
+
+// SELL-C-sigma: rows sorted by decreasing length within windows of sigma
+// rows, cut into slices of C rows padded to their longest row and stored
+// column major, entry k of lane r of slice s at sliceOffsets[s] + k * C + r.
+// Padding entries are column 0 with value 0
+inline uint32_t constexpr SELL_PADDING_ROW = UINT32_MAX;
+struct SellMatrix {
+  uint32_t rows = 0;
+  uint32_t columns = 0;
+  uint32_t sliceHeight = 0;          // C
+  std::vector<uint32_t> sliceOffsets; // slices + 1
+  std::vector<uint32_t> rowOrder;     // row of every lane, SELL_PADDING_ROW past the last row
+  std::vector<uint32_t> columnIndices;
+  std::vector<float> values;
+};
+// sortWindow: sigma, a multiple of sliceHeight, or 1 to keep the row order
+SellMatrix convertCsrToSell(CsrMatrix const& csr, uint32_t sliceHeight, uint32_t sortWindow);
+
+// - CsrSubgroup: a subgroup per row
+// - CsrWorkgroup: a workgroup per row, for long rows
+// - Sell: a lane per row of SELL-C-sigma, for short or irregular rows
+// Auto picks CsrWorkgroup when the average row fills a workgroup, else Sell
+// unless its padding exceeds half the non zeros, else CsrSubgroup
+enum class ESpmvFormat : uint8_t { Auto = 0, CsrSubgroup, CsrWorkgroup, Sell };
+
+// Device copy of a sparse matrix in the format its analysis picked (see
+// Spmv::analyze), reusable by any number of multiplications
+class SpmvMatrix {
+ public:
+  SpmvMatrix() = default;
+  SpmvMatrix(SpmvMatrix const&) = delete;
+  SpmvMatrix(SpmvMatrix&& that) noexcept;
+  SpmvMatrix& operator=(SpmvMatrix const&) = delete;
+  SpmvMatrix& operator=(SpmvMatrix&& that) noexcept;
+  // the caller ensures no multiplication still reads it
+  ~SpmvMatrix() noexcept;
+
+  // false when empty or if an allocation failed
+  explicit operator bool() const { return m_dev != nullptr; }
+  ESpmvFormat format() const { return m_format; }
+  uint32_t rows() const { return m_rows; }
+  uint32_t columns() const { return m_columns; }
+  uint32_t nonZeros() const { return m_nonZeros; }
+  // non zeros and padding
+  uint32_t storedEntries() const { return m_storedEntries; }
+
+ private:
+  friend class SpmvImpl;
+  void reset() noexcept;
+
+  VulkanDevice* m_dev = nullptr;
+  ESpmvFormat m_format = ESpmvFormat::Auto;
+  uint32_t m_rows = 0;
+  uint32_t m_columns = 0;
+  uint32_t m_nonZeros = 0;
+  uint32_t m_storedEntries = 0;
+  uint32_t m_sliceHeight = 0;
+  DeviceBuffer m_offsets; // CSR row offsets or SELL slice offsets
+  DeviceBuffer m_columnIndices;
+  DeviceBuffer m_values;
+  DeviceBuffer m_rowOrder; // SELL
+};
+
+// y = alpha * A x + beta * y in f32, beta 0 doesn't read y. x and y must not
+// overlap. analyze() makes the format decision and the device layout once
+class SpmvImpl;
+class Spmv {
+ public:
+  Spmv(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+    VulkanComputePipelines* pipelines = nullptr);
+  Spmv(Spmv const&) = delete;
+  Spmv(Spmv &&) noexcept = delete;
+  Spmv& operator=(Spmv const&) = delete;
+  Spmv& operator=(Spmv &&) noexcept = delete;
+  ~Spmv() noexcept;
+
+  // false if the kernels are missing or the device lacks subgroup arithmetic
+  explicit operator bool() const;
+  // C of the SELL layout, the subgroup size
+  uint32_t sliceHeight() const;
+
+  // uploads through stream: usable by commands recorded after it
+  SpmvMatrix analyze(ComputeStream& stream, CsrMatrix const& matrix, ESpmvFormat format = ESpmvFormat::Auto) const;
+  void multiply(VkCommandBuffer commandBuffer, SpmvMatrix const& matrix, float alpha, VkDeviceAddress x, float beta, VkDeviceAddress y);
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<SpmvImpl> m_impl;
+};
+
+// ------------------------------------------------------------------------------
+// Fft
+// ------------------------------------------------------------------------------
+// forward: exp(-2 pi i j k / n), inverse: exp(2 pi i j k / n), unscaled
+enum class EFftDirection : uint8_t { Forward = 0, Inverse };
+
+// Dispatches and twiddle factors of batched transforms of one shape (see
+// Fft::plan), reusable by any number of transforms
+struct FftStep;
+class FftPlan {
+ public:
+  FftPlan() noexcept;
+  FftPlan(FftPlan const&) = delete;
+  FftPlan(FftPlan&& that) noexcept;
+  FftPlan& operator=(FftPlan const&) = delete;
+  FftPlan& operator=(FftPlan&& that) noexcept;
+  // the caller ensures no transform still reads it
+  ~FftPlan() noexcept;
+
+  // false for unsupported shapes or if an allocation failed
+  explicit operator bool() const { return m_dev != nullptr; }
+  // 1 for 1D plans
+  uint32_t rows() const { return m_rows; }
+  uint32_t columns() const { return m_columns; }
+  uint32_t batch() const { return m_batch; }
+  // 1 when every transform fits shared memory
+  uint32_t dispatchCount() const;
+
+ private:
+  friend class FftImpl;
+  void reset() noexcept;
+
+  VulkanDevice* m_dev = nullptr;
+  uint32_t m_rows = 0;
+  uint32_t m_columns = 0;
+  uint32_t m_batch = 0;
+  std::vector<FftStep> m_steps;
+  DeviceBuffer m_rowTwiddles;    // exp(-2 pi i t / columns)
+  DeviceBuffer m_columnTwiddles; // exp(-2 pi i t / rows), 2D
+  DeviceBuffer m_scratch;        // four-step and global passes
+};
+
+// Batched complex f32 FFTs, interleaved (re, im), signal b at b * size, 2D
+// signals row major. Sizes are products of 2, 3, 5 and 7. Sizes up to
+// maxSharedSize() take one dispatch in shared memory; larger ones split in
+// two shared memory steps with a transpose (four-step), else run a global
+// Stockham pass per radix. 2D columns must fit shared memory.
+// src and dst may be the same buffer
+class FftImpl;
+class Fft {
+ public:
+  Fft(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+    VulkanComputePipelines* pipelines = nullptr);
+  Fft(Fft const&) = delete;
+  Fft(Fft &&) noexcept = delete;
+  Fft& operator=(Fft const&) = delete;
+  Fft& operator=(Fft &&) noexcept = delete;
+  ~Fft() noexcept;
+
+  explicit operator bool() const;
+  uint32_t maxSharedSize() const;
+  static bool supportedSize(uint32_t n);
+
+  // upload the twiddle factors through stream: usable by commands recorded
+  // after it
+  FftPlan plan(ComputeStream& stream, uint32_t n, uint32_t batch) const;
+  FftPlan plan2d(ComputeStream& stream, uint32_t rows, uint32_t columns, uint32_t batch) const;
+  void transform(VkCommandBuffer commandBuffer, FftPlan const& plan, EFftDirection direction, VkDeviceAddress src, VkDeviceAddress dst);
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<FftImpl> m_impl;
+};
+
+// ------------------------------------------------------------------------------
+// HashTable
+// ------------------------------------------------------------------------------
+// Uint64 needs VulkanDevice::hasInt64Atomics
+enum class EHashKey : uint8_t { Uint32 = 0, Uint64 };
+// Sum adds the values of a key, Count its occurrences
+enum class EHashAggregate : uint8_t { Sum = 0, Count };
+// lookup result of a missing key
+inline uint32_t constexpr HASH_NOT_FOUND = UINT32_MAX;
+
+// Device open addressing table of 32 or 64-bit keys to uint values, linear
+// probing, a power of 2 of slots. The all ones key is reserved for free
+// slots: inserting or aggregating it drops and counts it, looking it up
+// gives HASH_NOT_FOUND.
+// Every operation is one dispatch over n keys. Distinct keys past the
+// capacity are dropped and counted. clear() empties the table, before its
+// first use and between batches, without reallocating
+class HashTableImpl;
+class HashTable {
+ public:
+  // capacity: maxKeys at most loadFactor full
+  HashTable(VulkanDevice* dev, VulkanShaderRegistry const* shaders, EHashKey keyType, uint32_t maxKeys, float loadFactor = 0.5f,
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE, VulkanComputePipelines* pipelines = nullptr);
+  HashTable(HashTable const&) = delete;
+  HashTable(HashTable &&) noexcept = delete;
+  HashTable& operator=(HashTable const&) = delete;
+  HashTable& operator=(HashTable &&) noexcept = delete;
+  ~HashTable() noexcept;
+
+  // false if the kernels are missing, 64-bit keys lack device support or
+  // the allocation failed
+  explicit operator bool() const;
+  EHashKey keyType() const;
+  uint32_t capacity() const;
+  // 2 uint since the last clear(): distinct keys stored, keys dropped
+  // because the table was full or reserved. ComputeStream::download reads them
+  DeviceBuffer const& counters() const;
+
+  // fills the table and counters (transfer commands): the next operation
+  // must be recorded after a computeBarrier
+  void clear(VkCommandBuffer commandBuffer);
+  // values: uint per key, a key inserted twice keeps one of its values
+  void insert(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress keys, VkDeviceAddress values);
+  // results: uint per key, HASH_NOT_FOUND for missing ones
+  void lookup(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress keys, VkDeviceAddress results) const;
+  // adds to the values of the keys, inserted at 0; values unused by Count
+  void insertAggregate(VkCommandBuffer commandBuffer, EHashAggregate aggregate, uint32_t n, VkDeviceAddress keys, VkDeviceAddress values);
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<HashTableImpl> m_impl;
+};
+
+}
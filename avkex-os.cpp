@@ -1,5 +1,6 @@
 #include "avkex-os.h"
 
+#include <utility>
 #include <vector>
 
 #ifdef _WIN32
@@ -7,9 +8,19 @@
 #elif __APPLE__
 #  include <mach-o/dyld.h>
 #  include <sys/param.h> // MAXPATHLEN
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
 #elif __linux__
 #  include <unistd.h>
 #  include <limits.h>
+#  include <poll.h>
+#  include <sys/eventfd.h>
+#  include <sys/inotify.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
 #else
 #  error "Which OS are thou"
 #endif
@@ -41,6 +52,171 @@ std::optional<std::filesystem::path> getExecutableDirectory() {
 #endif
 }
 
+// ---- MappedFile ----
+
+std::optional<MappedFile> MappedFile::open(std::filesystem::path const& path) {
+#ifdef _WIN32
+  HANDLE const file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return std::nullopt;
+  }
+  LARGE_INTEGER fileSize{};
+  if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+    CloseHandle(file);
+    return std::nullopt;
+  }
+  HANDLE const mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  if (!mapping) {
+    return std::nullopt;
+  }
+  // the view keeps the mapping object alive
+  void const* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  CloseHandle(mapping);
+  if (!data) {
+    return std::nullopt;
+  }
+  return MappedFile(data, static_cast<size_t>(fileSize.QuadPart));
+#else
+  int const fd = ::open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return std::nullopt;
+  }
+  struct stat st{};
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    close(fd);
+    return std::nullopt;
+  }
+  size_t const size = static_cast<size_t>(st.st_size);
+  // the mapping stays valid once the descriptor is closed
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return std::nullopt;
+  }
+  return MappedFile(data, size);
+#endif
+}
+
+MappedFile::MappedFile(MappedFile&& that) noexcept
+ : m_data(std::exchange(that.m_data, nullptr)), m_size(std::exchange(that.m_size, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& that) noexcept {
+  if (this != &that) {
+    unmap();
+    m_data = std::exchange(that.m_data, nullptr);
+    m_size = std::exchange(that.m_size, 0);
+  }
+  return *this;
+}
+
+MappedFile::~MappedFile() noexcept {
+  unmap();
+}
+
+void MappedFile::unmap() noexcept {
+  if (!m_data) {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(m_data);
+#else
+  munmap(const_cast<void*>(m_data), m_size);
+#endif
+  m_data = nullptr;
+  m_size = 0;
+}
+
+// ---- DirectoryWatcher ----
+
+std::optional<DirectoryWatcher> DirectoryWatcher::open([[maybe_unused]] std::filesystem::path const& directory) {
+#ifdef __linux__
+  int const notifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (notifyFd < 0) {
+    return std::nullopt;
+  }
+  // close write: saved in place, moved to: written aside then renamed
+  if (inotify_add_watch(notifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    ::close(notifyFd);
+    return std::nullopt;
+  }
+  int const wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wakeFd < 0) {
+    ::close(notifyFd);
+    return std::nullopt;
+  }
+  return DirectoryWatcher(notifyFd, wakeFd);
+#else
+  return std::nullopt;
+#endif
+}
+
+DirectoryWatcher::DirectoryWatcher(DirectoryWatcher&& that) noexcept
+ : m_notifyFd(std::exchange(that.m_notifyFd, -1)), m_wakeFd(std::exchange(that.m_wakeFd, -1)) {}
+
+DirectoryWatcher& DirectoryWatcher::operator=(DirectoryWatcher&& that) noexcept {
+  if (this != &that) {
+    close();
+    m_notifyFd = std::exchange(that.m_notifyFd, -1);
+    m_wakeFd = std::exchange(that.m_wakeFd, -1);
+  }
+  return *this;
+}
+
+DirectoryWatcher::~DirectoryWatcher() noexcept {
+  close();
+}
+
+std::vector<std::string> DirectoryWatcher::wait([[maybe_unused]] std::chrono::milliseconds timeout) {
+  std::vector<std::string> names;
+#ifdef __linux__
+  pollfd fds[2] = {{m_notifyFd, POLLIN, 0}, {m_wakeFd, POLLIN, 0}};
+  if (poll(fds, 2, static_cast<int>(timeout.count())) <= 0) {
+    return names;
+  }
+  if (fds[1].revents & POLLIN) {
+    uint64_t count = 0;
+    [[maybe_unused]] ssize_t const n = read(m_wakeFd, &count, sizeof(count));
+    return names;
+  }
+  alignas(inotify_event) char buffer[4096];
+  while (true) {
+    ssize_t const length = read(m_notifyFd, buffer, sizeof(buffer));
+    if (length <= 0) {
+      break;
+    }
+    for (char const* ptr = buffer; ptr < buffer + length;) {
+      inotify_event const* event = reinterpret_cast<inotify_event const*>(ptr);
+      if (event->len > 0) {
+        names.emplace_back(event->name);
+      }
+      ptr += sizeof(inotify_event) + event->len;
+    }
+  }
+#endif
+  return names;
+}
+
+void DirectoryWatcher::interrupt() {
+#ifdef __linux__
+  uint64_t const one = 1;
+  [[maybe_unused]] ssize_t const n = write(m_wakeFd, &one, sizeof(one));
+#endif
+}
+
+void DirectoryWatcher::close() noexcept {
+#ifdef __linux__
+  if (m_notifyFd >= 0) {
+    ::close(m_notifyFd);
+  }
+  if (m_wakeFd >= 0) {
+    ::close(m_wakeFd);
+  }
+#endif
+  m_notifyFd = -1;
+  m_wakeFd = -1;
+}
+
 }
 
 namespace {
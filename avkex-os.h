@@ -2,12 +2,64 @@
 
 #include "avkex-macros.h"
 
+#include <chrono>
+#include <cstddef>
 #include <optional>
 #include <filesystem>
+#include <string>
+#include <vector>
 
 namespace avkex::os {
 
 std::optional<std::filesystem::path> getExecutableDirectory();
 
+// read-only mapping of a whole file, unmapped on destruction
+class MappedFile {
+ public:
+  static std::optional<MappedFile> open(std::filesystem::path const& path);
+
+  MappedFile(MappedFile const&) = delete;
+  MappedFile(MappedFile&& that) noexcept;
+  MappedFile& operator=(MappedFile const&) = delete;
+  MappedFile& operator=(MappedFile&& that) noexcept;
+  ~MappedFile() noexcept;
+
+  void const* data() const { return m_data; }
+  size_t size() const { return m_size; }
+
+ private:
+  MappedFile(void const* data, size_t size) : m_data(data), m_size(size) {}
+  void unmap() noexcept;
+
+  void const* m_data = nullptr;
+  size_t m_size = 0;
+};
+
+// files written or moved into a directory (inotify). Linux only, open fails
+// on other platforms
+class DirectoryWatcher {
+ public:
+  static std::optional<DirectoryWatcher> open(std::filesystem::path const& directory);
+
+  DirectoryWatcher(DirectoryWatcher const&) = delete;
+  DirectoryWatcher(DirectoryWatcher&& that) noexcept;
+  DirectoryWatcher& operator=(DirectoryWatcher const&) = delete;
+  DirectoryWatcher& operator=(DirectoryWatcher&& that) noexcept;
+  ~DirectoryWatcher() noexcept;
+
+  // blocks until changes, interrupt() or timeout. File names relative to the
+  // directory, empty on interrupt or timeout
+  std::vector<std::string> wait(std::chrono::milliseconds timeout);
+  // wakes up wait(), callable from any thread
+  void interrupt();
+
+ private:
+  DirectoryWatcher(int notifyFd, int wakeFd) : m_notifyFd(notifyFd), m_wakeFd(wakeFd) {}
+  void close() noexcept;
+
+  int m_notifyFd = -1;
+  int m_wakeFd = -1;
+};
+
 }
 
@@ -1,55 +1,44 @@
 #include "avkex.h"
 
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <thread>
+
 using namespace avkex;
 
 namespace {
 
-void fillShaderStage(VulkanDevice& dev, VkPipelineShaderStageCreateInfo& createInfo, SpvReflectShaderModule const& spvShaderModule, VkShaderModule shaderModule);
+void fillShaderStage(VkPipelineShaderStageCreateInfo& createInfo, VkShaderModuleCreateInfo& inlineCode, ShaderReflection const& reflection, ShaderStageSource const& source);
 
 }
 
 namespace avkex {
 
-std::vector<VulkanDescriptorSetLayoutData> reflectShaderDescriptors(SpvReflectShaderModule const& spvShaderModule) {
+std::vector<VulkanDescriptorSetLayoutData> reflectShaderDescriptors(ShaderReflection const& reflection) {
   std::vector<VulkanDescriptorSetLayoutData> data;
-  data.resize(spvShaderModule.descriptor_set_count);
-
-  std::vector<SpvReflectDescriptorSet*> sets;
-  sets.reserve(64);
-  uint32_t setCount = 0;
-  SpvReflectResult res = spvReflectEnumerateDescriptorSets(&spvShaderModule, &setCount, nullptr);
-  assert(res == SPV_REFLECT_RESULT_SUCCESS && "spvReflectEnumerateDescriptorSets(null)");
-  sets.clear();
-  if (setCount > 0) {
-    sets.resize(setCount);
-    data.resize(setCount);
-    res = spvReflectEnumerateDescriptorSets(&spvShaderModule, &setCount, sets.data());
-    assert(res == SPV_REFLECT_RESULT_SUCCESS && "spvReflectEnumerateDescriptorSets(sets)");
-  }
-
-  uint32_t i = 0;
-  for (SpvReflectDescriptorSet* pSpvSet : sets) {
-    uint32_t const index = i++;
-    data[index].setNumber = index;
-    data[index].createInfo = {};
-    data[index].createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    data[index].createInfo.bindingCount = pSpvSet->binding_count;
-    data[index].bindings.resize(pSpvSet->binding_count);
-    data[index].createInfo.pBindings = data[index].bindings.data();
-
-    uint32_t j = 0;
-    for (VkDescriptorSetLayoutBinding& binding : data[index].bindings) {
-      uint32_t const iBinding = j++;
-      SpvReflectDescriptorBinding const& spvBinding = *pSpvSet->bindings[iBinding];
-      binding.binding = spvBinding.binding;
-      binding.descriptorType = static_cast<VkDescriptorType>(spvBinding.descriptor_type);
-      // TODO: for now assume we refer to the first entry point
-      binding.stageFlags = static_cast<VkShaderStageFlagBits>(spvShaderModule.shader_stage);
-      binding.descriptorCount = 1;
-      for (uint32_t iDim = 0; iDim < spvBinding.array.dims_count; ++iDim) {
-        binding.descriptorCount *= spvBinding.array.dims[iDim];
-      }
-    }
+  data.resize(reflection.setCount());
+
+  for (uint32_t set = 0; set < data.size(); ++set) {
+    data[set].setNumber = set;
+    data[set].createInfo = {};
+    data[set].createInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  }
+  // bindings are sorted by set
+  for (ShaderReflection::Binding const& reflBinding : reflection.bindings) {
+    VkDescriptorSetLayoutBinding& binding = data[reflBinding.set].bindings.emplace_back();
+    binding.binding = reflBinding.binding;
+    binding.descriptorType = reflBinding.descriptorType;
+    binding.descriptorCount = reflBinding.descriptorCount;
+    binding.stageFlags = reflection.stage;
+    binding.pImmutableSamplers = nullptr;
+  }
+  for (VulkanDescriptorSetLayoutData& setData : data) {
+    setData.createInfo.bindingCount = static_cast<uint32_t>(setData.bindings.size());
+    setData.createInfo.pBindings = setData.bindings.data();
   }
 
   return data;
@@ -82,37 +71,337 @@ VkPipelineLayout createPipelineLayout(VulkanDevice& dev, uint32_t setLayoutCount
   return pipelineLayout;
 }
 
-VkPipeline createComputePipeline(VulkanDevice& dev, VkPipelineLayout pipelineLayout, SpvReflectShaderModule const& spvShaderModule, VkShaderModule shaderModule) {
+VkPipeline createComputePipeline(VulkanDevice& dev, VkPipelineLayout pipelineLayout, ShaderReflection const& reflection, ShaderStageSource const& source,
+  VkSpecializationInfo const* specialization, VkPipelineCache pipelineCache) {
   VkPipeline pipeline = VK_NULL_HANDLE;
 
   VkComputePipelineCreateInfo createInfo{};
   createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
   createInfo.layout = pipelineLayout;
-  fillShaderStage(dev, createInfo.stage, spvShaderModule, shaderModule);
+  VkShaderModuleCreateInfo inlineCode{};
+  fillShaderStage(createInfo.stage, inlineCode, reflection, source);
+  createInfo.stage.pSpecializationInfo = specialization;
 
-  // TODO pipeline caching (meaning you need to retain created VkShaderModule too)
   // TODO pipeline binary
   AVK_VK_RST(dev.api()->vkCreateComputePipelines(
-    dev.device(), VK_NULL_HANDLE, 1, &createInfo, nullptr, &pipeline));
+    dev.device(), pipelineCache, 1, &createInfo, nullptr, &pipeline));
+  return pipeline;
+}
+
+VkPipelineCache createPipelineCache(VulkanDevice& dev, std::filesystem::path const& path) {
+  std::vector<char> initialData;
+  if (std::ifstream file{path, std::ios::binary}; file) {
+    initialData.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+  VkPipelineCacheCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  createInfo.initialDataSize = initialData.size();
+  createInfo.pInitialData = initialData.empty() ? nullptr : initialData.data();
+
+  VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+  AVK_VK_RST(dev.api()->vkCreatePipelineCache(dev.device(), &createInfo, nullptr, &pipelineCache));
+  return pipelineCache;
+}
+
+bool savePipelineCache(VulkanDevice& dev, VkPipelineCache pipelineCache, std::filesystem::path const& path) {
+  size_t size = 0;
+  AVK_VK_RST(dev.api()->vkGetPipelineCacheData(dev.device(), pipelineCache, &size, nullptr));
+  std::vector<char> data(size);
+  VkResult const res = dev.api()->vkGetPipelineCacheData(dev.device(), pipelineCache, &size, data.data());
+  if (res != VK_SUCCESS) {
+    return false;
+  }
+  // written aside then renamed, a concurrent reader never sees half a cache
+  std::filesystem::path temp = path;
+  temp += ".tmp";
+  {
+    std::ofstream file{temp, std::ios::binary | std::ios::trunc};
+    file.write(data.data(), static_cast<std::streamsize>(size));
+    if (!file) {
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temp, path, ec);
+  return !ec;
+}
+
+std::vector<ComputePipelineResult> createComputePipelines(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache,
+  std::vector<ComputePipelineRequest> const& requests, uint32_t threadCount) {
+  using Clock = std::chrono::steady_clock;
+  std::vector<ComputePipelineResult> results(requests.size());
+  // one pipeline per claim: driver compile times vary a lot, small claims
+  // balance better than fixed chunks
+  std::atomic<size_t> next = 0;
+  auto const work = [&]() {
+    for (size_t i = next.fetch_add(1, std::memory_order_relaxed); i < requests.size(); i = next.fetch_add(1, std::memory_order_relaxed)) {
+      ComputePipelineRequest const& request = requests[i];
+      ComputePipelineResult& result = results[i];
+      VkSpecializationInfo specialization{};
+      specialization.mapEntryCount = static_cast<uint32_t>(request.specializationEntries.size());
+      specialization.pMapEntries = request.specializationEntries.data();
+      specialization.dataSize = request.specializationData.size();
+      specialization.pData = request.specializationData.data();
+
+      result.result = VK_ERROR_UNKNOWN;
+      shaders.withShader(request.shader, request.entryPoint, [&](ShaderStageSource const& source, ShaderReflection const& reflection) {
+        VkComputePipelineCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        createInfo.layout = request.layout;
+        VkShaderModuleCreateInfo inlineCode{};
+        fillShaderStage(createInfo.stage, inlineCode, reflection, source);
+        createInfo.stage.pSpecializationInfo = specialization.mapEntryCount > 0 ? &specialization : nullptr;
+
+        Clock::time_point const start = Clock::now();
+        result.result = dev.api()->vkCreateComputePipelines(dev.device(), pipelineCache, 1, &createInfo, nullptr, &result.pipeline);
+        result.duration = Clock::now() - start;
+      });
+      if (result.result != VK_SUCCESS) {
+        result.pipeline = VK_NULL_HANDLE;
+      }
+    }
+  };
+
+  if (threadCount == 0) {
+    threadCount = std::max(1U, std::thread::hardware_concurrency());
+  }
+  threadCount = static_cast<uint32_t>(std::min<size_t>(threadCount, requests.size()));
+  std::vector<std::thread> workers;
+  workers.reserve(threadCount > 0 ? threadCount - 1 : 0);
+  for (uint32_t t = 1; t < threadCount; ++t) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+  return results;
+}
+
+// ------------------------------------------------------------------------------
+// VulkanComputePipelinesImpl
+// ------------------------------------------------------------------------------
+class VulkanComputePipelinesImpl {
+ public:
+  VulkanComputePipelinesImpl(VulkanShaderRegistry* shaders, VulkanDiscardPool* discardPool, VkSemaphore timeline, size_t maxCount)
+   : m_shaders(shaders), m_discardPool(discardPool), m_timeline(timeline), m_capacity(maxCount), m_entries(std::make_unique<Entry[]>(maxCount)) {}
+
+  uint32_t add(VulkanDevice& dev, ComputePipelineRequest request, VkPipeline pipeline);
+  void remove(uint32_t id);
+  void use(uint64_t timelineValue) const;
+  VkPipeline get(uint32_t id, uint64_t timelineValue) const;
+  uint32_t rebuild(VulkanDevice& dev, ShaderHandle shader);
+  void cleanup() noexcept;
+
+  VkPipeline createPipeline(VulkanDevice& dev, ComputePipelineRequest const& request) const;
+
+ private:
+  // fixed array so that get() can index while add() appends. Removed entries
+  // have an invalid shader and no pipeline, add() reuses them
+  struct Entry {
+    ComputePipelineRequest request;
+    std::atomic<uint64_t> pipeline = 0; // handle bits
+  };
+
+  VulkanShaderRegistry* m_shaders;
+  VulkanDiscardPool* m_discardPool;
+  VkSemaphore m_timeline;
+  size_t m_capacity;
+  std::unique_ptr<Entry[]> m_entries;
+  std::atomic<uint32_t> m_count = 0;
+  std::mutex m_writeMtx;
+  std::vector<uint32_t> m_freeIds;
+  // highest timeline value handed to get() or use(). Readers raise it before loading a
+  // pipeline, writers read it after the swap: a reader which got the old
+  // pipeline is covered by the retire value (seq_cst on both sides)
+  mutable std::atomic<uint64_t> m_highestUse = 0;
+};
+
+uint32_t VulkanComputePipelinesImpl::add(VulkanDevice& dev, ComputePipelineRequest request, VkPipeline pipeline) {
+  if (pipeline == VK_NULL_HANDLE) {
+    return VulkanComputePipelines::INVALID_ID;
+  }
+  std::lock_guard wLock{m_writeMtx};
+  uint32_t id = m_count.load(std::memory_order_relaxed);
+  if (!m_freeIds.empty()) {
+    id = m_freeIds.back();
+    m_freeIds.pop_back();
+  } else if (id >= m_capacity) {
+    dev.api()->vkDestroyPipeline(dev.device(), pipeline, nullptr);
+    return VulkanComputePipelines::INVALID_ID;
+  }
+  Entry& entry = m_entries[id];
+  entry.request = std::move(request);
+  entry.pipeline.store(vkHandleBits(pipeline), std::memory_order_release);
+  if (id == m_count.load(std::memory_order_relaxed)) {
+    m_count.store(id + 1, std::memory_order_release);
+  }
+  return id;
+}
+
+void VulkanComputePipelinesImpl::remove(uint32_t id) {
+  std::lock_guard wLock{m_writeMtx};
+  if (id >= m_count.load(std::memory_order_relaxed)) {
+    return;
+  }
+  Entry& entry = m_entries[id];
+  uint64_t const previous = entry.pipeline.exchange(0, std::memory_order_seq_cst);
+  if (previous == 0) {
+    return;
+  }
+  uint64_t const retireValue = m_highestUse.load(std::memory_order_seq_cst);
+  m_discardPool->discardPipeline(m_timeline, retireValue, vkHandleFromBits<VkPipeline>(previous));
+  entry.request = {};
+  m_freeIds.push_back(id);
+}
+
+void VulkanComputePipelinesImpl::use(uint64_t timelineValue) const {
+  // usually already high enough, only the first use of a value writes
+  uint64_t highest = m_highestUse.load(std::memory_order_seq_cst);
+  while (highest < timelineValue && !m_highestUse.compare_exchange_weak(highest, timelineValue, std::memory_order_seq_cst)) {
+  }
+}
+
+VkPipeline VulkanComputePipelinesImpl::get(uint32_t id, uint64_t timelineValue) const {
+  if (id >= m_count.load(std::memory_order_acquire)) {
+    return VK_NULL_HANDLE;
+  }
+  use(timelineValue);
+  return vkHandleFromBits<VkPipeline>(m_entries[id].pipeline.load(std::memory_order_seq_cst));
+}
+
+uint32_t VulkanComputePipelinesImpl::rebuild(VulkanDevice& dev, ShaderHandle shader) {
+  std::lock_guard wLock{m_writeMtx};
+  uint32_t rebuilt = 0;
+  uint32_t const count = m_count.load(std::memory_order_relaxed);
+  for (uint32_t id = 0; id < count; ++id) {
+    Entry& entry = m_entries[id];
+    if (entry.request.shader != shader) {
+      continue;
+    }
+    VkPipeline const pipeline = createPipeline(dev, entry.request);
+    if (pipeline == VK_NULL_HANDLE) {
+      LOG_ERR << "Couldn't rebuild pipeline " << id << ", keeping the previous one" LOG_RST << std::endl;
+      continue;
+    }
+    uint64_t const previous = entry.pipeline.exchange(vkHandleBits(pipeline), std::memory_order_seq_cst);
+    uint64_t const retireValue = m_highestUse.load(std::memory_order_seq_cst);
+    m_discardPool->discardPipeline(m_timeline, retireValue, vkHandleFromBits<VkPipeline>(previous));
+    ++rebuilt;
+  }
+  return rebuilt;
+}
+
+void VulkanComputePipelinesImpl::cleanup() noexcept {
+  std::lock_guard wLock{m_writeMtx};
+  uint64_t const retireValue = m_highestUse.load(std::memory_order_seq_cst);
+  uint32_t const count = m_count.exchange(0, std::memory_order_acq_rel);
+  for (uint32_t id = 0; id < count; ++id) {
+    uint64_t const pipeline = m_entries[id].pipeline.exchange(0, std::memory_order_relaxed);
+    if (pipeline != 0) {
+      m_discardPool->discardPipeline(m_timeline, retireValue, vkHandleFromBits<VkPipeline>(pipeline));
+    }
+  }
+}
+
+VkPipeline VulkanComputePipelinesImpl::createPipeline(VulkanDevice& dev, ComputePipelineRequest const& request) const {
+  VkSpecializationInfo specialization{};
+  specialization.mapEntryCount = static_cast<uint32_t>(request.specializationEntries.size());
+  specialization.pMapEntries = request.specializationEntries.data();
+  specialization.dataSize = request.specializationData.size();
+  specialization.pData = request.specializationData.data();
+
+  // not createComputePipeline, which exits on failure: a shader edit the
+  // driver rejects keeps the previous pipeline
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  m_shaders->withShader(request.shader, request.entryPoint, [&](ShaderStageSource const& source, ShaderReflection const& reflection) {
+    VkComputePipelineCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    createInfo.layout = request.layout;
+    VkShaderModuleCreateInfo inlineCode{};
+    fillShaderStage(createInfo.stage, inlineCode, reflection, source);
+    createInfo.stage.pSpecializationInfo = specialization.mapEntryCount > 0 ? &specialization : nullptr;
+    if (dev.api()->vkCreateComputePipelines(dev.device(), VK_NULL_HANDLE, 1, &createInfo, nullptr, &pipeline) != VK_SUCCESS) {
+      pipeline = VK_NULL_HANDLE;
+    }
+  });
   return pipeline;
 }
 
+// ------------------------------------------------------------------------------
+// VulkanComputePipelines
+// ------------------------------------------------------------------------------
+
+VulkanComputePipelines::VulkanComputePipelines(VulkanDevice* dev, VulkanShaderRegistry* shaders, VulkanDiscardPool* discardPool, VkSemaphore timeline, size_t maxCount)
+ : m_impl(std::make_unique<VulkanComputePipelinesImpl>(shaders, discardPool, timeline, maxCount)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+VulkanComputePipelines::~VulkanComputePipelines() noexcept {
+  m_impl->cleanup();
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+uint32_t VulkanComputePipelines::add(ShaderHandle shader, std::string_view entryPoint, VkPipelineLayout layout) {
+  ComputePipelineRequest request;
+  request.shader = shader;
+  request.entryPoint = entryPoint;
+  request.layout = layout;
+  return add(std::move(request));
+}
+
+uint32_t VulkanComputePipelines::add(ComputePipelineRequest request) {
+  VkPipeline const pipeline = m_impl->createPipeline(*m_dev, request);
+  return m_impl->add(*m_dev, std::move(request), pipeline);
+}
+
+uint32_t VulkanComputePipelines::add(ComputePipelineRequest request, VkPipeline pipeline) {
+  return m_impl->add(*m_dev, std::move(request), pipeline);
+}
+
+void VulkanComputePipelines::remove(uint32_t id) {
+  m_impl->remove(id);
+}
+
+void VulkanComputePipelines::use(uint64_t timelineValue) const {
+  m_impl->use(timelineValue);
+}
+
+VkPipeline VulkanComputePipelines::get(uint32_t id, uint64_t timelineValue) const {
+  return m_impl->get(id, timelineValue);
+}
+
+uint32_t VulkanComputePipelines::rebuild(ShaderHandle shader) {
+  return m_impl->rebuild(*m_dev, shader);
+}
+
 }
 
 namespace {
 
-void fillShaderStage(VulkanDevice& dev, VkPipelineShaderStageCreateInfo& createInfo, SpvReflectShaderModule const& spvShaderModule, VkShaderModule shaderModule) {
+void fillShaderStage(VkPipelineShaderStageCreateInfo& createInfo, VkShaderModuleCreateInfo& inlineCode, ShaderReflection const& reflection, ShaderStageSource const& source) {
   createInfo = {};
   createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  createInfo.stage = static_cast<VkShaderStageFlagBits>(spvShaderModule.shader_stage);
+  createInfo.stage = reflection.stage;
 
-  // TODO: don't assume we want to take the main entrypoint
-  createInfo.pName = spvShaderModule.entry_point_name;
+  // entry point chosen through VulkanShaderRegistry::withShader
+  createInfo.pName = reflection.entryPoint.c_str();
 
-  // TODO: specialization info handling
-  assert(spvShaderModule.spec_constant_count == 0);
 
-  createInfo.module = shaderModule;
+  if (source.shaderModule != VK_NULL_HANDLE) {
+    createInfo.module = source.shaderModule;
+  } else {
+    // VK_KHR_maintenance5: a chained VkShaderModuleCreateInfo replaces the module
+    assert(source.pCode && source.codeSize > 0);
+    inlineCode = {};
+    inlineCode.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    inlineCode.codeSize = source.codeSize;
+    inlineCode.pCode = source.pCode;
+    createInfo.pNext = &inlineCode;
+  }
 }
 
 }
@@ -0,0 +1,187 @@
+#include "avkex.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+using namespace avkex;
+
+namespace {
+
+// the 32-bit BAR window most drivers expose without resizable BAR
+inline constexpr VkDeviceSize LEGACY_BAR_SIZE = 256ULL << 20;
+
+void writeJsonString(std::ostringstream& out, char const* str) {
+  out << '"';
+  for (char const* c = str; *c; ++c) {
+    switch (*c) {
+      case '"': out << "\\\""; break;
+      case '\\': out << "\\\\"; break;
+      default:
+        if (static_cast<unsigned char>(*c) < 0x20) {
+          char escaped[8];
+          std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(*c));
+          out << escaped;
+        } else {
+          out << *c;
+        }
+    }
+  }
+  out << '"';
+}
+
+void writeJsonUuid(std::ostringstream& out, uint8_t const (&uuid)[VK_UUID_SIZE]) {
+  char hex[2 * VK_UUID_SIZE + 1];
+  for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+    std::snprintf(hex + 2 * i, 3, "%02x", uuid[i]);
+  }
+  out << '"' << hex << '"';
+}
+
+template <typename T>
+void writeJsonArray3(std::ostringstream& out, T const (&values)[3]) {
+  out << '[' << values[0] << ", " << values[1] << ", " << values[2] << ']';
+}
+
+}
+
+namespace avkex {
+
+VulkanDeviceProfile captureDeviceProfile(VkPhysicalDevice physicalDevice, uint32_t computeQueueFamilyIndex) {
+  VulkanDeviceProfile profile{};
+
+  // properties, Vulkan 1.1 core chain
+  VkPhysicalDeviceSubgroupProperties subgroupProps{};
+  subgroupProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+  VkPhysicalDeviceIDProperties idProps{};
+  idProps.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+  idProps.pNext = &subgroupProps;
+  VkPhysicalDeviceProperties2 props{};
+  props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  props.pNext = &idProps;
+  vkGetPhysicalDeviceProperties2(physicalDevice, &props);
+  VkPhysicalDeviceProperties const& properties = props.properties;
+  VkPhysicalDeviceLimits const& limits = properties.limits;
+
+  std::memcpy(profile.deviceName, properties.deviceName, sizeof(profile.deviceName));
+  profile.deviceName[sizeof(profile.deviceName) - 1] = '\0';
+  profile.vendorID = properties.vendorID;
+  profile.deviceID = properties.deviceID;
+  profile.deviceType = properties.deviceType;
+  profile.apiVersion = properties.apiVersion;
+  profile.driverVersion = properties.driverVersion;
+  std::memcpy(profile.deviceUUID, idProps.deviceUUID, VK_UUID_SIZE);
+  std::memcpy(profile.driverUUID, idProps.driverUUID, VK_UUID_SIZE);
+
+  profile.subgroupSize = subgroupProps.subgroupSize;
+  profile.subgroupSupportedStages = subgroupProps.supportedStages;
+  profile.subgroupSupportedOperations = subgroupProps.supportedOperations;
+
+  for (uint32_t i = 0; i < 3; ++i) {
+    profile.maxComputeWorkGroupCount[i] = limits.maxComputeWorkGroupCount[i];
+    profile.maxComputeWorkGroupSize[i] = limits.maxComputeWorkGroupSize[i];
+  }
+  profile.maxComputeWorkGroupInvocations = limits.maxComputeWorkGroupInvocations;
+  profile.maxComputeSharedMemorySize = limits.maxComputeSharedMemorySize;
+  profile.maxPushConstantsSize = limits.maxPushConstantsSize;
+  profile.maxStorageBufferRange = limits.maxStorageBufferRange;
+  profile.maxUniformBufferRange = limits.maxUniformBufferRange;
+  profile.maxBoundDescriptorSets = limits.maxBoundDescriptorSets;
+
+  profile.minStorageBufferOffsetAlignment = limits.minStorageBufferOffsetAlignment;
+  profile.minUniformBufferOffsetAlignment = limits.minUniformBufferOffsetAlignment;
+  profile.nonCoherentAtomSize = limits.nonCoherentAtomSize;
+  profile.optimalBufferCopyOffsetAlignment = limits.optimalBufferCopyOffsetAlignment;
+  profile.minMemoryMapAlignment = limits.minMemoryMapAlignment;
+  profile.timestampPeriod = limits.timestampPeriod;
+
+  // timestamp support is per queue family
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilyProps(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilyProps.data());
+  if (computeQueueFamilyIndex < queueFamilyCount) {
+    profile.computeTimestampValidBits = queueFamilyProps[computeQueueFamilyIndex].timestampValidBits;
+  }
+
+  // memory
+  VkPhysicalDeviceMemoryProperties memProps{};
+  vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProps);
+  profile.memoryHeapCount = memProps.memoryHeapCount;
+  for (uint32_t i = 0; i < memProps.memoryHeapCount; ++i) {
+    profile.memoryHeaps[i].size = memProps.memoryHeaps[i].size;
+    profile.memoryHeaps[i].deviceLocal = memProps.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+  }
+  profile.memoryTypeCount = memProps.memoryTypeCount;
+  bool anyDeviceLocal = false;
+  bool allDeviceLocalHostVisible = true;
+  for (uint32_t i = 0; i < memProps.memoryTypeCount; ++i) {
+    VkMemoryType const& type = memProps.memoryTypes[i];
+    profile.memoryTypes[i].heapIndex = type.heapIndex;
+    profile.memoryTypes[i].propertyFlags = type.propertyFlags;
+    if (!(type.propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT))
+      continue;
+    anyDeviceLocal = true;
+    bool const hostVisible = type.propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    allDeviceLocalHostVisible &= hostVisible;
+    if (hostVisible && memProps.memoryHeaps[type.heapIndex].size > LEGACY_BAR_SIZE) {
+      profile.hasResizableBar = true;
+    }
+  }
+  profile.isUnifiedMemory = properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU ||
+    (anyDeviceLocal && allDeviceLocalHostVisible);
+  // unified memory is not a BAR
+  profile.hasResizableBar &= !profile.isUnifiedMemory;
+
+  return profile;
+}
+
+std::string VulkanDeviceProfile::toJson() const {
+  std::ostringstream out;
+  out << "{\n  \"deviceName\": ";
+  writeJsonString(out, deviceName);
+  out << ",\n  \"vendorID\": " << vendorID
+      << ",\n  \"deviceID\": " << deviceID
+      << ",\n  \"deviceType\": " << static_cast<uint32_t>(deviceType)
+      << ",\n  \"apiVersion\": \"" << VK_API_VERSION_MAJOR(apiVersion) << '.' << VK_API_VERSION_MINOR(apiVersion) << '.' << VK_API_VERSION_PATCH(apiVersion) << '"'
+      << ",\n  \"driverVersion\": " << driverVersion
+      << ",\n  \"deviceUUID\": ";
+  writeJsonUuid(out, deviceUUID);
+  out << ",\n  \"driverUUID\": ";
+  writeJsonUuid(out, driverUUID);
+  out << ",\n  \"subgroupSize\": " << subgroupSize
+      << ",\n  \"subgroupSupportedStages\": " << subgroupSupportedStages
+      << ",\n  \"subgroupSupportedOperations\": " << subgroupSupportedOperations
+      << ",\n  \"maxComputeWorkGroupCount\": ";
+  writeJsonArray3(out, maxComputeWorkGroupCount);
+  out << ",\n  \"maxComputeWorkGroupSize\": ";
+  writeJsonArray3(out, maxComputeWorkGroupSize);
+  out << ",\n  \"maxComputeWorkGroupInvocations\": " << maxComputeWorkGroupInvocations
+      << ",\n  \"maxComputeSharedMemorySize\": " << maxComputeSharedMemorySize
+      << ",\n  \"maxPushConstantsSize\": " << maxPushConstantsSize
+      << ",\n  \"maxStorageBufferRange\": " << maxStorageBufferRange
+      << ",\n  \"maxUniformBufferRange\": " << maxUniformBufferRange
+      << ",\n  \"maxBoundDescriptorSets\": " << maxBoundDescriptorSets
+      << ",\n  \"minStorageBufferOffsetAlignment\": " << minStorageBufferOffsetAlignment
+      << ",\n  \"minUniformBufferOffsetAlignment\": " << minUniformBufferOffsetAlignment
+      << ",\n  \"nonCoherentAtomSize\": " << nonCoherentAtomSize
+      << ",\n  \"optimalBufferCopyOffsetAlignment\": " << optimalBufferCopyOffsetAlignment
+      << ",\n  \"minMemoryMapAlignment\": " << minMemoryMapAlignment
+      << ",\n  \"timestampPeriod\": " << timestampPeriod
+      << ",\n  \"computeTimestampValidBits\": " << computeTimestampValidBits
+      << ",\n  \"memoryHeaps\": [";
+  for (uint32_t i = 0; i < memoryHeapCount; ++i) {
+    out << (i ? ", " : "") << "{\"size\": " << memoryHeaps[i].size << ", \"deviceLocal\": " << (memoryHeaps[i].deviceLocal ? "true" : "false") << '}';
+  }
+  out << "],\n  \"memoryTypes\": [";
+  for (uint32_t i = 0; i < memoryTypeCount; ++i) {
+    out << (i ? ", " : "") << "{\"heapIndex\": " << memoryTypes[i].heapIndex << ", \"propertyFlags\": " << memoryTypes[i].propertyFlags << '}';
+  }
+  out << "],\n  \"hasResizableBar\": " << (hasResizableBar ? "true" : "false")
+      << ",\n  \"isUnifiedMemory\": " << (isUnifiedMemory ? "true" : "false")
+      << "\n}\n";
+  return out.str();
+}
+
+}
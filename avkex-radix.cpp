@@ -0,0 +1,256 @@
+#include "avkex-kernels.h"
+
+#include <array>
+
+using namespace avkex;
+
+namespace {
+
+// mirrors Params of shaders/radix.comp
+struct RadixParams {
+  VkDeviceAddress srcKeys;
+  VkDeviceAddress dstKeys;
+  VkDeviceAddress srcValues;
+  VkDeviceAddress dstValues;
+  VkDeviceAddress srcSegments;
+  VkDeviceAddress dstSegments;
+  VkDeviceAddress histogram;
+  VkDeviceAddress segmentOffsets;
+  uint32_t n;
+  uint32_t shift;
+  uint32_t keyType;
+  uint32_t digitFromSegments;
+  uint32_t segmentCount;
+  uint32_t pad0;
+};
+static_assert(sizeof(RadixParams) == 88);
+
+uint32_t constexpr ITEMS_PER_INVOCATION = 8;
+uint32_t constexpr PREFERRED_RADIX_BITS = 8;
+// smallest subgroup assumed for the shared subgroup counts: drivers may run
+// compute below the reported subgroup size, not below this
+uint32_t constexpr MIN_SUBGROUP_SIZE = 8;
+// of the scratch regions
+VkDeviceSize constexpr SCRATCH_ALIGNMENT = 256;
+
+VkDeviceSize alignScratch(VkDeviceSize size) {
+  return (size + SCRATCH_ALIGNMENT - 1) / SCRATCH_ALIGNMENT * SCRATCH_ALIGNMENT;
+}
+
+uint32_t keyWords(ESortKey keyType) {
+  return keyType >= ESortKey::Uint64 ? 2 : 1;
+}
+
+uint32_t bitWidth(uint32_t x) {
+  uint32_t bits = 0;
+  for (; x != 0; x >>= 1) {
+    ++bits;
+  }
+  return bits;
+}
+
+}
+
+namespace avkex {
+
+// ------------------------------------------------------------------------------
+// RadixSortImpl
+// ------------------------------------------------------------------------------
+class RadixSortImpl {
+ public:
+  RadixSortImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines);
+
+  bool valid() const { return m_valid; }
+  uint32_t radixBits() const { return m_radixBits; }
+  uint32_t tileSize() const { return m_workgroupSize * ITEMS_PER_INVOCATION; }
+  VkDeviceSize scratchSize(uint32_t n, ESortKey keyType, bool withValues, uint32_t segmentCount) const;
+
+  void sort(VulkanDevice const& dev, VkCommandBuffer commandBuffer, ESortKey keyType, uint32_t n, VkDeviceAddress keys,
+    VkDeviceAddress values, VkDeviceAddress segmentOffsets, uint32_t segmentCount, DeviceBuffer const& scratch);
+
+ private:
+  // scratch regions: the scan state first, PrefixScan zeroes from offset 0
+  struct ScratchLayout {
+    VkDeviceSize histogram = 0;
+    VkDeviceSize keys = 0;
+    VkDeviceSize values = 0;
+    VkDeviceSize segments = 0; // two ping pong arrays
+    VkDeviceSize size = 0;
+  };
+  uint32_t tileCount(uint32_t n) const { return (n + tileSize() - 1) / tileSize(); }
+  uint32_t histogramSize(uint32_t n) const { return (1U << m_radixBits) * tileCount(n); }
+  ScratchLayout scratchLayout(uint32_t n, ESortKey keyType, bool withValues, uint32_t segmentCount) const;
+
+  bool m_valid = false;
+  uint32_t m_workgroupSize = 0;
+  uint32_t m_radixBits = PREFERRED_RADIX_BITS;
+  PrefixScan m_scan;
+  // [64-bit keys]
+  std::array<ComputeKernel, 2> m_histograms;
+  // [64-bit keys][values][segments]
+  std::array<std::array<std::array<ComputeKernel, 2>, 2>, 2> m_scatters;
+  ComputeKernel m_segmentIds;
+};
+
+RadixSortImpl::RadixSortImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines)
+ : m_scan(&dev, &shaders, pipelineCache, pipelines) {
+  VulkanDeviceProfile const& profile = dev.profile();
+  VkSubgroupFeatureFlags const required = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+  if (!(profile.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) || (profile.subgroupSupportedOperations & required) != required) {
+    LOG_ERR << "RadixSort needs subgroup ballot in compute shaders" LOG_RST << std::endl;
+    return;
+  }
+  if (!m_scan) {
+    return;
+  }
+  // the scatter keeps a count per digit and subgroup: smaller workgroups, then
+  // 4-bit digits until it fits
+  uint32_t const minSubgroupSize = std::max(1U, std::min(profile.subgroupSize, MIN_SUBGROUP_SIZE));
+  auto const sharedSize = [&](uint32_t workgroupSize, uint32_t radixBits) {
+    return (1U << radixBits) * (workgroupSize / minSubgroupSize + 1) * sizeof(uint32_t);
+  };
+  m_workgroupSize = chooseWorkgroupSize(profile);
+  while (sharedSize(m_workgroupSize, m_radixBits) > profile.maxComputeSharedMemorySize && m_workgroupSize / 2 >= profile.subgroupSize) {
+    m_workgroupSize /= 2;
+  }
+  if (sharedSize(m_workgroupSize, m_radixBits) > profile.maxComputeSharedMemorySize) {
+    m_radixBits = 4;
+  }
+  uint32_t const maxSubgroups = m_workgroupSize / minSubgroupSize;
+
+  std::vector<ComputeKernelDesc> descs;
+  descs.reserve(2 + 2 * 2 * 2 + 1);
+  for (uint32_t wide = 0; wide < 2; ++wide) {
+    descs.push_back({&m_histograms[wide], "radix_histogram", sizeof(RadixParams),
+      {m_workgroupSize, ITEMS_PER_INVOCATION, m_radixBits, 1 + wide, 0, 0, maxSubgroups}});
+    for (uint32_t hasValues = 0; hasValues < 2; ++hasValues) {
+      for (uint32_t hasSegments = 0; hasSegments < 2; ++hasSegments) {
+        descs.push_back({&m_scatters[wide][hasValues][hasSegments], "radix_scatter", sizeof(RadixParams),
+          {m_workgroupSize, ITEMS_PER_INVOCATION, m_radixBits, 1 + wide, hasValues, hasSegments, maxSubgroups}});
+      }
+    }
+  }
+  descs.push_back({&m_segmentIds, "radix_segment_ids", sizeof(RadixParams), {m_workgroupSize}});
+  m_valid = createComputeKernels(dev, shaders, pipelineCache, descs, pipelines);
+}
+
+RadixSortImpl::ScratchLayout RadixSortImpl::scratchLayout(uint32_t n, ESortKey keyType, bool withValues, uint32_t segmentCount) const {
+  ScratchLayout layout;
+  layout.histogram = alignScratch(m_scan.scratchSize(histogramSize(n)));
+  layout.keys = layout.histogram + alignScratch(VkDeviceSize{histogramSize(n)} * sizeof(uint32_t));
+  layout.values = layout.keys + alignScratch(VkDeviceSize{n} * keyWords(keyType) * sizeof(uint32_t));
+  layout.segments = layout.values + (withValues ? alignScratch(VkDeviceSize{n} * sizeof(uint32_t)) : 0);
+  layout.size = layout.segments + (segmentCount > 1 ? 2 * alignScratch(VkDeviceSize{n} * sizeof(uint32_t)) : 0);
+  return layout;
+}
+
+VkDeviceSize RadixSortImpl::scratchSize(uint32_t n, ESortKey keyType, bool withValues, uint32_t segmentCount) const {
+  return scratchLayout(n, keyType, withValues, segmentCount).size;
+}
+
+void RadixSortImpl::sort(VulkanDevice const& dev, VkCommandBuffer commandBuffer, ESortKey keyType, uint32_t n, VkDeviceAddress keys,
+  VkDeviceAddress values, VkDeviceAddress segmentOffsets, uint32_t segmentCount, DeviceBuffer const& scratch) {
+  assert(m_valid);
+  assert(n < (1U << 31));
+  if (n < 2) {
+    return;
+  }
+  VulkanDeviceProfile const& profile = dev.profile();
+  bool const hasValues = values != 0;
+  bool const hasSegments = segmentCount > 1;
+  ScratchLayout const layout = scratchLayout(n, keyType, hasValues, segmentCount);
+  assert(scratch.size >= layout.size);
+  uint32_t const wide = keyWords(keyType) - 1;
+  uint32_t const tiles = tileCount(n);
+  uint32_t const groupCountX = std::min(tiles, profile.maxComputeWorkGroupCount[0]);
+  uint32_t const groupCountY = (tiles + groupCountX - 1) / groupCountX;
+
+  // even pass counts leave the result in the caller's buffers. Segment id
+  // passes above the highest segment bit see digit 0 and only copy
+  uint32_t const keyPasses = 32 * keyWords(keyType) / m_radixBits;
+  uint32_t segmentPasses = hasSegments ? (bitWidth(segmentCount - 1) + m_radixBits - 1) / m_radixBits : 0;
+  segmentPasses += (keyPasses + segmentPasses) % 2;
+
+  // [pass parity]: the caller's buffers, then the scratch copies
+  std::array<VkDeviceAddress, 2> const keyBuffers{keys, scratch.address + layout.keys};
+  std::array<VkDeviceAddress, 2> const valueBuffers{values, hasValues ? scratch.address + layout.values : 0};
+  VkDeviceSize const segmentSize = alignScratch(VkDeviceSize{n} * sizeof(uint32_t));
+  std::array<VkDeviceAddress, 2> const segmentBuffers{hasSegments ? scratch.address + layout.segments : 0,
+    hasSegments ? scratch.address + layout.segments + segmentSize : 0};
+  VkDeviceAddress const histogram = scratch.address + layout.histogram;
+
+  RadixParams params{};
+  params.histogram = histogram;
+  params.n = n;
+  params.keyType = static_cast<uint32_t>(keyType) % 3;
+  if (hasSegments) {
+    params.dstSegments = segmentBuffers[0];
+    params.segmentOffsets = segmentOffsets;
+    params.segmentCount = segmentCount;
+    m_segmentIds.dispatch(commandBuffer, params, chooseGroupCount(profile, n, m_workgroupSize, 4096));
+  }
+  for (uint32_t pass = 0; pass < keyPasses + segmentPasses; ++pass) {
+    uint32_t const src = pass % 2;
+    uint32_t const dst = 1 - src;
+    bool const segmentPass = pass >= keyPasses;
+    params.srcKeys = keyBuffers[src];
+    params.dstKeys = keyBuffers[dst];
+    params.srcValues = valueBuffers[src];
+    params.dstValues = valueBuffers[dst];
+    params.srcSegments = segmentBuffers[src];
+    params.dstSegments = segmentBuffers[dst];
+    params.shift = (segmentPass ? pass - keyPasses : pass) * m_radixBits;
+    params.digitFromSegments = segmentPass ? 1 : 0;
+    // the previous pass still reads the histogram
+    computeBarrier(dev, commandBuffer);
+    m_histograms[wide].dispatch(commandBuffer, params, groupCountX, groupCountY);
+    computeBarrier(dev, commandBuffer);
+    m_scan.exclusiveScan(commandBuffer, EScanType::Uint32, EScanOp::Add, histogramSize(n), histogram, histogram, scratch);
+    computeBarrier(dev, commandBuffer);
+    m_scatters[wide][hasValues][hasSegments].dispatch(commandBuffer, params, groupCountX, groupCountY);
+  }
+}
+
+// ------------------------------------------------------------------------------
+// RadixSort
+// ------------------------------------------------------------------------------
+
+RadixSort::RadixSort(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines)
+ : m_impl(std::make_unique<RadixSortImpl>(*dev, *shaders, pipelineCache, pipelines)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+RadixSort::~RadixSort() noexcept {
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+RadixSort::operator bool() const {
+  return m_impl->valid();
+}
+
+uint32_t RadixSort::radixBits() const {
+  return m_impl->radixBits();
+}
+
+uint32_t RadixSort::tileSize() const {
+  return m_impl->tileSize();
+}
+
+VkDeviceSize RadixSort::scratchSize(uint32_t n, ESortKey keyType, bool withValues, uint32_t segmentCount) const {
+  return m_impl->scratchSize(n, keyType, withValues, segmentCount);
+}
+
+void RadixSort::sort(VkCommandBuffer commandBuffer, ESortKey keyType, uint32_t n, VkDeviceAddress keys, VkDeviceAddress values,
+  DeviceBuffer const& scratch) {
+  m_impl->sort(*m_dev, commandBuffer, keyType, n, keys, values, 0, 1, scratch);
+}
+
+void RadixSort::sortSegments(VkCommandBuffer commandBuffer, ESortKey keyType, uint32_t n, VkDeviceAddress keys, VkDeviceAddress values,
+  VkDeviceAddress segmentOffsets, uint32_t segmentCount, DeviceBuffer const& scratch) {
+  m_impl->sort(*m_dev, commandBuffer, keyType, n, keys, values, segmentOffsets, segmentCount, scratch);
+}
+
+}
@@ -0,0 +1,164 @@
+#include "avkex-kernels.h"
+
+#include <array>
+
+using namespace avkex;
+
+namespace {
+
+// mirrors Params of shaders/reduce.comp
+struct ReduceParams {
+  VkDeviceAddress src;
+  VkDeviceAddress segmentOffsets;
+  VkDeviceAddress partials;
+  VkDeviceAddress counters;
+  VkDeviceAddress dst;
+  uint32_t n;
+  uint32_t segmentCount;
+  uint32_t groupsPerSegment;
+  uint32_t singlePass;
+};
+static_assert(sizeof(ReduceParams) == 56);
+
+uint32_t constexpr TYPE_COUNT = 3;
+uint32_t constexpr OP_COUNT = 5;
+// elements per invocation before a segment gets another workgroup
+uint32_t constexpr ITEMS_PER_INVOCATION = 16;
+// partials per segment, reduced by one workgroup
+uint32_t constexpr MAX_GROUPS_PER_SEGMENT = 1024;
+VkDeviceSize constexpr PARTIALS_ALIGNMENT = 256;
+
+}
+
+namespace avkex {
+
+// ------------------------------------------------------------------------------
+// ReductionImpl
+// ------------------------------------------------------------------------------
+class ReductionImpl {
+ public:
+  ReductionImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines);
+
+  bool valid() const { return m_valid; }
+  VkDeviceSize scratchSize(uint32_t n, uint32_t segmentCount) const;
+
+  void reduce(VulkanDevice const& dev, VkCommandBuffer commandBuffer, EReduceType type, EReduceOp op, EReduceMode mode, uint32_t n,
+    VkDeviceAddress src, VkDeviceAddress segmentOffsets, uint32_t segmentCount, VkDeviceAddress dst, DeviceBuffer const& scratch) const;
+
+ private:
+  uint32_t groupsPerSegment(uint32_t n, uint32_t segmentCount) const;
+  // counters first, partials after
+  VkDeviceSize partialsOffset(uint32_t segmentCount) const {
+    return (segmentCount * sizeof(uint32_t) + PARTIALS_ALIGNMENT - 1) / PARTIALS_ALIGNMENT * PARTIALS_ALIGNMENT;
+  }
+
+  bool m_valid = false;
+  uint32_t m_workgroupSize = 0;
+  // [type][op][finish]
+  std::array<std::array<std::array<ComputeKernel, 2>, OP_COUNT>, TYPE_COUNT> m_kernels;
+};
+
+ReductionImpl::ReductionImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines) {
+  VulkanDeviceProfile const& profile = dev.profile();
+  VkSubgroupFeatureFlags const required = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+  if (!(profile.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) || (profile.subgroupSupportedOperations & required) != required) {
+    LOG_ERR << "Reduction needs subgroup arithmetic in compute shaders" LOG_RST << std::endl;
+    return;
+  }
+  m_workgroupSize = chooseWorkgroupSize(profile);
+
+  std::array<std::string_view, TYPE_COUNT> constexpr entries{"reduce_u32", "reduce_i32", "reduce_f32"};
+  std::vector<ComputeKernelDesc> descs;
+  descs.reserve(TYPE_COUNT * OP_COUNT * 2);
+  for (uint32_t type = 0; type < TYPE_COUNT; ++type) {
+    for (uint32_t op = 0; op < OP_COUNT; ++op) {
+      for (uint32_t finish = 0; finish < 2; ++finish) {
+        descs.push_back({&m_kernels[type][op][finish], entries[type], sizeof(ReduceParams), {m_workgroupSize, op, finish}});
+      }
+    }
+  }
+  m_valid = createComputeKernels(dev, shaders, pipelineCache, descs, pipelines);
+}
+
+uint32_t ReductionImpl::groupsPerSegment(uint32_t n, uint32_t segmentCount) const {
+  uint64_t const perSegment = (uint64_t{n} + segmentCount - 1) / segmentCount;
+  uint64_t const itemsPerGroup = uint64_t{m_workgroupSize} * ITEMS_PER_INVOCATION;
+  return static_cast<uint32_t>(std::clamp<uint64_t>((perSegment + itemsPerGroup - 1) / itemsPerGroup, 1, MAX_GROUPS_PER_SEGMENT));
+}
+
+VkDeviceSize ReductionImpl::scratchSize(uint32_t n, uint32_t segmentCount) const {
+  segmentCount = std::max(1U, segmentCount);
+  uint32_t const groups = groupsPerSegment(n, segmentCount);
+  return groups == 1 ? 0 : partialsOffset(segmentCount) + VkDeviceSize{segmentCount} * groups * 2 * sizeof(uint32_t);
+}
+
+void ReductionImpl::reduce(VulkanDevice const& dev, VkCommandBuffer commandBuffer, EReduceType type, EReduceOp op, EReduceMode mode,
+  uint32_t n, VkDeviceAddress src, VkDeviceAddress segmentOffsets, uint32_t segmentCount, VkDeviceAddress dst,
+  DeviceBuffer const& scratch) const {
+  assert(m_valid);
+  if (segmentCount == 0) {
+    return;
+  }
+  VulkanDeviceProfile const& profile = dev.profile();
+  uint32_t const groups = groupsPerSegment(n, segmentCount);
+  bool const singlePass = mode == EReduceMode::SinglePass;
+  assert(scratch.size >= scratchSize(n, segmentCount));
+  auto const& kernels = m_kernels[static_cast<uint32_t>(type)][static_cast<uint32_t>(op)];
+  ReduceParams params{src, segmentOffsets, 0, 0, dst, n, segmentCount, groups, singlePass ? 1U : 0U};
+  if (groups > 1) {
+    params.counters = scratch.address;
+    params.partials = scratch.address + partialsOffset(segmentCount);
+    // the previous user of the scratch may still run
+    computeBarrier(dev, commandBuffer);
+    if (singlePass) {
+      dev.api()->vkCmdFillBuffer(commandBuffer, scratch.buffer, 0, segmentCount * sizeof(uint32_t), 0);
+      computeBarrier(dev, commandBuffer);
+    }
+  }
+  uint64_t const totalGroups = uint64_t{groups} * segmentCount;
+  uint32_t const groupCountX = static_cast<uint32_t>(std::min<uint64_t>(totalGroups, profile.maxComputeWorkGroupCount[0]));
+  uint32_t const groupCountY = static_cast<uint32_t>((totalGroups + groupCountX - 1) / groupCountX);
+  assert(groupCountY <= profile.maxComputeWorkGroupCount[1]);
+  kernels[0].dispatch(commandBuffer, params, groupCountX, groupCountY);
+  if (groups > 1 && !singlePass) {
+    computeBarrier(dev, commandBuffer);
+    uint32_t const finishX = std::min(segmentCount, profile.maxComputeWorkGroupCount[0]);
+    kernels[1].dispatch(commandBuffer, params, finishX, (segmentCount + finishX - 1) / finishX);
+  }
+}
+
+// ------------------------------------------------------------------------------
+// Reduction
+// ------------------------------------------------------------------------------
+
+Reduction::Reduction(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines)
+ : m_impl(std::make_unique<ReductionImpl>(*dev, *shaders, pipelineCache, pipelines)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+Reduction::~Reduction() noexcept {
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+Reduction::operator bool() const {
+  return m_impl->valid();
+}
+
+VkDeviceSize Reduction::scratchSize(uint32_t n, uint32_t segmentCount) const {
+  return m_impl->scratchSize(n, segmentCount);
+}
+
+void Reduction::reduce(VkCommandBuffer commandBuffer, EReduceType type, EReduceOp op, EReduceMode mode, uint32_t n, VkDeviceAddress src,
+  VkDeviceAddress dst, DeviceBuffer const& scratch) {
+  m_impl->reduce(*m_dev, commandBuffer, type, op, mode, n, src, 0, 1, dst, scratch);
+}
+
+void Reduction::reduceSegments(VkCommandBuffer commandBuffer, EReduceType type, EReduceOp op, EReduceMode mode, uint32_t n,
+  VkDeviceAddress src, VkDeviceAddress segmentOffsets, uint32_t segmentCount, VkDeviceAddress dst, DeviceBuffer const& scratch) {
+  m_impl->reduce(*m_dev, commandBuffer, type, op, mode, n, src, segmentOffsets, segmentCount, dst, scratch);
+}
+
+}
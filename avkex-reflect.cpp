@@ -0,0 +1,104 @@
+#include "avkex.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace avkex;
+
+namespace {
+
+void reflectEntryPoint(SpvReflectShaderModule const& spvShaderModule, SpvReflectEntryPoint const& spvEntryPoint, std::vector<uint32_t> const& specConstantIds, ShaderReflection& reflection);
+
+}
+
+namespace avkex {
+
+bool reflectShader(uint32_t const* pCode, size_t codeSize, std::vector<ShaderReflection>& outEntryPoints) {
+  SpvReflectShaderModule spvShaderModule{};
+  // no copy: the module only lives in this function
+  SpvReflectResult res = spvReflectCreateShaderModule2(SPV_REFLECT_MODULE_FLAG_NO_COPY, codeSize, pCode, &spvShaderModule);
+  if (res != SPV_REFLECT_RESULT_SUCCESS) {
+    LOG_ERR << "Error in spvReflectCreateShaderModule" LOG_RST << std::endl;
+    return false;
+  }
+  if (spvShaderModule.entry_point_count == 0) {
+    LOG_ERR << "SPIR-V module without entry point" LOG_RST << std::endl;
+    spvReflectDestroyShaderModule(&spvShaderModule);
+    return false;
+  }
+
+  // specialization constants are module wide
+  std::vector<uint32_t> specConstantIds;
+  uint32_t count = 0;
+  res = spvReflectEnumerateSpecializationConstants(&spvShaderModule, &count, nullptr);
+  if (res == SPV_REFLECT_RESULT_SUCCESS && count > 0) {
+    std::vector<SpvReflectSpecializationConstant*> constants(count);
+    res = spvReflectEnumerateSpecializationConstants(&spvShaderModule, &count, constants.data());
+    assert(res == SPV_REFLECT_RESULT_SUCCESS && "spvReflectEnumerateSpecializationConstants");
+    specConstantIds.reserve(count);
+    for (SpvReflectSpecializationConstant const* constant : constants) {
+      specConstantIds.push_back(constant->constant_id);
+    }
+  }
+
+  std::vector<ShaderReflection> entryPoints(spvShaderModule.entry_point_count);
+  for (uint32_t i = 0; i < spvShaderModule.entry_point_count; ++i) {
+    reflectEntryPoint(spvShaderModule, spvShaderModule.entry_points[i], specConstantIds, entryPoints[i]);
+  }
+
+  spvReflectDestroyShaderModule(&spvShaderModule);
+  outEntryPoints = std::move(entryPoints);
+  return true;
+}
+
+}
+
+namespace {
+
+void reflectEntryPoint(SpvReflectShaderModule const& spvShaderModule, SpvReflectEntryPoint const& spvEntryPoint, std::vector<uint32_t> const& specConstantIds, ShaderReflection& reflection) {
+  reflection.entryPoint = spvEntryPoint.name;
+  reflection.stage = static_cast<VkShaderStageFlagBits>(spvEntryPoint.shader_stage);
+  reflection.localSize[0] = spvEntryPoint.local_size.x;
+  reflection.localSize[1] = spvEntryPoint.local_size.y;
+  reflection.localSize[2] = spvEntryPoint.local_size.z;
+  reflection.specConstantIds = specConstantIds;
+
+  uint32_t count = 0;
+  SpvReflectResult res = spvReflectEnumerateEntryPointDescriptorBindings(&spvShaderModule, spvEntryPoint.name, &count, nullptr);
+  if (res == SPV_REFLECT_RESULT_SUCCESS && count > 0) {
+    std::vector<SpvReflectDescriptorBinding*> bindings(count);
+    res = spvReflectEnumerateEntryPointDescriptorBindings(&spvShaderModule, spvEntryPoint.name, &count, bindings.data());
+    assert(res == SPV_REFLECT_RESULT_SUCCESS && "spvReflectEnumerateEntryPointDescriptorBindings");
+    reflection.bindings.reserve(count);
+    for (SpvReflectDescriptorBinding const* spvBinding : bindings) {
+      ShaderReflection::Binding& binding = reflection.bindings.emplace_back();
+      binding.set = spvBinding->set;
+      binding.binding = spvBinding->binding;
+      binding.descriptorType = static_cast<VkDescriptorType>(spvBinding->descriptor_type);
+      binding.descriptorCount = 1;
+      for (uint32_t iDim = 0; iDim < spvBinding->array.dims_count; ++iDim) {
+        binding.descriptorCount *= spvBinding->array.dims[iDim];
+      }
+    }
+    std::sort(reflection.bindings.begin(), reflection.bindings.end(), [](ShaderReflection::Binding const& a, ShaderReflection::Binding const& b) {
+      return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+    });
+  }
+
+  count = 0;
+  res = spvReflectEnumerateEntryPointPushConstantBlocks(&spvShaderModule, spvEntryPoint.name, &count, nullptr);
+  if (res == SPV_REFLECT_RESULT_SUCCESS && count > 0) {
+    std::vector<SpvReflectBlockVariable*> blocks(count);
+    res = spvReflectEnumerateEntryPointPushConstantBlocks(&spvShaderModule, spvEntryPoint.name, &count, blocks.data());
+    assert(res == SPV_REFLECT_RESULT_SUCCESS && "spvReflectEnumerateEntryPointPushConstantBlocks");
+    reflection.pushConstantRanges.reserve(count);
+    for (SpvReflectBlockVariable const* block : blocks) {
+      VkPushConstantRange& range = reflection.pushConstantRanges.emplace_back();
+      range.stageFlags = reflection.stage;
+      range.offset = block->offset;
+      range.size = block->size;
+    }
+  }
+}
+
+}
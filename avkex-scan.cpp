@@ -0,0 +1,178 @@
+#include "avkex-kernels.h"
+
+#include <array>
+
+using namespace avkex;
+
+namespace {
+
+// mirrors Params of shaders/scan.comp
+struct ScanParams {
+  VkDeviceAddress src;
+  VkDeviceAddress flags;
+  VkDeviceAddress dst;
+  VkDeviceAddress scratch;
+  VkDeviceAddress count;
+  uint32_t n;
+  uint32_t inclusive;
+  uint32_t itemsPerGroup;
+  uint32_t pad0;
+};
+static_assert(sizeof(ScanParams) == 56);
+
+uint32_t constexpr OP_COUNT = 7;
+uint32_t constexpr FLOAT_OP_COUNT = 4; // no bitwise operators
+uint32_t constexpr PREFERRED_ITEMS_PER_INVOCATION = 8;
+// per tile: aggregate, inclusive prefix, flag
+uint32_t constexpr STATUS_WORDS_PER_TILE = 3;
+
+}
+
+namespace avkex {
+
+// ------------------------------------------------------------------------------
+// PrefixScanImpl
+// ------------------------------------------------------------------------------
+class PrefixScanImpl {
+ public:
+  PrefixScanImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines);
+
+  bool valid() const { return m_valid; }
+  uint32_t tileSize() const { return m_workgroupSize * m_itemsPerInvocation; }
+  VkDeviceSize scratchSize(uint32_t n) const {
+    return (1 + STATUS_WORDS_PER_TILE * static_cast<VkDeviceSize>(tileCount(n))) * sizeof(uint32_t);
+  }
+
+  void scan(VulkanDevice const& dev, VkCommandBuffer commandBuffer, EScanType type, EScanOp op, bool inclusive, uint32_t n,
+    VkDeviceAddress src, VkDeviceAddress dst, DeviceBuffer const& scratch) const;
+  void compact(VulkanDevice const& dev, VkCommandBuffer commandBuffer, bool partition, uint32_t n, VkDeviceAddress values,
+    VkDeviceAddress flags, VkDeviceAddress dst, VkDeviceAddress count, uint32_t itemsPerGroup, DeviceBuffer const& scratch) const;
+
+ private:
+  uint32_t tileCount(uint32_t n) const { return (n + tileSize() - 1) / tileSize(); }
+  void launch(VulkanDevice const& dev, VkCommandBuffer commandBuffer, ComputeKernel const& kernel, ScanParams& params,
+    DeviceBuffer const& scratch) const;
+
+  bool m_valid = false;
+  uint32_t m_workgroupSize = 0;
+  uint32_t m_itemsPerInvocation = PREFERRED_ITEMS_PER_INVOCATION;
+  std::array<ComputeKernel, OP_COUNT> m_uintScans;
+  std::array<ComputeKernel, FLOAT_OP_COUNT> m_floatScans;
+  // [partition]
+  std::array<ComputeKernel, 2> m_compactions;
+};
+
+PrefixScanImpl::PrefixScanImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines) {
+  VulkanDeviceProfile const& profile = dev.profile();
+  VkSubgroupFeatureFlags const required = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT | VK_SUBGROUP_FEATURE_BALLOT_BIT;
+  if (!(profile.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) || (profile.subgroupSupportedOperations & required) != required) {
+    LOG_ERR << "PrefixScan needs subgroup arithmetic and ballot in compute shaders" LOG_RST << std::endl;
+    return;
+  }
+  m_workgroupSize = chooseWorkgroupSize(profile);
+  // the tile and the subgroup prefixes live in shared memory
+  while (m_itemsPerInvocation > 1 && (m_workgroupSize * (m_itemsPerInvocation + 1) + 8) * sizeof(uint32_t) > profile.maxComputeSharedMemorySize) {
+    m_itemsPerInvocation /= 2;
+  }
+
+  std::vector<ComputeKernelDesc> descs;
+  descs.reserve(OP_COUNT + FLOAT_OP_COUNT + 2);
+  for (uint32_t op = 0; op < OP_COUNT; ++op) {
+    descs.push_back({&m_uintScans[op], "scan_u32", sizeof(ScanParams), {m_workgroupSize, m_itemsPerInvocation, op, 0}});
+  }
+  for (uint32_t op = 0; op < FLOAT_OP_COUNT; ++op) {
+    descs.push_back({&m_floatScans[op], "scan_f32", sizeof(ScanParams), {m_workgroupSize, m_itemsPerInvocation, op, 0}});
+  }
+  for (uint32_t partition = 0; partition < 2; ++partition) {
+    descs.push_back({&m_compactions[partition], "scan_compact", sizeof(ScanParams), {m_workgroupSize, m_itemsPerInvocation, 0, partition}});
+  }
+  m_valid = createComputeKernels(dev, shaders, pipelineCache, descs, pipelines);
+}
+
+void PrefixScanImpl::launch(VulkanDevice const& dev, VkCommandBuffer commandBuffer, ComputeKernel const& kernel, ScanParams& params,
+  DeviceBuffer const& scratch) const {
+  VkDeviceSize const statusSize = scratchSize(params.n);
+  assert(scratch.size >= statusSize);
+  params.scratch = scratch.address;
+  // the previous user of the scratch may still run
+  computeBarrier(dev, commandBuffer);
+  dev.api()->vkCmdFillBuffer(commandBuffer, scratch.buffer, 0, statusSize, 0);
+  computeBarrier(dev, commandBuffer);
+  // tiles are taken from the counter, only the workgroup count matters
+  // n = 0 compactions still write the count
+  uint32_t const tiles = std::max(1U, tileCount(params.n));
+  uint32_t const groupCountX = std::min(tiles, dev.profile().maxComputeWorkGroupCount[0]);
+  kernel.dispatch(commandBuffer, params, groupCountX, (tiles + groupCountX - 1) / groupCountX);
+}
+
+void PrefixScanImpl::scan(VulkanDevice const& dev, VkCommandBuffer commandBuffer, EScanType type, EScanOp op, bool inclusive, uint32_t n,
+  VkDeviceAddress src, VkDeviceAddress dst, DeviceBuffer const& scratch) const {
+  assert(m_valid);
+  assert(n <= UINT32_MAX - tileSize());
+  if (n == 0) {
+    return;
+  }
+  uint32_t const opIndex = static_cast<uint32_t>(op);
+  assert(type == EScanType::Uint32 || opIndex < FLOAT_OP_COUNT);
+  ComputeKernel const& kernel = type == EScanType::Uint32 ? m_uintScans[opIndex] : m_floatScans[opIndex];
+  ScanParams params{src, 0, dst, 0, 0, n, inclusive ? 1U : 0U, 0, 0};
+  launch(dev, commandBuffer, kernel, params, scratch);
+}
+
+void PrefixScanImpl::compact(VulkanDevice const& dev, VkCommandBuffer commandBuffer, bool partition, uint32_t n, VkDeviceAddress values,
+  VkDeviceAddress flags, VkDeviceAddress dst, VkDeviceAddress count, uint32_t itemsPerGroup, DeviceBuffer const& scratch) const {
+  assert(m_valid);
+  assert(n <= UINT32_MAX - tileSize() && itemsPerGroup > 0);
+  ScanParams params{values, flags, dst, 0, count, n, 0, itemsPerGroup, 0};
+  launch(dev, commandBuffer, m_compactions[partition], params, scratch);
+}
+
+// ------------------------------------------------------------------------------
+// PrefixScan
+// ------------------------------------------------------------------------------
+
+PrefixScan::PrefixScan(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines)
+ : m_impl(std::make_unique<PrefixScanImpl>(*dev, *shaders, pipelineCache, pipelines)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+PrefixScan::~PrefixScan() noexcept {
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+PrefixScan::operator bool() const {
+  return m_impl->valid();
+}
+
+uint32_t PrefixScan::tileSize() const {
+  return m_impl->tileSize();
+}
+
+VkDeviceSize PrefixScan::scratchSize(uint32_t n) const {
+  return m_impl->scratchSize(n);
+}
+
+void PrefixScan::inclusiveScan(VkCommandBuffer commandBuffer, EScanType type, EScanOp op, uint32_t n, VkDeviceAddress src, VkDeviceAddress dst,
+  DeviceBuffer const& scratch) {
+  m_impl->scan(*m_dev, commandBuffer, type, op, true, n, src, dst, scratch);
+}
+
+void PrefixScan::exclusiveScan(VkCommandBuffer commandBuffer, EScanType type, EScanOp op, uint32_t n, VkDeviceAddress src, VkDeviceAddress dst,
+  DeviceBuffer const& scratch) {
+  m_impl->scan(*m_dev, commandBuffer, type, op, false, n, src, dst, scratch);
+}
+
+void PrefixScan::compact(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress values, VkDeviceAddress flags, VkDeviceAddress dst,
+  VkDeviceAddress count, uint32_t itemsPerGroup, DeviceBuffer const& scratch) {
+  m_impl->compact(*m_dev, commandBuffer, false, n, values, flags, dst, count, itemsPerGroup, scratch);
+}
+
+void PrefixScan::partition(VkCommandBuffer commandBuffer, uint32_t n, VkDeviceAddress values, VkDeviceAddress flags, VkDeviceAddress dst,
+  VkDeviceAddress count, uint32_t itemsPerGroup, DeviceBuffer const& scratch) {
+  m_impl->compact(*m_dev, commandBuffer, true, n, values, flags, dst, count, itemsPerGroup, scratch);
+}
+
+}
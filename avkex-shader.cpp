@@ -1,11 +1,15 @@
 #include "avkex.h"
 
+#include <algorithm>
 #include <atomic>
+#include <deque>
 #include <iostream>
+#include <mutex>
 #include <unordered_map>
 #include <thread>
 #include <shared_mutex>
 #include <string>
+#include <string_view>
 
 // Note: Shader modules are not the only way to provide SPIR-V Code to
 // the Vulkan Runtime
@@ -25,40 +29,94 @@ class ShaderData {
   ~ShaderData() noexcept { assert(m_shaderModule == VK_NULL_HANDLE && "cleanup not called"); }
 #endif
 
-  ShaderData(VulkanDevice& dev, uint32_t const* pCode, uint32_t wordCount) : m_pCode(pCode, pCode + wordCount) {
-    size_t const codeSize = static_cast<size_t>(wordCount) * sizeof(uint32_t);
-    // 1. reflect data
-    SpvReflectResult const res = spvReflectCreateShaderModule2(
-      SPV_REFLECT_MODULE_FLAG_NO_COPY, codeSize, m_pCode.data(), &m_spvShaderModule);
-    if (res != SPV_REFLECT_RESULT_SUCCESS) {
-      m_spvShaderModule.entry_point_name = nullptr;
-      LOG_ERR << "Error in spvReflectCreateShaderModule" LOG_RST << std::endl;
+  // With VK_KHR_maintenance5 the code is kept and handed inline to pipeline
+  // creation. Otherwise the module is created and the code freed on return,
+  // valid() is false if the driver rejected it
+  ShaderData(VulkanDevice& dev, std::vector<uint32_t>&& code, std::vector<ShaderReflection>&& entryPoints)
+   : m_entryPoints(std::move(entryPoints)) {
+    if (dev.hasMaintenance5()) {
+      m_ownedCode = std::move(code);
+      m_pCode = m_ownedCode.data();
+      m_codeSize = m_ownedCode.size() * sizeof(uint32_t);
+      return;
     }
+    std::vector<uint32_t> const consumed = std::move(code);
+    createModule(dev, consumed.data(), consumed.size() * sizeof(uint32_t));
+  }
 
-    // 2. create shader module (TODO non crashing failure)
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = codeSize;
-    createInfo.pCode = pCode;
-    AVK_VK_RST(dev.api()->vkCreateShaderModule(dev.device(), &createInfo, nullptr, &m_shaderModule));
+  // Borrowed code, owner keeps it alive while used. Without VK_KHR_maintenance5
+  // the module is created by the first source() call: packs hold variants
+  // for optional capabilities (f16, cooperative matrix, int64 atomics), and
+  // only those the kernels select, after checking the device, get a module
+  ShaderData(VulkanDevice& dev, uint32_t const* pCode, size_t wordCount, std::shared_ptr<void const> owner, std::vector<ShaderReflection>&& entryPoints)
+   : m_entryPoints(std::move(entryPoints)), m_pCode(pCode), m_codeSize(wordCount * sizeof(uint32_t)), m_codeOwner(std::move(owner)) {
+    if (!dev.hasMaintenance5()) {
+      m_moduleOnce = std::make_unique<std::once_flag>();
+    }
   }
 
   void cleanup(VulkanDevice& dev) noexcept {
-    // 1. destroy shader module
-    dev.api()->vkDestroyShaderModule(dev.device(), m_shaderModule, nullptr);
-    m_shaderModule = VK_NULL_HANDLE;
-    // 2. destory reflection data
-    spvReflectDestroyShaderModule(&m_spvShaderModule);
+    if (m_shaderModule != VK_NULL_HANDLE) {
+      dev.api()->vkDestroyShaderModule(dev.device(), m_shaderModule, nullptr);
+      m_shaderModule = VK_NULL_HANDLE;
+    }
+    m_ownedCode = {};
+    m_codeOwner.reset();
+    m_pCode = nullptr;
+    m_codeSize = 0;
+  }
+
+  bool valid() const { return m_shaderModule != VK_NULL_HANDLE || m_pCode != nullptr; }
+
+  // empty if the module couldn't be created
+  ShaderStageSource source(VulkanDevice const& dev) const {
+    if (m_moduleOnce) {
+      std::call_once(*m_moduleOnce, [&]() { createModule(dev, m_pCode, m_codeSize); });
+    }
+    ShaderStageSource source;
+    source.shaderModule = m_shaderModule;
+    // borrowed code without VK_KHR_maintenance5 can't go inline
+    if (m_shaderModule == VK_NULL_HANDLE && !m_moduleOnce) {
+      source.pCode = m_pCode;
+      source.codeSize = m_codeSize;
+    }
+    return source;
   }
 
-  VkShaderModule shaderModule() const { return m_shaderModule; }
-  // be ware of how you use a getter to a reference
-  SpvReflectShaderModule const& spvShaderModule() const { return m_spvShaderModule; }
+  // empty name selects the first one
+  ShaderReflection const* entryPoint(std::string_view name) const {
+    if (name.empty()) {
+      return m_entryPoints.empty() ? nullptr : &m_entryPoints.front();
+    }
+    for (ShaderReflection const& reflection : m_entryPoints) {
+      if (reflection.entryPoint == name) {
+        return &reflection;
+      }
+    }
+    return nullptr;
+  }
 
  private:
-  std::vector<uint32_t> m_pCode;
-  SpvReflectShaderModule m_spvShaderModule = {};
-  VkShaderModule m_shaderModule = VK_NULL_HANDLE;
+  // not AVK_VK_RST: a bad hot reload edit must not end the process
+  void createModule(VulkanDevice const& dev, uint32_t const* pCode, size_t codeSize) const {
+    VkShaderModuleCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    createInfo.codeSize = codeSize;
+    createInfo.pCode = pCode;
+    if (dev.api()->vkCreateShaderModule(dev.device(), &createInfo, nullptr, &m_shaderModule) != VK_SUCCESS) {
+      m_shaderModule = VK_NULL_HANDLE;
+    }
+  }
+
+  std::vector<ShaderReflection> m_entryPoints;
+  // inline SPIR-V only, either owned or borrowed from m_codeOwner
+  uint32_t const* m_pCode = nullptr;
+  size_t m_codeSize = 0;
+  std::vector<uint32_t> m_ownedCode;
+  std::shared_ptr<void const> m_codeOwner;
+  // borrowed code without VK_KHR_maintenance5: guards the deferred module
+  std::unique_ptr<std::once_flag> m_moduleOnce;
+  mutable VkShaderModule m_shaderModule = VK_NULL_HANDLE;
 };
 
 // ------------------------------------------------------------------------------
@@ -66,64 +124,257 @@ class ShaderData {
 // ------------------------------------------------------------------------------
 class VulkanShaderRegistryImpl {
  public:
-  VulkanShaderRegistryImpl(size_t minCap, size_t maxCap) : m_maxCap(maxCap) {
-    m_map.reserve(minCap);
-  }
+  VulkanShaderRegistryImpl(size_t minCap, size_t maxCap);
 
-  bool registerShader(VulkanDevice& dev, std::string_view name, uint32_t const* pCode, uint32_t wordCount);
+  ShaderHandle registerShader(VulkanDevice& dev, std::string_view name, std::vector<uint32_t>&& code);
+  std::vector<ShaderHandle> registerShaderPack(VulkanDevice& dev, std::shared_ptr<ShaderPack const> const& pack);
+  bool replaceShader(VulkanDevice& dev, ShaderHandle handle, std::vector<uint32_t>&& code);
+  bool unregisterShader(VulkanDevice& dev, ShaderHandle handle);
   bool unregisterShader(VulkanDevice& dev, std::string_view name);
-  bool withShader(std::string_view name, std::function<void(VkShaderModule, SpvReflectShaderModule const&)> const& func) const;
+  ShaderHandle findShader(std::string_view name) const;
+  bool withShader(VulkanDevice const& dev, ShaderHandle handle, std::string_view entryPoint, VulkanShaderRegistry::ShaderCallback callback,
+    void* context) const;
   void cleanup(VulkanDevice& dev) noexcept;
 
  private:
+  struct Slot {
+    std::string_view name; // interned in m_names
+    uint32_t generation = 0; // of the live shader, or of the last one
+    std::unique_ptr<ShaderData> shader;
+  };
+
+  // what readers see, entry i mirrors m_slots[i]
+  struct SnapshotEntry {
+    uint32_t generation; // 0 if the slot is empty
+    ShaderData const* shader;
+  };
+  using Snapshot = std::vector<SnapshotEntry>;
+
+  struct Retired {
+    uint64_t epoch;
+    std::unique_ptr<Snapshot> snapshot;
+    std::unique_ptr<ShaderData> shader;
+  };
+
+  static ShaderHandle makeHandle(uint32_t index, uint32_t generation) { return ShaderHandle{(generation << ShaderHandle::INDEX_BITS) | index}; }
+
+  // under write lock. makeShader() builds the ShaderData once the slot is
+  // known, nullptr fails the insertion
+  template <typename MakeShader>
+  ShaderHandle insertShader(VulkanDevice& dev, std::string_view name, MakeShader&& makeShader);
+
+  // under write lock. m_slots changed, publish a new snapshot and retire the
+  // previous one together with the removed shader, if any
+  void publish(VulkanDevice& dev, std::unique_ptr<ShaderData> removed);
+  void reclaim(VulkanDevice& dev);
+  bool unregisterSlot(VulkanDevice& dev, uint32_t index);
+
   size_t m_maxCap;
-  mutable std::shared_mutex m_mapMtx;
-  // note: you can avoid constructing a std string and hash the string view
-  std::unordered_map<std::string, ShaderData> m_map;
+  size_t m_liveCount = 0;
+  mutable std::shared_mutex m_writeMtx;
+  std::deque<std::string> m_names; // stable addresses for the string_view keys
+  std::unordered_map<std::string_view, uint32_t> m_nameToSlot;
+  std::vector<Slot> m_slots;
+  std::vector<Retired> m_retired;
+
+  mutable EpochDomain m_epochs;
+  std::atomic<Snapshot*> m_snapshot;
 };
 
-bool VulkanShaderRegistryImpl::registerShader(VulkanDevice& dev, std::string_view name, uint32_t const* pCode, uint32_t wordCount) {
-  std::lock_guard wLock{m_mapMtx};
-  // 1. already exists
-  if (m_map.find(std::string(name)) != m_map.end()) {
+VulkanShaderRegistryImpl::VulkanShaderRegistryImpl(size_t minCap, size_t maxCap)
+ : m_maxCap(std::min<size_t>(maxCap, ShaderHandle::INDEX_MASK + 1)), m_snapshot(new Snapshot) {
+  m_nameToSlot.reserve(minCap);
+  m_slots.reserve(minCap);
+}
+
+ShaderHandle VulkanShaderRegistryImpl::registerShader(VulkanDevice& dev, std::string_view name, std::vector<uint32_t>&& code) {
+  // reflect outside of the lock
+  std::vector<ShaderReflection> entryPoints;
+  if (code.empty() || !reflectShader(code.data(), code.size() * sizeof(uint32_t), entryPoints)) {
+    return {};
+  }
+  std::lock_guard wLock{m_writeMtx};
+  return insertShader(dev, name, [&]() -> std::unique_ptr<ShaderData> {
+    auto shader = std::make_unique<ShaderData>(dev, std::move(code), std::move(entryPoints));
+    if (!shader->valid()) {
+      return nullptr;
+    }
+    return shader;
+  });
+}
+
+std::vector<ShaderHandle> VulkanShaderRegistryImpl::registerShaderPack(VulkanDevice& dev, std::shared_ptr<ShaderPack const> const& pack) {
+  std::vector<ShaderHandle> handles;
+  if (!pack) {
+    return handles;
+  }
+  handles.reserve(pack->shaderCount());
+  std::lock_guard wLock{m_writeMtx};
+  for (uint32_t i = 0; i < pack->shaderCount(); ++i) {
+    handles.push_back(insertShader(dev, pack->shaderName(i), [&]() {
+      return std::make_unique<ShaderData>(dev, pack->shaderCode(i), pack->shaderWordCount(i), pack, pack->shaderEntryPoints(i));
+    }));
+  }
+  return handles;
+}
+
+bool VulkanShaderRegistryImpl::replaceShader(VulkanDevice& dev, ShaderHandle handle, std::vector<uint32_t>&& code) {
+  // reflect and create the module outside of the lock
+  std::vector<ShaderReflection> entryPoints;
+  if (!handle || code.empty() || !reflectShader(code.data(), code.size() * sizeof(uint32_t), entryPoints)) {
+    return false;
+  }
+  auto shader = std::make_unique<ShaderData>(dev, std::move(code), std::move(entryPoints));
+  if (!shader->valid()) {
+    return false;
+  }
+  std::lock_guard wLock{m_writeMtx};
+  uint32_t const index = handle.index();
+  if (index >= m_slots.size() || !m_slots[index].shader || m_slots[index].generation != handle.generation()) {
+    shader->cleanup(dev);
     return false;
   }
+  // same generation: live handles follow the swap
+  std::swap(m_slots[index].shader, shader);
+  publish(dev, std::move(shader));
+  return true;
+}
+
+template <typename MakeShader>
+ShaderHandle VulkanShaderRegistryImpl::insertShader(VulkanDevice& dev, std::string_view name, MakeShader&& makeShader) {
+  // 1. already exists
+  uint32_t index = -1U;
+  if (auto it = m_nameToSlot.find(name); it != m_nameToSlot.end()) {
+    index = it->second;
+    if (m_slots[index].shader) {
+      return {};
+    }
+  }
   // 2. capacity reached
-  if (m_map.size() >= m_maxCap) {
+  if (m_liveCount >= m_maxCap || (index == -1U && m_slots.size() > ShaderHandle::INDEX_MASK)) {
+    return {};
+  }
+  // 3. intern the name, its slot is kept when unregistered
+  if (index == -1U) {
+    std::string_view const interned = m_names.emplace_back(name);
+    index = static_cast<uint32_t>(m_slots.size());
+    m_slots.push_back({interned, 0, nullptr});
+    m_nameToSlot.emplace(interned, index);
+  }
+  std::unique_ptr<ShaderData> shader = makeShader();
+  if (!shader) {
+    return {};
+  }
+  Slot& slot = m_slots[index];
+  slot.generation = slot.generation % ShaderHandle::MAX_GENERATION + 1;
+  slot.shader = std::move(shader);
+  ++m_liveCount;
+  publish(dev, nullptr);
+  return makeHandle(index, slot.generation);
+}
+
+bool VulkanShaderRegistryImpl::unregisterShader(VulkanDevice& dev, ShaderHandle handle) {
+  std::lock_guard wLock{m_writeMtx};
+  uint32_t const index = handle.index();
+  if (!handle || index >= m_slots.size() || m_slots[index].generation != handle.generation()) {
     return false;
   }
-  // 3. try insertion (someone else might have acquired lock)
-  auto [it, wasInserted] = m_map.try_emplace(std::string(name), dev, pCode, wordCount);
-  return wasInserted;
+  return unregisterSlot(dev, index);
 }
 
 bool VulkanShaderRegistryImpl::unregisterShader(VulkanDevice& dev, std::string_view name) {
-  std::lock_guard wLock{m_mapMtx};
-  auto it = m_map.find(std::string(name)); 
-  if (it == m_map.end()) {
+  std::lock_guard wLock{m_writeMtx};
+  auto it = m_nameToSlot.find(name);
+  if (it == m_nameToSlot.end()) {
     return false;
   }
-  it->second.cleanup(dev);
-  m_map.erase(it);
-  return true;
+  return unregisterSlot(dev, it->second);
+}
+
+ShaderHandle VulkanShaderRegistryImpl::findShader(std::string_view name) const {
+  std::shared_lock rLock{m_writeMtx};
+  if (auto it = m_nameToSlot.find(name); it != m_nameToSlot.end() && m_slots[it->second].shader) {
+    return makeHandle(it->second, m_slots[it->second].generation);
+  }
+  return {};
 }
 
-bool VulkanShaderRegistryImpl::withShader(std::string_view name, std::function<void(VkShaderModule, SpvReflectShaderModule const&)> const& func) const {
-  std::shared_lock rLock{m_mapMtx};
-  if (auto it = m_map.find(std::string(name)); it != m_map.end()) {
-    func(it->second.shaderModule(), it->second.spvShaderModule());
-    return true;
+bool VulkanShaderRegistryImpl::withShader(VulkanDevice const& dev, ShaderHandle handle, std::string_view entryPoint,
+  VulkanShaderRegistry::ShaderCallback callback, void* context) const {
+  if (!handle) {
+    return false;
+  }
+  EpochDomain::Guard const guard = m_epochs.pin();
+  Snapshot const* snapshot = m_snapshot.load(std::memory_order_acquire);
+  if (!snapshot || handle.index() >= snapshot->size()) {
+    return false;
+  }
+  SnapshotEntry const& entry = (*snapshot)[handle.index()];
+  if (entry.generation != handle.generation()) {
+    return false;
+  }
+  ShaderReflection const* reflection = entry.shader->entryPoint(entryPoint);
+  if (!reflection) {
+    return false;
+  }
+  ShaderStageSource const source = entry.shader->source(dev);
+  if (source.shaderModule == VK_NULL_HANDLE && !source.pCode) {
+    return false;
   }
-  return false;
+  callback(context, source, *reflection);
+  return true;
 }
 
 void VulkanShaderRegistryImpl::cleanup(VulkanDevice& dev) noexcept {
-  std::lock_guard wLock{m_mapMtx};
-  while (!m_map.empty()) {
-    auto it = m_map.begin();
-    it->second.cleanup(dev);
-    m_map.erase(it);
+  std::lock_guard wLock{m_writeMtx};
+  std::unique_ptr<Snapshot> const last{m_snapshot.exchange(nullptr, std::memory_order_acq_rel)};
+  m_epochs.synchronize();
+  for (Retired& retired : m_retired) {
+    if (retired.shader) {
+      retired.shader->cleanup(dev);
+    }
   }
+  m_retired.clear();
+  for (Slot& slot : m_slots) {
+    if (slot.shader) {
+      slot.shader->cleanup(dev);
+      slot.shader.reset();
+    }
+  }
+  m_liveCount = 0;
+}
+
+void VulkanShaderRegistryImpl::publish(VulkanDevice& dev, std::unique_ptr<ShaderData> removed) {
+  auto next = std::make_unique<Snapshot>();
+  next->reserve(m_slots.size());
+  for (Slot const& slot : m_slots) {
+    next->push_back({slot.shader ? slot.generation : 0, slot.shader.get()});
+  }
+  std::unique_ptr<Snapshot> previous{m_snapshot.exchange(next.release(), std::memory_order_acq_rel)};
+  m_retired.push_back({m_epochs.retire(), std::move(previous), std::move(removed)});
+  reclaim(dev);
+}
+
+void VulkanShaderRegistryImpl::reclaim(VulkanDevice& dev) {
+  // retired in epoch order, safe ones form a prefix
+  size_t safeCount = 0;
+  while (safeCount < m_retired.size() && m_epochs.isSafe(m_retired[safeCount].epoch)) {
+    if (m_retired[safeCount].shader) {
+      m_retired[safeCount].shader->cleanup(dev);
+    }
+    ++safeCount;
+  }
+  m_retired.erase(m_retired.begin(), m_retired.begin() + safeCount);
+}
+
+bool VulkanShaderRegistryImpl::unregisterSlot(VulkanDevice& dev, uint32_t index) {
+  Slot& slot = m_slots[index];
+  if (!slot.shader) {
+    return false;
+  }
+  --m_liveCount;
+  publish(dev, std::move(slot.shader));
+  return true;
 }
 
 // ------------------------------------------------------------------------------
@@ -143,16 +394,41 @@ VulkanShaderRegistry::~VulkanShaderRegistry() noexcept {
   m_dev = nullptr;
 }
 
-bool VulkanShaderRegistry::registerShader(std::string_view name, uint32_t const* pCode, uint32_t wordCount) {
-  return m_impl->registerShader(*m_dev, name, pCode, wordCount);
+ShaderHandle VulkanShaderRegistry::registerShader(std::string_view name, std::vector<uint32_t>&& code) {
+  return m_impl->registerShader(*m_dev, name, std::move(code));
+}
+
+std::vector<ShaderHandle> VulkanShaderRegistry::registerShaderPack(std::shared_ptr<ShaderPack const> const& pack) {
+  return m_impl->registerShaderPack(*m_dev, pack);
+}
+
+std::future<ShaderHandle> VulkanShaderRegistry::registerShader(std::string_view name, ShaderCompiler& compiler, ShaderSource source) {
+  auto promise = std::make_shared<std::promise<ShaderHandle>>();
+  std::future<ShaderHandle> result = promise->get_future();
+  compiler.compile(std::move(source), [this, name = std::string(name), promise](std::vector<uint32_t>&& code) {
+    promise->set_value(code.empty() ? ShaderHandle{} : registerShader(name, std::move(code)));
+  });
+  return result;
+}
+
+bool VulkanShaderRegistry::replaceShader(ShaderHandle handle, std::vector<uint32_t>&& code) {
+  return m_impl->replaceShader(*m_dev, handle, std::move(code));
+}
+
+bool VulkanShaderRegistry::unregisterShader(ShaderHandle handle) {
+  return m_impl->unregisterShader(*m_dev, handle);
 }
 
 bool VulkanShaderRegistry::unregisterShader(std::string_view name) {
   return m_impl->unregisterShader(*m_dev, name);
 }
 
-bool VulkanShaderRegistry::withShader(std::string_view shader, std::function<void(VkShaderModule, SpvReflectShaderModule const&)> const& func) const {
-  return m_impl->withShader(shader, func);
+ShaderHandle VulkanShaderRegistry::findShader(std::string_view name) const {
+  return m_impl->findShader(name);
+}
+
+bool VulkanShaderRegistry::withShader(ShaderHandle handle, std::string_view entryPoint, ShaderCallback callback, void* context) const {
+  return m_impl->withShader(*m_dev, handle, entryPoint, callback, context);
 }
 
 }
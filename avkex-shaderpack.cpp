@@ -0,0 +1,258 @@
+#include "avkex.h"
+#include "avkex-shaderpack.h"
+
+#include <fstream>
+#include <iostream>
+
+using namespace avkex;
+
+namespace {
+
+template <typename T>
+T const* table(uint8_t const* bytes, uint32_t offset) {
+  return reinterpret_cast<T const*>(bytes + offset);
+}
+
+// [offset, offset + count * elemSize) inside the file
+bool inFile(uint64_t fileSize, uint32_t offset, uint32_t count, uint32_t elemSize) {
+  return offset % alignof(uint32_t) == 0 && uint64_t{offset} + uint64_t{count} * elemSize <= fileSize;
+}
+
+bool inRange(uint32_t first, uint32_t count, uint32_t total) {
+  return uint64_t{first} + count <= total;
+}
+
+uint32_t alignUp4(size_t value) { return static_cast<uint32_t>((value + 3) & ~size_t{3}); }
+
+}
+
+namespace avkex {
+
+std::shared_ptr<ShaderPack const> ShaderPack::open(std::filesystem::path const& path) {
+  std::optional<os::MappedFile> file = os::MappedFile::open(path);
+  if (!file) {
+    LOG_ERR << "Couldn't map shader pack " << path.string() << LOG_RST << std::endl;
+    return nullptr;
+  }
+  std::shared_ptr<ShaderPack> pack{new ShaderPack(std::move(*file))};
+  if (!pack->validate()) {
+    LOG_ERR << "Invalid shader pack " << path.string() << LOG_RST << std::endl;
+    return nullptr;
+  }
+  return pack;
+}
+
+bool ShaderPack::validate() const {
+  size_t const fileSize = m_file.size();
+  if (fileSize < sizeof(pack::Header)) {
+    return false;
+  }
+  pack::Header const& header = *table<pack::Header>(bytes(), 0);
+  if (header.magic != pack::MAGIC || header.version != pack::VERSION || header.fileSize != fileSize) {
+    return false;
+  }
+  if (!inFile(fileSize, header.shadersOffset, header.shaderCount, sizeof(pack::Shader)) ||
+      !inFile(fileSize, header.entryPointsOffset, header.entryPointCount, sizeof(pack::EntryPoint)) ||
+      !inFile(fileSize, header.bindingsOffset, header.bindingCount, sizeof(pack::Binding)) ||
+      !inFile(fileSize, header.pushConstantsOffset, header.pushConstantCount, sizeof(pack::PushConstant)) ||
+      !inFile(fileSize, header.specConstantsOffset, header.specConstantCount, sizeof(uint32_t)) ||
+      !inFile(fileSize, header.stringsOffset, header.stringsSize, 1)) {
+    return false;
+  }
+
+  char const* strings = table<char>(bytes(), header.stringsOffset);
+  auto const validString = [&](pack::String const& str) {
+    return uint64_t{str.offset} + str.length < header.stringsSize && strings[str.offset + str.length] == '\0';
+  };
+
+  pack::Shader const* shaders = table<pack::Shader>(bytes(), header.shadersOffset);
+  for (uint32_t i = 0; i < header.shaderCount; ++i) {
+    pack::Shader const& shader = shaders[i];
+    if (!validString(shader.name) || !validString(shader.source) || !validString(shader.defines) || shader.codeWordCount == 0 ||
+        !inFile(fileSize, shader.codeOffset, shader.codeWordCount, sizeof(uint32_t)) ||
+        !inRange(shader.firstEntryPoint, shader.entryPointCount, header.entryPointCount)) {
+      return false;
+    }
+  }
+  pack::EntryPoint const* entryPoints = table<pack::EntryPoint>(bytes(), header.entryPointsOffset);
+  for (uint32_t i = 0; i < header.entryPointCount; ++i) {
+    pack::EntryPoint const& entryPoint = entryPoints[i];
+    if (!validString(entryPoint.name) ||
+        !inRange(entryPoint.firstBinding, entryPoint.bindingCount, header.bindingCount) ||
+        !inRange(entryPoint.firstPushConstant, entryPoint.pushConstantCount, header.pushConstantCount) ||
+        !inRange(entryPoint.firstSpecConstant, entryPoint.specConstantCount, header.specConstantCount)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+uint32_t ShaderPack::shaderCount() const { return table<pack::Header>(bytes(), 0)->shaderCount; }
+
+std::string_view ShaderPack::shaderName(uint32_t index) const {
+  pack::Header const& header = *table<pack::Header>(bytes(), 0);
+  pack::String const& name = table<pack::Shader>(bytes(), header.shadersOffset)[index].name;
+  return {table<char>(bytes(), header.stringsOffset) + name.offset, name.length};
+}
+
+std::string_view ShaderPack::shaderSource(uint32_t index) const {
+  pack::Header const& header = *table<pack::Header>(bytes(), 0);
+  pack::String const& source = table<pack::Shader>(bytes(), header.shadersOffset)[index].source;
+  return {table<char>(bytes(), header.stringsOffset) + source.offset, source.length};
+}
+
+std::vector<std::pair<std::string, std::string>> ShaderPack::shaderDefines(uint32_t index) const {
+  pack::Header const& header = *table<pack::Header>(bytes(), 0);
+  pack::String const& defines = table<pack::Shader>(bytes(), header.shadersOffset)[index].defines;
+  std::string_view list{table<char>(bytes(), header.stringsOffset) + defines.offset, defines.length};
+  std::vector<std::pair<std::string, std::string>> result;
+  while (!list.empty()) {
+    size_t const comma = list.find(',');
+    std::string_view const define = list.substr(0, comma);
+    size_t const eq = define.find('=');
+    result.emplace_back(define.substr(0, eq), eq == std::string_view::npos ? std::string_view{} : define.substr(eq + 1));
+    list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+  }
+  return result;
+}
+
+uint32_t const* ShaderPack::shaderCode(uint32_t index) const {
+  pack::Header const& header = *table<pack::Header>(bytes(), 0);
+  return table<uint32_t>(bytes(), table<pack::Shader>(bytes(), header.shadersOffset)[index].codeOffset);
+}
+
+uint32_t ShaderPack::shaderWordCount(uint32_t index) const {
+  pack::Header const& header = *table<pack::Header>(bytes(), 0);
+  return table<pack::Shader>(bytes(), header.shadersOffset)[index].codeWordCount;
+}
+
+std::vector<ShaderReflection> ShaderPack::shaderEntryPoints(uint32_t index) const {
+  pack::Header const& header = *table<pack::Header>(bytes(), 0);
+  pack::Shader const& shader = table<pack::Shader>(bytes(), header.shadersOffset)[index];
+  char const* strings = table<char>(bytes(), header.stringsOffset);
+  pack::EntryPoint const* entryPoints = table<pack::EntryPoint>(bytes(), header.entryPointsOffset) + shader.firstEntryPoint;
+  pack::Binding const* bindings = table<pack::Binding>(bytes(), header.bindingsOffset);
+  pack::PushConstant const* pushConstants = table<pack::PushConstant>(bytes(), header.pushConstantsOffset);
+  uint32_t const* specConstants = table<uint32_t>(bytes(), header.specConstantsOffset);
+
+  std::vector<ShaderReflection> result(shader.entryPointCount);
+  for (uint32_t i = 0; i < shader.entryPointCount; ++i) {
+    pack::EntryPoint const& entryPoint = entryPoints[i];
+    ShaderReflection& reflection = result[i];
+    reflection.entryPoint.assign(strings + entryPoint.name.offset, entryPoint.name.length);
+    reflection.stage = static_cast<VkShaderStageFlagBits>(entryPoint.stage);
+    std::copy(std::begin(entryPoint.localSize), std::end(entryPoint.localSize), reflection.localSize);
+    reflection.bindings.reserve(entryPoint.bindingCount);
+    for (uint32_t b = 0; b < entryPoint.bindingCount; ++b) {
+      pack::Binding const& binding = bindings[entryPoint.firstBinding + b];
+      reflection.bindings.push_back({binding.set, binding.binding, static_cast<VkDescriptorType>(binding.descriptorType), binding.descriptorCount});
+    }
+    reflection.pushConstantRanges.reserve(entryPoint.pushConstantCount);
+    for (uint32_t p = 0; p < entryPoint.pushConstantCount; ++p) {
+      pack::PushConstant const& pushConstant = pushConstants[entryPoint.firstPushConstant + p];
+      reflection.pushConstantRanges.push_back({pushConstant.stageFlags, pushConstant.offset, pushConstant.size});
+    }
+    reflection.specConstantIds.assign(specConstants + entryPoint.firstSpecConstant,
+      specConstants + entryPoint.firstSpecConstant + entryPoint.specConstantCount);
+  }
+  return result;
+}
+
+bool ShaderPack::write(std::filesystem::path const& path, std::vector<Input> const& shaders) {
+  std::vector<pack::Shader> packShaders;
+  std::vector<pack::EntryPoint> packEntryPoints;
+  std::vector<pack::Binding> packBindings;
+  std::vector<pack::PushConstant> packPushConstants;
+  std::vector<uint32_t> packSpecConstants;
+  std::string strings;
+  auto const addString = [&strings](std::string_view str) {
+    pack::String const packString{static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(str.size())};
+    strings.append(str);
+    strings.push_back('\0');
+    return packString;
+  };
+
+  for (Input const& input : shaders) {
+    pack::Shader& shader = packShaders.emplace_back();
+    shader.name = addString(input.name);
+    shader.source = addString(input.source);
+    std::string defines;
+    for (auto const& [name, value] : input.defines) {
+      if (!defines.empty()) defines.push_back(',');
+      defines.append(name);
+      if (!value.empty()) defines.append("=").append(value);
+    }
+    shader.defines = addString(defines);
+    shader.codeWordCount = static_cast<uint32_t>(input.code.size());
+    shader.firstEntryPoint = static_cast<uint32_t>(packEntryPoints.size());
+    shader.entryPointCount = static_cast<uint32_t>(input.entryPoints.size());
+    for (ShaderReflection const& reflection : input.entryPoints) {
+      pack::EntryPoint& entryPoint = packEntryPoints.emplace_back();
+      entryPoint.name = addString(reflection.entryPoint);
+      entryPoint.stage = reflection.stage;
+      std::copy(std::begin(reflection.localSize), std::end(reflection.localSize), entryPoint.localSize);
+      entryPoint.firstBinding = static_cast<uint32_t>(packBindings.size());
+      entryPoint.bindingCount = static_cast<uint32_t>(reflection.bindings.size());
+      for (ShaderReflection::Binding const& binding : reflection.bindings) {
+        packBindings.push_back({binding.set, binding.binding, static_cast<uint32_t>(binding.descriptorType), binding.descriptorCount});
+      }
+      entryPoint.firstPushConstant = static_cast<uint32_t>(packPushConstants.size());
+      entryPoint.pushConstantCount = static_cast<uint32_t>(reflection.pushConstantRanges.size());
+      for (VkPushConstantRange const& range : reflection.pushConstantRanges) {
+        packPushConstants.push_back({range.stageFlags, range.offset, range.size});
+      }
+      entryPoint.firstSpecConstant = static_cast<uint32_t>(packSpecConstants.size());
+      entryPoint.specConstantCount = static_cast<uint32_t>(reflection.specConstantIds.size());
+      packSpecConstants.insert(packSpecConstants.end(), reflection.specConstantIds.begin(), reflection.specConstantIds.end());
+    }
+  }
+  strings.resize(alignUp4(strings.size()), '\0');
+
+  // lay out the sections
+  pack::Header header{};
+  header.magic = pack::MAGIC;
+  header.version = pack::VERSION;
+  uint32_t offset = sizeof(pack::Header);
+  auto const place = [&offset](uint32_t& sectionOffset, uint32_t& sectionCount, size_t count, size_t elemSize) {
+    sectionOffset = offset;
+    sectionCount = static_cast<uint32_t>(count);
+    offset += alignUp4(count * elemSize);
+  };
+  place(header.shadersOffset, header.shaderCount, packShaders.size(), sizeof(pack::Shader));
+  place(header.entryPointsOffset, header.entryPointCount, packEntryPoints.size(), sizeof(pack::EntryPoint));
+  place(header.bindingsOffset, header.bindingCount, packBindings.size(), sizeof(pack::Binding));
+  place(header.pushConstantsOffset, header.pushConstantCount, packPushConstants.size(), sizeof(pack::PushConstant));
+  place(header.specConstantsOffset, header.specConstantCount, packSpecConstants.size(), sizeof(uint32_t));
+  place(header.stringsOffset, header.stringsSize, strings.size(), 1);
+  for (size_t i = 0; i < shaders.size(); ++i) {
+    packShaders[i].codeOffset = offset;
+    offset += static_cast<uint32_t>(shaders[i].code.size() * sizeof(uint32_t));
+  }
+  header.fileSize = offset;
+
+  std::ofstream file{path, std::ios::binary | std::ios::trunc};
+  if (!file) {
+    LOG_ERR << "Couldn't open " << path.string() << " for writing" LOG_RST << std::endl;
+    return false;
+  }
+  auto const writeBytes = [&file](void const* data, size_t size) {
+    file.write(static_cast<char const*>(data), static_cast<std::streamsize>(size));
+  };
+  writeBytes(&header, sizeof(header));
+  writeBytes(packShaders.data(), packShaders.size() * sizeof(pack::Shader));
+  writeBytes(packEntryPoints.data(), packEntryPoints.size() * sizeof(pack::EntryPoint));
+  writeBytes(packBindings.data(), packBindings.size() * sizeof(pack::Binding));
+  writeBytes(packPushConstants.data(), packPushConstants.size() * sizeof(pack::PushConstant));
+  writeBytes(packSpecConstants.data(), packSpecConstants.size() * sizeof(uint32_t));
+  writeBytes(strings.data(), strings.size());
+  for (Input const& input : shaders) {
+    writeBytes(input.code.data(), input.code.size() * sizeof(uint32_t));
+  }
+  if (!file) {
+    LOG_ERR << "Failed writing " << path.string() << LOG_RST << std::endl;
+    return false;
+  }
+  return true;
+}
+
+}
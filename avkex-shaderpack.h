@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+
+// Shader pack binary layout, written by the avkex-shaderpack tool and mapped
+// as is by avkex::ShaderPack. Little endian, every section 4-byte aligned,
+// offsets in bytes from the start of the file.
+// [Header][Shader...][EntryPoint...][Binding...][PushConstant...][spec constant ids][strings][SPIR-V...]
+namespace avkex::pack {
+
+inline constexpr uint32_t MAGIC = 0x504B5641; // "AVKP"
+inline constexpr uint32_t VERSION = 2;
+
+// strings are null terminated, length excludes the terminator
+struct String {
+  uint32_t offset; // into the string section
+  uint32_t length;
+};
+
+struct Header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t fileSize;
+  uint32_t shaderCount;
+  uint32_t shadersOffset;
+  uint32_t entryPointCount;
+  uint32_t entryPointsOffset;
+  uint32_t bindingCount;
+  uint32_t bindingsOffset;
+  uint32_t pushConstantCount;
+  uint32_t pushConstantsOffset;
+  uint32_t specConstantCount;
+  uint32_t specConstantsOffset;
+  uint32_t stringsSize;
+  uint32_t stringsOffset;
+  uint32_t reserved;
+};
+
+// source and defines are what the shader was compiled from, for hot reload:
+// the source file path (empty if unknown) and the defines joined as
+// "NAME[=value],..." like on the avkex-shaderpack command line
+struct Shader {
+  String name;
+  String source;
+  String defines;
+  uint32_t codeOffset;
+  uint32_t codeWordCount;
+  uint32_t firstEntryPoint;
+  uint32_t entryPointCount;
+};
+
+// ranges index the Binding, PushConstant and spec constant id sections
+struct EntryPoint {
+  String name;
+  uint32_t stage; // VkShaderStageFlagBits
+  uint32_t localSize[3];
+  uint32_t firstBinding;
+  uint32_t bindingCount;
+  uint32_t firstPushConstant;
+  uint32_t pushConstantCount;
+  uint32_t firstSpecConstant;
+  uint32_t specConstantCount;
+};
+
+struct Binding {
+  uint32_t set;
+  uint32_t binding;
+  uint32_t descriptorType; // VkDescriptorType
+  uint32_t descriptorCount;
+};
+
+struct PushConstant {
+  uint32_t stageFlags;
+  uint32_t offset;
+  uint32_t size;
+};
+
+static_assert(sizeof(Header) == 64);
+static_assert(sizeof(Shader) == 40);
+static_assert(sizeof(EntryPoint) == 48);
+static_assert(sizeof(Binding) == 16);
+static_assert(sizeof(PushConstant) == 12);
+
+}
@@ -0,0 +1,143 @@
+#include "avkex-kernels.h"
+
+#include <array>
+
+using namespace avkex;
+
+namespace {
+
+// mirrors Params of shaders/smallsolve.comp
+struct SmallSolveParams {
+  VkDeviceAddress a;
+  VkDeviceAddress b;
+  VkDeviceAddress permutation;
+  VkDeviceAddress info;
+  uint32_t n;
+  uint32_t nrhs;
+  uint32_t batchCount;
+  uint32_t batchStride;
+  uint32_t mode;
+  uint32_t unitDiagonal;
+};
+static_assert(sizeof(SmallSolveParams) == 56);
+
+// smallsolve.comp SOLVE_* modes
+uint32_t constexpr SOLVE_LU = 0;
+uint32_t constexpr SOLVE_CHOLESKY = 1;
+uint32_t constexpr SOLVE_LOWER = 2;
+uint32_t constexpr SOLVE_UPPER = 3;
+
+// kernels per size class, rows per matrix rounded up to the class
+std::array<uint32_t, 4> constexpr SIZE_CLASSES{4, 8, 16, 32};
+static_assert(SIZE_CLASSES.back() == BatchedSolver::MAX_SIZE);
+
+enum : uint32_t { KERNEL_LU = 0, KERNEL_CHOLESKY, KERNEL_SOLVE, KERNEL_COUNT };
+
+}
+
+namespace avkex {
+
+// ------------------------------------------------------------------------------
+// BatchedSolverImpl
+// ------------------------------------------------------------------------------
+class BatchedSolverImpl {
+ public:
+  BatchedSolverImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines);
+
+  bool valid() const { return m_valid; }
+
+  void run(VulkanDevice const& dev, VkCommandBuffer commandBuffer, uint32_t kernel, SmallSolveParams const& params) const;
+
+ private:
+  bool m_valid = false;
+  // matrices per workgroup, per size class
+  std::array<uint32_t, SIZE_CLASSES.size()> m_matricesPerGroup{};
+  // [size class][kernel]
+  std::array<std::array<ComputeKernel, KERNEL_COUNT>, SIZE_CLASSES.size()> m_kernels;
+};
+
+BatchedSolverImpl::BatchedSolverImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines) {
+  uint32_t const workgroupSize = chooseWorkgroupSize(dev.profile());
+  std::array<std::string_view, KERNEL_COUNT> constexpr entries{"smallsolve_lu", "smallsolve_cholesky", "smallsolve_solve"};
+  std::vector<ComputeKernelDesc> descs;
+  descs.reserve(SIZE_CLASSES.size() * KERNEL_COUNT);
+  for (uint32_t sizeClass = 0; sizeClass < SIZE_CLASSES.size(); ++sizeClass) {
+    uint32_t const rows = SIZE_CLASSES[sizeClass];
+    m_matricesPerGroup[sizeClass] = std::max(1U, workgroupSize / rows);
+    for (uint32_t kernel = 0; kernel < KERNEL_COUNT; ++kernel) {
+      descs.push_back({&m_kernels[sizeClass][kernel], entries[kernel], sizeof(SmallSolveParams),
+        {m_matricesPerGroup[sizeClass] * rows, rows}});
+    }
+  }
+  m_valid = createComputeKernels(dev, shaders, pipelineCache, descs, pipelines);
+}
+
+void BatchedSolverImpl::run(VulkanDevice const& dev, VkCommandBuffer commandBuffer, uint32_t kernel, SmallSolveParams const& params) const {
+  assert(m_valid);
+  assert(params.n <= BatchedSolver::MAX_SIZE && params.batchStride >= params.batchCount);
+  assert(uint64_t{params.n} * std::max(params.n, params.nrhs) * params.batchStride <= UINT32_MAX);
+  if (params.n == 0 || params.batchCount == 0) {
+    return;
+  }
+  VulkanDeviceProfile const& profile = dev.profile();
+  uint32_t const sizeClass = static_cast<uint32_t>(
+    std::lower_bound(SIZE_CLASSES.begin(), SIZE_CLASSES.end(), params.n) - SIZE_CLASSES.begin());
+  uint32_t const groups = (params.batchCount + m_matricesPerGroup[sizeClass] - 1) / m_matricesPerGroup[sizeClass];
+  uint32_t const groupCountX = std::min(groups, profile.maxComputeWorkGroupCount[0]);
+  uint32_t const groupCountY = (groups + groupCountX - 1) / groupCountX;
+  assert(groupCountY <= profile.maxComputeWorkGroupCount[1]);
+  m_kernels[sizeClass][kernel].dispatch(commandBuffer, params, groupCountX, groupCountY);
+}
+
+// ------------------------------------------------------------------------------
+// BatchedSolver
+// ------------------------------------------------------------------------------
+
+BatchedSolver::BatchedSolver(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines)
+ : m_impl(std::make_unique<BatchedSolverImpl>(*dev, *shaders, pipelineCache, pipelines)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+BatchedSolver::~BatchedSolver() noexcept {
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+BatchedSolver::operator bool() const {
+  return m_impl->valid();
+}
+
+void BatchedSolver::factorLu(VkCommandBuffer commandBuffer, uint32_t n, uint32_t batchCount, uint32_t batchStride, VkDeviceAddress a,
+  VkDeviceAddress permutation, VkDeviceAddress info) {
+  SmallSolveParams const params{a, 0, permutation, info, n, 0, batchCount, batchStride, 0, 0};
+  m_impl->run(*m_dev, commandBuffer, KERNEL_LU, params);
+}
+
+void BatchedSolver::factorCholesky(VkCommandBuffer commandBuffer, uint32_t n, uint32_t batchCount, uint32_t batchStride,
+  VkDeviceAddress a, VkDeviceAddress info) {
+  SmallSolveParams const params{a, 0, 0, info, n, 0, batchCount, batchStride, 0, 0};
+  m_impl->run(*m_dev, commandBuffer, KERNEL_CHOLESKY, params);
+}
+
+void BatchedSolver::solveLu(VkCommandBuffer commandBuffer, uint32_t n, uint32_t nrhs, uint32_t batchCount, uint32_t batchStride,
+  VkDeviceAddress a, VkDeviceAddress permutation, VkDeviceAddress b) {
+  SmallSolveParams const params{a, b, permutation, 0, n, nrhs, batchCount, batchStride, SOLVE_LU, 0};
+  m_impl->run(*m_dev, commandBuffer, KERNEL_SOLVE, params);
+}
+
+void BatchedSolver::solveCholesky(VkCommandBuffer commandBuffer, uint32_t n, uint32_t nrhs, uint32_t batchCount, uint32_t batchStride,
+  VkDeviceAddress a, VkDeviceAddress b) {
+  SmallSolveParams const params{a, b, 0, 0, n, nrhs, batchCount, batchStride, SOLVE_CHOLESKY, 0};
+  m_impl->run(*m_dev, commandBuffer, KERNEL_SOLVE, params);
+}
+
+void BatchedSolver::solveTriangular(VkCommandBuffer commandBuffer, ETriangle triangle, bool unitDiagonal, uint32_t n, uint32_t nrhs,
+  uint32_t batchCount, uint32_t batchStride, VkDeviceAddress a, VkDeviceAddress b) {
+  uint32_t const mode = triangle == ETriangle::Lower ? SOLVE_LOWER : SOLVE_UPPER;
+  SmallSolveParams const params{a, b, 0, 0, n, nrhs, batchCount, batchStride, mode, unitDiagonal ? 1U : 0U};
+  m_impl->run(*m_dev, commandBuffer, KERNEL_SOLVE, params);
+}
+
+}
@@ -0,0 +1,294 @@
+#include "avkex-kernels.h"
+
+#include <numeric>
+
+using namespace avkex;
+
+namespace {
+
+// mirrors Params of shaders/spmv.comp
+struct SpmvParams {
+  VkDeviceAddress offsets;
+  VkDeviceAddress columns;
+  VkDeviceAddress values;
+  VkDeviceAddress rows;
+  VkDeviceAddress x;
+  VkDeviceAddress y;
+  uint32_t rowCount;
+  uint32_t sliceHeight;
+  float alpha;
+  float beta;
+};
+static_assert(sizeof(SpmvParams) == 64);
+
+// sigma of Auto, in slices
+uint32_t constexpr SORT_WINDOW_SLICES = 32;
+// Auto takes SELL up to stored entries = non zeros * MAX_SELL_PADDING
+double constexpr MAX_SELL_PADDING = 1.5;
+
+// checks the CSR structure in debug builds
+[[maybe_unused]] bool validCsr(CsrMatrix const& csr) {
+  if (csr.rowOffsets.size() != size_t{csr.rows} + 1 || csr.rowOffsets.front() != 0 ||
+      csr.rowOffsets.back() != csr.columnIndices.size() || csr.values.size() != csr.columnIndices.size()) {
+    return false;
+  }
+  return std::is_sorted(csr.rowOffsets.begin(), csr.rowOffsets.end()) &&
+         std::all_of(csr.columnIndices.begin(), csr.columnIndices.end(), [&csr](uint32_t column) { return column < csr.columns; });
+}
+
+}
+
+namespace avkex {
+
+SellMatrix convertCsrToSell(CsrMatrix const& csr, uint32_t sliceHeight, uint32_t sortWindow) {
+  assert(validCsr(csr) && sliceHeight > 0 && (sortWindow == 1 || sortWindow % sliceHeight == 0));
+  uint32_t const sliceCount = (csr.rows + sliceHeight - 1) / sliceHeight;
+  auto const length = [&csr](uint32_t row) { return csr.rowOffsets[row + 1] - csr.rowOffsets[row]; };
+
+  SellMatrix sell;
+  sell.rows = csr.rows;
+  sell.columns = csr.columns;
+  sell.sliceHeight = sliceHeight;
+  sell.rowOrder.assign(size_t{sliceCount} * sliceHeight, SELL_PADDING_ROW);
+  std::iota(sell.rowOrder.begin(), sell.rowOrder.begin() + csr.rows, 0U);
+  if (sortWindow > 1) {
+    for (uint32_t first = 0; first < csr.rows; first += std::min(sortWindow, csr.rows - first)) {
+      auto const begin = sell.rowOrder.begin() + first;
+      std::stable_sort(begin, begin + std::min(sortWindow, csr.rows - first),
+        [&length](uint32_t a, uint32_t b) { return length(a) > length(b); });
+    }
+  }
+
+  sell.sliceOffsets.resize(size_t{sliceCount} + 1);
+  sell.sliceOffsets[0] = 0;
+  for (uint32_t slice = 0; slice < sliceCount; ++slice) {
+    uint32_t width = 0;
+    for (uint32_t lane = 0; lane < sliceHeight; ++lane) {
+      uint32_t const row = sell.rowOrder[size_t{slice} * sliceHeight + lane];
+      width = row == SELL_PADDING_ROW ? width : std::max(width, length(row));
+    }
+    uint64_t const end = uint64_t{sell.sliceOffsets[slice]} + uint64_t{width} * sliceHeight;
+    assert(end <= UINT32_MAX);
+    sell.sliceOffsets[slice + 1] = static_cast<uint32_t>(end);
+  }
+  sell.columnIndices.assign(sell.sliceOffsets.back(), 0);
+  sell.values.assign(sell.sliceOffsets.back(), 0.f);
+  for (uint32_t slot = 0; slot < sell.rowOrder.size(); ++slot) {
+    uint32_t const row = sell.rowOrder[slot];
+    if (row == SELL_PADDING_ROW) {
+      continue;
+    }
+    uint32_t const base = sell.sliceOffsets[slot / sliceHeight] + slot % sliceHeight;
+    for (uint32_t k = 0; k < length(row); ++k) {
+      sell.columnIndices[base + k * sliceHeight] = csr.columnIndices[csr.rowOffsets[row] + k];
+      sell.values[base + k * sliceHeight] = csr.values[csr.rowOffsets[row] + k];
+    }
+  }
+  return sell;
+}
+
+// ------------------------------------------------------------------------------
+// SpmvMatrix
+// ------------------------------------------------------------------------------
+
+SpmvMatrix::SpmvMatrix(SpmvMatrix&& that) noexcept
+ : m_dev(std::exchange(that.m_dev, nullptr)),
+   m_format(that.m_format),
+   m_rows(that.m_rows),
+   m_columns(that.m_columns),
+   m_nonZeros(that.m_nonZeros),
+   m_storedEntries(that.m_storedEntries),
+   m_sliceHeight(that.m_sliceHeight),
+   m_offsets(std::exchange(that.m_offsets, {})),
+   m_columnIndices(std::exchange(that.m_columnIndices, {})),
+   m_values(std::exchange(that.m_values, {})),
+   m_rowOrder(std::exchange(that.m_rowOrder, {})) {}
+
+SpmvMatrix& SpmvMatrix::operator=(SpmvMatrix&& that) noexcept {
+  if (this != &that) {
+    reset();
+    m_dev = std::exchange(that.m_dev, nullptr);
+    m_format = that.m_format;
+    m_rows = that.m_rows;
+    m_columns = that.m_columns;
+    m_nonZeros = that.m_nonZeros;
+    m_storedEntries = that.m_storedEntries;
+    m_sliceHeight = that.m_sliceHeight;
+    m_offsets = std::exchange(that.m_offsets, {});
+    m_columnIndices = std::exchange(that.m_columnIndices, {});
+    m_values = std::exchange(that.m_values, {});
+    m_rowOrder = std::exchange(that.m_rowOrder, {});
+  }
+  return *this;
+}
+
+SpmvMatrix::~SpmvMatrix() noexcept {
+  reset();
+}
+
+void SpmvMatrix::reset() noexcept {
+  if (!m_dev) {
+    return;
+  }
+  for (DeviceBuffer* buffer : {&m_offsets, &m_columnIndices, &m_values, &m_rowOrder}) {
+    if (*buffer) {
+      destroyDeviceBuffer(*m_dev, *buffer);
+    }
+  }
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+// ------------------------------------------------------------------------------
+// SpmvImpl
+// ------------------------------------------------------------------------------
+class SpmvImpl {
+ public:
+  SpmvImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines);
+
+  bool valid() const { return m_valid; }
+  uint32_t sliceHeight() const { return m_sliceHeight; }
+
+  SpmvMatrix analyze(VulkanDevice& dev, ComputeStream& stream, CsrMatrix const& matrix, ESpmvFormat format) const;
+  void multiply(VulkanDevice const& dev, VkCommandBuffer commandBuffer, SpmvMatrix const& matrix, float alpha, VkDeviceAddress x,
+    float beta, VkDeviceAddress y) const;
+
+ private:
+  bool m_valid = false;
+  uint32_t m_workgroupSize = 0;
+  uint32_t m_sliceHeight = 0;
+  ComputeKernel m_csrSubgroup;
+  ComputeKernel m_csrWorkgroup;
+  ComputeKernel m_sell;
+};
+
+SpmvImpl::SpmvImpl(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines) {
+  VulkanDeviceProfile const& profile = dev.profile();
+  VkSubgroupFeatureFlags const required = VK_SUBGROUP_FEATURE_BASIC_BIT | VK_SUBGROUP_FEATURE_ARITHMETIC_BIT;
+  if (!(profile.subgroupSupportedStages & VK_SHADER_STAGE_COMPUTE_BIT) || (profile.subgroupSupportedOperations & required) != required) {
+    LOG_ERR << "Spmv needs subgroup arithmetic in compute shaders" LOG_RST << std::endl;
+    return;
+  }
+  m_workgroupSize = chooseWorkgroupSize(profile);
+  m_sliceHeight = std::max(1U, profile.subgroupSize);
+  m_valid = createComputeKernels(dev, shaders, pipelineCache, {
+    {&m_csrSubgroup, "spmv_csr", sizeof(SpmvParams), {m_workgroupSize, 0}},
+    {&m_csrWorkgroup, "spmv_csr", sizeof(SpmvParams), {m_workgroupSize, 1}},
+    {&m_sell, "spmv_sell", sizeof(SpmvParams), {m_workgroupSize}},
+  }, pipelines);
+}
+
+SpmvMatrix SpmvImpl::analyze(VulkanDevice& dev, ComputeStream& stream, CsrMatrix const& matrix, ESpmvFormat format) const {
+  assert(m_valid && validCsr(matrix));
+  uint32_t const nonZeros = static_cast<uint32_t>(matrix.columnIndices.size());
+  double const averageRow = matrix.rows > 0 ? static_cast<double>(nonZeros) / matrix.rows : 0.0;
+  SellMatrix sell;
+  if (format == ESpmvFormat::Auto || format == ESpmvFormat::Sell) {
+    sell = convertCsrToSell(matrix, m_sliceHeight, m_sliceHeight * SORT_WINDOW_SLICES);
+  }
+  if (format == ESpmvFormat::Auto) {
+    if (averageRow >= m_workgroupSize) {
+      format = ESpmvFormat::CsrWorkgroup;
+    } else if (sell.sliceOffsets.back() <= MAX_SELL_PADDING * nonZeros) {
+      format = ESpmvFormat::Sell;
+    } else {
+      format = ESpmvFormat::CsrSubgroup;
+    }
+  }
+  bool const isSell = format == ESpmvFormat::Sell;
+  std::vector<uint32_t> const& offsets = isSell ? sell.sliceOffsets : matrix.rowOffsets;
+  std::vector<uint32_t> const& columnIndices = isSell ? sell.columnIndices : matrix.columnIndices;
+  std::vector<float> const& values = isSell ? sell.values : matrix.values;
+
+  SpmvMatrix result;
+  dev.acquire();
+  result.m_dev = &dev;
+  result.m_format = format;
+  result.m_rows = matrix.rows;
+  result.m_columns = matrix.columns;
+  result.m_nonZeros = nonZeros;
+  result.m_storedEntries = static_cast<uint32_t>(columnIndices.size());
+  result.m_sliceHeight = isSell ? m_sliceHeight : 0;
+  // empty buffers still get an address
+  auto const upload = [&dev, &stream](DeviceBuffer& buffer, void const* data, VkDeviceSize size) {
+    buffer = createDeviceBuffer(dev, std::max<VkDeviceSize>(size, 4));
+    if (buffer && size > 0) {
+      stream.upload(buffer, data, size);
+    }
+    return static_cast<bool>(buffer);
+  };
+  bool ok = upload(result.m_offsets, offsets.data(), offsets.size() * sizeof(uint32_t)) &&
+            upload(result.m_columnIndices, columnIndices.data(), columnIndices.size() * sizeof(uint32_t)) &&
+            upload(result.m_values, values.data(), values.size() * sizeof(float));
+  if (ok && isSell) {
+    ok = upload(result.m_rowOrder, sell.rowOrder.data(), sell.rowOrder.size() * sizeof(uint32_t));
+  }
+  if (!ok) {
+    LOG_ERR << "Spmv: couldn't allocate the matrix" LOG_RST << std::endl;
+    return SpmvMatrix{};
+  }
+  return result;
+}
+
+void SpmvImpl::multiply(VulkanDevice const& dev, VkCommandBuffer commandBuffer, SpmvMatrix const& matrix, float alpha, VkDeviceAddress x,
+  float beta, VkDeviceAddress y) const {
+  assert(m_valid && matrix);
+  if (matrix.m_rows == 0) {
+    return;
+  }
+  VulkanDeviceProfile const& profile = dev.profile();
+  SpmvParams const params{matrix.m_offsets.address, matrix.m_columnIndices.address, matrix.m_values.address,
+    matrix.m_rowOrder.address, x, y, matrix.m_rows, matrix.m_sliceHeight, alpha, beta};
+  // grid-stride loops cover what the group count limit leaves out
+  uint32_t const maxGroups = profile.maxComputeWorkGroupCount[0];
+  switch (matrix.m_format) {
+  case ESpmvFormat::CsrSubgroup: {
+    uint32_t const rowsPerGroup = std::max(1U, m_workgroupSize / std::max(1U, profile.subgroupSize));
+    m_csrSubgroup.dispatch(commandBuffer, params, chooseGroupCount(profile, matrix.m_rows, rowsPerGroup, maxGroups));
+    break;
+  }
+  case ESpmvFormat::CsrWorkgroup:
+    m_csrWorkgroup.dispatch(commandBuffer, params, chooseGroupCount(profile, matrix.m_rows, 1, maxGroups));
+    break;
+  default: {
+    uint64_t const slots = uint64_t{(matrix.m_rows + m_sliceHeight - 1) / m_sliceHeight} * m_sliceHeight;
+    m_sell.dispatch(commandBuffer, params, chooseGroupCount(profile, slots, m_workgroupSize, maxGroups));
+    break;
+  }
+  }
+}
+
+// ------------------------------------------------------------------------------
+// Spmv
+// ------------------------------------------------------------------------------
+
+Spmv::Spmv(VulkanDevice* dev, VulkanShaderRegistry const* shaders, VkPipelineCache pipelineCache, VulkanComputePipelines* pipelines)
+ : m_impl(std::make_unique<SpmvImpl>(*dev, *shaders, pipelineCache, pipelines)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+Spmv::~Spmv() noexcept {
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+Spmv::operator bool() const {
+  return m_impl->valid();
+}
+
+uint32_t Spmv::sliceHeight() const {
+  return m_impl->sliceHeight();
+}
+
+SpmvMatrix Spmv::analyze(ComputeStream& stream, CsrMatrix const& matrix, ESpmvFormat format) const {
+  return m_impl->analyze(*m_dev, stream, matrix, format);
+}
+
+void Spmv::multiply(VkCommandBuffer commandBuffer, SpmvMatrix const& matrix, float alpha, VkDeviceAddress x, float beta,
+  VkDeviceAddress y) {
+  m_impl->multiply(*m_dev, commandBuffer, matrix, alpha, x, beta, y);
+}
+
+}
@@ -0,0 +1,408 @@
+#include "avkex.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <string>
+
+using namespace avkex;
+
+namespace {
+
+// database file: one winner per line
+//   <device uuid hex>-<driver version> <kernel> <nanoseconds> <name>=<value>...
+// lines of other devices are kept untouched, one file can serve a fleet
+inline constexpr char const* DATABASE_HEADER = "# avkex kernel tuning database v1";
+
+struct TuningEntry {
+  double nanoseconds = 0;
+  std::vector<std::pair<std::string, uint32_t>> values;
+};
+// key: "<device key> <kernel>"
+using TuningTable = std::map<std::string, TuningEntry, std::less<>>;
+
+std::string deviceKey(VulkanDeviceProfile const& profile) {
+  char hex[2 * VK_UUID_SIZE + 1];
+  for (uint32_t i = 0; i < VK_UUID_SIZE; ++i) {
+    std::snprintf(hex + 2 * i, 3, "%02x", profile.deviceUUID[i]);
+  }
+  return std::string(hex) + '-' + std::to_string(profile.driverVersion);
+}
+
+bool isToken(std::string_view str) {
+  return !str.empty() && std::none_of(str.begin(), str.end(), [](char c) {
+    return c == '=' || static_cast<unsigned char>(c) <= ' ';
+  });
+}
+
+// malformed lines are skipped, the next save drops them
+TuningTable loadTable(std::filesystem::path const& path) {
+  TuningTable table;
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream in(line);
+    std::string device;
+    std::string kernel;
+    TuningEntry entry;
+    if (!(in >> device >> kernel >> entry.nanoseconds)) {
+      continue;
+    }
+    std::string token;
+    bool valid = true;
+    while (valid && in >> token) {
+      size_t const eq = token.find('=');
+      valid = eq != std::string::npos && eq > 0;
+      if (valid) {
+        entry.values.emplace_back(token.substr(0, eq), static_cast<uint32_t>(std::strtoul(token.c_str() + eq + 1, nullptr, 10)));
+      }
+    }
+    if (valid) {
+      table[device + ' ' + kernel] = std::move(entry);
+    }
+  }
+  return table;
+}
+
+bool saveTable(std::filesystem::path const& path, TuningTable const& table) {
+  // written aside then renamed, a concurrent reader never sees half a database
+  std::filesystem::path temp = path;
+  temp += ".tmp";
+  {
+    std::ofstream file{temp, std::ios::trunc};
+    file << DATABASE_HEADER << '\n';
+    for (auto const& [key, entry] : table) {
+      file << key << ' ' << entry.nanoseconds;
+      for (auto const& [name, value] : entry.values) {
+        file << ' ' << name << '=' << value;
+      }
+      file << '\n';
+    }
+    if (!file) {
+      return false;
+    }
+  }
+  std::error_code ec;
+  std::filesystem::rename(temp, path, ec);
+  return !ec;
+}
+
+// stored values in parameter order, if the entry still matches the space
+std::optional<std::vector<uint32_t>> matchSpace(TuningEntry const& entry, TuningSpace const& space) {
+  if (entry.values.size() != space.parameters.size()) {
+    return std::nullopt;
+  }
+  std::vector<uint32_t> values;
+  values.reserve(space.parameters.size());
+  for (TuningParameter const& parameter : space.parameters) {
+    auto const it = std::find_if(entry.values.begin(), entry.values.end(), [&](auto const& pair) { return pair.first == parameter.name; });
+    if (it == entry.values.end() ||
+        std::find(parameter.candidates.begin(), parameter.candidates.end(), it->second) == parameter.candidates.end()) {
+      return std::nullopt;
+    }
+    values.push_back(it->second);
+  }
+  return values;
+}
+
+// cartesian product of the candidates, first parameter varying fastest
+std::vector<std::vector<uint32_t>> enumerateSpace(TuningSpace const& space) {
+  std::vector<std::vector<uint32_t>> combinations;
+  std::vector<size_t> indices(space.parameters.size(), 0);
+  for (TuningParameter const& parameter : space.parameters) {
+    if (parameter.candidates.empty()) {
+      return combinations;
+    }
+  }
+  while (true) {
+    std::vector<uint32_t> values(space.parameters.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+      values[i] = space.parameters[i].candidates[indices[i]];
+    }
+    if (!space.isValid || space.isValid(values)) {
+      combinations.push_back(std::move(values));
+    }
+    size_t digit = 0;
+    for (; digit < indices.size(); ++digit) {
+      if (++indices[digit] < space.parameters[digit].candidates.size())
+        break;
+      indices[digit] = 0;
+    }
+    if (digit == indices.size()) {
+      return combinations;
+    }
+  }
+}
+
+std::filesystem::path defaultDatabasePath() {
+  std::optional<std::filesystem::path> const exeDir = os::getExecutableDirectory();
+  return exeDir ? *exeDir / KernelTuner::DEFAULT_DATABASE_NAME : std::filesystem::path{KernelTuner::DEFAULT_DATABASE_NAME};
+}
+
+}
+
+namespace avkex {
+
+// ------------------------------------------------------------------------------
+// KernelTunerImpl
+// ------------------------------------------------------------------------------
+class KernelTunerImpl {
+ public:
+  KernelTunerImpl(VulkanDevice& dev, VulkanShaderRegistry const* shaders, std::filesystem::path databasePath, uint32_t repetitions);
+  void cleanup(VulkanDevice& dev) noexcept;
+
+  TuningResult tune(VulkanDevice& dev, TuningSpace const& space, VkPipelineCache pipelineCache);
+  void invalidate(std::string_view kernel);
+
+ private:
+  // median device time of the candidate in timestamp ticks
+  std::optional<uint64_t> timeCandidate(VulkanDevice& dev, VkPipeline pipeline, TuningSpace const& space, std::vector<uint32_t> const& values);
+  // reloads the file first so winners stored meanwhile by other processes survive
+  void store(std::string const& key, TuningEntry entry);
+
+  VulkanShaderRegistry const* m_shaders;
+  std::filesystem::path m_databasePath;
+  uint32_t m_repetitions;
+  std::string m_deviceKey;
+  double m_timestampPeriod;
+  uint64_t m_timestampMask;
+
+  std::mutex m_mtx;
+  TuningTable m_table;
+  VkCommandPool m_commandPool = VK_NULL_HANDLE;
+  VkCommandBuffer m_commandBuffer = VK_NULL_HANDLE;
+  VkQueryPool m_queryPool = VK_NULL_HANDLE; // 2 timestamps per repetition
+  VkFence m_fence = VK_NULL_HANDLE;
+};
+
+KernelTunerImpl::KernelTunerImpl(VulkanDevice& dev, VulkanShaderRegistry const* shaders, std::filesystem::path databasePath, uint32_t repetitions)
+ : m_shaders(shaders), m_databasePath(databasePath.empty() ? defaultDatabasePath() : std::move(databasePath)), m_repetitions(std::max(1U, repetitions)),
+   m_deviceKey(deviceKey(dev.profile())), m_timestampPeriod(dev.profile().timestampPeriod) {
+  uint32_t const validBits = dev.profile().computeTimestampValidBits;
+  m_timestampMask = validBits >= 64 ? ~0ULL : (1ULL << validBits) - 1;
+  m_table = loadTable(m_databasePath);
+  if (validBits == 0) {
+    LOG_ERR << "The compute queue has no timestamps, kernels can't be tuned" LOG_RST << std::endl;
+    return;
+  }
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex = dev.computeQueueFamilyIndex();
+  AVK_VK_RST(dev.api()->vkCreateCommandPool(dev.device(), &poolInfo, nullptr, &m_commandPool));
+
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = m_commandPool;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = 1;
+  AVK_VK_RST(dev.api()->vkAllocateCommandBuffers(dev.device(), &allocInfo, &m_commandBuffer));
+
+  VkQueryPoolCreateInfo queryInfo{};
+  queryInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  queryInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  queryInfo.queryCount = 2 * m_repetitions;
+  AVK_VK_RST(dev.api()->vkCreateQueryPool(dev.device(), &queryInfo, nullptr, &m_queryPool));
+
+  VkFenceCreateInfo fenceInfo{};
+  fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  AVK_VK_RST(dev.api()->vkCreateFence(dev.device(), &fenceInfo, nullptr, &m_fence));
+}
+
+void KernelTunerImpl::cleanup(VulkanDevice& dev) noexcept {
+  // every submission was waited on, nothing is pending
+  if (m_fence != VK_NULL_HANDLE) dev.api()->vkDestroyFence(dev.device(), m_fence, nullptr);
+  if (m_queryPool != VK_NULL_HANDLE) dev.api()->vkDestroyQueryPool(dev.device(), m_queryPool, nullptr);
+  if (m_commandPool != VK_NULL_HANDLE) dev.api()->vkDestroyCommandPool(dev.device(), m_commandPool, nullptr);
+  m_fence = VK_NULL_HANDLE;
+  m_queryPool = VK_NULL_HANDLE;
+  m_commandPool = VK_NULL_HANDLE;
+  m_commandBuffer = VK_NULL_HANDLE;
+}
+
+TuningResult KernelTunerImpl::tune(VulkanDevice& dev, TuningSpace const& space, VkPipelineCache pipelineCache) {
+  TuningResult result;
+  std::string const key = m_deviceKey + ' ' + space.kernel;
+  bool const persistent = isToken(space.kernel) &&
+    std::all_of(space.parameters.begin(), space.parameters.end(), [](TuningParameter const& p) { return isToken(p.name); });
+  if (!persistent) {
+    LOG_ERR << "Kernel '" << space.kernel << "' or one of its parameters isn't a valid database key, its winner won't be stored" LOG_RST << std::endl;
+  }
+
+  std::lock_guard lock{m_mtx};
+  if (auto const it = m_table.find(key); persistent && it != m_table.end()) {
+    if (std::optional<std::vector<uint32_t>> values = matchSpace(it->second, space)) {
+      result.values = std::move(*values);
+      result.nanoseconds = it->second.nanoseconds;
+      result.fromDatabase = true;
+      return result;
+    }
+  }
+  if (m_queryPool == VK_NULL_HANDLE || !space.record) {
+    return result;
+  }
+
+  std::vector<std::vector<uint32_t>> const combinations = enumerateSpace(space);
+  std::vector<ComputePipelineRequest> requests;
+  requests.reserve(combinations.size());
+  for (std::vector<uint32_t> const& values : combinations) {
+    requests.push_back(KernelTuner::specialize(space, values));
+  }
+  // compiled in parallel up front, timed one by one
+  std::vector<ComputePipelineResult> const pipelines = createComputePipelines(dev, *m_shaders, pipelineCache, requests);
+
+  uint64_t bestTicks = UINT64_MAX;
+  for (size_t i = 0; i < combinations.size(); ++i) {
+    VkPipeline const pipeline = pipelines[i].pipeline;
+    if (pipeline == VK_NULL_HANDLE) {
+      continue;
+    }
+    std::optional<uint64_t> const ticks = timeCandidate(dev, pipeline, space, combinations[i]);
+    dev.api()->vkDestroyPipeline(dev.device(), pipeline, nullptr);
+    if (ticks && *ticks < bestTicks) {
+      bestTicks = *ticks;
+      result.values = combinations[i];
+    }
+  }
+  if (result.values.empty()) {
+    LOG_ERR << "No candidate of kernel " << space.kernel << " could run" LOG_RST << std::endl;
+    return result;
+  }
+  result.nanoseconds = static_cast<double>(bestTicks) * m_timestampPeriod;
+
+  std::ostringstream summary;
+  TuningEntry entry;
+  entry.nanoseconds = result.nanoseconds;
+  for (size_t i = 0; i < space.parameters.size(); ++i) {
+    entry.values.emplace_back(space.parameters[i].name, result.values[i]);
+    summary << ' ' << space.parameters[i].name << '=' << result.values[i];
+  }
+  LOG_LOG << "Tuned " << space.kernel << " over " << combinations.size() << " candidates:" << summary.str() << " (" << result.nanoseconds << " ns)" << std::endl;
+  if (persistent) {
+    store(key, std::move(entry));
+  }
+  return result;
+}
+
+void KernelTunerImpl::invalidate(std::string_view kernel) {
+  std::string key = m_deviceKey + ' ';
+  key += kernel;
+  std::lock_guard lock{m_mtx};
+  m_table = loadTable(m_databasePath);
+  if (m_table.erase(key) > 0 && !saveTable(m_databasePath, m_table)) {
+    LOG_ERR << "Couldn't write tuning database " << m_databasePath.string() << LOG_RST << std::endl;
+  }
+}
+
+std::optional<uint64_t> KernelTunerImpl::timeCandidate(VulkanDevice& dev, VkPipeline pipeline, TuningSpace const& space, std::vector<uint32_t> const& values) {
+  VolkDeviceTable const& api = *dev.api();
+  uint32_t const queryCount = 2 * m_repetitions;
+  AVK_VK_RST(api.vkResetCommandBuffer(m_commandBuffer, 0));
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  AVK_VK_RST(api.vkBeginCommandBuffer(m_commandBuffer, &beginInfo));
+  api.vkCmdResetQueryPool(m_commandBuffer, m_queryPool, 0, queryCount);
+  api.vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+  // runs are serialized: a timestamp at the compute stage is written once all
+  // previous compute work is done, the barrier keeps runs from overlapping
+  // and orders their memory accesses
+  VkMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  space.record(m_commandBuffer, values); // warm up caches and clocks
+  for (uint32_t r = 0; r < m_repetitions; ++r) {
+    api.vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+    api.vkCmdWriteTimestamp(m_commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, m_queryPool, 2 * r);
+    space.record(m_commandBuffer, values);
+    api.vkCmdWriteTimestamp(m_commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, m_queryPool, 2 * r + 1);
+  }
+  AVK_VK_RST(api.vkEndCommandBuffer(m_commandBuffer));
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &m_commandBuffer;
+  AVK_VK_RST(api.vkQueueSubmit(dev.computeQueue(), 1, &submitInfo, m_fence));
+  AVK_VK_RST(api.vkWaitForFences(dev.device(), 1, &m_fence, VK_TRUE, UINT64_MAX));
+  AVK_VK_RST(api.vkResetFences(dev.device(), 1, &m_fence));
+
+  std::vector<uint64_t> timestamps(queryCount);
+  VkResult const res = api.vkGetQueryPoolResults(dev.device(), m_queryPool, 0, queryCount, timestamps.size() * sizeof(uint64_t),
+    timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+  if (res != VK_SUCCESS) {
+    return std::nullopt;
+  }
+  std::vector<uint64_t> ticks(m_repetitions);
+  for (uint32_t r = 0; r < m_repetitions; ++r) {
+    // masked difference handles a counter wrapping between the two writes
+    ticks[r] = (timestamps[2 * r + 1] - timestamps[2 * r]) & m_timestampMask;
+  }
+  std::nth_element(ticks.begin(), ticks.begin() + ticks.size() / 2, ticks.end());
+  return ticks[ticks.size() / 2];
+}
+
+void KernelTunerImpl::store(std::string const& key, TuningEntry entry) {
+  m_table = loadTable(m_databasePath);
+  m_table[key] = std::move(entry);
+  if (!saveTable(m_databasePath, m_table)) {
+    LOG_ERR << "Couldn't write tuning database " << m_databasePath.string() << LOG_RST << std::endl;
+  }
+}
+
+// ------------------------------------------------------------------------------
+// KernelTuner
+// ------------------------------------------------------------------------------
+
+KernelTuner::KernelTuner(VulkanDevice* dev, VulkanShaderRegistry const* shaders, std::filesystem::path databasePath, uint32_t repetitions)
+ : m_impl(std::make_unique<KernelTunerImpl>(*dev, shaders, std::move(databasePath), repetitions)) {
+  dev->acquire();
+  m_dev = dev;
+}
+
+KernelTuner::~KernelTuner() noexcept {
+  m_impl->cleanup(*m_dev);
+  m_impl.reset();
+  m_dev->release();
+  m_dev = nullptr;
+}
+
+TuningResult KernelTuner::tune(TuningSpace const& space, VkPipelineCache pipelineCache) {
+  return m_impl->tune(*m_dev, space, pipelineCache);
+}
+
+void KernelTuner::invalidate(std::string_view kernel) {
+  m_impl->invalidate(kernel);
+}
+
+ComputePipelineRequest KernelTuner::specialize(TuningSpace const& space, std::vector<uint32_t> const& values) {
+  assert(values.size() == space.parameters.size());
+  ComputePipelineRequest request;
+  request.shader = space.shader;
+  request.entryPoint = space.entryPoint;
+  request.layout = space.layout;
+  request.specializationEntries.resize(values.size());
+  request.specializationData.resize(values.size() * sizeof(uint32_t));
+  for (size_t i = 0; i < values.size(); ++i) {
+    VkSpecializationMapEntry& entry = request.specializationEntries[i];
+    entry.constantID = space.parameters[i].specConstantId;
+    entry.offset = static_cast<uint32_t>(i * sizeof(uint32_t));
+    entry.size = sizeof(uint32_t);
+    std::memcpy(request.specializationData.data() + entry.offset, &values[i], sizeof(uint32_t));
+  }
+  return request;
+}
+
+}
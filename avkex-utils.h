@@ -5,11 +5,40 @@
 #include <atomic>
 #include <cassert>
 #include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
 #include <thread>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  include <immintrin.h>
+#endif
+#if __cplusplus < 202002L && defined(__linux__)
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
 namespace avkex {
 
+// std::hardware_destructive_interference_size is not available everywhere
+inline constexpr size_t CACHE_LINE_SIZE = 64;
+
+// owner tag of per thread state. Unlike std::thread::id, never reused
+inline uint64_t uniqueThreadId() {
+  static std::atomic<uint64_t> s_nextId = 1;
+  thread_local uint64_t const t_id = s_nextId.fetch_add(1, std::memory_order_relaxed);
+  return t_id;
+}
+
+// entries of the thread local caches of EpochDomain and SegmentedMpscQueue.
+// Evicted entries are found again by owner through the object's own list,
+// so a thread touching many short lived objects doesn't grow its cache
+inline constexpr size_t THREAD_CACHE_CAPACITY = 8;
+
 // ------------------------------------------------------------------------------
 // RingBuffer
 // ------------------------------------------------------------------------------
@@ -47,6 +76,11 @@ class RingBuffer {
     ++m_start;
     --m_size;
   }
+  void pop_front(size_t count) {
+    assert(count <= m_size);
+    m_start += count;
+    m_size -= count;
+  }
   void clear() {
     m_buffer.clear();
     m_start = 0;
@@ -70,51 +104,607 @@ class RingBuffer {
 };
 
 // ------------------------------------------------------------------------------
-// AtomicVector
+// Bit Utilities
+// ------------------------------------------------------------------------------
+
+// floor(log2(x)), x > 0. Plain loop to stay portable (no std::bit_width in C++17)
+constexpr inline uint32_t log2Floor(uint64_t x) {
+  assert(x > 0);
+  uint32_t result = 0;
+  while (x >>= 1)
+    ++result;
+  return result;
+}
+
+// ceil(log2(x)), x > 0
+constexpr inline uint32_t log2Ceil(uint64_t x) {
+  uint32_t const floor = log2Floor(x);
+  return (x & (x - 1)) == 0 ? floor : floor + 1;
+}
+
+constexpr inline bool isPowerOfTwo(uint64_t x) { return x != 0 && (x & (x - 1)) == 0; }
+
+// ------------------------------------------------------------------------------
+// SpscRingBuffer
 // ------------------------------------------------------------------------------
 
+// Bounded single producer single consumer ring buffer, lock-free and wait-free.
+// - capacity is rounded up to a power of two, indices are free running and
+//   masked on access
+// - producer and consumer indices live on their own cache line, each side keeps
+//   a cached copy of the other side's index to avoid touching its cache line on
+//   every operation
+// - batch operations publish the whole batch with a single release store
 template <typename T>
-struct AtomicVector {
+class SpscRingBuffer {
+  static_assert(std::is_default_constructible_v<T> && std::is_nothrow_move_assignable_v<T>);
+
+ public:
+  explicit SpscRingBuffer(size_t capacity)
+   : m_capacity(size_t{1} << log2Ceil(capacity)), m_mask(m_capacity - 1), m_buffer(new T[m_capacity]) {}
+  SpscRingBuffer(SpscRingBuffer const&) = delete;
+  SpscRingBuffer(SpscRingBuffer&&) noexcept = delete;
+  SpscRingBuffer& operator=(SpscRingBuffer const&) = delete;
+  SpscRingBuffer& operator=(SpscRingBuffer&&) noexcept = delete;
+  ~SpscRingBuffer() noexcept { delete[] m_buffer; }
+
+  size_t capacity() const noexcept { return m_capacity; }
+  // approximate if called while the other side is active
+  size_t size() const noexcept {
+    return m_tail.value.load(std::memory_order_acquire) - m_head.value.load(std::memory_order_acquire);
+  }
+
+  // producer only
+  bool tryPush(T value) { return tryPush(&value, 1) == 1; }
+  // producer only. returns how many elements were moved in (possibly 0)
+  size_t tryPush(T* values, size_t count) {
+    size_t const tail = m_tail.value.load(std::memory_order_relaxed);
+    size_t freeSlots = m_capacity - (tail - m_producerCachedHead);
+    if (freeSlots < count) {
+      m_producerCachedHead = m_head.value.load(std::memory_order_acquire);
+      freeSlots = m_capacity - (tail - m_producerCachedHead);
+    }
+    size_t const n = count < freeSlots ? count : freeSlots;
+    for (size_t i = 0; i < n; ++i) {
+      m_buffer[(tail + i) & m_mask] = std::move(values[i]);
+    }
+    if (n > 0)
+      m_tail.value.store(tail + n, std::memory_order_release);
+    return n;
+  }
+
+  // consumer only
+  bool tryPop(T& out) { return tryPop(&out, 1) == 1; }
+  // consumer only. returns how many elements were moved out (possibly 0)
+  size_t tryPop(T* out, size_t maxCount) {
+    size_t const head = m_head.value.load(std::memory_order_relaxed);
+    size_t available = m_consumerCachedTail - head;
+    if (available < maxCount) {
+      m_consumerCachedTail = m_tail.value.load(std::memory_order_acquire);
+      available = m_consumerCachedTail - head;
+    }
+    size_t const n = maxCount < available ? maxCount : available;
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = std::move(m_buffer[(head + i) & m_mask]);
+    }
+    if (n > 0)
+      m_head.value.store(head + n, std::memory_order_release);
+    return n;
+  }
+
+ private:
+  struct alignas(CACHE_LINE_SIZE) PaddedIndex {
+    std::atomic<size_t> value = 0;
+  };
+
+  size_t const m_capacity;
+  size_t const m_mask;
+  T* const m_buffer;
+
+  PaddedIndex m_head; // consumer writes
+  alignas(CACHE_LINE_SIZE) size_t m_consumerCachedTail = 0;
+  PaddedIndex m_tail; // producer writes
+  alignas(CACHE_LINE_SIZE) size_t m_producerCachedHead = 0;
+};
+
+// ------------------------------------------------------------------------------
+// MpmcRingBuffer
+// ------------------------------------------------------------------------------
+
+// Bounded multi producer multi consumer ring buffer (Dmitry Vyukov's design).
+// - each cell carries a sequence number telling whether it's free for the
+//   producer of a given lap or full for the consumer of that lap
+// - producers (consumers) claim positions with a CAS on the enqueue (dequeue)
+//   index. Batches claim a run of consecutive ready cells with a single CAS
+// - lock-free, not wait-free: a thread preempted between claim and publish
+//   delays the threads which need its cell on the next lap
+// - capacity is rounded up to a power of two
+// https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+template <typename T>
+class MpmcRingBuffer {
+  static_assert(std::is_default_constructible_v<T> && std::is_nothrow_move_assignable_v<T>);
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+ public:
+  explicit MpmcRingBuffer(size_t capacity)
+   : m_mask((size_t{1} << log2Ceil(capacity)) - 1), m_cells(new Cell[m_mask + 1]) {
+    for (size_t i = 0; i <= m_mask; ++i) {
+      m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+  MpmcRingBuffer(MpmcRingBuffer const&) = delete;
+  MpmcRingBuffer(MpmcRingBuffer&&) noexcept = delete;
+  MpmcRingBuffer& operator=(MpmcRingBuffer const&) = delete;
+  MpmcRingBuffer& operator=(MpmcRingBuffer&&) noexcept = delete;
+  ~MpmcRingBuffer() noexcept { delete[] m_cells; }
+
+  size_t capacity() const noexcept { return m_mask + 1; }
+
+  bool tryPush(T value) { return tryPush(&value, 1) == 1; }
+  // returns how many elements were moved in (possibly 0)
+  size_t tryPush(T* values, size_t count) {
+    if (count == 0)
+      return 0;
+    size_t pos = m_enqueuePos.value.load(std::memory_order_relaxed);
+    for (;;) {
+      // count the consecutive free cells starting at pos
+      size_t n = 0;
+      intptr_t diff = 0;
+      for (; n < count; ++n) {
+        size_t const seq = m_cells[(pos + n) & m_mask].sequence.load(std::memory_order_acquire);
+        diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + n);
+        if (diff != 0)
+          break;
+      }
+      if (n == 0) {
+        if (diff < 0)
+          return 0; // full
+        pos = m_enqueuePos.value.load(std::memory_order_relaxed); // pos already claimed
+        continue;
+      }
+      if (m_enqueuePos.value.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed, std::memory_order_relaxed)) {
+        for (size_t i = 0; i < n; ++i) {
+          Cell& cell = m_cells[(pos + i) & m_mask];
+          cell.data = std::move(values[i]);
+          cell.sequence.store(pos + i + 1, std::memory_order_release);
+        }
+        return n;
+      }
+      // CAS failure reloaded pos
+    }
+  }
+
+  bool tryPop(T& out) { return tryPop(&out, 1) == 1; }
+  // returns how many elements were moved out (possibly 0)
+  size_t tryPop(T* out, size_t maxCount) {
+    if (maxCount == 0)
+      return 0;
+    size_t pos = m_dequeuePos.value.load(std::memory_order_relaxed);
+    for (;;) {
+      // count the consecutive full cells starting at pos
+      size_t n = 0;
+      intptr_t diff = 0;
+      for (; n < maxCount; ++n) {
+        size_t const seq = m_cells[(pos + n) & m_mask].sequence.load(std::memory_order_acquire);
+        diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + n + 1);
+        if (diff != 0)
+          break;
+      }
+      if (n == 0) {
+        if (diff < 0)
+          return 0; // empty
+        pos = m_dequeuePos.value.load(std::memory_order_relaxed); // pos already claimed
+        continue;
+      }
+      if (m_dequeuePos.value.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed, std::memory_order_relaxed)) {
+        for (size_t i = 0; i < n; ++i) {
+          Cell& cell = m_cells[(pos + i) & m_mask];
+          out[i] = std::move(cell.data);
+          cell.sequence.store(pos + i + m_mask + 1, std::memory_order_release);
+        }
+        return n;
+      }
+    }
+  }
+
+ private:
+  struct alignas(CACHE_LINE_SIZE) PaddedIndex {
+    std::atomic<size_t> value = 0;
+  };
+
+  size_t const m_mask;
+  Cell* const m_cells;
+  PaddedIndex m_enqueuePos;
+  PaddedIndex m_dequeuePos;
+};
+
+// ------------------------------------------------------------------------------
+// Spin Then Park
+// ------------------------------------------------------------------------------
+
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+  _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+// Bounded exponential backoff. spinOnce returns false once the budget is spent,
+// at which point the caller should park (atomicWait) instead of burning a core
+class SpinWait {
+ public:
+  static constexpr uint32_t PAUSE_ROUNDS = 7; // 1 + 2 + ... + 64 pauses
+  static constexpr uint32_t YIELD_ROUNDS = 2;
+
+  bool spinOnce() {
+    if (m_round < PAUSE_ROUNDS) {
+      for (uint32_t i = 0; i < (1U << m_round); ++i) {
+        cpuRelax();
+      }
+    } else if (m_round < PAUSE_ROUNDS + YIELD_ROUNDS) {
+      std::this_thread::yield();
+    } else {
+      return false;
+    }
+    ++m_round;
+    return true;
+  }
+
+  void reset() { m_round = 0; }
+
+ private:
+  uint32_t m_round = 0;
+};
+
+// Block while word == expected. May return spuriously, callers loop.
+// C++20 uses std::atomic::wait, C++17 on Linux a private futex, anything else
+// degrades to a yield
+template <typename I>
+inline void atomicWait(std::atomic<I>& word, I expected) {
+  static_assert(std::is_integral_v<I> && sizeof(I) == sizeof(uint32_t) && sizeof(std::atomic<I>) == sizeof(I));
+#if __cplusplus >= 202002L
+  word.wait(expected, std::memory_order_relaxed);
+#elif defined(__linux__)
+  syscall(SYS_futex, reinterpret_cast<I*>(&word), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+#else
+  if (word.load(std::memory_order_relaxed) == expected)
+    std::this_thread::yield();
+#endif
+}
+
+template <typename I>
+inline void atomicNotifyAll(std::atomic<I>& word) {
+  static_assert(std::is_integral_v<I> && sizeof(I) == sizeof(uint32_t) && sizeof(std::atomic<I>) == sizeof(I));
+#if __cplusplus >= 202002L
+  word.notify_all();
+#elif defined(__linux__)
+  syscall(SYS_futex, reinterpret_cast<I*>(&word), FUTEX_WAKE_PRIVATE, INT32_MAX, nullptr, nullptr, 0);
+#else
+  (void)word;
+#endif
+}
+
+// ------------------------------------------------------------------------------
+// AdaptiveSharedMutex
+// ------------------------------------------------------------------------------
+
+// Reader/writer lock on a single 32-bit word, spins with bounded backoff, then
+// parks on the word. Meets SharedMutex, usable with std::shared_lock/lock_guard.
+// - writer preference: a waiting writer stops new readers from entering
+// - a PARKED bit lets unlockers skip the wake syscall when nobody sleeps
+// - not recursive, a reader must not upgrade
+class AdaptiveSharedMutex {
+  static constexpr uint32_t WRITER = 1U;
+  static constexpr uint32_t WRITER_WAITING = 1U << 1;
+  static constexpr uint32_t PARKED = 1U << 2;
+  static constexpr uint32_t READER = 1U << 3;
+  static constexpr uint32_t READER_MASK = ~(READER - 1);
+
+ public:
+  AdaptiveSharedMutex() = default;
+  AdaptiveSharedMutex(AdaptiveSharedMutex const&) = delete;
+  AdaptiveSharedMutex& operator=(AdaptiveSharedMutex const&) = delete;
+
+  bool try_lock() {
+    uint32_t state = m_state.load(std::memory_order_relaxed);
+    return (state & (WRITER | READER_MASK)) == 0 &&
+      m_state.compare_exchange_strong(state, (state | WRITER) & ~WRITER_WAITING, std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  void lock() {
+    SpinWait spin;
+    uint32_t state = m_state.load(std::memory_order_relaxed);
+    while (true) {
+      if ((state & (WRITER | READER_MASK)) == 0) {
+        // clear WRITER_WAITING, other waiting writers set it again on their next pass
+        if (m_state.compare_exchange_weak(state, (state | WRITER) & ~WRITER_WAITING, std::memory_order_acquire, std::memory_order_relaxed))
+          return;
+        continue;
+      }
+      if ((state & WRITER_WAITING) == 0) {
+        m_state.compare_exchange_weak(state, state | WRITER_WAITING, std::memory_order_relaxed, std::memory_order_relaxed);
+        continue;
+      }
+      state = spinOrPark(spin, state);
+    }
+  }
+
+  void unlock() {
+    assert(m_state.load(std::memory_order_relaxed) & WRITER);
+    uint32_t const prev = m_state.fetch_and(~(WRITER | PARKED), std::memory_order_release);
+    if (prev & PARKED)
+      atomicNotifyAll(m_state);
+  }
+
+  bool try_lock_shared() {
+    uint32_t state = m_state.load(std::memory_order_relaxed);
+    return (state & (WRITER | WRITER_WAITING)) == 0 &&
+      m_state.compare_exchange_strong(state, state + READER, std::memory_order_acquire, std::memory_order_relaxed);
+  }
+
+  void lock_shared() {
+    SpinWait spin;
+    uint32_t state = m_state.load(std::memory_order_relaxed);
+    while (true) {
+      if ((state & (WRITER | WRITER_WAITING)) == 0) {
+        if (m_state.compare_exchange_weak(state, state + READER, std::memory_order_acquire, std::memory_order_relaxed))
+          return;
+        continue;
+      }
+      state = spinOrPark(spin, state);
+    }
+  }
+
+  void unlock_shared() {
+    assert(m_state.load(std::memory_order_relaxed) & READER_MASK);
+    uint32_t const prev = m_state.fetch_sub(READER, std::memory_order_release);
+    if ((prev & READER_MASK) == READER && (prev & PARKED)) {
+      // last reader out wakes the parked writers (and readers queued behind them)
+      if (m_state.fetch_and(~PARKED, std::memory_order_relaxed) & PARKED)
+        atomicNotifyAll(m_state);
+    }
+  }
+
+  // snapshot, for assertions
+  bool isLocked() const { return m_state.load(std::memory_order_relaxed) & (WRITER | READER_MASK); }
+
+ private:
+  // returns the reloaded state
+  uint32_t spinOrPark(SpinWait& spin, uint32_t state) {
+    if (spin.spinOnce())
+      return m_state.load(std::memory_order_relaxed);
+    if ((state & PARKED) == 0 && !m_state.compare_exchange_weak(state, state | PARKED, std::memory_order_relaxed, std::memory_order_relaxed))
+      return state;
+    atomicWait(m_state, state | PARKED);
+    spin.reset();
+    return m_state.load(std::memory_order_relaxed);
+  }
+
+  std::atomic<uint32_t> m_state = 0;
+  static_assert(std::atomic<uint32_t>::is_always_lock_free);
+};
+
+// ------------------------------------------------------------------------------
+// SeqLocked
+// ------------------------------------------------------------------------------
+
+// Seqlock protected value for read-mostly data: readers never write shared
+// memory, they copy the value and retry if a writer raced them. Writers
+// serialize on an AdaptiveSharedMutex.
+// The value is stored as relaxed atomic words so the racing copy is not a data race
+template <typename T>
+class SeqLocked {
+  static_assert(std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>);
+  static constexpr size_t WORD_COUNT = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+ public:
+  explicit SeqLocked(T const& value = T{}) { storeWords(value); }
+  SeqLocked(SeqLocked const&) = delete;
+  SeqLocked& operator=(SeqLocked const&) = delete;
+
+  T load() const {
+    SpinWait spin;
+    while (true) {
+      uint32_t const before = m_sequence.load(std::memory_order_acquire);
+      if ((before & 1) == 0) {
+        uint64_t words[WORD_COUNT];
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+          words[i] = m_words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (m_sequence.load(std::memory_order_relaxed) == before) {
+          T value;
+          std::memcpy(&value, words, sizeof(T));
+          return value;
+        }
+      }
+      if (!spin.spinOnce())
+        std::this_thread::yield(); // writers hold the sequence odd for a copy only
+    }
+  }
+
+  void store(T const& value) {
+    update([&value](T& current) { current = value; });
+  }
+
+  // func(T&) runs with writers excluded, readers retry meanwhile
+  template <typename F>
+  void update(F&& func) {
+    std::lock_guard<AdaptiveSharedMutex> lk{m_writeLock};
+    T value;
+    uint64_t words[WORD_COUNT];
+    for (size_t i = 0; i < WORD_COUNT; ++i) {
+      words[i] = m_words[i].load(std::memory_order_relaxed);
+    }
+    std::memcpy(&value, words, sizeof(T));
+    func(value);
+
+    uint32_t const sequence = m_sequence.load(std::memory_order_relaxed);
+    m_sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    storeWords(value);
+    m_sequence.store(sequence + 2, std::memory_order_release);
+  }
+
  private:
-  static constexpr uint32_t ATOMIC_FREE = 0;
-  static constexpr uint32_t ATOMIC_READING = 2;
-  static constexpr uint32_t ATOMIC_WRITING = 1;
+  void storeWords(T const& value) {
+    uint64_t words[WORD_COUNT]{};
+    std::memcpy(words, &value, sizeof(T));
+    for (size_t i = 0; i < WORD_COUNT; ++i) {
+      m_words[i].store(words[i], std::memory_order_relaxed);
+    }
+  }
+
+  alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> m_sequence = 0;
+  std::atomic<uint64_t> m_words[WORD_COUNT];
+  AdaptiveSharedMutex m_writeLock;
+};
+
+// ------------------------------------------------------------------------------
+// EpochDomain
+// ------------------------------------------------------------------------------
+
+// Epoch based reclamation for read-mostly structures published through atomic
+// pointers. Readers pin() around their accesses: no lock, no allocation after a
+// thread's first pin. Writers unlink, take retire() as the epoch of what they
+// unlinked and free it once isSafe(epoch).
+// - each reader thread owns a cache line sized slot for the domain lifetime
+// - pins do not nest
+class EpochDomain {
+  static constexpr uint64_t QUIESCENT = UINT64_MAX;
+
+  struct alignas(CACHE_LINE_SIZE) Participant {
+    std::atomic<uint64_t> epoch = QUIESCENT;
+    Participant* next = nullptr;
+    uint64_t owner = 0; // uniqueThreadId
+  };
+
+  struct CacheEntry {
+    uint64_t domainId;
+    Participant* participant;
+  };
 
+ public:
+  class Guard {
+   public:
+    Guard(Guard const&) = delete;
+    Guard& operator=(Guard const&) = delete;
+    ~Guard() noexcept { m_participant->epoch.store(QUIESCENT, std::memory_order_release); }
+
+   private:
+    friend class EpochDomain;
+    explicit Guard(Participant* participant) : m_participant(participant) {}
+    Participant* m_participant;
+  };
+
+  EpochDomain() : m_id(s_nextId.fetch_add(1, std::memory_order_relaxed)) {}
+  EpochDomain(EpochDomain const&) = delete;
+  EpochDomain& operator=(EpochDomain const&) = delete;
+  ~EpochDomain() noexcept {
+    Participant* participant = m_participants.load(std::memory_order_acquire);
+    while (participant) {
+      assert(participant->epoch.load(std::memory_order_relaxed) == QUIESCENT);
+      delete std::exchange(participant, participant->next);
+    }
+  }
+
+  [[nodiscard]] Guard pin() {
+    Participant* participant = localParticipant();
+    assert(participant->epoch.load(std::memory_order_relaxed) == QUIESCENT && "pins do not nest");
+    participant->epoch.store(m_globalEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    // pairs with the fence in isSafe: either the writer sees this pin or this
+    // reader sees what was unlinked before the epoch it read was retired
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return Guard{participant};
+  }
+
+  // call after unlinking, returns the epoch of the unlinked memory
+  uint64_t retire() { return m_globalEpoch.fetch_add(1, std::memory_order_seq_cst) + 1; }
+
+  // no reader pinned before the retirement of epoch is still pinned
+  bool isSafe(uint64_t epoch) const {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (Participant* participant = m_participants.load(std::memory_order_acquire); participant; participant = participant->next) {
+      if (participant->epoch.load(std::memory_order_acquire) < epoch)
+        return false;
+    }
+    return true;
+  }
+
+  // blocks until everything unlinked so far can be freed
+  void synchronize() {
+    uint64_t const epoch = retire();
+    SpinWait spin;
+    while (!isSafe(epoch)) {
+      if (!spin.spinOnce())
+        std::this_thread::yield();
+    }
+  }
+
+ private:
+  Participant* localParticipant() {
+    thread_local std::vector<CacheEntry> t_cache;
+    for (CacheEntry const& entry : t_cache) {
+      if (entry.domainId == m_id)
+        return entry.participant;
+    }
+    // evicted or first pin: only this thread publishes participants it owns
+    uint64_t const owner = uniqueThreadId();
+    Participant* participant = m_participants.load(std::memory_order_acquire);
+    while (participant && participant->owner != owner) {
+      participant = participant->next;
+    }
+    if (!participant) {
+      participant = new Participant;
+      participant->owner = owner;
+      participant->next = m_participants.load(std::memory_order_relaxed);
+      while (!m_participants.compare_exchange_weak(participant->next, participant, std::memory_order_release, std::memory_order_relaxed)) {
+      }
+    }
+    if (t_cache.size() == THREAD_CACHE_CAPACITY)
+      t_cache.erase(t_cache.begin());
+    t_cache.push_back({m_id, participant});
+    return participant;
+  }
+
+  static inline std::atomic<uint64_t> s_nextId = 1;
+
+  std::atomic<uint64_t> m_globalEpoch = 1;
+  std::atomic<Participant*> m_participants = nullptr;
+  uint64_t m_id;
+};
+
+// ------------------------------------------------------------------------------
+// AtomicVector
+// ------------------------------------------------------------------------------
+
+// std::vector guarded by an AdaptiveSharedMutex
+template <typename T>
+struct AtomicVector {
  public:
   explicit AtomicVector(uint32_t cap) { m_vec.reserve(cap); }
 
-  // Unchecked move semantics: The application relies on assertions to be correct
-  AtomicVector(AtomicVector&& that) noexcept 
-   : m_vec(std::move(that.m_vec)),
-     m_state(that.m_state.load(std::memory_order_relaxed)),
-     m_refCount(that.m_refCount.load(std::memory_order_relaxed)) {
+  // Unchecked move semantics: The application relies on assertions to be correct.
+  // Both vectors must be unlocked, the lock itself is not moved
+  AtomicVector(AtomicVector&& that) noexcept : m_vec(std::move(that.m_vec)) {
 #ifdef AVK_DEBUG
-    uint32_t const state = that.m_state.load(std::memory_order_relaxed);
-    assert(state == ATOMIC_FREE || state == ATOMIC_WRITING);
-    assert(that.m_refCount.load(std::memory_order_relaxed) == 0);
+    assert(!that.m_lock.isLocked());
 #endif
-
-    that.m_state.store(ATOMIC_FREE, std::memory_order_relaxed);
-    that.m_refCount.store(0, std::memory_order_relaxed);
   }
 
   AtomicVector& operator=(AtomicVector&& that) noexcept {
     if (this != &that) {
       // this and that should be free
 #ifdef AVK_DEBUG
-      uint32_t const thisState = m_state.load(std::memory_order_relaxed);
-      uint32_t const thatState = that.m_state.load(std::memory_order_relaxed);
-      assert(thisState == ATOMIC_FREE || thisState == ATOMIC_WRITING);
-      assert(thatState == ATOMIC_FREE || thatState == ATOMIC_WRITING);
-      assert(m_refCount.load(std::memory_order_relaxed) == 0);
-      assert(that.m_refCount.load(std::memory_order_relaxed) == 0);
+      assert(!m_lock.isLocked());
+      assert(!that.m_lock.isLocked());
 #endif
       m_vec = std::move(that.m_vec);
-      m_state.store(that.m_state.load(std::memory_order_relaxed), std::memory_order_relaxed);
-      m_refCount.store(that.m_refCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
-
-      that.m_state.store(ATOMIC_FREE, std::memory_order_relaxed);
-      that.m_refCount.store(0, std::memory_order_relaxed);
     }
     return *this;
   }
@@ -134,70 +724,218 @@ struct AtomicVector {
   }
 
   std::vector<T> const& acquireRead() {
-    while (true) {
-      uint32_t state = m_state.load(std::memory_order_relaxed);
-      if (state != ATOMIC_FREE && state != ATOMIC_READING) {
-        std::this_thread::yield();
-        continue;
-      }
-        
-      if (!m_state.compare_exchange_weak(state, ATOMIC_READING, std::memory_order_relaxed, std::memory_order_relaxed)) {
-        std::this_thread::yield();
-        continue;
-      }
-      
-      m_refCount.fetch_add(1, std::memory_order_acquire); // memory barrier here
-      return m_vec;
-    }
-    // [[unreachable]]; TODO Actual compiler dependent attribute
+    m_lock.lock_shared();
     return m_vec;
   }
 
   std::vector<T>& acquireWrite() {
-    while (true) {
-      uint32_t state = m_state.load(std::memory_order_relaxed);
-      if (state != ATOMIC_FREE) {
-        std::this_thread::yield();
-        continue;
-      }
+    m_lock.lock();
+    return m_vec;
+  }
 
-      if (!m_state.compare_exchange_weak(state, ATOMIC_WRITING, std::memory_order_relaxed, std::memory_order_relaxed)) {
-        std::this_thread::yield();
-        continue;
+  void releaseWrite() { m_lock.unlock(); }
+  void releaseRead() { m_lock.unlock_shared(); }
+
+ private:
+  std::vector<T> m_vec;
+  AdaptiveSharedMutex m_lock;
+};
+
+// ------------------------------------------------------------------------------
+// SegmentedMpscQueue
+// ------------------------------------------------------------------------------
+
+// Unbounded multi producer single consumer queue made of fixed size chunks.
+// - every producer thread gets its own lane (a single producer chunk list),
+//   found through a bounded thread local cache, hence producers never contend with
+//   each other, never block and never fail (unless the heap does)
+// - FIFO order is guaranteed per producer thread, not across threads
+// - the consumer frees (or hands back to the lane as spare) whole chunks once
+//   they're fully consumed and the producer moved on. No memmove ever happens
+// - consumers are serialized with a try-lock: a concurrent consume call returns
+//   immediately, as someone else is already draining the queue
+// - lanes are kept until the queue dies, so prefer long lived producer threads
+// - moving the queue requires no producer or consumer to be active
+template <typename T, uint32_t ChunkCapacity = 256>
+class SegmentedMpscQueue {
+  static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
+  static_assert(ChunkCapacity > 0);
+
+  struct Chunk {
+    // written by producer only, read by consumer
+    std::atomic<uint32_t> count = 0;
+    std::atomic<Chunk*> next = nullptr;
+    alignas(T) unsigned char storage[ChunkCapacity * sizeof(T)];
+
+    T* slot(uint32_t i) { return std::launder(reinterpret_cast<T*>(storage) + i); }
+  };
+
+  struct Lane {
+    // producer side
+    alignas(CACHE_LINE_SIZE) Chunk* tail = nullptr;
+    // consumer side
+    alignas(CACHE_LINE_SIZE) Chunk* head = nullptr;
+    uint32_t consumed = 0;
+    // single slot exchange of a consumed chunk from consumer to producer
+    std::atomic<Chunk*> spare = nullptr;
+    // immutable once the lane is published
+    Lane* nextLane = nullptr;
+    uint64_t owner = 0; // uniqueThreadId
+  };
+
+ public:
+  SegmentedMpscQueue() : m_id(s_nextId.fetch_add(1, std::memory_order_relaxed)) {}
+  SegmentedMpscQueue(SegmentedMpscQueue const&) = delete;
+  SegmentedMpscQueue& operator=(SegmentedMpscQueue const&) = delete;
+
+  // Unchecked move semantics: The application relies on assertions to be correct
+  SegmentedMpscQueue(SegmentedMpscQueue&& that) noexcept
+   : m_lanes(that.m_lanes.exchange(nullptr, std::memory_order_relaxed)), m_id(that.m_id) {
+    that.m_id = s_nextId.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  SegmentedMpscQueue& operator=(SegmentedMpscQueue&& that) noexcept {
+    if (this != &that) {
+      freeLanes();
+      m_lanes.store(that.m_lanes.exchange(nullptr, std::memory_order_relaxed), std::memory_order_relaxed);
+      m_id = that.m_id;
+      that.m_id = s_nextId.fetch_add(1, std::memory_order_relaxed);
+    }
+    return *this;
+  }
+
+  ~SegmentedMpscQueue() noexcept { freeLanes(); }
+
+  template <typename... Args>
+  void push(Args&&... args) {
+    Lane* const lane = threadLane();
+    Chunk* tail = lane->tail;
+    uint32_t count = tail->count.load(std::memory_order_relaxed); // we're the only writer
+    if (count == ChunkCapacity) {
+      Chunk* fresh = lane->spare.exchange(nullptr, std::memory_order_acquire);
+      if (fresh) {
+        fresh->count.store(0, std::memory_order_relaxed);
+        fresh->next.store(nullptr, std::memory_order_relaxed);
+      } else {
+        fresh = new Chunk();
       }
- 
-      m_state.load(std::memory_order_acquire); // memory barrier here
-      return m_vec;
+      tail->next.store(fresh, std::memory_order_release);
+      lane->tail = fresh;
+      tail = fresh;
+      count = 0;
     }
-    // [[unreachable]]; TODO Actual compiler dependent attribute
-    return m_vec;
+    new (tail->storage + count * sizeof(T)) T{std::forward<Args>(args)...};
+    tail->count.store(count + 1, std::memory_order_release);
   }
 
-  void releaseWrite() {
-#ifdef AVK_DEBUG
-    assert(m_state.load(std::memory_order_relaxed) == ATOMIC_WRITING);
-#endif
-    m_state.store(ATOMIC_FREE, std::memory_order_release); // memory barrier here
+  // visits the items of each lane in order, popping them while func returns
+  // true. When func returns false, moves on to the next lane.
+  // returns false if another thread is consuming
+  template <typename F> // TODO enable_if callable with T const&, returning bool
+  bool consumeWhile(F&& func) {
+    if (m_consuming.test_and_set(std::memory_order_acquire))
+      return false;
+    for (Lane* lane = m_lanes.load(std::memory_order_acquire); lane; lane = lane->nextLane) {
+      while (true) {
+        Chunk* const head = lane->head;
+        uint32_t const published = head->count.load(std::memory_order_acquire);
+        bool stopped = false;
+        while (lane->consumed < published) {
+          if (!func(static_cast<T const&>(*head->slot(lane->consumed)))) {
+            stopped = true;
+            break;
+          }
+          ++lane->consumed;
+        }
+        if (stopped || lane->consumed < ChunkCapacity)
+          break;
+        // chunk fully consumed. If the producer moved on, it won't touch it anymore
+        Chunk* const next = head->next.load(std::memory_order_acquire);
+        if (!next)
+          break;
+        lane->head = next;
+        lane->consumed = 0;
+        if (Chunk* old = lane->spare.exchange(head, std::memory_order_release); old) {
+          delete old;
+        }
+      }
+    }
+    m_consuming.clear(std::memory_order_release);
+    return true;
   }
 
-  void releaseRead() {
-#ifdef AVK_DEBUG
-    assert(m_state.load(std::memory_order_relaxed) == ATOMIC_READING);
-    assert(m_refCount.load(std::memory_order_relaxed) > 0);
-#endif
-    uint32_t const prevCount = m_refCount.fetch_sub(1, std::memory_order_relaxed);
-    if (prevCount == 1) {
-      m_state.store(ATOMIC_FREE, std::memory_order_release); // memory barrier here
-    } else {
-      m_state.store(ATOMIC_READING, std::memory_order_release); // memory barrier here
+  // conservative: returns false while another thread is consuming
+  bool empty() {
+    if (m_consuming.test_and_set(std::memory_order_acquire))
+      return false;
+    bool result = true;
+    for (Lane* lane = m_lanes.load(std::memory_order_acquire); lane && result; lane = lane->nextLane) {
+      Chunk* const head = lane->head;
+      result = lane->consumed == head->count.load(std::memory_order_acquire) 
+            && !head->next.load(std::memory_order_acquire);
     }
+    m_consuming.clear(std::memory_order_release);
+    return result;
   }
 
  private:
-  std::vector<T> m_vec;
-  std::atomic<uint32_t> m_state = 0;
-  std::atomic<uint32_t> m_refCount = 0;
-  static_assert(std::atomic<uint32_t>::is_always_lock_free);
+  Lane* threadLane() {
+    struct CacheEntry {
+      uint64_t queueId;
+      Lane* lane;
+    };
+    // queue ids are never reused, hence entries of dead queues never match.
+    // They age out of the bounded cache instead
+    thread_local std::vector<CacheEntry> cache;
+    for (CacheEntry const& entry : cache) {
+      if (entry.queueId == m_id)
+        return entry.lane;
+    }
+
+    // slow path: the entry was evicted, or first push of this thread on this
+    // queue. A second lane would break the per thread order, so look first
+    uint64_t const owner = uniqueThreadId();
+    Lane* lane = m_lanes.load(std::memory_order_acquire);
+    while (lane && lane->owner != owner) {
+      lane = lane->nextLane;
+    }
+    if (!lane) {
+      // lock-free prepend
+      lane = new Lane();
+      lane->tail = lane->head = new Chunk();
+      lane->owner = owner;
+      Lane* first = m_lanes.load(std::memory_order_relaxed);
+      do {
+        lane->nextLane = first;
+      } while (!m_lanes.compare_exchange_weak(first, lane, std::memory_order_release, std::memory_order_relaxed));
+    }
+    if (cache.size() == THREAD_CACHE_CAPACITY)
+      cache.erase(cache.begin());
+    cache.push_back({m_id, lane});
+    return lane;
+  }
+
+  void freeLanes() noexcept {
+    Lane* lane = m_lanes.exchange(nullptr, std::memory_order_acquire);
+    while (lane) {
+      Chunk* chunk = lane->head;
+      while (chunk) {
+        Chunk* const next = chunk->next.load(std::memory_order_relaxed);
+        delete chunk;
+        chunk = next;
+      }
+      delete lane->spare.load(std::memory_order_relaxed);
+      Lane* const nextLane = lane->nextLane;
+      delete lane;
+      lane = nextLane;
+    }
+  }
+
+  static inline std::atomic<uint64_t> s_nextId = 1;
+
+  std::atomic<Lane*> m_lanes = nullptr;
+  uint64_t m_id;
+  std::atomic_flag m_consuming = ATOMIC_FLAG_INIT;
 };
 
 // ------------------------------------------------------------------------------
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "avkex-macros.h" // required before volk
+#include "avkex-os.h"
 #include "avkex-utils.h"
 
 #include <volk.h>
@@ -9,8 +10,14 @@
 #include <spirv_reflect.h>
 
 #include <atomic>
+#include <chrono>
 #include <functional>
+#include <future>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
 namespace avkex {
@@ -18,6 +25,14 @@ namespace avkex {
 enum class EVulkanOptionalExtensionSupport : uint64_t {
   MemoryBudget = static_cast<uint64_t>(1) << 0,
   DedicatedAllocation = static_cast<uint64_t>(1) << 1,
+  // with its dependencies VK_KHR_dynamic_rendering, VK_KHR_depth_stencil_resolve, VK_KHR_create_renderpass2
+  Maintenance5 = static_cast<uint64_t>(1) << 2,
+  // VK_KHR_16bit_storage and VK_KHR_shader_float16_int8 with storageBuffer16BitAccess and shaderFloat16
+  Float16 = static_cast<uint64_t>(1) << 3,
+  // VK_KHR_cooperative_matrix with cooperativeMatrix, in compute shaders
+  CooperativeMatrix = static_cast<uint64_t>(1) << 4,
+  // VK_KHR_shader_atomic_int64 with shaderBufferInt64Atomics, and shaderInt64
+  Int64Atomics = static_cast<uint64_t>(1) << 5,
 };
 using VulkanExtBits = std::underlying_type_t<EVulkanOptionalExtensionSupport>;
 
@@ -43,6 +58,10 @@ struct VulkanPhysicalDeviceQueryResult {
 
   bool hasMemoryBudgetExt() const { return optionalExtensions & EVulkanOptionalExtensionSupport::MemoryBudget; }
   bool hasDedicatedAllocationExt() const { return optionalExtensions & EVulkanOptionalExtensionSupport::DedicatedAllocation; }
+  bool hasMaintenance5Ext() const { return optionalExtensions & EVulkanOptionalExtensionSupport::Maintenance5; }
+  bool hasFloat16Ext() const { return optionalExtensions & EVulkanOptionalExtensionSupport::Float16; }
+  bool hasCooperativeMatrixExt() const { return optionalExtensions & EVulkanOptionalExtensionSupport::CooperativeMatrix; }
+  bool hasInt64AtomicsExt() const { return optionalExtensions & EVulkanOptionalExtensionSupport::Int64Atomics; }
 
   EVulkanOptionalExtensionSupport optionalExtensions;
   // TODO can be modified in future for surface support on linux and windows
@@ -56,6 +75,68 @@ struct VulkanPhysicalDeviceQueryResult {
   int32_t score;
 };
 
+// Compute relevant properties and limits, captured once at device creation.
+// Trivially copyable: launch code reads it to pick tile sizes and grid shapes
+struct VulkanDeviceProfile {
+  struct MemoryHeap {
+    VkDeviceSize size;
+    bool deviceLocal;
+  };
+  struct MemoryType {
+    uint32_t heapIndex;
+    VkMemoryPropertyFlags propertyFlags;
+  };
+
+  // identity
+  char deviceName[VK_MAX_PHYSICAL_DEVICE_NAME_SIZE];
+  uint32_t vendorID;
+  uint32_t deviceID;
+  VkPhysicalDeviceType deviceType;
+  uint32_t apiVersion;
+  uint32_t driverVersion; // vendor specific encoding
+  uint8_t deviceUUID[VK_UUID_SIZE];
+  uint8_t driverUUID[VK_UUID_SIZE];
+
+  // subgroups
+  uint32_t subgroupSize;
+  VkShaderStageFlags subgroupSupportedStages;
+  VkSubgroupFeatureFlags subgroupSupportedOperations;
+
+  // compute limits
+  uint32_t maxComputeWorkGroupCount[3];
+  uint32_t maxComputeWorkGroupSize[3];
+  uint32_t maxComputeWorkGroupInvocations;
+  uint32_t maxComputeSharedMemorySize;
+  uint32_t maxPushConstantsSize;
+  uint32_t maxStorageBufferRange;
+  uint32_t maxUniformBufferRange;
+  uint32_t maxBoundDescriptorSets;
+
+  // alignments
+  VkDeviceSize minStorageBufferOffsetAlignment;
+  VkDeviceSize minUniformBufferOffsetAlignment;
+  VkDeviceSize nonCoherentAtomSize;
+  VkDeviceSize optimalBufferCopyOffsetAlignment;
+  size_t minMemoryMapAlignment;
+
+  // timestamps, on the compute queue family. 0 valid bits: no timestamps
+  float timestampPeriod; // nanoseconds per tick
+  uint32_t computeTimestampValidBits;
+
+  // memory
+  uint32_t memoryHeapCount;
+  MemoryHeap memoryHeaps[VK_MAX_MEMORY_HEAPS];
+  uint32_t memoryTypeCount;
+  MemoryType memoryTypes[VK_MAX_MEMORY_TYPES];
+  // device local and host visible memory over the legacy 256 MiB window
+  bool hasResizableBar;
+  // every device local memory type is host visible (integrated, Apple)
+  bool isUnifiedMemory;
+
+  std::string toJson() const;
+};
+VulkanDeviceProfile captureDeviceProfile(VkPhysicalDevice physicalDevice, uint32_t computeQueueFamilyIndex);
+
 struct VulkanDeviceInfo {
   VkPhysicalDevice physicalDevice;
   VulkanPhysicalDeviceQueryResult queryResult;
@@ -102,6 +183,18 @@ class VulkanDevice {
   VkDevice device() const { return m_device; }
   VolkDeviceTable const* api() const { return m_table.get(); }
   VmaAllocator allocator() const { return m_allocator; }
+  // the allocator is externally synchronized: hold this around every vma* call.
+  // Innermost lock, take no other lock while holding it
+  [[nodiscard]] std::unique_lock<std::mutex> lockAllocator() const { return std::unique_lock{m_allocatorMtx}; }
+  // shader stages can take SPIR-V inline, no VkShaderModule needed
+  bool hasMaintenance5() const { return m_optionalExtensions & EVulkanOptionalExtensionSupport::Maintenance5; }
+  // f16 in storage buffers and shader arithmetic
+  bool hasFloat16() const { return m_optionalExtensions & EVulkanOptionalExtensionSupport::Float16; }
+  // subgroup scope matrices, shapes from vkGetPhysicalDeviceCooperativeMatrixPropertiesKHR
+  bool hasCooperativeMatrix() const { return m_optionalExtensions & EVulkanOptionalExtensionSupport::CooperativeMatrix; }
+  // 64-bit integers in shaders, atomics on them in storage buffers
+  bool hasInt64Atomics() const { return m_optionalExtensions & EVulkanOptionalExtensionSupport::Int64Atomics; }
+  VulkanDeviceProfile const& profile() const { return m_profile; }
 
   VkQueue graphicsQueue() const { return m_graphicsQueue; }
   uint32_t graphicsQueueFamilyIndex() const { return m_graphicsQueueFamilyIndex; }
@@ -120,6 +213,9 @@ class VulkanDevice {
   VkDevice m_device = VK_NULL_HANDLE;
   std::unique_ptr<VolkDeviceTable> m_table;
   VmaAllocator m_allocator = VK_NULL_HANDLE;
+  mutable std::mutex m_allocatorMtx; // not moved, no vma call runs during a move
+  EVulkanOptionalExtensionSupport m_optionalExtensions{};
+  VulkanDeviceProfile m_profile{};
 
   // queues (TODO more generic? maybe?)
   VkQueue m_graphicsQueue = VK_NULL_HANDLE;
@@ -136,8 +232,65 @@ class VulkanDevice {
   static_assert(std::atomic_int::is_always_lock_free); // for .exchange
 };
 
+// non dispatchable handles are pointers on 64-bit platforms and uint64_t otherwise
+template <typename H>
+inline uint64_t vkHandleBits(H handle) {
+  if constexpr (std::is_pointer_v<H>) {
+    return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(handle));
+  } else {
+    return handle;
+  }
+}
+
+template <typename H>
+inline H vkHandleFromBits(uint64_t bits) {
+  if constexpr (std::is_pointer_v<H>) {
+    return reinterpret_cast<H>(static_cast<uintptr_t>(bits));
+  } else {
+    return bits;
+  }
+}
+
+// object types handled by the discard pool deferred deletion table (memory
+// backed resources, ie buffers and images, go through VMA instead)
+enum class EVulkanObjectType : uint32_t {
+  Pipeline,
+  PipelineLayout,
+  PipelineCache,
+  DescriptorSetLayout,
+  DescriptorPool,
+  ShaderModule,
+  Event,
+  ImageView,
+  BufferView,
+  Sampler,
+  QueryPool,
+  Count
+};
+
 // Discard Pool Based Resource Management
 // - Warning: assumes VkSemaphore last enough
+// - discarding is lock-free and never fails once the semaphore is registered
+//   (returns false only for unregistered semaphores). Resources discarded by
+//   the same thread should have non decreasing timeline values
+// - Buffer recycling: buffers discarded with `recycleBuffer` are not destroyed
+//   once their timeline value is reached, but moved into power of two size
+//   class free lists keyed by (usage, memory properties). `acquireBuffer` pops
+//   from those before asking VMA for a new buffer
+//   - bytes retained by the free lists are capped by a high water mark. Over it,
+//     retired buffers are destroyed as usual
+//   - a free buffer which wasn't reused for `maxIdleCollects` calls to `collect`
+//     is destroyed (idle trimming)
+// - Optional background collector thread: frees resources as soon as their
+//   semaphore reaches their value (wait-any on the smallest pending value of
+//   each semaphore), so the application doesn't need to call `collect`.
+//   Passes are at least `minInterval` apart. While idle, it sleeps until the
+//   next discard or `idleTimeout`. Unregistering a semaphore may block for up
+//   to `idleTimeout` while the collector finishes waiting on it
+// - Non memory backed objects (see EVulkanObjectType) go into a deferred deletion
+//   table, which stores, per object type, a readyValue column and a handle
+//   column (structure of arrays), and destroys them in type batched loops.
+//   Pipelines and friends can then be retired without an idle wait
 class VulkanDiscardPoolImpl;
 class VulkanDiscardPool {
  public:
@@ -148,16 +301,42 @@ class VulkanDiscardPool {
   VulkanDiscardPool& operator=(VulkanDiscardPool &&) noexcept = delete;
   ~VulkanDiscardPool() noexcept;
 
-  bool registerTimelineSemaphore(VkSemaphore sem, uint32_t minResCap = 256, uint32_t compactionThreshold = 1024, uint32_t maxResCap = 2048);
+  bool registerTimelineSemaphore(VkSemaphore sem);
   bool unregisterTimelineSemaphore(VkSemaphore sem);
 
   void collect();
   void collectSemaphore(VkSemaphore sem);
 
+  void startCollectorThread(std::chrono::microseconds minInterval = std::chrono::microseconds(500), std::chrono::milliseconds idleTimeout = std::chrono::milliseconds(10));
+  void stopCollectorThread();
+
   bool discardBuffer(VkSemaphore sem, uint64_t readyValue, VkBuffer buffer, VmaAllocation alloc);
   bool discardImage(VkSemaphore sem, uint64_t readyValue, VkImage image, VmaAllocation alloc);
   // ...
 
+  bool discardObject(VkSemaphore sem, uint64_t readyValue, EVulkanObjectType type, uint64_t handleBits);
+  bool discardPipeline(VkSemaphore sem, uint64_t readyValue, VkPipeline pipeline) { return discardObject(sem, readyValue, EVulkanObjectType::Pipeline, vkHandleBits(pipeline)); }
+  bool discardPipelineLayout(VkSemaphore sem, uint64_t readyValue, VkPipelineLayout layout) { return discardObject(sem, readyValue, EVulkanObjectType::PipelineLayout, vkHandleBits(layout)); }
+  bool discardPipelineCache(VkSemaphore sem, uint64_t readyValue, VkPipelineCache cache) { return discardObject(sem, readyValue, EVulkanObjectType::PipelineCache, vkHandleBits(cache)); }
+  bool discardDescriptorSetLayout(VkSemaphore sem, uint64_t readyValue, VkDescriptorSetLayout layout) { return discardObject(sem, readyValue, EVulkanObjectType::DescriptorSetLayout, vkHandleBits(layout)); }
+  bool discardDescriptorPool(VkSemaphore sem, uint64_t readyValue, VkDescriptorPool pool) { return discardObject(sem, readyValue, EVulkanObjectType::DescriptorPool, vkHandleBits(pool)); }
+  bool discardShaderModule(VkSemaphore sem, uint64_t readyValue, VkShaderModule shaderModule) { return discardObject(sem, readyValue, EVulkanObjectType::ShaderModule, vkHandleBits(shaderModule)); }
+  bool discardEvent(VkSemaphore sem, uint64_t readyValue, VkEvent event) { return discardObject(sem, readyValue, EVulkanObjectType::Event, vkHandleBits(event)); }
+  bool discardImageView(VkSemaphore sem, uint64_t readyValue, VkImageView view) { return discardObject(sem, readyValue, EVulkanObjectType::ImageView, vkHandleBits(view)); }
+  bool discardBufferView(VkSemaphore sem, uint64_t readyValue, VkBufferView view) { return discardObject(sem, readyValue, EVulkanObjectType::BufferView, vkHandleBits(view)); }
+  bool discardSampler(VkSemaphore sem, uint64_t readyValue, VkSampler sampler) { return discardObject(sem, readyValue, EVulkanObjectType::Sampler, vkHandleBits(sampler)); }
+  bool discardQueryPool(VkSemaphore sem, uint64_t readyValue, VkQueryPool queryPool) { return discardObject(sem, readyValue, EVulkanObjectType::QueryPool, vkHandleBits(queryPool)); }
+
+  // size is the size the buffer was created with, usage its creation usage flags.
+  // Host visible buffers not created with VMA_ALLOCATION_CREATE_MAPPED_BIT are destroyed
+  bool recycleBuffer(VkSemaphore sem, uint64_t readyValue, VkBuffer buffer, VmaAllocation alloc, VkDeviceSize size, VkBufferUsageFlags usage);
+  // returned buffer has size rounded up to the next power of two. If memFlags
+  // contain VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, the allocation is persistently mapped
+  VkBuffer acquireBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags memFlags, VmaAllocation* outAlloc);
+  void setRecycleLimits(VkDeviceSize highWaterBytes, uint32_t maxIdleCollects);
+  // destroys all free buffers
+  void trimRecycledBuffers();
+
  private:
   VulkanDevice* m_dev = nullptr;
   std::unique_ptr<VulkanDiscardPoolImpl> m_impl = nullptr;
@@ -219,13 +398,144 @@ struct VulkanDescriptorSetLayoutData {
   uint32_t setNumber;
   std::vector<VkDescriptorSetLayoutBinding> bindings;
 };
-std::vector<VulkanDescriptorSetLayoutData> reflectShaderDescriptors(SpvReflectShaderModule const& spvShaderModule);
+
+// Flat reflection summary of one entry point of a shader, what the registry
+// keeps once the SPIR-V words and the spirv-reflect module are freed
+struct ShaderReflection {
+  struct Binding {
+    uint32_t set;
+    uint32_t binding;
+    VkDescriptorType descriptorType;
+    uint32_t descriptorCount;
+  };
+
+  std::string entryPoint;
+  VkShaderStageFlagBits stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  uint32_t localSize[3] = {1, 1, 1};
+  std::vector<Binding> bindings; // sorted by set, then binding
+  std::vector<VkPushConstantRange> pushConstantRanges;
+  std::vector<uint32_t> specConstantIds;
+
+  uint32_t setCount() const { return bindings.empty() ? 0 : bindings.back().set + 1; }
+};
+// one summary per entry point, in module order
+bool reflectShader(uint32_t const* pCode, size_t codeSize, std::vector<ShaderReflection>& outEntryPoints);
+// one entry per set number up to the highest one, sets without bindings included
+std::vector<VulkanDescriptorSetLayoutData> reflectShaderDescriptors(ShaderReflection const& reflection);
 VkDescriptorSetLayout createDescriptorSetLayout(VulkanDevice& dev, VulkanDescriptorSetLayoutData const& setLayoutData);
 
+// SPIR-V for a pipeline shader stage: either a module or, with
+// VK_KHR_maintenance5, the words themselves chained to the stage create info
+struct ShaderStageSource {
+  VkShaderModule shaderModule = VK_NULL_HANDLE;
+  uint32_t const* pCode = nullptr;
+  size_t codeSize = 0; // bytes
+};
+
+// Registry slot index and generation packed in 32 bits. Generation 0 is never
+// handed out, so a default constructed handle is invalid
+struct ShaderHandle {
+  static constexpr uint32_t INDEX_BITS = 20;
+  static constexpr uint32_t INDEX_MASK = (1U << INDEX_BITS) - 1;
+  static constexpr uint32_t MAX_GENERATION = (1U << (32 - INDEX_BITS)) - 1;
+
+  uint32_t value = 0;
+
+  uint32_t index() const { return value & INDEX_MASK; }
+  uint32_t generation() const { return value >> INDEX_BITS; }
+  explicit operator bool() const { return value != 0; }
+  friend bool operator==(ShaderHandle a, ShaderHandle b) { return a.value == b.value; }
+  friend bool operator!=(ShaderHandle a, ShaderHandle b) { return a.value != b.value; }
+};
+
+// Source for runtime compilation. Defines are prepended as
+// "#define name value" lines, in order
+enum class EShaderLanguage : uint8_t { Glsl, Hlsl };
+struct ShaderSource {
+  EShaderLanguage language = EShaderLanguage::Glsl;
+  VkShaderStageFlagBits stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  std::string code;
+  std::string entryPoint = "main";
+  std::vector<std::pair<std::string, std::string>> defines;
+};
+
+// In-process glslang compiler running on a worker pool. Results are cached
+// on disk under a hash of source, defines, entry point, stage, glslang version
+// and target SPIR-V version, repeated compilations load the cached words.
+// An empty cache directory disables the disk cache
+class ShaderCompilerImpl;
+class ShaderCompiler {
+ public:
+  // SPIR-V version as in the module header, 1.3 is the Vulkan 1.1 maximum
+  static constexpr uint32_t SPIRV_1_3 = 0x00010300;
+
+  // threadCount 0 picks the hardware concurrency
+  explicit ShaderCompiler(std::filesystem::path cacheDirectory, uint32_t threadCount = 0, uint32_t spirvVersion = SPIRV_1_3);
+  ShaderCompiler(ShaderCompiler const&) = delete;
+  ShaderCompiler(ShaderCompiler &&) noexcept = delete;
+  ShaderCompiler& operator=(ShaderCompiler const&) = delete;
+  ShaderCompiler& operator=(ShaderCompiler &&) noexcept = delete;
+  // waits for queued compilations
+  ~ShaderCompiler() noexcept;
+
+  // empty vector on failure, errors are logged
+  std::future<std::vector<uint32_t>> compile(ShaderSource source);
+  // onDone runs on a worker thread
+  void compile(ShaderSource source, std::function<void(std::vector<uint32_t>&& code)> onDone);
+
+  uint64_t cacheHits() const;
+  uint64_t cacheMisses() const;
+
+ private:
+  std::unique_ptr<ShaderCompilerImpl> m_impl;
+};
+
+// Read-only view of a memory mapped shader pack (layout in avkex-shaderpack.h)
+// produced by the avkex-shaderpack tool: SPIR-V is used in place and the
+// reflection is precomputed, opening validates the tables only
+class ShaderPack {
+ public:
+  struct Input {
+    std::string name;
+    std::vector<uint32_t> code;
+    std::vector<ShaderReflection> entryPoints;
+    // what code was compiled from, kept for hot reload. Names and values
+    // of the defines contain no ','
+    std::string source;
+    std::vector<std::pair<std::string, std::string>> defines;
+  };
+
+  // nullptr if the file can't be mapped or isn't a valid pack
+  static std::shared_ptr<ShaderPack const> open(std::filesystem::path const& path);
+  static bool write(std::filesystem::path const& path, std::vector<Input> const& shaders);
+
+  uint32_t shaderCount() const;
+  std::string_view shaderName(uint32_t index) const;
+  // source file path, empty if unknown
+  std::string_view shaderSource(uint32_t index) const;
+  std::vector<std::pair<std::string, std::string>> shaderDefines(uint32_t index) const;
+  uint32_t const* shaderCode(uint32_t index) const;
+  uint32_t shaderWordCount(uint32_t index) const;
+  std::vector<ShaderReflection> shaderEntryPoints(uint32_t index) const;
+
+ private:
+  explicit ShaderPack(os::MappedFile&& file) : m_file(std::move(file)) {}
+  bool validate() const;
+  uint8_t const* bytes() const { return static_cast<uint8_t const*>(m_file.data()); }
+
+  os::MappedFile m_file;
+};
+
 class VulkanShaderRegistryImpl;
+// Names are interned once and keep their slot, re-registering a name bumps
+// the slot generation so stale handles fail lookups.
+// Handle lookups read an immutable snapshot table published by writers and
+// reclaimed through an EpochDomain: no lock, no allocation.
+// Name lookups are for setup code, they share the writers' lock
 class VulkanShaderRegistry {
  public:
-  // makes a copy
+  using ShaderCallback = void (*)(void* context, ShaderStageSource const&, ShaderReflection const&);
+
   VulkanShaderRegistry(VulkanDevice* dev, size_t minCap = 64, size_t maxCap = 2048);
   VulkanShaderRegistry(VulkanShaderRegistry const&) = delete;
   VulkanShaderRegistry(VulkanShaderRegistry &&) noexcept = delete;
@@ -233,22 +543,210 @@ class VulkanShaderRegistry {
   VulkanShaderRegistry& operator=(VulkanShaderRegistry &&) noexcept = delete;
   ~VulkanShaderRegistry() noexcept;
 
-  bool registerShader(std::string_view name, uint32_t const* pCode, uint32_t wordCount);
+  // invalid handle if the name is taken, the capacity reached or the SPIR-V
+  // can't be reflected. Unless the device has VK_KHR_maintenance5 the code
+  // is freed once the VkShaderModule is created
+  ShaderHandle registerShader(std::string_view name, std::vector<uint32_t>&& code);
+  // makes a copy
+  ShaderHandle registerShader(std::string_view name, uint32_t const* pCode, uint32_t wordCount) { return registerShader(name, std::vector<uint32_t>(pCode, pCode + wordCount)); }
+  // zero-copy and no reflection parsing: the pack is kept alive, its words are
+  // used in place with VK_KHR_maintenance5, else each module is created by
+  // the first withShader() on it. One handle per pack shader, invalid where
+  // registration failed
+  std::vector<ShaderHandle> registerShaderPack(std::shared_ptr<ShaderPack const> const& pack);
+  // compiles on the compiler workers then registers, the registry must
+  // outlive the returned future
+  std::future<ShaderHandle> registerShader(std::string_view name, ShaderCompiler& compiler, ShaderSource source);
+  // hot swap: the handle stays valid and resolves to the new code, the
+  // previous shader is retired once no withShader() call can see it.
+  // False, keeping the previous shader, if the handle is stale or the SPIR-V
+  // can't be reflected or made into a module
+  bool replaceShader(ShaderHandle handle, std::vector<uint32_t>&& code);
+  bool unregisterShader(ShaderHandle handle);
   bool unregisterShader(std::string_view name);
-  bool withShader(std::string_view shader, std::function<void(VkShaderModule, SpvReflectShaderModule const&)> const& func) const;
-
-  bool registerShader(std::string_view name, std::vector<uint32_t>&& code) { return code.empty() ? false : registerShader(name, code.data(), static_cast<uint32_t>(code.size())); }
+  ShaderHandle findShader(std::string_view name) const;
+
+  // func(ShaderStageSource const&, ShaderReflection const&) runs pinned to the
+  // registry epoch, it must not register or unregister shaders itself.
+  // An empty entry point name selects the first entry point. False, without
+  // calling func, if the handle is stale or the module couldn't be created
+  template <typename F>
+  bool withShader(ShaderHandle handle, std::string_view entryPoint, F&& func) const {
+    return withShader(handle, entryPoint, &invokeCallback<std::remove_reference_t<F>>,
+      const_cast<void*>(static_cast<void const*>(std::addressof(func))));
+  }
+  template <typename F>
+  bool withShader(ShaderHandle handle, F&& func) const { return withShader(handle, std::string_view{}, std::forward<F>(func)); }
+  template <typename F>
+  bool withShader(std::string_view name, F&& func) const { return withShader(findShader(name), std::string_view{}, std::forward<F>(func)); }
+  bool withShader(ShaderHandle handle, std::string_view entryPoint, ShaderCallback callback, void* context) const;
 
  private:
+  template <typename F>
+  static void invokeCallback(void* context, ShaderStageSource const& source, ShaderReflection const& reflection) {
+    (*static_cast<F*>(context))(source, reflection);
+  }
+
   VulkanDevice* m_dev = nullptr;
   std::unique_ptr<VulkanShaderRegistryImpl> m_impl;
 };
 
+// Watch mode (Linux): reloads the shaders of a directory into the registry
+// when their file is written. <name>[.*].spv is loaded as is, <name>.comp and
+// <name>.glsl (GLSL), <name>.hlsl (HLSL) are compiled as compute shaders when
+// a compiler is given. Only names already registered are reloaded.
+// Shaders of a pack added with addPack() are reloaded from the file they were
+// built from instead: every pack entry of that file is recompiled with its
+// own defines under its registered name.
+// onReloaded runs on the watcher thread, typically to rebuild pipelines
+class ShaderWatcherImpl;
+class ShaderWatcher {
+ public:
+  ShaderWatcher(VulkanShaderRegistry* shaders, std::filesystem::path directory, ShaderCompiler* compiler = nullptr,
+    std::function<void(ShaderHandle)> onReloaded = {});
+  ShaderWatcher(ShaderWatcher const&) = delete;
+  ShaderWatcher(ShaderWatcher &&) noexcept = delete;
+  ShaderWatcher& operator=(ShaderWatcher const&) = delete;
+  ShaderWatcher& operator=(ShaderWatcher &&) noexcept = delete;
+  ~ShaderWatcher() noexcept;
+
+  // false if the platform or the directory can't be watched
+  bool isWatching() const;
+  // pack entries are matched to changed files by file name
+  void addPack(ShaderPack const& pack);
+
+ private:
+  std::unique_ptr<ShaderWatcherImpl> m_impl;
+};
+
 // Basic compute pipeline creation
-// - while spvShaderModule._internal->code_size exists, I prefer not relying on internal behaviour
-// - TODO: throw away reflection data once VkShaderModule is created
 VkPipelineLayout createPipelineLayout(VulkanDevice& dev, uint32_t setLayoutCount = 0, VkDescriptorSetLayout const* pSetLayouts = nullptr, uint32_t pushConstantRangeCount = 0, VkPushConstantRange const* pPushConstantRanges = nullptr);
-VkPipeline createComputePipeline(VulkanDevice& dev, VkPipelineLayout pipelineLayout, SpvReflectShaderModule const& spvShaderModule, VkShaderModule shaderModule);
+VkPipeline createComputePipeline(VulkanDevice& dev, VkPipelineLayout pipelineLayout, ShaderReflection const& reflection, ShaderStageSource const& source,
+  VkSpecializationInfo const* specialization = nullptr, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+
+// Pipeline cache seeded from a file written by savePipelineCache. Missing or
+// foreign data (other device or driver) gives an empty cache, the driver
+// validates the header
+VkPipelineCache createPipelineCache(VulkanDevice& dev, std::filesystem::path const& path);
+bool savePipelineCache(VulkanDevice& dev, VkPipelineCache pipelineCache, std::filesystem::path const& path);
+
+// Bulk compute pipeline creation
+struct ComputePipelineRequest {
+  ShaderHandle shader;
+  std::string entryPoint; // empty selects the first one
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+  std::vector<VkSpecializationMapEntry> specializationEntries;
+  std::vector<uint8_t> specializationData;
+};
+struct ComputePipelineResult {
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkResult result = VK_SUCCESS; // VK_ERROR_UNKNOWN if the shader handle is stale
+  std::chrono::nanoseconds duration{}; // host time spent in vkCreateComputePipelines
+};
+// Requests are spread over threadCount threads, the caller included (0 picks
+// the hardware concurrency), all creating into the same internally
+// synchronized pipeline cache. Results are in request order
+std::vector<ComputePipelineResult> createComputePipelines(VulkanDevice& dev, VulkanShaderRegistry const& shaders, VkPipelineCache pipelineCache,
+  std::vector<ComputePipelineRequest> const& requests, uint32_t threadCount = 0);
+
+// Compute pipelines which follow shader hot swaps. get() is lock free and
+// records the timeline value of the submission using the pipeline, rebuild()
+// swaps new pipelines in and hands the previous ones to the discard pool with
+// the highest value recorded so far: no device idle, no dispatch waiting
+class VulkanComputePipelinesImpl;
+class VulkanComputePipelines {
+ public:
+  static constexpr uint32_t INVALID_ID = -1U;
+
+  // timeline: semaphore signaled by the submissions using the pipelines,
+  // registered to the discard pool
+  VulkanComputePipelines(VulkanDevice* dev, VulkanShaderRegistry* shaders, VulkanDiscardPool* discardPool, VkSemaphore timeline, size_t maxCount = 1024);
+  VulkanComputePipelines(VulkanComputePipelines const&) = delete;
+  VulkanComputePipelines(VulkanComputePipelines &&) noexcept = delete;
+  VulkanComputePipelines& operator=(VulkanComputePipelines const&) = delete;
+  VulkanComputePipelines& operator=(VulkanComputePipelines &&) noexcept = delete;
+  ~VulkanComputePipelines() noexcept;
+
+  // INVALID_ID if the pipeline can't be created or the capacity is reached.
+  // The layout is borrowed and must outlive the pipeline
+  uint32_t add(ShaderHandle shader, std::string_view entryPoint, VkPipelineLayout layout);
+  uint32_t add(ComputePipelineRequest request);
+  // takes ownership of pipeline, created from request (eg by
+  // createComputePipelines), even on failure
+  uint32_t add(ComputePipelineRequest request, VkPipeline pipeline);
+  // the pipeline goes to the discard pool, the id may be reused
+  void remove(uint32_t id);
+  // timelineValue: signaled once the commands using the pipeline completed
+  VkPipeline get(uint32_t id, uint64_t timelineValue) const;
+  // raises the retire value as get() does, for recordings which call get()
+  // before knowing their timeline value: use() it first, then get(id, 0)
+  void use(uint64_t timelineValue) const;
+  // recreates the pipelines of shader, returns how many were swapped
+  uint32_t rebuild(ShaderHandle shader);
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<VulkanComputePipelinesImpl> m_impl;
+};
+
+// Kernel auto-tuning: a kernel declares its tunable specialization constants
+// (workgroup size, elements per thread, vector width, ...) and the candidate
+// values of each. Every valid combination is compiled, timed on the device
+// with timestamp queries, and the fastest is stored in a tuning database
+// keyed by device UUID and driver version, so later runs skip the sweep
+struct TuningParameter {
+  std::string name; // no whitespace nor '='
+  uint32_t specConstantId = 0;
+  std::vector<uint32_t> candidates;
+};
+struct TuningSpace {
+  std::string kernel; // database key, no whitespace
+  ShaderHandle shader;
+  std::string entryPoint; // empty selects the first one
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+  std::vector<TuningParameter> parameters;
+  // optional, rejects combinations before compiling them (eg workgroups over
+  // profile().maxComputeWorkGroupInvocations)
+  std::function<bool(std::vector<uint32_t> const& values)> isValid;
+  // records the work to time with the candidate pipeline already bound:
+  // descriptor sets, push constants, dispatches sized from values
+  std::function<void(VkCommandBuffer commandBuffer, std::vector<uint32_t> const& values)> record;
+};
+struct TuningResult {
+  std::vector<uint32_t> values; // one per parameter, empty if no candidate ran
+  double nanoseconds = 0; // median device time of the winner
+  bool fromDatabase = false;
+};
+
+// tune() submits to the compute queue and waits for each candidate: call it
+// at startup, while nothing else submits to that queue. Calls are serialized
+class KernelTunerImpl;
+class KernelTuner {
+ public:
+  static constexpr char const* DEFAULT_DATABASE_NAME = "kernel-tuning.txt";
+
+  // repetitions: timed runs per candidate, the median is kept. An empty
+  // databasePath is DEFAULT_DATABASE_NAME next to the executable
+  KernelTuner(VulkanDevice* dev, VulkanShaderRegistry const* shaders, std::filesystem::path databasePath = {}, uint32_t repetitions = 5);
+  KernelTuner(KernelTuner const&) = delete;
+  KernelTuner(KernelTuner &&) noexcept = delete;
+  KernelTuner& operator=(KernelTuner const&) = delete;
+  KernelTuner& operator=(KernelTuner &&) noexcept = delete;
+  ~KernelTuner() noexcept;
+
+  // stored winner for this device and driver if it still fits the space,
+  // otherwise sweeps the space and stores the new winner
+  TuningResult tune(TuningSpace const& space, VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+  // forgets the stored winner, the next tune() sweeps again
+  void invalidate(std::string_view kernel);
+
+  // pipeline request of space specialized with values (uint32 constants)
+  static ComputePipelineRequest specialize(TuningSpace const& space, std::vector<uint32_t> const& values);
+
+ private:
+  VulkanDevice* m_dev = nullptr;
+  std::unique_ptr<KernelTunerImpl> m_impl;
+};
 
 // Memory Management with VMA
 
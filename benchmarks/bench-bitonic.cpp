@@ -0,0 +1,189 @@
+// GPU bitonic sort of 32-bit keys, key only and key-value, against std::sort
+// and a parallel CPU sort (std::sort of one chunk per thread, then parallel
+// pairwise std::inplace_merge rounds), after a correctness check of every
+// key type on a size that isn't a power of two.
+// GPU times are medians of GPU timestamps around the sort alone: bitonic
+// sort is data oblivious, re-sorting sorted data costs the same. CPU times
+// are medians over fresh copies of the input.
+// usage: avkex-bench-bitonic [elements] [cpuThreads]
+#include "bench-gpu.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+#include <thread>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+uint32_t constexpr REPETITIONS = 7;
+
+void parallelSort(std::vector<uint32_t>& keys, uint32_t threadCount) {
+  size_t const n = keys.size();
+  std::vector<size_t> bounds(threadCount + 1);
+  for (uint32_t t = 0; t <= threadCount; ++t) {
+    bounds[t] = n * t / threadCount;
+  }
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < threadCount; ++t) {
+    threads.emplace_back([&, t]() { std::sort(keys.begin() + bounds[t], keys.begin() + bounds[t + 1]); });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  for (uint32_t width = 1; width < threadCount; width *= 2) {
+    threads.clear();
+    for (uint32_t t = 0; t + width < threadCount; t += 2 * width) {
+      size_t const first = bounds[t];
+      size_t const middle = bounds[t + width];
+      size_t const last = bounds[std::min(t + 2 * width, threadCount)];
+      threads.emplace_back([&keys, first, middle, last]() {
+        std::inplace_merge(keys.begin() + first, keys.begin() + middle, keys.begin() + last);
+      });
+    }
+    for (std::thread& thread : threads) {
+      thread.join();
+    }
+  }
+}
+
+template <typename F>
+double cpuMedianNs(std::vector<uint32_t> const& input, F&& sort) {
+  std::vector<double> samples;
+  std::vector<uint32_t> keys;
+  for (uint32_t rep = 0; rep < REPETITIONS; ++rep) {
+    keys = input;
+    Clock::time_point const start = Clock::now();
+    sort(keys);
+    samples.push_back(static_cast<double>(elapsedNs(start, Clock::now())));
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+// raw 32-bit patterns of the key type, values are the original indices
+bool verify(GpuContext& gpu, BitonicSort& sorter, ESortKey keyType, bool withValues) {
+  uint32_t const n = 3 * sorter.tileSize() * 37 + 11;
+  std::mt19937 rng{7};
+  std::vector<uint32_t> keys(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    if (keyType == ESortKey::Float32) {
+      float const value = std::uniform_real_distribution<float>{-1e3f, 1e3f}(rng);
+      std::memcpy(&keys[i], &value, sizeof(float));
+    } else {
+      // narrow range: plenty of duplicates
+      keys[i] = keyType == ESortKey::Int32 ? static_cast<uint32_t>(static_cast<int32_t>(rng() % 2001) - 1000) : rng() % 4096;
+    }
+  }
+  std::vector<uint32_t> values(n);
+  std::iota(values.begin(), values.end(), 0);
+
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  DeviceBuffer dKeys = createDeviceBuffer(dev, n * sizeof(uint32_t));
+  DeviceBuffer dValues = createDeviceBuffer(dev, n * sizeof(uint32_t));
+  stream.upload(dKeys, keys.data(), n * sizeof(uint32_t));
+  stream.upload(dValues, values.data(), n * sizeof(uint32_t));
+  sorter.sort(stream.commandBuffer(), keyType, n, dKeys.address, withValues ? dValues.address : 0);
+  stream.barrier();
+  std::vector<uint32_t> sortedKeys(n), sortedValues(n);
+  stream.download(dKeys, sortedKeys.data(), n * sizeof(uint32_t));
+  stream.download(dValues, sortedValues.data(), n * sizeof(uint32_t));
+  stream.submitAndWait();
+  destroyDeviceBuffer(dev, dKeys);
+  destroyDeviceBuffer(dev, dValues);
+
+  auto const less = [keyType](uint32_t a, uint32_t b) {
+    if (keyType == ESortKey::Int32)
+      return static_cast<int32_t>(a) < static_cast<int32_t>(b);
+    if (keyType == ESortKey::Float32) {
+      float fa, fb;
+      std::memcpy(&fa, &a, sizeof(float));
+      std::memcpy(&fb, &b, sizeof(float));
+      return fa < fb;
+    }
+    return a < b;
+  };
+  std::vector<uint32_t> expected = keys;
+  std::sort(expected.begin(), expected.end(), less);
+  if (expected != sortedKeys) {
+    std::printf("keys mismatch (key type %u)\n", static_cast<uint32_t>(keyType));
+    return false;
+  }
+  if (withValues) {
+    std::vector<bool> seen(n);
+    for (uint32_t i = 0; i < n; ++i) {
+      uint32_t const origin = sortedValues[i];
+      if (origin >= n || seen[origin] || keys[origin] != sortedKeys[i]) {
+        std::printf("values mismatch at %u (key type %u)\n", i, static_cast<uint32_t>(keyType));
+        return false;
+      }
+      seen[origin] = true;
+    }
+  }
+  return true;
+}
+
+void printRow(char const* name, uint32_t n, double ns) {
+  std::printf("%-28s %12.2f %12.1f\n", name, ns / 1e6, ns > 0 ? n / ns * 1e3 : 0);
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const n = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : (1U << 24);
+  uint32_t const cpuThreads = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10))
+                                       : std::max(1U, std::thread::hardware_concurrency());
+  std::unique_ptr<GpuContext> gpu = createGpuContext();
+  if (!gpu) {
+    return 1;
+  }
+  {
+    BitonicSort sorter(gpu->device.get(), gpu->shaders.get());
+    if (!sorter) {
+      return 1;
+    }
+    for (ESortKey keyType : {ESortKey::Uint32, ESortKey::Int32, ESortKey::Float32}) {
+      for (bool withValues : {false, true}) {
+        if (!verify(*gpu, sorter, keyType, withValues)) {
+          return 1;
+        }
+      }
+    }
+    std::printf("correctness: ok, tile %u\n", sorter.tileSize());
+
+    std::mt19937 rng{1};
+    std::vector<uint32_t> input(n);
+    for (uint32_t& key : input) {
+      key = rng();
+    }
+    VulkanDevice& dev = *gpu->device;
+    ComputeStream& stream = *gpu->stream;
+    DeviceBuffer keys = createDeviceBuffer(dev, n * sizeof(uint32_t));
+    DeviceBuffer values = createDeviceBuffer(dev, n * sizeof(uint32_t));
+    if (!keys || !values) {
+      return 1;
+    }
+    stream.upload(keys, input.data(), n * sizeof(uint32_t));
+    stream.upload(values, input.data(), n * sizeof(uint32_t));
+    stream.submitAndWait();
+
+    std::printf("elements: %u, cpu threads: %u\n", n, cpuThreads);
+    std::printf("%-28s %12s %12s\n", "implementation", "time (ms)", "Mkeys/s");
+    printRow("gpu bitonic keys", n, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+      sorter.sort(cmd, ESortKey::Uint32, n, keys.address);
+    }));
+    printRow("gpu bitonic key-value", n, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+      sorter.sort(cmd, ESortKey::Uint32, n, keys.address, values.address);
+    }));
+    printRow("std::sort", n, cpuMedianNs(input, [](std::vector<uint32_t>& keys) { std::sort(keys.begin(), keys.end()); }));
+    printRow("parallel chunk sort + merge", n, cpuMedianNs(input, [cpuThreads](std::vector<uint32_t>& keys) { parallelSort(keys, cpuThreads); }));
+
+    destroyDeviceBuffer(dev, keys);
+    destroyDeviceBuffer(dev, values);
+  }
+  return 0;
+}
@@ -0,0 +1,172 @@
+// Bandwidth of the BLAS level-1 kernels against a device to device
+// vkCmdCopyBuffer, the practical roofline, after a correctness check against
+// the host on a size with a scalar tail and through a misaligned (scalar
+// path) address. The workgroup size is the tuned one (KernelTuner database
+// next to the executable).
+// Times are medians of GPU timestamps, bytes are the minimal traffic per op.
+// usage: avkex-bench-blas1 [elements]
+#include "bench-gpu.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <random>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+uint32_t constexpr REPETITIONS = 15;
+
+bool near(double expected, double actual, double tolerance) {
+  return std::abs(expected - actual) <= tolerance * std::max(1.0, std::abs(expected));
+}
+
+bool checkVector(char const* name, std::vector<float> const& expected, std::vector<float> const& actual) {
+  for (size_t i = 0; i < expected.size(); ++i) {
+    if (!near(expected[i], actual[i], 1e-5)) {
+      std::printf("%s mismatch at %zu: expected %g, got %g\n", name, i, expected[i], actual[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+// the GPU sequence mirrored on the host, elementwise in float, reductions in double
+bool verify(GpuContext& gpu, Blas1& blas) {
+  uint32_t const n = (1U << 20) + 3;
+  float const alpha = 0.75f;
+  float const beta = -1.5f;
+  std::mt19937 rng{42};
+  std::uniform_real_distribution<float> dist{-1.f, 1.f};
+  std::vector<float> x(n), y(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    x[i] = dist(rng);
+    y[i] = dist(rng);
+  }
+
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  DeviceBuffer dx = createDeviceBuffer(dev, n * sizeof(float));
+  DeviceBuffer dy = createDeviceBuffer(dev, n * sizeof(float));
+  DeviceBuffer dz = createDeviceBuffer(dev, n * sizeof(float));
+  DeviceBuffer dResults = createDeviceBuffer(dev, 3 * sizeof(float));
+  stream.upload(dx, x.data(), n * sizeof(float));
+  stream.upload(dy, y.data(), n * sizeof(float));
+  VkCommandBuffer const cmd = stream.commandBuffer();
+  blas.dot(cmd, n, dx.address, dy.address, dResults.address);
+  blas.nrm2(cmd, n, dx.address, dResults.address + sizeof(float));
+  blas.asum(cmd, n, dx.address, dResults.address + 2 * sizeof(float));
+  blas.axpy(cmd, n, alpha, dx.address, dy.address);
+  stream.barrier();
+  blas.axpy(cmd, n - 1, alpha, dx.address + sizeof(float), dy.address + sizeof(float));
+  stream.barrier();
+  blas.scal(cmd, n, beta, dx.address);
+  stream.barrier();
+  blas.copy(cmd, n, dx.address, dz.address);
+  stream.barrier();
+  blas.swap(cmd, n, dy.address, dz.address);
+  std::vector<float> gx(n), gy(n), gz(n), gResults(3);
+  stream.download(dx, gx.data(), n * sizeof(float));
+  stream.download(dy, gy.data(), n * sizeof(float));
+  stream.download(dz, gz.data(), n * sizeof(float));
+  stream.download(dResults, gResults.data(), 3 * sizeof(float));
+  stream.submitAndWait();
+  for (DeviceBuffer* buffer : {&dx, &dy, &dz, &dResults}) {
+    destroyDeviceBuffer(dev, *buffer);
+  }
+
+  double dot = 0, sumSquares = 0, asum = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    dot += static_cast<double>(x[i]) * y[i];
+    sumSquares += static_cast<double>(x[i]) * x[i];
+    asum += std::abs(x[i]);
+  }
+  for (uint32_t i = 0; i < n; ++i) {
+    y[i] += alpha * x[i];
+  }
+  for (uint32_t i = 1; i < n; ++i) {
+    y[i] += alpha * x[i];
+  }
+  for (uint32_t i = 0; i < n; ++i) {
+    x[i] *= beta;
+  }
+  std::vector<float> z = x;
+  std::swap(y, z);
+
+  bool ok = checkVector("axpy/scal", x, gx) && checkVector("swap", y, gy) && checkVector("copy/swap", z, gz);
+  double const expectedResults[3] = {dot, std::sqrt(sumSquares), asum};
+  char const* const resultNames[3] = {"dot", "nrm2", "asum"};
+  for (uint32_t r = 0; r < 3; ++r) {
+    if (!near(expectedResults[r], gResults[r], 1e-3)) {
+      std::printf("%s mismatch: expected %g, got %g\n", resultNames[r], expectedResults[r], gResults[r]);
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void printRow(char const* name, double ns, double bytes, double copyGBs) {
+  double const gbs = ns > 0 ? bytes / ns : 0;
+  std::printf("%-10s %12.1f %10.1f %9.1f%%\n", name, ns / 1e3, gbs, copyGBs > 0 ? 100 * gbs / copyGBs : 0);
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const n = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : (1U << 25);
+  std::unique_ptr<GpuContext> gpu = createGpuContext();
+  if (!gpu) {
+    return 1;
+  }
+  {
+    KernelTuner tuner(gpu->device.get(), gpu->shaders.get());
+    Blas1 blas(gpu->device.get(), gpu->shaders.get(), VK_NULL_HANDLE, nullptr, &tuner);
+    if (!blas) {
+      return 1;
+    }
+    if (!verify(*gpu, blas)) {
+      return 1;
+    }
+    std::printf("correctness: ok, workgroup size %u\n", blas.workgroupSize());
+
+    VulkanDevice& dev = *gpu->device;
+    ComputeStream& stream = *gpu->stream;
+    VkDeviceSize const bytes = static_cast<VkDeviceSize>(n) * sizeof(float);
+    DeviceBuffer x = createDeviceBuffer(dev, bytes);
+    DeviceBuffer y = createDeviceBuffer(dev, bytes);
+    DeviceBuffer result = createDeviceBuffer(dev, sizeof(float));
+    if (!x || !y || !result) {
+      return 1;
+    }
+    // contents don't matter for the bandwidth, keep them finite
+    VkCommandBuffer const cmd = stream.commandBuffer();
+    dev.api()->vkCmdFillBuffer(cmd, x.buffer, 0, VK_WHOLE_SIZE, 0x3f800000); // 1.f
+    dev.api()->vkCmdFillBuffer(cmd, y.buffer, 0, VK_WHOLE_SIZE, 0);
+    stream.submitAndWait();
+
+    double const N = static_cast<double>(n);
+    double const copyNs = gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+      VkBufferCopy region{};
+      region.size = bytes;
+      dev.api()->vkCmdCopyBuffer(cmd, x.buffer, y.buffer, 1, &region);
+    });
+    double const copyGBs = copyNs > 0 ? 8 * N / copyNs : 0;
+
+    std::printf("elements: %u (%.1f MiB per vector)\n", n, bytes / (1024.0 * 1024.0));
+    std::printf("%-10s %12s %10s %10s\n", "op", "time (us)", "GB/s", "of copy");
+    printRow("memcpy", copyNs, 8 * N, copyGBs);
+    printRow("axpy", gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) { blas.axpy(cmd, n, 1e-3f, x.address, y.address); }), 12 * N, copyGBs);
+    printRow("scal", gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) { blas.scal(cmd, n, 1.f, x.address); }), 8 * N, copyGBs);
+    printRow("copy", gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) { blas.copy(cmd, n, x.address, y.address); }), 8 * N, copyGBs);
+    printRow("swap", gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) { blas.swap(cmd, n, x.address, y.address); }), 16 * N, copyGBs);
+    printRow("dot", gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) { blas.dot(cmd, n, x.address, y.address, result.address); }), 8 * N, copyGBs);
+    printRow("nrm2", gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) { blas.nrm2(cmd, n, x.address, result.address); }), 4 * N, copyGBs);
+    printRow("asum", gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) { blas.asum(cmd, n, x.address, result.address); }), 4 * N, copyGBs);
+
+    for (DeviceBuffer* buffer : {&x, &y, &result}) {
+      destroyDeviceBuffer(dev, *buffer);
+    }
+  }
+  return 0;
+}
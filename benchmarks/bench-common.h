@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+namespace avkex::bench {
+
+using Clock = std::chrono::steady_clock;
+
+inline uint64_t elapsedNs(Clock::time_point start, Clock::time_point end) {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+// process wide, all threads
+inline double processCpuSeconds() { return static_cast<double>(std::clock()) / CLOCKS_PER_SEC; }
+
+// lock of AtomicVector before AdaptiveSharedMutex, kept as a baseline
+class LegacyYieldRwLock {
+  static constexpr uint32_t ATOMIC_FREE = 0;
+  static constexpr uint32_t ATOMIC_READING = 2;
+  static constexpr uint32_t ATOMIC_WRITING = 1;
+
+ public:
+  void lock_shared() {
+    while (true) {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      if (state != ATOMIC_FREE && state != ATOMIC_READING) {
+        std::this_thread::yield();
+        continue;
+      }
+      if (!m_state.compare_exchange_weak(state, ATOMIC_READING, std::memory_order_relaxed, std::memory_order_relaxed)) {
+        std::this_thread::yield();
+        continue;
+      }
+      m_refCount.fetch_add(1, std::memory_order_acquire);
+      return;
+    }
+  }
+
+  void lock() {
+    while (true) {
+      uint32_t state = m_state.load(std::memory_order_relaxed);
+      if (state != ATOMIC_FREE) {
+        std::this_thread::yield();
+        continue;
+      }
+      if (!m_state.compare_exchange_weak(state, ATOMIC_WRITING, std::memory_order_acquire, std::memory_order_relaxed)) {
+        std::this_thread::yield();
+        continue;
+      }
+      return;
+    }
+  }
+
+  void unlock() { m_state.store(ATOMIC_FREE, std::memory_order_release); }
+
+  void unlock_shared() {
+    uint32_t const prevCount = m_refCount.fetch_sub(1, std::memory_order_release);
+    if (prevCount == 1) {
+      m_state.store(ATOMIC_FREE, std::memory_order_release);
+    } else {
+      m_state.store(ATOMIC_READING, std::memory_order_release);
+    }
+  }
+
+ private:
+  std::atomic<uint32_t> m_state = 0;
+  std::atomic<uint32_t> m_refCount = 0;
+};
+
+struct LatencySummary {
+  uint64_t p50;
+  uint64_t p90;
+  uint64_t p99;
+  uint64_t p999;
+  uint64_t max;
+};
+
+// sorts samples in place
+inline LatencySummary summarize(std::vector<uint64_t>& samples) {
+  LatencySummary summary{};
+  if (samples.empty())
+    return summary;
+  std::sort(samples.begin(), samples.end());
+  auto const at = [&samples](double q) {
+    size_t const i = static_cast<size_t>(q * static_cast<double>(samples.size() - 1));
+    return samples[i];
+  };
+  summary.p50 = at(0.5);
+  summary.p90 = at(0.9);
+  summary.p99 = at(0.99);
+  summary.p999 = at(0.999);
+  summary.max = samples.back();
+  return summary;
+}
+
+inline void printLatencyHeader() {
+  std::printf("%-28s %9s %12s %8s %8s %8s %9s %10s\n",
+    "implementation", "threads", "Mops/s", "p50", "p90", "p99", "p99.9", "max (ns)");
+}
+
+inline void printLatencyRow(char const* name, uint32_t threads, double mopsPerSec, LatencySummary const& s) {
+  std::printf("%-28s %9u %12.2f %8llu %8llu %8llu %9llu %10llu\n", name, threads, mopsPerSec,
+    static_cast<unsigned long long>(s.p50), static_cast<unsigned long long>(s.p90),
+    static_cast<unsigned long long>(s.p99), static_cast<unsigned long long>(s.p999),
+    static_cast<unsigned long long>(s.max));
+}
+
+inline void printCpuLatencyHeader() {
+  std::printf("%-28s %9s %12s %8s %8s %8s %8s %9s %10s\n",
+    "implementation", "threads", "Mops/s", "cpu/wall", "p50", "p90", "p99", "p99.9", "max (ns)");
+}
+
+// cpuPerWall: cores kept busy on average
+inline void printCpuLatencyRow(char const* name, uint32_t threads, double mopsPerSec, double cpuPerWall, LatencySummary const& s) {
+  std::printf("%-28s %9u %12.2f %8.2f %8llu %8llu %8llu %9llu %10llu\n", name, threads, mopsPerSec, cpuPerWall,
+    static_cast<unsigned long long>(s.p50), static_cast<unsigned long long>(s.p90),
+    static_cast<unsigned long long>(s.p99), static_cast<unsigned long long>(s.p999),
+    static_cast<unsigned long long>(s.max));
+}
+
+}
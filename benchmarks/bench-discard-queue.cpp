@@ -0,0 +1,155 @@
+// Multi producer discard latency of the discard pool queues, against the
+// previous SemaphoreContent implementation (AtomicVector write spin-lock per
+// discard, capacity limited growth, front erase compaction on collect).
+// A collector thread plays the role of both the GPU (advances the timeline) and
+// of the discard pool collect call.
+// usage: avkex-bench-discard-queue [itemsPerProducer]
+#include "avkex-utils.h"
+#include "bench-common.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+struct FakePending {
+  FakePending(uint64_t _resource, uint64_t _alloc, uint64_t _readyValue)
+  : resource(_resource), alloc(_alloc), readyValue(_readyValue) {}
+
+  uint64_t resource;
+  uint64_t alloc;
+  uint64_t readyValue;
+};
+
+// previous SemaphoreContent vector + its collectVec
+class LegacyDiscardList {
+ public:
+  static uint32_t constexpr MIN_CAP = 256;
+  static uint32_t constexpr COMPACTION_THRESHOLD = 1024;
+  static uint32_t constexpr MAX_CAP = 1U << 22;
+
+  LegacyDiscardList() { m_pending.reserve(MIN_CAP); }
+
+  bool discard(uint64_t resource, uint64_t readyValue) {
+    m_lock.lock();
+    bool const result = vectorEmplaceWithGrowthLimit(m_pending, MAX_CAP, resource, resource, readyValue);
+    m_lock.unlock();
+    return result;
+  }
+
+  uint64_t collect(uint64_t readyValue) {
+    uint64_t freed = 0;
+    m_lock.lock();
+    while (m_start < m_pending.size() && m_pending[m_start].readyValue <= readyValue) {
+      freed += m_pending[m_start].resource != 0;
+      ++m_start;
+    }
+    if (m_start > COMPACTION_THRESHOLD) {
+      m_pending.erase(m_pending.begin(), m_pending.begin() + m_start);
+      m_start = 0;
+    }
+    m_lock.unlock();
+    return freed;
+  }
+
+ private:
+  // the AtomicVector of the time: a vector behind the yield loop lock
+  std::vector<FakePending> m_pending;
+  LegacyYieldRwLock m_lock;
+  size_t m_start = 0;
+};
+
+class QueueDiscardList {
+ public:
+  bool discard(uint64_t resource, uint64_t readyValue) {
+    m_queue.push(resource, resource, readyValue);
+    return true;
+  }
+
+  uint64_t collect(uint64_t readyValue) {
+    uint64_t freed = 0;
+    m_queue.consumeWhile([&freed, readyValue](FakePending const& p) {
+      if (p.readyValue > readyValue)
+        return false;
+      freed += p.resource != 0;
+      return true;
+    });
+    return freed;
+  }
+
+ private:
+  SegmentedMpscQueue<FakePending> m_queue;
+};
+
+template <typename List>
+void run(char const* name, uint32_t producerCount, uint32_t itemsPerProducer) {
+  List list;
+  std::atomic<uint64_t> timeline = 0;
+  std::atomic<bool> producing = true;
+  std::atomic<uint32_t> failures = 0;
+  std::vector<std::vector<uint64_t>> samples(producerCount);
+
+  std::thread collector([&]() {
+    while (producing.load(std::memory_order_relaxed)) {
+      uint64_t const completed = timeline.fetch_add(1, std::memory_order_relaxed);
+      list.collect(completed);
+    }
+    list.collect(UINT64_MAX);
+  });
+
+  Clock::time_point const start = Clock::now();
+  std::vector<std::thread> producers;
+  producers.reserve(producerCount);
+  for (uint32_t t = 0; t < producerCount; ++t) {
+    producers.emplace_back([&, t]() {
+      std::vector<uint64_t>& mine = samples[t];
+      mine.reserve(itemsPerProducer);
+      for (uint32_t i = 0; i < itemsPerProducer; ++i) {
+        uint64_t const readyValue = timeline.load(std::memory_order_relaxed) + 1;
+        Clock::time_point const before = Clock::now();
+        bool const ok = list.discard(i + 1, readyValue);
+        Clock::time_point const after = Clock::now();
+        mine.push_back(elapsedNs(before, after));
+        if (!ok)
+          failures.fetch_add(1, std::memory_order_relaxed);
+      }
+    });
+  }
+  for (std::thread& producer : producers) {
+    producer.join();
+  }
+  Clock::time_point const end = Clock::now();
+  producing.store(false, std::memory_order_relaxed);
+  collector.join();
+
+  std::vector<uint64_t> all;
+  all.reserve(static_cast<size_t>(producerCount) * itemsPerProducer);
+  for (std::vector<uint64_t> const& mine : samples) {
+    all.insert(all.end(), mine.begin(), mine.end());
+  }
+  double const seconds = static_cast<double>(elapsedNs(start, end)) * 1e-9;
+  double const mops = static_cast<double>(all.size()) / seconds * 1e-6;
+  printLatencyRow(name, producerCount, mops, summarize(all));
+  if (uint32_t const failed = failures.load(); failed > 0) {
+    std::printf("  %u discards failed (leaked resources)\n", failed);
+  }
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const itemsPerProducer = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 200'000;
+  uint32_t const maxThreads = std::max(2U, std::thread::hardware_concurrency());
+
+  std::printf("discard latency, %u discards per producer, 1 collector thread\n", itemsPerProducer);
+  printLatencyHeader();
+  for (uint32_t producers = 1; producers <= maxThreads; producers *= 2) {
+    run<LegacyDiscardList>("AtomicVector (legacy)", producers, itemsPerProducer);
+    run<QueueDiscardList>("SegmentedMpscQueue", producers, itemsPerProducer);
+  }
+}
@@ -0,0 +1,268 @@
+// Batched complex FFTs against a host Stockham FFT on all threads: GFLOP/s
+// (5 n log2 n per transform) and GB/s of one read and one write of the data,
+// for many short signals, a few long ones (four-step) and 2D batches.
+// Before, forward transforms of every path (shared, four-step, global
+// passes, 2D, in place) are checked against the host in double by relative
+// L2 error, and inverse transforms must bring back n times the input.
+// GPU times are medians of GPU timestamps, host times medians of runs
+// usage: avkex-bench-fft [points per batch]
+#include "bench-gpu.h"
+
+#include <cmath>
+#include <complex>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+uint32_t constexpr REPETITIONS = 7;
+
+std::vector<uint32_t> hostRadices(uint32_t n) {
+  std::vector<uint32_t> radices;
+  for (uint32_t const radix : {8U, 4U, 2U, 3U, 5U, 7U}) {
+    for (; n % radix == 0; n /= radix) {
+      radices.push_back(radix);
+    }
+  }
+  return radices;
+}
+
+// exp(sign 2 pi i t / n)
+template <typename T>
+std::vector<std::complex<T>> hostTwiddles(uint32_t n, int sign) {
+  double const pi = std::acos(-1.0);
+  std::vector<std::complex<T>> twiddles(n);
+  for (uint32_t t = 0; t < n; ++t) {
+    twiddles[t] = std::complex<T>(std::polar(1.0, sign * 2.0 * pi * t / n));
+  }
+  return twiddles;
+}
+
+// Stockham passes, radices as direct DFTs, result in x
+template <typename T>
+void hostFft(std::complex<T>* x, std::complex<T>* work, uint32_t n, std::vector<std::complex<T>> const& twiddles) {
+  std::complex<T>* a = x;
+  std::complex<T>* b = work;
+  uint32_t ns = 1;
+  for (uint32_t const radix : hostRadices(n)) {
+    uint32_t const m = n / radix;
+    uint32_t const step = n / (ns * radix);
+    for (uint32_t j = 0; j < m; ++j) {
+      uint32_t const k = j % ns;
+      std::complex<T> v[8];
+      for (uint32_t r = 0; r < radix; ++r) {
+        v[r] = a[j + r * m] * twiddles[r * k * step];
+      }
+      for (uint32_t q = 0; q < radix; ++q) {
+        std::complex<T> sum = v[0];
+        for (uint32_t r = 1; r < radix; ++r) {
+          sum += v[r] * twiddles[(r * q % radix) * (n / radix)];
+        }
+        b[(j - k) * radix + k + q * ns] = sum;
+      }
+    }
+    std::swap(a, b);
+    ns *= radix;
+  }
+  if (a != x) {
+    std::copy(a, a + n, x);
+  }
+}
+
+// rows then columns of each row major signal
+template <typename T>
+void hostFft2d(std::complex<T>* x, uint32_t rows, uint32_t columns, uint32_t batch, int sign) {
+  std::vector<std::complex<T>> const rowTwiddles = hostTwiddles<T>(columns, sign);
+  std::vector<std::complex<T>> const columnTwiddles = hostTwiddles<T>(rows, sign);
+  std::vector<std::complex<T>> work(std::max(rows, columns));
+  std::vector<std::complex<T>> column(rows);
+  for (uint32_t b = 0; b < batch; ++b) {
+    std::complex<T>* signal = x + size_t{b} * rows * columns;
+    for (uint32_t row = 0; row < rows; ++row) {
+      hostFft(signal + size_t{row} * columns, work.data(), columns, rowTwiddles);
+    }
+    if (rows == 1) {
+      continue;
+    }
+    for (uint32_t c = 0; c < columns; ++c) {
+      for (uint32_t row = 0; row < rows; ++row) {
+        column[row] = signal[size_t{row} * columns + c];
+      }
+      hostFft(column.data(), work.data(), rows, columnTwiddles);
+      for (uint32_t row = 0; row < rows; ++row) {
+        signal[size_t{row} * columns + c] = column[row];
+      }
+    }
+  }
+}
+
+double relativeError(std::complex<float> const* result, std::complex<double> const* expected, size_t count, double scale = 1.0) {
+  double error = 0;
+  double norm = 0;
+  for (size_t i = 0; i < count; ++i) {
+    error += std::norm(std::complex<double>(result[i]) - expected[i] * scale);
+    norm += std::norm(expected[i] * scale);
+  }
+  return norm > 0 ? std::sqrt(error / norm) : std::sqrt(error);
+}
+
+bool verify(GpuContext& gpu, Fft& fft, uint32_t rows, uint32_t columns, uint32_t batch, bool inPlace) {
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  size_t const points = size_t{rows} * columns * batch;
+  std::mt19937 rng{columns};
+  std::uniform_real_distribution<float> uniform{-1.f, 1.f};
+  std::vector<std::complex<float>> x(points);
+  for (std::complex<float>& value : x) {
+    value = {uniform(rng), uniform(rng)};
+  }
+  FftPlan plan = fft.plan2d(stream, rows, columns, batch);
+  DeviceBuffer dX = createDeviceBuffer(dev, points * sizeof(x[0]));
+  DeviceBuffer dY = createDeviceBuffer(dev, points * sizeof(x[0]));
+  if (!plan || !dX || !dY) {
+    return false;
+  }
+  DeviceBuffer const& out = inPlace ? dX : dY;
+  std::vector<std::complex<float>> forward(points);
+  std::vector<std::complex<float>> back(points);
+  stream.upload(dX, x.data(), points * sizeof(x[0]));
+  stream.barrier();
+  fft.transform(stream.commandBuffer(), plan, EFftDirection::Forward, dX.address, out.address);
+  stream.barrier();
+  stream.download(out, forward.data(), points * sizeof(x[0]));
+  // and back, in place
+  fft.transform(stream.commandBuffer(), plan, EFftDirection::Inverse, out.address, out.address);
+  stream.barrier();
+  stream.download(out, back.data(), points * sizeof(x[0]));
+  stream.submitAndWait();
+  destroyDeviceBuffer(dev, dX);
+  destroyDeviceBuffer(dev, dY);
+
+  std::vector<std::complex<double>> expected(x.begin(), x.end());
+  hostFft2d(expected.data(), rows, columns, batch, -1);
+  double const tolerance = 1e-6 * std::max(1.0, std::log2(static_cast<double>(rows) * columns));
+  double const forwardError = relativeError(forward.data(), expected.data(), points);
+  std::vector<std::complex<double>> const input(x.begin(), x.end());
+  double const backError = relativeError(back.data(), input.data(), points, static_cast<double>(rows) * columns);
+  if (!(forwardError <= tolerance && backError <= tolerance)) {
+    std::printf("mismatch: %u x %u, batch %u%s: forward error %g, inverse error %g\n", rows, columns, batch, inPlace ? ", in place" : "",
+      forwardError, backError);
+    return false;
+  }
+  return true;
+}
+
+void printRow(char const* name, double flops, double bytes, double ns) {
+  std::printf("%-44s %12.3f %10.1f %10.1f\n", name, ns / 1e6, ns > 0 ? flops / ns : 0, ns > 0 ? bytes / ns : 0);
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const points = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 1U << 24;
+  std::unique_ptr<GpuContext> gpu = createGpuContext();
+  if (!gpu) {
+    return 1;
+  }
+  {
+    Fft fft(gpu->device.get(), gpu->shaders.get());
+    if (!fft) {
+      return 1;
+    }
+    uint32_t const shared = fft.maxSharedSize();
+    // rows, columns, batch, in place: shared memory sizes, four-step, global
+    // passes (3^15 has no split in shared memory), 2D
+    struct Shape {
+      uint32_t rows;
+      uint32_t columns;
+      uint32_t batch;
+      bool inPlace;
+    };
+    std::vector<Shape> const checks{{1, 1, 3, false}, {1, 2, 5, false}, {1, 7, 9, false}, {1, 60, 33, false}, {1, 343, 4, true},
+      {1, 1000, 3, false}, {1, shared, 2, false}, {1, 6000, 2, false}, {1, 3 << 17, 2, true}, {1, 14348907, 1, true},
+      {12, 20, 3, false}, {64, 64, 2, true}, {shared, 8, 1, false}};
+    for (Shape const& shape : checks) {
+      if (!verify(*gpu, fft, shape.rows, shape.columns, shape.batch, shape.inPlace)) {
+        return 1;
+      }
+    }
+    std::printf("correctness: ok\n");
+
+    VulkanDevice& dev = *gpu->device;
+    ComputeStream& stream = *gpu->stream;
+    std::vector<Shape> shapes;
+    for (uint32_t const n : {64U, 256U, 1024U, 4096U, 1U << 16, 1U << 20}) {
+      shapes.push_back({1, n, std::max(1U, points / n), false});
+    }
+    for (uint32_t const n : {100U, 1000U}) {
+      shapes.push_back({1, n, std::max(1U, points / n), false});
+    }
+    for (uint32_t const side : {256U, 1024U}) {
+      shapes.push_back({side, side, std::max(1U, points / (side * side)), false});
+    }
+
+    std::printf("%-44s %12s %10s %10s\n", "operation", "time (ms)", "GFLOP/s", "GB/s");
+    for (Shape const& shape : shapes) {
+      if (shape.rows > shared) {
+        continue;
+      }
+      size_t const total = size_t{shape.rows} * shape.columns * shape.batch;
+      double const n = static_cast<double>(shape.rows) * shape.columns;
+      double const flops = 5.0 * n * std::log2(n) * shape.batch;
+      double const bytes = 2.0 * total * sizeof(std::complex<float>);
+      std::vector<std::complex<float>> x(total);
+      std::mt19937 rng{7};
+      for (std::complex<float>& value : x) {
+        value = {std::uniform_real_distribution<float>{-1.f, 1.f}(rng), 0.f};
+      }
+      FftPlan plan = fft.plan2d(stream, shape.rows, shape.columns, shape.batch);
+      DeviceBuffer dX = createDeviceBuffer(dev, total * sizeof(x[0]));
+      DeviceBuffer dY = createDeviceBuffer(dev, total * sizeof(x[0]));
+      if (!plan || !dX || !dY) {
+        return 1;
+      }
+      stream.upload(dX, x.data(), total * sizeof(x[0]));
+      stream.submitAndWait();
+      char name[80];
+      if (shape.rows == 1) {
+        std::snprintf(name, sizeof(name), "gpu %u x %u, %u dispatch(es)", shape.batch, shape.columns, plan.dispatchCount());
+      } else {
+        std::snprintf(name, sizeof(name), "gpu %u x %ux%u, %u dispatch(es)", shape.batch, shape.rows, shape.columns, plan.dispatchCount());
+      }
+      printRow(name, flops, bytes, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+        fft.transform(cmd, plan, EFftDirection::Forward, dX.address, dY.address);
+      }));
+      destroyDeviceBuffer(dev, dX);
+      destroyDeviceBuffer(dev, dY);
+
+      // the batch split over the threads
+      uint32_t const threadCount = std::max(1U, std::thread::hardware_concurrency());
+      std::vector<double> samples;
+      for (uint32_t rep = 0; rep < REPETITIONS; ++rep) {
+        std::vector<std::complex<float>> data = x;
+        Clock::time_point const start = Clock::now();
+        std::vector<std::thread> threads;
+        for (uint32_t t = 0; t < threadCount; ++t) {
+          threads.emplace_back([&data, &shape, t, threadCount]() {
+            uint32_t const first = static_cast<uint32_t>(uint64_t{shape.batch} * t / threadCount);
+            uint32_t const last = static_cast<uint32_t>(uint64_t{shape.batch} * (t + 1) / threadCount);
+            if (first < last) {
+              hostFft2d(data.data() + size_t{first} * shape.rows * shape.columns, shape.rows, shape.columns, last - first, -1);
+            }
+          });
+        }
+        for (std::thread& thread : threads) {
+          thread.join();
+        }
+        samples.push_back(static_cast<double>(elapsedNs(start, Clock::now())));
+      }
+      std::sort(samples.begin(), samples.end());
+      printRow("host, all threads", flops, bytes, samples[samples.size() / 2]);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,252 @@
+// Device GEMM throughput against a multithreaded host GEMM: GFLOP/s of square
+// f32 and f16 products and of a batch of small ones. Before, every type is
+// checked against a host reference on uneven shapes, padded leading
+// dimensions (scalar loads), beta != 0 and strided batches.
+// f16 inputs are multiples of 1/256 in [-1, 1], exact in f16, so both types
+// share the tolerance of f32 accumulation order.
+// GPU times are medians of GPU timestamps, host times medians of runs
+// usage: avkex-bench-gemm [size]
+#include "bench-gpu.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+uint32_t constexpr REPETITIONS = 7;
+uint32_t constexpr SMALL_SIZE = 128;
+uint32_t constexpr SMALL_BATCH = 64;
+
+// normal values and zero, truncating the mantissa
+uint16_t toHalf(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  uint32_t const sign = (bits >> 16) & 0x8000U;
+  int32_t const exponent = static_cast<int32_t>((bits >> 23) & 0xFFU) - 127 + 15;
+  if (exponent <= 0) {
+    return static_cast<uint16_t>(sign);
+  }
+  return static_cast<uint16_t>(sign | (static_cast<uint32_t>(exponent) << 10) | ((bits >> 13) & 0x3FFU));
+}
+
+struct Problem {
+  uint32_t m;
+  uint32_t n;
+  uint32_t k;
+  uint32_t pad; // added to every leading dimension
+  uint32_t batchCount;
+  float alpha;
+  float beta;
+};
+
+// row major, double accumulation
+void hostGemm(Problem const& pb, float const* a, uint32_t lda, float const* b, uint32_t ldb, float* c, uint32_t ldc) {
+  for (uint32_t i = 0; i < pb.m; ++i) {
+    for (uint32_t j = 0; j < pb.n; ++j) {
+      double sum = 0;
+      for (uint32_t l = 0; l < pb.k; ++l) {
+        sum += double{a[i * lda + l]} * b[l * ldb + j];
+      }
+      double const prior = pb.beta != 0.f ? double{pb.beta} * c[i * ldc + j] : 0.0;
+      c[i * ldc + j] = static_cast<float>(pb.alpha * sum + prior);
+    }
+  }
+}
+
+// square, i-k-j order over row blocks on every hardware thread
+void hostParallelGemm(uint32_t size, float const* a, float const* b, float* c) {
+  uint32_t const threadCount = std::max(1U, std::thread::hardware_concurrency());
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < threadCount; ++t) {
+    threads.emplace_back([=]() {
+      for (uint32_t i = size * t / threadCount; i < size * (t + 1) / threadCount; ++i) {
+        float* row = c + uint64_t{i} * size;
+        std::fill(row, row + size, 0.f);
+        for (uint32_t l = 0; l < size; ++l) {
+          float const x = a[uint64_t{i} * size + l];
+          float const* bRow = b + uint64_t{l} * size;
+          for (uint32_t j = 0; j < size; ++j) {
+            row[j] += x * bRow[j];
+          }
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+std::vector<float> randomMatrix(std::mt19937& rng, size_t count) {
+  std::vector<float> values(count);
+  for (float& value : values) {
+    value = static_cast<float>(static_cast<int32_t>(rng() % 513) - 256) / 256.f;
+  }
+  return values;
+}
+
+// uploads f32 or f16 copies of values
+DeviceBuffer uploadInputs(GpuContext& gpu, EGemmType type, std::vector<float> const& values) {
+  VulkanDevice& dev = *gpu.device;
+  if (type == EGemmType::Float32) {
+    DeviceBuffer buffer = createDeviceBuffer(dev, values.size() * sizeof(float));
+    gpu.stream->upload(buffer, values.data(), values.size() * sizeof(float));
+    return buffer;
+  }
+  std::vector<uint16_t> halves(values.size());
+  std::transform(values.begin(), values.end(), halves.begin(), toHalf);
+  DeviceBuffer buffer = createDeviceBuffer(dev, halves.size() * sizeof(uint16_t));
+  gpu.stream->upload(buffer, halves.data(), halves.size() * sizeof(uint16_t));
+  return buffer;
+}
+
+bool verify(GpuContext& gpu, Gemm& gemm, EGemmType type, Problem const& pb) {
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  uint32_t const lda = pb.k + pb.pad;
+  uint32_t const ldb = pb.n + pb.pad;
+  uint32_t const ldc = pb.n + pb.pad;
+  uint32_t const strideA = pb.m * lda;
+  uint32_t const strideB = pb.k * ldb;
+  uint32_t const strideC = pb.m * ldc;
+  std::mt19937 rng{pb.m * 31 + pb.n * 7 + pb.k};
+  std::vector<float> const a = randomMatrix(rng, size_t{strideA} * pb.batchCount);
+  std::vector<float> const b = randomMatrix(rng, size_t{strideB} * pb.batchCount);
+  std::vector<float> c = randomMatrix(rng, size_t{strideC} * pb.batchCount);
+
+  DeviceBuffer dA = uploadInputs(gpu, type, a);
+  DeviceBuffer dB = uploadInputs(gpu, type, b);
+  DeviceBuffer dC = createDeviceBuffer(dev, c.size() * sizeof(float));
+  stream.upload(dC, c.data(), c.size() * sizeof(float));
+  stream.barrier();
+  if (pb.batchCount == 1) {
+    gemm.gemm(stream.commandBuffer(), type, pb.m, pb.n, pb.k, pb.alpha, dA.address, lda, dB.address, ldb, pb.beta, dC.address, ldc);
+  } else {
+    gemm.gemmStridedBatched(stream.commandBuffer(), type, pb.m, pb.n, pb.k, pb.alpha, dA.address, lda, strideA, dB.address, ldb, strideB,
+      pb.beta, dC.address, ldc, strideC, pb.batchCount);
+  }
+  std::vector<float> result(c.size());
+  stream.barrier();
+  stream.download(dC, result.data(), result.size() * sizeof(float));
+  stream.submitAndWait();
+  for (DeviceBuffer* buffer : {&dA, &dB, &dC}) {
+    destroyDeviceBuffer(dev, *buffer);
+  }
+
+  std::vector<float> expected = c;
+  for (uint32_t batch = 0; batch < pb.batchCount; ++batch) {
+    hostGemm(pb, a.data() + size_t{batch} * strideA, lda, b.data() + size_t{batch} * strideB, ldb,
+      expected.data() + size_t{batch} * strideC, ldc);
+  }
+  for (size_t i = 0; i < expected.size(); ++i) {
+    // padding columns must stay untouched
+    bool const padding = i % ldc >= pb.n;
+    float const tolerance = padding ? 0.f : 1e-5f * pb.k + 1e-5f;
+    if (!(std::abs(expected[i] - result[i]) <= tolerance * std::max(1.f, std::abs(expected[i])))) {
+      std::printf("mismatch: type %u, %ux%ux%u pad %u batch %u at %zu: expected %g, got %g\n", static_cast<uint32_t>(type), pb.m, pb.n,
+        pb.k, pb.pad, pb.batchCount, i, expected[i], result[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+void printRow(char const* name, double flops, double ns) {
+  std::printf("%-32s %12.3f %12.1f\n", name, ns / 1e6, ns > 0 ? flops / ns : 0);
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const size = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 1024;
+  std::unique_ptr<GpuContext> gpu = createGpuContext();
+  if (!gpu) {
+    return 1;
+  }
+  {
+    Gemm gemm(gpu->device.get(), gpu->shaders.get());
+    if (!gemm) {
+      return 1;
+    }
+    std::vector<EGemmType> types{EGemmType::Float32};
+    if (gemm.supports(EGemmType::Float16)) {
+      types.push_back(EGemmType::Float16);
+    }
+    std::printf("f16: %s, cooperative matrix: %s\n", gemm.supports(EGemmType::Float16) ? "yes" : "no",
+      gemm.usesCooperativeMatrix() ? "yes" : "no");
+
+    std::vector<Problem> const problems{
+      {1, 1, 1, 0, 1, 1.f, 0.f},
+      {64, 64, 16, 0, 1, 1.f, 0.f},
+      {67, 45, 33, 0, 1, 0.5f, 2.f},
+      {67, 45, 33, 1, 1, 1.f, -1.f},
+      {200, 130, 301, 4, 1, 1.f, 0.f},
+      {128, 256, 64, 0, 1, 2.f, 0.25f},
+      {33, 17, 70, 0, 5, 1.f, 1.f},
+      {96, 80, 40, 3, 3, -1.f, 0.f},
+    };
+    for (EGemmType type : types) {
+      for (Problem const& problem : problems) {
+        if (!verify(*gpu, gemm, type, problem)) {
+          return 1;
+        }
+      }
+    }
+    std::printf("correctness: ok\n");
+
+    VulkanDevice& dev = *gpu->device;
+    ComputeStream& stream = *gpu->stream;
+    std::mt19937 rng{1};
+    size_t const count = size_t{size} * size;
+    size_t const smallCount = size_t{SMALL_SIZE} * SMALL_SIZE * SMALL_BATCH;
+    std::vector<float> const a = randomMatrix(rng, std::max(count, smallCount));
+    std::vector<float> const b = randomMatrix(rng, std::max(count, smallCount));
+    DeviceBuffer dC = createDeviceBuffer(dev, std::max(count, smallCount) * sizeof(float));
+    if (!dC) {
+      return 1;
+    }
+
+    double const flops = 2.0 * size * size * size;
+    double const smallFlops = 2.0 * SMALL_SIZE * SMALL_SIZE * SMALL_SIZE * SMALL_BATCH;
+    std::printf("size: %u, batch: %u x %u\n", size, SMALL_BATCH, SMALL_SIZE);
+    std::printf("%-32s %12s %12s\n", "operation", "time (ms)", "GFLOP/s");
+    for (EGemmType type : types) {
+      DeviceBuffer dA = uploadInputs(*gpu, type, a);
+      DeviceBuffer dB = uploadInputs(*gpu, type, b);
+      char const* typeName = type == EGemmType::Float32 ? "f32" : "f16";
+      char name[64];
+      std::snprintf(name, sizeof(name), "gpu %s %u^3", typeName, size);
+      printRow(name, flops, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+        gemm.gemm(cmd, type, size, size, size, 1.f, dA.address, size, dB.address, size, 0.f, dC.address, size);
+      }));
+      std::snprintf(name, sizeof(name), "gpu %s batched %u x %u^3", typeName, SMALL_BATCH, SMALL_SIZE);
+      uint32_t const stride = SMALL_SIZE * SMALL_SIZE;
+      printRow(name, smallFlops, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+        gemm.gemmStridedBatched(cmd, type, SMALL_SIZE, SMALL_SIZE, SMALL_SIZE, 1.f, dA.address, SMALL_SIZE, stride, dB.address,
+          SMALL_SIZE, stride, 0.f, dC.address, SMALL_SIZE, stride, SMALL_BATCH);
+      }));
+      destroyDeviceBuffer(dev, dA);
+      destroyDeviceBuffer(dev, dB);
+    }
+
+    std::vector<float> hostC(count);
+    std::vector<double> samples;
+    for (uint32_t rep = 0; rep < REPETITIONS; ++rep) {
+      Clock::time_point const start = Clock::now();
+      hostParallelGemm(size, a.data(), b.data(), hostC.data());
+      samples.push_back(static_cast<double>(elapsedNs(start, Clock::now())));
+    }
+    std::sort(samples.begin(), samples.end());
+    char name[64];
+    std::snprintf(name, sizeof(name), "host f32 %u^3, %u threads", size, std::max(1U, std::thread::hardware_concurrency()));
+    printRow(name, flops, samples[samples.size() / 2]);
+
+    destroyDeviceBuffer(dev, dC);
+  }
+  return 0;
+}
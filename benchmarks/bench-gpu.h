@@ -0,0 +1,65 @@
+#pragma once
+
+#include "avkex-kernels.h"
+#include "avkex-os.h"
+#include "bench-common.h"
+
+#include <memory>
+
+namespace avkex::bench {
+
+// First eligible device with the kernels of the shader pack next to the
+// executable, and a stream to record into. Members die in reverse order
+struct GpuContext {
+  VulkanApp app;
+  std::unique_ptr<VulkanDevice> device;
+  std::unique_ptr<VulkanCommandBufferManager> commandBuffers;
+  std::unique_ptr<VulkanShaderRegistry> shaders;
+  std::unique_ptr<ComputeStream> stream;
+};
+
+// null (logged) without a device or a shader pack
+inline std::unique_ptr<GpuContext> createGpuContext() {
+  auto context = std::make_unique<GpuContext>();
+  std::vector<VulkanDeviceInfo> const devs = context->app.getEligibleDevices();
+  if (devs.empty()) {
+    LOG_ERR << "No vulkan capable devices found" LOG_RST << std::endl;
+    return nullptr;
+  }
+  std::optional<std::filesystem::path> const exeDir = os::getExecutableDirectory();
+  std::shared_ptr<ShaderPack const> const pack = exeDir ? ShaderPack::open(*exeDir / "shaders" / "shaders.avkpack") : nullptr;
+  if (!pack) {
+    LOG_ERR << "Couldn't load the shader pack" LOG_RST << std::endl;
+    return nullptr;
+  }
+  context->device = std::make_unique<VulkanDevice>(context->app.instance(), devs[0]);
+  context->commandBuffers = std::make_unique<VulkanCommandBufferManager>(context->device.get());
+  context->shaders = std::make_unique<VulkanShaderRegistry>(context->device.get());
+  context->shaders->registerShaderPack(pack);
+  context->stream = std::make_unique<ComputeStream>(context->device.get(), context->commandBuffers.get());
+  std::printf("device: %s\n", context->device->profile().deviceName);
+  return context;
+}
+
+// median device time of repetitions of record (one warmup first), each one
+// serialized against the previous by a barrier. 0 without timestamps
+template <typename F>
+double gpuMedianNs(ComputeStream& stream, uint32_t repetitions, F&& record) {
+  repetitions = std::min(repetitions, ComputeStream::TIMESTAMP_SLOTS / 2);
+  record(stream.commandBuffer());
+  for (uint32_t rep = 0; rep < repetitions; ++rep) {
+    stream.barrier();
+    stream.timestamp(2 * rep);
+    record(stream.commandBuffer());
+    stream.timestamp(2 * rep + 1);
+  }
+  stream.submitAndWait();
+  std::vector<double> samples(repetitions);
+  for (uint32_t rep = 0; rep < repetitions; ++rep) {
+    samples[rep] = stream.elapsedNanoseconds(2 * rep, 2 * rep + 1);
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples.empty() ? 0.0 : samples[samples.size() / 2];
+}
+
+}
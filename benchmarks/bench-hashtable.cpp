@@ -0,0 +1,420 @@
+// Device hash table against std::unordered_map and a host open addressing
+// table with the same hash and probing, on one thread: Mkeys/s of building
+// from distinct keys, probing hits and misses, and a group-by sum of many
+// keys into a few groups, for 32 and 64-bit keys at load factors 0.5 and 0.8.
+// Before, lookups after inserts, sum and count aggregates, the counters, the
+// reserved key, a full table dropping keys and reuse after clear() are
+// checked on the host.
+// GPU times are medians of GPU timestamps, host times medians of runs
+// usage: avkex-bench-hashtable [keys]
+#include "bench-gpu.h"
+
+#include <cstdlib>
+#include <random>
+#include <unordered_map>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+uint32_t constexpr REPETITIONS = 7;
+
+template <typename K>
+K constexpr EMPTY_KEY = static_cast<K>(~K{0});
+
+// the hash of shaders/hashtable.comp
+uint32_t hostHash(uint32_t key) {
+  key ^= key >> 16;
+  key *= 0x85EBCA6BU;
+  key ^= key >> 13;
+  key *= 0xC2B2AE35U;
+  key ^= key >> 16;
+  return key;
+}
+
+uint32_t hostHash(uint64_t key) {
+  key ^= key >> 33;
+  key *= 0xFF51AFD7ED558CCDULL;
+  key ^= key >> 33;
+  key *= 0xC4CEB9FE1A85EC53ULL;
+  key ^= key >> 33;
+  return static_cast<uint32_t>(key);
+}
+
+// distinct keys for distinct indices: odd multipliers are bijections
+template <typename K>
+std::vector<K> distinctKeys(uint64_t first, uint32_t count) {
+  std::vector<K> keys;
+  keys.reserve(count);
+  for (uint64_t i = first; keys.size() < count; ++i) {
+    K const key = static_cast<K>(static_cast<K>(i) * static_cast<K>(0x9E3779B97F4A7C15ULL) ^ static_cast<K>(0x5BD1E9955BD1E995ULL));
+    if (key != EMPTY_KEY<K>) {
+      keys.push_back(key);
+    }
+  }
+  return keys;
+}
+
+// open addressing as on the device, on one thread
+template <typename K>
+class HostTable {
+ public:
+  explicit HostTable(uint32_t capacity) : m_keys(capacity, EMPTY_KEY<K>), m_values(capacity, 0), m_mask(capacity - 1) {}
+
+  void insert(K key, uint32_t value) {
+    for (uint32_t slot = hostHash(key) & m_mask;; slot = (slot + 1) & m_mask) {
+      if (m_keys[slot] == key || m_keys[slot] == EMPTY_KEY<K>) {
+        m_keys[slot] = key;
+        m_values[slot] = value;
+        return;
+      }
+    }
+  }
+
+  void add(K key, uint32_t value) {
+    for (uint32_t slot = hostHash(key) & m_mask;; slot = (slot + 1) & m_mask) {
+      if (m_keys[slot] == key || m_keys[slot] == EMPTY_KEY<K>) {
+        m_keys[slot] = key;
+        m_values[slot] += value;
+        return;
+      }
+    }
+  }
+
+  uint32_t lookup(K key) const {
+    for (uint32_t slot = hostHash(key) & m_mask;; slot = (slot + 1) & m_mask) {
+      if (m_keys[slot] == key) {
+        return m_values[slot];
+      }
+      if (m_keys[slot] == EMPTY_KEY<K>) {
+        return HASH_NOT_FOUND;
+      }
+    }
+  }
+
+ private:
+  std::vector<K> m_keys;
+  std::vector<uint32_t> m_values;
+  uint32_t m_mask;
+};
+
+template <typename K>
+DeviceBuffer uploadVector(GpuContext& gpu, std::vector<K> const& data) {
+  DeviceBuffer buffer = createDeviceBuffer(*gpu.device, data.size() * sizeof(K));
+  if (buffer && !data.empty()) {
+    gpu.stream->upload(buffer, data.data(), data.size() * sizeof(K));
+  }
+  return buffer;
+}
+
+// lookups of inserted keys and misses, the counters, then sum and count
+// group-by on the same table after clear()
+template <typename K>
+bool verify(GpuContext& gpu, EHashKey keyType, uint32_t n) {
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  std::mt19937 rng{n};
+  std::vector<K> const keys = distinctKeys<K>(0, n);
+  std::vector<K> queries = distinctKeys<K>(uint64_t{1} << 31, n);
+  queries.insert(queries.begin(), keys.begin(), keys.end());
+  queries.push_back(EMPTY_KEY<K>);
+  std::vector<uint32_t> values(n);
+  for (uint32_t& value : values) {
+    value = rng() % HASH_NOT_FOUND;
+  }
+  // group-by input: n keys of a few groups
+  uint32_t const groupCount = n / 16 + 1;
+  std::vector<K> groupKeys(n);
+  std::vector<uint32_t> groupValues(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    groupKeys[i] = keys[rng() % std::min(n, groupCount)];
+    groupValues[i] = rng() % 1000;
+  }
+  // reserved: dropped and counted, never found
+  groupKeys[n - 1] = EMPTY_KEY<K>;
+
+  HashTable table(&dev, gpu.shaders.get(), keyType, n);
+  DeviceBuffer dKeys = uploadVector(gpu, keys);
+  DeviceBuffer dValues = uploadVector(gpu, values);
+  DeviceBuffer dQueries = uploadVector(gpu, queries);
+  DeviceBuffer dGroupKeys = uploadVector(gpu, groupKeys);
+  DeviceBuffer dGroupValues = uploadVector(gpu, groupValues);
+  DeviceBuffer dResults = createDeviceBuffer(dev, queries.size() * sizeof(uint32_t));
+  if (!table || !dKeys || !dValues || !dQueries || !dGroupKeys || !dGroupValues || !dResults) {
+    return false;
+  }
+  std::vector<uint32_t> found(queries.size());
+  std::vector<uint32_t> sums(queries.size());
+  std::vector<uint32_t> counts(queries.size());
+  uint32_t counters[3][2]{};
+  VkCommandBuffer cmd = stream.commandBuffer();
+  stream.barrier();
+  table.clear(cmd);
+  computeBarrier(dev, cmd);
+  table.insert(cmd, n, dKeys.address, dValues.address);
+  computeBarrier(dev, cmd);
+  table.lookup(cmd, static_cast<uint32_t>(queries.size()), dQueries.address, dResults.address);
+  stream.barrier();
+  stream.download(dResults, found.data(), found.size() * sizeof(uint32_t));
+  stream.download(table.counters(), counters[0], sizeof(counters[0]));
+  for (EHashAggregate const aggregate : {EHashAggregate::Sum, EHashAggregate::Count}) {
+    table.clear(cmd);
+    computeBarrier(dev, cmd);
+    table.insertAggregate(cmd, aggregate, n, dGroupKeys.address, dGroupValues.address);
+    computeBarrier(dev, cmd);
+    table.lookup(cmd, static_cast<uint32_t>(queries.size()), dQueries.address, dResults.address);
+    stream.barrier();
+    bool const sum = aggregate == EHashAggregate::Sum;
+    stream.download(dResults, (sum ? sums : counts).data(), queries.size() * sizeof(uint32_t));
+    stream.download(table.counters(), counters[sum ? 1 : 2], sizeof(counters[0]));
+  }
+  stream.submitAndWait();
+
+  std::unordered_map<K, uint32_t> expectedSums;
+  std::unordered_map<K, uint32_t> expectedCounts;
+  for (uint32_t i = 0; i < n - 1; ++i) {
+    expectedSums[groupKeys[i]] += groupValues[i];
+    ++expectedCounts[groupKeys[i]];
+  }
+  uint32_t const distinctGroups = static_cast<uint32_t>(expectedSums.size());
+  bool ok = counters[0][0] == n && counters[0][1] == 0 && counters[1][0] == distinctGroups && counters[1][1] == 1 &&
+            counters[2][0] == distinctGroups && counters[2][1] == 1;
+  if (!ok) {
+    std::printf("mismatch: %u keys, counters %u %u, %u %u, %u %u\n", n, counters[0][0], counters[0][1], counters[1][0], counters[1][1],
+      counters[2][0], counters[2][1]);
+  }
+  for (size_t i = 0; ok && i < queries.size(); ++i) {
+    auto const sum = expectedSums.find(queries[i]);
+    auto const count = expectedCounts.find(queries[i]);
+    ok = found[i] == (i < n ? values[i] : HASH_NOT_FOUND) && sums[i] == (sum != expectedSums.end() ? sum->second : HASH_NOT_FOUND) &&
+         counts[i] == (count != expectedCounts.end() ? count->second : HASH_NOT_FOUND);
+    if (!ok) {
+      std::printf("mismatch: %u keys, query %zu: %u, sum %u, count %u\n", n, i, found[i], sums[i], counts[i]);
+    }
+  }
+  for (DeviceBuffer* buffer : {&dKeys, &dValues, &dQueries, &dGroupKeys, &dGroupValues, &dResults}) {
+    destroyDeviceBuffer(dev, *buffer);
+  }
+  return ok;
+}
+
+// more distinct keys than slots: every slot taken, the rest dropped, and
+// the stored keys keep their values
+template <typename K>
+bool verifyFull(GpuContext& gpu, EHashKey keyType) {
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  uint32_t constexpr capacity = 64;
+  uint32_t constexpr n = 100;
+  std::vector<K> const keys = distinctKeys<K>(12345, n);
+  std::vector<uint32_t> values(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    values[i] = i;
+  }
+  HashTable table(&dev, gpu.shaders.get(), keyType, capacity, 1.f);
+  DeviceBuffer dKeys = uploadVector(gpu, keys);
+  DeviceBuffer dValues = uploadVector(gpu, values);
+  DeviceBuffer dResults = createDeviceBuffer(dev, n * sizeof(uint32_t));
+  if (!table || table.capacity() != capacity || !dKeys || !dValues || !dResults) {
+    return false;
+  }
+  std::vector<uint32_t> found(n);
+  uint32_t counters[2]{};
+  VkCommandBuffer cmd = stream.commandBuffer();
+  stream.barrier();
+  table.clear(cmd);
+  computeBarrier(dev, cmd);
+  table.insert(cmd, n, dKeys.address, dValues.address);
+  computeBarrier(dev, cmd);
+  table.lookup(cmd, n, dKeys.address, dResults.address);
+  stream.barrier();
+  stream.download(dResults, found.data(), n * sizeof(uint32_t));
+  stream.download(table.counters(), counters, sizeof(counters));
+  stream.submitAndWait();
+  destroyDeviceBuffer(dev, dKeys);
+  destroyDeviceBuffer(dev, dValues);
+  destroyDeviceBuffer(dev, dResults);
+
+  uint32_t stored = 0;
+  bool ok = counters[0] == capacity && counters[1] == n - capacity;
+  for (uint32_t i = 0; ok && i < n; ++i) {
+    ok = found[i] == values[i] || found[i] == HASH_NOT_FOUND;
+    stored += found[i] == values[i] ? 1 : 0;
+  }
+  if (!ok || stored != capacity) {
+    std::printf("mismatch: full table, counters %u %u, %u found\n", counters[0], counters[1], stored);
+    return false;
+  }
+  return true;
+}
+
+template <typename F>
+double hostMedianNs(F&& run) {
+  std::vector<double> samples;
+  for (uint32_t rep = 0; rep < REPETITIONS; ++rep) {
+    Clock::time_point const start = Clock::now();
+    run();
+    samples.push_back(static_cast<double>(elapsedNs(start, Clock::now())));
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+void printRow(char const* name, uint64_t keys, double ns) {
+  std::printf("%-44s %12.3f %12.1f\n", name, ns / 1e6, ns > 0 ? keys / ns * 1e3 : 0);
+}
+
+// the sink keeps the host probes from being optimized out
+template <typename K>
+bool benchmark(GpuContext& gpu, EHashKey keyType, char const* keyName, uint32_t n, uint32_t& sink) {
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  std::mt19937 rng{7};
+  std::vector<K> const keys = distinctKeys<K>(0, n);
+  std::vector<K> const misses = distinctKeys<K>(uint64_t{1} << 31, n);
+  std::vector<uint32_t> values(n);
+  for (uint32_t& value : values) {
+    value = rng() % 1000;
+  }
+  uint32_t const groupCount = std::max(1U, n / 64);
+  std::vector<K> groupKeys(n);
+  for (K& key : groupKeys) {
+    key = keys[rng() % groupCount];
+  }
+  DeviceBuffer dKeys = uploadVector(gpu, keys);
+  DeviceBuffer dMisses = uploadVector(gpu, misses);
+  DeviceBuffer dValues = uploadVector(gpu, values);
+  DeviceBuffer dGroupKeys = uploadVector(gpu, groupKeys);
+  DeviceBuffer dResults = createDeviceBuffer(dev, size_t{n} * sizeof(uint32_t));
+  if (!dKeys || !dMisses || !dValues || !dGroupKeys || !dResults) {
+    return false;
+  }
+  stream.submitAndWait();
+
+  char name[80];
+  for (float const loadFactor : {0.5f, 0.8f}) {
+    HashTable table(&dev, gpu.shaders.get(), keyType, n, loadFactor);
+    if (!table) {
+      return false;
+    }
+    std::snprintf(name, sizeof(name), "gpu %s build, load %.1f", keyName, loadFactor);
+    printRow(name, n, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+      table.clear(cmd);
+      computeBarrier(dev, cmd);
+      table.insert(cmd, n, dKeys.address, dValues.address);
+    }));
+    std::snprintf(name, sizeof(name), "gpu %s probe hits, load %.1f", keyName, loadFactor);
+    printRow(name, n, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+      table.lookup(cmd, n, dKeys.address, dResults.address);
+    }));
+    std::snprintf(name, sizeof(name), "gpu %s probe misses, load %.1f", keyName, loadFactor);
+    printRow(name, n, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+      table.lookup(cmd, n, dMisses.address, dResults.address);
+    }));
+
+    HostTable<K> host(table.capacity());
+    std::snprintf(name, sizeof(name), "host open addressing build, load %.1f", loadFactor);
+    printRow(name, n, hostMedianNs([&]() {
+      host = HostTable<K>(table.capacity());
+      for (uint32_t i = 0; i < n; ++i) {
+        host.insert(keys[i], values[i]);
+      }
+    }));
+    std::snprintf(name, sizeof(name), "host open addressing probe hits, load %.1f", loadFactor);
+    printRow(name, n, hostMedianNs([&]() {
+      for (K const key : keys) {
+        sink += host.lookup(key);
+      }
+    }));
+    std::snprintf(name, sizeof(name), "host open addressing probe misses, load %.1f", loadFactor);
+    printRow(name, n, hostMedianNs([&]() {
+      for (K const key : misses) {
+        sink += host.lookup(key);
+      }
+    }));
+  }
+
+  std::unordered_map<K, uint32_t> map;
+  printRow("std::unordered_map build", n, hostMedianNs([&]() {
+    map = std::unordered_map<K, uint32_t>();
+    map.reserve(n);
+    for (uint32_t i = 0; i < n; ++i) {
+      map[keys[i]] = values[i];
+    }
+  }));
+  printRow("std::unordered_map probe hits", n, hostMedianNs([&]() {
+    for (K const key : keys) {
+      sink += map.find(key)->second;
+    }
+  }));
+  printRow("std::unordered_map probe misses", n, hostMedianNs([&]() {
+    for (K const key : misses) {
+      sink += map.find(key) == map.end() ? 1 : 0;
+    }
+  }));
+
+  // group-by sum: n keys into n / 64 groups
+  {
+    HashTable table(&dev, gpu.shaders.get(), keyType, groupCount);
+    if (!table) {
+      return false;
+    }
+    printRow("gpu group-by sum", n, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+      table.clear(cmd);
+      computeBarrier(dev, cmd);
+      table.insertAggregate(cmd, EHashAggregate::Sum, n, dGroupKeys.address, dValues.address);
+    }));
+    printRow("host open addressing group-by sum", n, hostMedianNs([&]() {
+      HostTable<K> host(table.capacity());
+      for (uint32_t i = 0; i < n; ++i) {
+        host.add(groupKeys[i], values[i]);
+      }
+      sink += host.lookup(groupKeys[0]);
+    }));
+    printRow("std::unordered_map group-by sum", n, hostMedianNs([&]() {
+      std::unordered_map<K, uint32_t> groups;
+      for (uint32_t i = 0; i < n; ++i) {
+        groups[groupKeys[i]] += values[i];
+      }
+      sink += static_cast<uint32_t>(groups.size());
+    }));
+  }
+
+  for (DeviceBuffer* buffer : {&dKeys, &dMisses, &dValues, &dGroupKeys, &dResults}) {
+    destroyDeviceBuffer(dev, *buffer);
+  }
+  return true;
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const n = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 1U << 24;
+  if (n == 0 || n > (1U << 30)) {
+    std::printf("keys must be in [1, 2^30]\n");
+    return 1;
+  }
+  std::unique_ptr<GpuContext> gpu = createGpuContext();
+  if (!gpu) {
+    return 1;
+  }
+  bool const keys64 = gpu->device->hasInt64Atomics();
+  for (uint32_t const size : {1U, 1000U, 1U << 20}) {
+    if (!verify<uint32_t>(*gpu, EHashKey::Uint32, size) || (keys64 && !verify<uint64_t>(*gpu, EHashKey::Uint64, size))) {
+      return 1;
+    }
+  }
+  if (!verifyFull<uint32_t>(*gpu, EHashKey::Uint32) || (keys64 && !verifyFull<uint64_t>(*gpu, EHashKey::Uint64))) {
+    return 1;
+  }
+  std::printf("correctness: ok%s\n", keys64 ? "" : " (no 64-bit keys on this device)");
+
+  uint32_t sink = 0;
+  std::printf("%-44s %12s %12s\n", "operation", "time (ms)", "Mkeys/s");
+  if (!benchmark<uint32_t>(*gpu, EHashKey::Uint32, "u32", n, sink) || (keys64 && !benchmark<uint64_t>(*gpu, EHashKey::Uint64, "u64", n, sink))) {
+    return 1;
+  }
+  std::printf("(host checksum %u)\n", sink);
+  return 0;
+}
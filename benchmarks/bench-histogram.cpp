@@ -0,0 +1,281 @@
+// Device histograms against reading the data back: GB/s of u8 256 bins,
+// f32 range binning into 1000 bins and u32 into 2^20 bins (global atomics),
+// then the host wall time of a full download binned on the CPU against a
+// device histogram downloading only the bins. Before, every input, binning
+// and bin count class (small and large shared, global) is checked against
+// the host on one segment and on uneven segments, with and without clamping.
+// GPU times are medians of GPU timestamps, wall times medians of submissions
+// usage: avkex-bench-histogram [elements]
+#include "bench-gpu.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <random>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+uint32_t constexpr REPETITIONS = 7;
+uint32_t constexpr DROPPED = UINT32_MAX;
+
+uint32_t elementSize(EHistogramInput input) {
+  switch (input) {
+  case EHistogramInput::Uint8: return 1;
+  case EHistogramInput::Uint16: return 2;
+  default: return 4;
+  }
+}
+
+uint32_t rawValue(EHistogramInput input, uint8_t const* data, uint32_t i) {
+  switch (input) {
+  case EHistogramInput::Uint8: return data[i];
+  case EHistogramInput::Uint16: {
+    uint16_t value;
+    std::memcpy(&value, data + 2 * i, sizeof(value));
+    return value;
+  }
+  default: {
+    uint32_t value;
+    std::memcpy(&value, data + 4 * i, sizeof(value));
+    return value;
+  }
+  }
+}
+
+// the binning of shaders/histogram.comp
+uint32_t hostBin(EHistogramInput input, HistogramBinning const& binning, uint32_t binCount, uint32_t raw) {
+  if (binning.function == EHistogramBinning::Bits) {
+    return (raw >> binning.shift) & (binCount - 1);
+  }
+  bool const isFloat = input == EHistogramInput::Float32;
+  if (binning.function == EHistogramBinning::Direct && !isFloat) {
+    return raw < binCount ? raw : (binning.clampOutliers ? binCount - 1 : DROPPED);
+  }
+  float x = static_cast<float>(raw);
+  if (isFloat) {
+    std::memcpy(&x, &raw, sizeof(x));
+  }
+  float const scale = static_cast<float>(binCount) / (binning.max - binning.min);
+  float const t = binning.function == EHistogramBinning::Range ? (x - binning.min) * scale : x;
+  if (std::isnan(t)) {
+    return DROPPED;
+  }
+  if (binning.clampOutliers) {
+    return static_cast<uint32_t>(std::clamp(t, 0.f, static_cast<float>(binCount - 1)));
+  }
+  return t >= 0.f && t < static_cast<float>(binCount) ? std::min(static_cast<uint32_t>(t), binCount - 1) : DROPPED;
+}
+
+// random raw values of the input type, a few out of range and NaNs
+std::vector<uint8_t> randomInput(std::mt19937& rng, EHistogramInput input, uint32_t n, float spread) {
+  std::vector<uint8_t> data(histogramSourceBytes(input, n));
+  for (uint32_t i = 0; i < n; ++i) {
+    switch (input) {
+    case EHistogramInput::Uint8: data[i] = static_cast<uint8_t>(rng()); break;
+    case EHistogramInput::Uint16: {
+      uint16_t const value = static_cast<uint16_t>(rng());
+      std::memcpy(&data[2 * i], &value, sizeof(value));
+      break;
+    }
+    case EHistogramInput::Uint32: {
+      uint32_t const value = static_cast<uint32_t>(std::uniform_real_distribution<float>{0.f, spread * 1.1f}(rng));
+      std::memcpy(&data[4 * i], &value, sizeof(value));
+      break;
+    }
+    case EHistogramInput::Float32: {
+      float value = std::uniform_real_distribution<float>{-0.1f * spread, spread * 1.1f}(rng);
+      if (rng() % 1000 == 0) {
+        value = std::numeric_limits<float>::quiet_NaN();
+      }
+      std::memcpy(&data[4 * i], &value, sizeof(value));
+      break;
+    }
+    }
+  }
+  return data;
+}
+
+bool verify(GpuContext& gpu, Histogram& histogram, EHistogramInput input, HistogramBinning const& binning, uint32_t binCount,
+  bool segmented) {
+  uint32_t const n = (1U << 20) + 3;
+  std::mt19937 rng{binCount + static_cast<uint32_t>(input) * 7 + static_cast<uint32_t>(binning.function) * 13};
+  std::vector<uint8_t> const data = randomInput(rng, input, n, binning.function == EHistogramBinning::Range ? binning.max : binCount);
+  std::vector<uint32_t> offsets{0};
+  if (segmented) {
+    // uneven, unaligned to words, with empty ones
+    while (offsets.back() < n) {
+      offsets.push_back(std::min<uint32_t>(n, offsets.back() + (rng() % 4 == 0 ? 0 : rng() % 150001)));
+    }
+  } else {
+    offsets.push_back(n);
+  }
+  uint32_t const segmentCount = static_cast<uint32_t>(offsets.size() - 1);
+
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  DeviceBuffer src = createDeviceBuffer(dev, data.size());
+  DeviceBuffer dOffsets = createDeviceBuffer(dev, offsets.size() * sizeof(uint32_t));
+  DeviceBuffer dst = createDeviceBuffer(dev, size_t{segmentCount} * binCount * sizeof(uint32_t));
+  stream.upload(src, data.data(), data.size());
+  stream.upload(dOffsets, offsets.data(), offsets.size() * sizeof(uint32_t));
+  // counts add to dst: a non zero start checks that too
+  std::vector<uint32_t> expected(size_t{segmentCount} * binCount, 1);
+  stream.upload(dst, expected.data(), expected.size() * sizeof(uint32_t));
+  stream.barrier();
+  if (segmented) {
+    histogram.histogramSegments(stream.commandBuffer(), input, binning, binCount, n, src.address, dOffsets.address, segmentCount,
+      dst.address);
+  } else {
+    histogram.histogram(stream.commandBuffer(), input, binning, binCount, n, src.address, dst.address);
+  }
+  std::vector<uint32_t> result(expected.size());
+  stream.barrier();
+  stream.download(dst, result.data(), result.size() * sizeof(uint32_t));
+  stream.submitAndWait();
+  for (DeviceBuffer* buffer : {&src, &dOffsets, &dst}) {
+    destroyDeviceBuffer(dev, *buffer);
+  }
+
+  for (uint32_t s = 0; s < segmentCount; ++s) {
+    for (uint32_t i = offsets[s]; i < offsets[s + 1]; ++i) {
+      uint32_t const bin = hostBin(input, binning, binCount, rawValue(input, data.data(), i));
+      if (bin != DROPPED) {
+        ++expected[size_t{s} * binCount + bin];
+      }
+    }
+  }
+  for (size_t i = 0; i < expected.size(); ++i) {
+    if (expected[i] != result[i]) {
+      std::printf("mismatch: input %u binning %u%s bins %u segment %zu/%u bin %zu: expected %u, got %u\n", static_cast<uint32_t>(input),
+        static_cast<uint32_t>(binning.function), binning.clampOutliers ? " clamped" : "", binCount, i / binCount, segmentCount,
+        i % binCount, expected[i], result[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename F>
+double wallMedianNs(F&& run) {
+  std::vector<double> samples;
+  for (uint32_t rep = 0; rep < REPETITIONS; ++rep) {
+    Clock::time_point const start = Clock::now();
+    run();
+    samples.push_back(static_cast<double>(elapsedNs(start, Clock::now())));
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+void printRow(char const* name, uint64_t bytes, double ns) {
+  std::printf("%-36s %12.3f %12.1f\n", name, ns / 1e6, ns > 0 ? bytes / ns : 0);
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const n = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : (1U << 26);
+  std::unique_ptr<GpuContext> gpu = createGpuContext();
+  if (!gpu) {
+    return 1;
+  }
+  {
+    Histogram histogram(gpu->device.get(), gpu->shaders.get());
+    if (!histogram) {
+      return 1;
+    }
+    // small shared, large shared and global bins
+    uint32_t const largeBins = std::max(histogram.maxSharedBins() / 2, 4096U);
+    for (EHistogramInput input : {EHistogramInput::Uint8, EHistogramInput::Uint16, EHistogramInput::Uint32, EHistogramInput::Float32}) {
+      for (uint32_t binCount : {16U, 1000U, largeBins, 1U << 18}) {
+        for (bool clampOutliers : {false, true}) {
+          std::vector<HistogramBinning> binnings{
+            {EHistogramBinning::Direct, 0.f, 1.f, 0, clampOutliers},
+            {EHistogramBinning::Range, -2.f, 0.75f * binCount, 0, clampOutliers},
+          };
+          if ((binCount & (binCount - 1)) == 0) {
+            binnings.push_back({EHistogramBinning::Bits, 0.f, 1.f, 3, clampOutliers});
+          }
+          for (HistogramBinning const& binning : binnings) {
+            if (!verify(*gpu, histogram, input, binning, binCount, false) || !verify(*gpu, histogram, input, binning, binCount, true)) {
+              return 1;
+            }
+          }
+        }
+      }
+    }
+    std::printf("correctness: ok\n");
+
+    struct Case {
+      char const* name;
+      EHistogramInput input;
+      HistogramBinning binning;
+      uint32_t binCount;
+    };
+    std::vector<Case> const cases{
+      {"u8 direct, 256 bins", EHistogramInput::Uint8, {}, 256},
+      {"f32 range, 1000 bins", EHistogramInput::Float32, {EHistogramBinning::Range, 0.f, 1000.f}, 1000},
+      {"u32 bits, 2^20 bins", EHistogramInput::Uint32, {EHistogramBinning::Bits, 0.f, 1.f, 4}, 1U << 20},
+    };
+    VulkanDevice& dev = *gpu->device;
+    ComputeStream& stream = *gpu->stream;
+    std::mt19937 rng{1};
+    std::printf("elements: %u\n", n);
+    std::printf("%-36s %12s %12s\n", "operation", "time (ms)", "GB/s");
+    for (Case const& c : cases) {
+      std::vector<uint8_t> const data = randomInput(rng, c.input, n, 1000.f);
+      uint64_t const bytes = uint64_t{n} * elementSize(c.input);
+      DeviceBuffer src = createDeviceBuffer(dev, data.size());
+      DeviceBuffer dst = createDeviceBuffer(dev, c.binCount * sizeof(uint32_t));
+      if (!src || !dst) {
+        return 1;
+      }
+      stream.upload(src, data.data(), data.size());
+      stream.submitAndWait();
+
+      char name[80];
+      std::snprintf(name, sizeof(name), "gpu %s", c.name);
+      printRow(name, bytes, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+        dev.api()->vkCmdFillBuffer(cmd, dst.buffer, 0, VK_WHOLE_SIZE, 0);
+        computeBarrier(dev, cmd);
+        histogram.histogram(cmd, c.input, c.binning, c.binCount, n, src.address, dst.address);
+      }));
+
+      std::vector<uint8_t> readBack(data.size());
+      std::vector<uint32_t> hostBins(c.binCount);
+      std::snprintf(name, sizeof(name), "wall: download + host, %s", c.name);
+      printRow(name, bytes, wallMedianNs([&]() {
+        stream.download(src, readBack.data(), readBack.size());
+        stream.submitAndWait();
+        std::fill(hostBins.begin(), hostBins.end(), 0);
+        for (uint32_t i = 0; i < n; ++i) {
+          uint32_t const bin = hostBin(c.input, c.binning, c.binCount, rawValue(c.input, readBack.data(), i));
+          if (bin != DROPPED) {
+            ++hostBins[bin];
+          }
+        }
+      }));
+      std::vector<uint32_t> bins(c.binCount);
+      std::snprintf(name, sizeof(name), "wall: gpu + bins download, %s", c.name);
+      printRow(name, bytes, wallMedianNs([&]() {
+        VkCommandBuffer const cmd = stream.commandBuffer();
+        dev.api()->vkCmdFillBuffer(cmd, dst.buffer, 0, VK_WHOLE_SIZE, 0);
+        computeBarrier(dev, cmd);
+        histogram.histogram(cmd, c.input, c.binning, c.binCount, n, src.address, dst.address);
+        stream.barrier();
+        stream.download(dst, bins.data(), bins.size() * sizeof(uint32_t));
+        stream.submitAndWait();
+      }));
+      if (bins != hostBins) {
+        std::printf("mismatch: %s\n", c.name);
+        return 1;
+      }
+      destroyDeviceBuffer(dev, src);
+      destroyDeviceBuffer(dev, dst);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,263 @@
+// GPU LSD radix sort of 32- and 64-bit keys, key only and key-value, against
+// std::stable_sort and std::sort, after a check of every key type, with and
+// without values and segments, against std::stable_sort (values are the
+// original indices, so the check covers stability).
+// Each GPU repetition restores the unsorted keys with vkCmdCopyBuffer first:
+// sorted input scatters coalesced and would flatter the sort. The median of
+// the copies alone is subtracted. CPU times are medians over fresh copies
+// usage: avkex-bench-radix [elements]
+#include "bench-gpu.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <random>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+uint32_t constexpr REPETITIONS = 7;
+
+uint32_t keyWords(ESortKey keyType) {
+  return keyType >= ESortKey::Uint64 ? 2 : 1;
+}
+
+// raw words of n keys of the type, narrow ranges for plenty of duplicates
+std::vector<uint32_t> randomKeys(ESortKey keyType, uint32_t n, std::mt19937& rng) {
+  std::vector<uint32_t> words(n * keyWords(keyType));
+  for (uint32_t i = 0; i < n; ++i) {
+    switch (keyType) {
+    case ESortKey::Uint32: words[i] = rng() % 4096; break;
+    case ESortKey::Int32: words[i] = static_cast<uint32_t>(static_cast<int32_t>(rng() % 2001) - 1000); break;
+    case ESortKey::Float32: {
+      float const value = std::uniform_real_distribution<float>{-1e3f, 1e3f}(rng);
+      std::memcpy(&words[i], &value, sizeof(float));
+      break;
+    }
+    case ESortKey::Uint64: {
+      // duplicates in the low word, the high word decides
+      uint64_t const value = (uint64_t{rng() % 64} << 40) | (rng() % 16);
+      std::memcpy(&words[2 * i], &value, sizeof(uint64_t));
+      break;
+    }
+    case ESortKey::Int64: {
+      int64_t const value = (static_cast<int64_t>(rng() % 2001) - 1000) * (int64_t{1} << 33) + rng() % 4;
+      std::memcpy(&words[2 * i], &value, sizeof(int64_t));
+      break;
+    }
+    case ESortKey::Float64: {
+      double const value = std::uniform_real_distribution<double>{-1e3, 1e3}(rng);
+      std::memcpy(&words[2 * i], &value, sizeof(double));
+      break;
+    }
+    }
+  }
+  return words;
+}
+
+// strict order of keys a and b of the raw words. Floats order -0 before +0
+// like the sort
+bool keyLess(ESortKey keyType, uint32_t const* words, uint32_t a, uint32_t b) {
+  auto const floatLess = [](auto x, auto y) {
+    return x < y || (x == y && std::signbit(x) && !std::signbit(y));
+  };
+  switch (keyType) {
+  case ESortKey::Uint32: return words[a] < words[b];
+  case ESortKey::Int32: return static_cast<int32_t>(words[a]) < static_cast<int32_t>(words[b]);
+  case ESortKey::Float32: {
+    float x, y;
+    std::memcpy(&x, &words[a], sizeof(float));
+    std::memcpy(&y, &words[b], sizeof(float));
+    return floatLess(x, y);
+  }
+  case ESortKey::Uint64: {
+    uint64_t x, y;
+    std::memcpy(&x, &words[2 * a], sizeof(uint64_t));
+    std::memcpy(&y, &words[2 * b], sizeof(uint64_t));
+    return x < y;
+  }
+  case ESortKey::Int64: {
+    int64_t x, y;
+    std::memcpy(&x, &words[2 * a], sizeof(int64_t));
+    std::memcpy(&y, &words[2 * b], sizeof(int64_t));
+    return x < y;
+  }
+  case ESortKey::Float64: {
+    double x, y;
+    std::memcpy(&x, &words[2 * a], sizeof(double));
+    std::memcpy(&y, &words[2 * b], sizeof(double));
+    return floatLess(x, y);
+  }
+  }
+  return false;
+}
+
+bool verify(GpuContext& gpu, RadixSort& sorter, ESortKey keyType, bool withValues, bool segmented) {
+  uint32_t const n = 5 * sorter.tileSize() + 123;
+  std::mt19937 rng{11};
+  std::vector<uint32_t> const keys = randomKeys(keyType, n, rng);
+  uint32_t const words = keyWords(keyType);
+  std::vector<uint32_t> offsets{0};
+  if (segmented) {
+    // uneven segments, some empty
+    for (uint32_t i = 1; i < 300; ++i) {
+      offsets.push_back(static_cast<uint32_t>(uint64_t{n} * i / 300 / 97 * 97));
+    }
+    offsets.push_back(n);
+  } else {
+    offsets.push_back(n);
+  }
+  uint32_t const segmentCount = static_cast<uint32_t>(offsets.size() - 1);
+
+  // expected: indices stably sorted by key within each segment
+  std::vector<uint32_t> expected(n);
+  std::iota(expected.begin(), expected.end(), 0);
+  for (uint32_t s = 0; s < segmentCount; ++s) {
+    std::stable_sort(expected.begin() + offsets[s], expected.begin() + offsets[s + 1],
+      [&](uint32_t a, uint32_t b) { return keyLess(keyType, keys.data(), a, b); });
+  }
+
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  DeviceBuffer dKeys = createDeviceBuffer(dev, keys.size() * sizeof(uint32_t));
+  DeviceBuffer dValues = createDeviceBuffer(dev, n * sizeof(uint32_t));
+  DeviceBuffer dOffsets = createDeviceBuffer(dev, offsets.size() * sizeof(uint32_t));
+  DeviceBuffer scratch = createDeviceBuffer(dev, sorter.scratchSize(n, keyType, withValues, segmentCount));
+  std::vector<uint32_t> values(n);
+  std::iota(values.begin(), values.end(), 0);
+  stream.upload(dKeys, keys.data(), keys.size() * sizeof(uint32_t));
+  stream.upload(dValues, values.data(), n * sizeof(uint32_t));
+  stream.upload(dOffsets, offsets.data(), offsets.size() * sizeof(uint32_t));
+  stream.barrier();
+  VkDeviceAddress const valueAddress = withValues ? dValues.address : 0;
+  if (segmented) {
+    sorter.sortSegments(stream.commandBuffer(), keyType, n, dKeys.address, valueAddress, dOffsets.address, segmentCount, scratch);
+  } else {
+    sorter.sort(stream.commandBuffer(), keyType, n, dKeys.address, valueAddress, scratch);
+  }
+  stream.barrier();
+  std::vector<uint32_t> sortedKeys(keys.size()), sortedValues(n);
+  stream.download(dKeys, sortedKeys.data(), keys.size() * sizeof(uint32_t));
+  stream.download(dValues, sortedValues.data(), n * sizeof(uint32_t));
+  stream.submitAndWait();
+  destroyDeviceBuffer(dev, dKeys);
+  destroyDeviceBuffer(dev, dValues);
+  destroyDeviceBuffer(dev, dOffsets);
+  destroyDeviceBuffer(dev, scratch);
+
+  for (uint32_t i = 0; i < n; ++i) {
+    if (std::memcmp(&sortedKeys[i * words], &keys[expected[i] * words], words * sizeof(uint32_t)) != 0) {
+      std::printf("keys mismatch at %u (key type %u, segments %u)\n", i, static_cast<uint32_t>(keyType), segmentCount);
+      return false;
+    }
+    if (withValues && sortedValues[i] != expected[i]) {
+      std::printf("values mismatch at %u (key type %u, segments %u)\n", i, static_cast<uint32_t>(keyType), segmentCount);
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T, typename F>
+double cpuMedianNs(std::vector<T> const& input, F&& sort) {
+  std::vector<double> samples;
+  std::vector<T> data;
+  for (uint32_t rep = 0; rep < REPETITIONS; ++rep) {
+    data = input;
+    Clock::time_point const start = Clock::now();
+    sort(data);
+    samples.push_back(static_cast<double>(elapsedNs(start, Clock::now())));
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+void printRow(char const* name, uint32_t n, double ns) {
+  std::printf("%-32s %12.2f %12.1f\n", name, ns / 1e6, ns > 0 ? n / ns * 1e3 : 0);
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const n = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : (1U << 24);
+  std::unique_ptr<GpuContext> gpu = createGpuContext();
+  if (!gpu) {
+    return 1;
+  }
+  {
+    RadixSort sorter(gpu->device.get(), gpu->shaders.get());
+    if (!sorter) {
+      return 1;
+    }
+    for (ESortKey keyType : {ESortKey::Uint32, ESortKey::Int32, ESortKey::Float32, ESortKey::Uint64, ESortKey::Int64, ESortKey::Float64}) {
+      for (bool withValues : {false, true}) {
+        for (bool segmented : {false, true}) {
+          if (!verify(*gpu, sorter, keyType, withValues, segmented)) {
+            return 1;
+          }
+        }
+      }
+    }
+    std::printf("correctness: ok, %u-bit digits, tile %u\n", sorter.radixBits(), sorter.tileSize());
+
+    std::mt19937 rng{1};
+    std::vector<uint32_t> input32(n);
+    for (uint32_t& key : input32) {
+      key = rng();
+    }
+    std::vector<uint64_t> input64(n);
+    for (uint64_t& key : input64) {
+      key = (uint64_t{rng()} << 32) | rng();
+    }
+    VulkanDevice& dev = *gpu->device;
+    ComputeStream& stream = *gpu->stream;
+    VkDeviceSize const keyBytes = n * sizeof(uint64_t);
+    DeviceBuffer source = createDeviceBuffer(dev, keyBytes);
+    DeviceBuffer keys = createDeviceBuffer(dev, keyBytes);
+    DeviceBuffer values = createDeviceBuffer(dev, n * sizeof(uint32_t));
+    // one scratch for every sort below
+    DeviceBuffer scratch = createDeviceBuffer(dev, sorter.scratchSize(n, ESortKey::Uint64, true));
+    if (!source || !keys || !values || !scratch) {
+      return 1;
+    }
+    stream.upload(values, input32.data(), n * sizeof(uint32_t));
+    stream.submitAndWait();
+
+    std::printf("elements: %u\n", n);
+    std::printf("%-32s %12s %12s\n", "implementation", "time (ms)", "Mkeys/s");
+    for (ESortKey keyType : {ESortKey::Uint32, ESortKey::Uint64}) {
+      bool const wide = keyType == ESortKey::Uint64;
+      VkDeviceSize const bytes = n * sizeof(uint32_t) * keyWords(keyType);
+      stream.upload(source, wide ? static_cast<void const*>(input64.data()) : input32.data(), bytes);
+      stream.submitAndWait();
+      auto const restore = [&](VkCommandBuffer cmd) {
+        VkBufferCopy const region{0, 0, bytes};
+        dev.api()->vkCmdCopyBuffer(cmd, source.buffer, keys.buffer, 1, &region);
+        computeBarrier(dev, cmd);
+      };
+      double const restoreNs = gpuMedianNs(stream, REPETITIONS, restore);
+      for (bool withValues : {false, true}) {
+        double const ns = gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+          restore(cmd);
+          sorter.sort(cmd, keyType, n, keys.address, withValues ? values.address : 0, scratch);
+        });
+        char name[64];
+        std::snprintf(name, sizeof(name), "gpu radix %s %s", wide ? "u64" : "u32", withValues ? "key-value" : "keys");
+        printRow(name, n, std::max(0.0, ns - restoreNs));
+      }
+    }
+    printRow("std::stable_sort u32", n, cpuMedianNs(input32, [](std::vector<uint32_t>& data) { std::stable_sort(data.begin(), data.end()); }));
+    printRow("std::sort u32", n, cpuMedianNs(input32, [](std::vector<uint32_t>& data) { std::sort(data.begin(), data.end()); }));
+    printRow("std::stable_sort u64", n, cpuMedianNs(input64, [](std::vector<uint64_t>& data) { std::stable_sort(data.begin(), data.end()); }));
+    printRow("std::sort u64", n, cpuMedianNs(input64, [](std::vector<uint64_t>& data) { std::sort(data.begin(), data.end()); }));
+
+    destroyDeviceBuffer(dev, source);
+    destroyDeviceBuffer(dev, keys);
+    destroyDeviceBuffer(dev, values);
+    destroyDeviceBuffer(dev, scratch);
+  }
+  return 0;
+}
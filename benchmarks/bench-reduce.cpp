@@ -0,0 +1,226 @@
+// Device reductions against reading the buffer back: the GPU time of sum and
+// argmax in both modes, then the host wall time of a full download reduced on
+// the CPU against a device reduction downloading 8 bytes. Before, every type,
+// op and mode is checked against the host on one large segment and on
+// uneven segments, and both modes must agree to the bit.
+// GPU times are medians of GPU timestamps, wall times medians of submissions
+// usage: avkex-bench-reduce [elements]
+#include "bench-gpu.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <random>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+uint32_t constexpr REPETITIONS = 7;
+
+template <typename T>
+ReductionResult hostReduce(EReduceOp op, T const* values, uint32_t n) {
+  if (op == EReduceOp::Sum) {
+    // f32 in double, integers wrap like the device
+    using Accumulator = std::conditional_t<std::is_floating_point_v<T>, double, uint32_t>;
+    Accumulator sum = 0;
+    for (uint32_t i = 0; i < n; ++i) {
+      sum += static_cast<Accumulator>(values[i]);
+    }
+    T const value = static_cast<T>(sum);
+    ReductionResult result{0, 0};
+    std::memcpy(&result.bits, &value, sizeof(T));
+    return result;
+  }
+  bool const min = op == EReduceOp::Min || op == EReduceOp::ArgMin;
+  T best = min ? std::numeric_limits<T>::max() : std::numeric_limits<T>::lowest();
+  if constexpr (std::is_floating_point_v<T>) {
+    best = min ? std::numeric_limits<T>::infinity() : -std::numeric_limits<T>::infinity();
+  }
+  uint32_t index = REDUCTION_NO_INDEX;
+  for (uint32_t i = 0; i < n; ++i) {
+    if (min ? values[i] < best : values[i] > best) {
+      best = values[i];
+      index = i;
+    } else if (values[i] == best && index == REDUCTION_NO_INDEX) {
+      index = i;
+    }
+  }
+  bool const arg = op == EReduceOp::ArgMin || op == EReduceOp::ArgMax;
+  ReductionResult result{0, arg ? index : 0};
+  std::memcpy(&result.bits, &best, sizeof(T));
+  return result;
+}
+
+bool matches(EReduceType type, EReduceOp op, ReductionResult expected, ReductionResult actual) {
+  if (type == EReduceType::Float32 && op == EReduceOp::Sum) {
+    float const e = expected.value<float>();
+    return std::abs(e - actual.value<float>()) <= 1e-4f * std::max(1.f, std::abs(e));
+  }
+  return expected.bits == actual.bits && expected.index == actual.index;
+}
+
+bool verify(GpuContext& gpu, Reduction& reduction, bool segmented) {
+  uint32_t const n = segmented ? (1U << 20) : (1U << 22) + 5;
+  std::mt19937 rng{5};
+  std::vector<uint32_t> words(n);
+  std::vector<uint32_t> offsets{0};
+  if (segmented) {
+    // uneven, with empty ones, large enough for several workgroups each
+    while (offsets.back() < n) {
+      offsets.push_back(std::min<uint32_t>(n, offsets.back() + (rng() % 4 == 0 ? 0 : rng() % 60000)));
+    }
+  } else {
+    offsets.push_back(n);
+  }
+  uint32_t const segmentCount = static_cast<uint32_t>(offsets.size() - 1);
+
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  DeviceBuffer src = createDeviceBuffer(dev, n * sizeof(uint32_t));
+  DeviceBuffer dOffsets = createDeviceBuffer(dev, offsets.size() * sizeof(uint32_t));
+  DeviceBuffer dst = createDeviceBuffer(dev, 2 * segmentCount * sizeof(ReductionResult));
+  DeviceBuffer scratch = createDeviceBuffer(dev, std::max<VkDeviceSize>(4, reduction.scratchSize(n, segmentCount)));
+  stream.upload(dOffsets, offsets.data(), offsets.size() * sizeof(uint32_t));
+  bool ok = true;
+  for (EReduceType type : {EReduceType::Uint32, EReduceType::Int32, EReduceType::Float32}) {
+    for (uint32_t i = 0; i < n; ++i) {
+      if (type == EReduceType::Float32) {
+        float const value = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
+        std::memcpy(&words[i], &value, sizeof(float));
+      } else {
+        // duplicates, ties for the arg ops
+        words[i] = type == EReduceType::Int32 ? static_cast<uint32_t>(static_cast<int32_t>(rng() % 20001) - 10000) : rng() % 100000;
+      }
+    }
+    stream.upload(src, words.data(), n * sizeof(uint32_t));
+    for (EReduceOp op : {EReduceOp::Sum, EReduceOp::Min, EReduceOp::Max, EReduceOp::ArgMin, EReduceOp::ArgMax}) {
+      for (EReduceMode mode : {EReduceMode::SinglePass, EReduceMode::TwoPass}) {
+        VkDeviceAddress const out = dst.address + static_cast<uint32_t>(mode) * segmentCount * sizeof(ReductionResult);
+        stream.barrier();
+        if (segmented) {
+          reduction.reduceSegments(stream.commandBuffer(), type, op, mode, n, src.address, dOffsets.address, segmentCount, out, scratch);
+        } else {
+          reduction.reduce(stream.commandBuffer(), type, op, mode, n, src.address, out, scratch);
+        }
+      }
+      std::vector<ReductionResult> results(2 * segmentCount);
+      stream.barrier();
+      stream.download(dst, results.data(), results.size() * sizeof(ReductionResult));
+      stream.submitAndWait();
+      for (uint32_t s = 0; s < segmentCount && ok; ++s) {
+        uint32_t const first = offsets[s];
+        uint32_t const count = offsets[s + 1] - first;
+        ReductionResult expected{};
+        switch (type) {
+        case EReduceType::Uint32: expected = hostReduce(op, words.data() + first, count); break;
+        case EReduceType::Int32: expected = hostReduce(op, reinterpret_cast<int32_t const*>(words.data()) + first, count); break;
+        case EReduceType::Float32: expected = hostReduce(op, reinterpret_cast<float const*>(words.data()) + first, count); break;
+        }
+        ReductionResult const single = results[s];
+        ReductionResult const twoPass = results[segmentCount + s];
+        if (!matches(type, op, expected, single) || single.bits != twoPass.bits || single.index != twoPass.index) {
+          std::printf("mismatch: type %u op %u segment %u/%u: expected (%08x, %u), single pass (%08x, %u), two pass (%08x, %u)\n",
+            static_cast<uint32_t>(type), static_cast<uint32_t>(op), s, segmentCount, expected.bits, expected.index, single.bits,
+            single.index, twoPass.bits, twoPass.index);
+          ok = false;
+        }
+      }
+    }
+  }
+  for (DeviceBuffer* buffer : {&src, &dOffsets, &dst, &scratch}) {
+    destroyDeviceBuffer(dev, *buffer);
+  }
+  return ok;
+}
+
+template <typename F>
+double wallMedianNs(F&& run) {
+  std::vector<double> samples;
+  for (uint32_t rep = 0; rep < REPETITIONS; ++rep) {
+    Clock::time_point const start = Clock::now();
+    run();
+    samples.push_back(static_cast<double>(elapsedNs(start, Clock::now())));
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+void printRow(char const* name, uint32_t n, double ns) {
+  std::printf("%-32s %12.3f %12.1f\n", name, ns / 1e6, ns > 0 ? n * sizeof(float) / ns : 0);
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const n = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : (1U << 26);
+  std::unique_ptr<GpuContext> gpu = createGpuContext();
+  if (!gpu) {
+    return 1;
+  }
+  {
+    Reduction reduction(gpu->device.get(), gpu->shaders.get());
+    if (!reduction) {
+      return 1;
+    }
+    if (!verify(*gpu, reduction, false) || !verify(*gpu, reduction, true)) {
+      return 1;
+    }
+    std::printf("correctness: ok\n");
+
+    std::mt19937 rng{1};
+    std::vector<float> input(n);
+    for (float& value : input) {
+      value = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
+    }
+    VulkanDevice& dev = *gpu->device;
+    ComputeStream& stream = *gpu->stream;
+    DeviceBuffer src = createDeviceBuffer(dev, n * sizeof(float));
+    DeviceBuffer dst = createDeviceBuffer(dev, sizeof(ReductionResult));
+    DeviceBuffer scratch = createDeviceBuffer(dev, std::max<VkDeviceSize>(4, reduction.scratchSize(n)));
+    if (!src || !dst || !scratch) {
+      return 1;
+    }
+    stream.upload(src, input.data(), n * sizeof(float));
+    stream.submitAndWait();
+
+    std::printf("elements: %u\n", n);
+    std::printf("%-32s %12s %12s\n", "operation", "time (ms)", "GB/s");
+    for (EReduceOp op : {EReduceOp::Sum, EReduceOp::ArgMax}) {
+      for (EReduceMode mode : {EReduceMode::SinglePass, EReduceMode::TwoPass}) {
+        char name[64];
+        std::snprintf(name, sizeof(name), "gpu %s %s", op == EReduceOp::Sum ? "sum" : "argmax",
+          mode == EReduceMode::SinglePass ? "single pass" : "two pass");
+        printRow(name, n, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+          reduction.reduce(cmd, EReduceType::Float32, op, mode, n, src.address, dst.address, scratch);
+        }));
+      }
+    }
+
+    std::vector<float> readBack(n);
+    double hostSum = 0;
+    printRow("wall: download + host sum", n, wallMedianNs([&]() {
+      stream.download(src, readBack.data(), n * sizeof(float));
+      stream.submitAndWait();
+      hostSum = 0;
+      for (float value : readBack) {
+        hostSum += value;
+      }
+    }));
+    ReductionResult result{};
+    printRow("wall: gpu sum + 8 byte download", n, wallMedianNs([&]() {
+      reduction.reduce(stream.commandBuffer(), EReduceType::Float32, EReduceOp::Sum, EReduceMode::SinglePass, n, src.address, dst.address,
+        scratch);
+      stream.barrier();
+      stream.download(dst, &result, sizeof(result));
+      stream.submitAndWait();
+    }));
+    std::printf("sum: host %g, gpu %g\n", hostSum, result.value<float>());
+
+    for (DeviceBuffer* buffer : {&src, &dst, &scratch}) {
+      destroyDeviceBuffer(dev, *buffer);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,152 @@
+// Throughput and push-to-pop latency of the bounded ring buffers across
+// producer/consumer counts and batch sizes, against a mutex protected
+// RingBuffer with the same capacity bound.
+// The threads column is producers + consumers.
+// usage: avkex-bench-ringbuffer [itemsPerProducer] [capacity]
+#include "avkex-utils.h"
+#include "bench-common.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+struct Item {
+  uint64_t pushNs = 0; // since the run start
+};
+
+class MutexRingBuffer {
+ public:
+  explicit MutexRingBuffer(size_t capacity) : m_capacity(capacity), m_ring(capacity) {}
+
+  size_t tryPush(Item* values, size_t count) {
+    std::lock_guard<std::mutex> lk{m_mtx};
+    size_t const n = std::min(count, m_capacity - m_ring.size());
+    for (size_t i = 0; i < n; ++i) {
+      m_ring.push_back(values[i]);
+    }
+    return n;
+  }
+
+  size_t tryPop(Item* out, size_t maxCount) {
+    std::lock_guard<std::mutex> lk{m_mtx};
+    size_t const n = std::min(maxCount, m_ring.size());
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = m_ring[i];
+    }
+    m_ring.pop_front(n);
+    return n;
+  }
+
+ private:
+  std::mutex m_mtx;
+  size_t m_capacity;
+  RingBuffer<Item> m_ring;
+};
+
+template <typename Queue>
+void run(char const* name, uint32_t producerCount, uint32_t consumerCount, uint32_t batch,
+  uint32_t itemsPerProducer, size_t capacity) {
+  Queue queue(capacity);
+  uint64_t const total = static_cast<uint64_t>(producerCount) * itemsPerProducer;
+  std::atomic<uint64_t> consumed = 0;
+  std::vector<std::vector<uint64_t>> samples(consumerCount);
+  Clock::time_point const start = Clock::now();
+
+  std::vector<std::thread> threads;
+  threads.reserve(producerCount + consumerCount);
+  for (uint32_t t = 0; t < producerCount; ++t) {
+    threads.emplace_back([&]() {
+      std::vector<Item> items(batch);
+      uint32_t remaining = itemsPerProducer;
+      while (remaining > 0) {
+        size_t const want = std::min<size_t>(batch, remaining);
+        uint64_t const now = elapsedNs(start, Clock::now());
+        for (size_t i = 0; i < want; ++i) {
+          items[i].pushNs = now;
+        }
+        size_t pushed = 0;
+        while (pushed < want) {
+          size_t const n = queue.tryPush(items.data() + pushed, want - pushed);
+          if (n == 0)
+            std::this_thread::yield();
+          pushed += n;
+        }
+        remaining -= static_cast<uint32_t>(want);
+      }
+    });
+  }
+  for (uint32_t t = 0; t < consumerCount; ++t) {
+    threads.emplace_back([&, t]() {
+      std::vector<uint64_t>& mine = samples[t];
+      mine.reserve(total / consumerCount + batch);
+      std::vector<Item> items(batch);
+      while (consumed.load(std::memory_order_relaxed) < total) {
+        size_t const n = queue.tryPop(items.data(), batch);
+        if (n == 0) {
+          std::this_thread::yield();
+          continue;
+        }
+        uint64_t const now = elapsedNs(start, Clock::now());
+        for (size_t i = 0; i < n; ++i) {
+          mine.push_back(now - items[i].pushNs);
+        }
+        consumed.fetch_add(n, std::memory_order_relaxed);
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  Clock::time_point const end = Clock::now();
+
+  std::vector<uint64_t> all;
+  all.reserve(total);
+  for (std::vector<uint64_t> const& mine : samples) {
+    all.insert(all.end(), mine.begin(), mine.end());
+  }
+  double const seconds = static_cast<double>(elapsedNs(start, end)) * 1e-9;
+  double const mops = static_cast<double>(all.size()) / seconds * 1e-6;
+  std::string const label = std::string(name) + " " + std::to_string(producerCount) + "p" +
+    std::to_string(consumerCount) + "c b" + std::to_string(batch);
+  printLatencyRow(label.c_str(), producerCount + consumerCount, mops, summarize(all));
+}
+
+struct Config {
+  uint32_t producers;
+  uint32_t consumers;
+};
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const itemsPerProducer = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 500'000;
+  size_t const capacity = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4096;
+  uint32_t const maxThreads = std::max(2U, std::thread::hardware_concurrency());
+  uint32_t const batches[] = {1, 16};
+
+  std::printf("ring buffers, %u items per producer, capacity %zu\n", itemsPerProducer, capacity);
+  printLatencyHeader();
+  for (uint32_t batch : batches) {
+    run<MutexRingBuffer>("RingBuffer+mutex", 1, 1, batch, itemsPerProducer, capacity);
+    run<SpscRingBuffer<Item>>("SpscRingBuffer", 1, 1, batch, itemsPerProducer, capacity);
+    run<MpmcRingBuffer<Item>>("MpmcRingBuffer", 1, 1, batch, itemsPerProducer, capacity);
+  }
+
+  Config const configs[] = {{2, 2}, {4, 4}, {1, 4}, {4, 1}, {8, 8}};
+  for (Config const& config : configs) {
+    if (config.producers + config.consumers > maxThreads)
+      continue;
+    for (uint32_t batch : batches) {
+      run<MutexRingBuffer>("RingBuffer+mutex", config.producers, config.consumers, batch, itemsPerProducer, capacity);
+      run<MpmcRingBuffer<Item>>("MpmcRingBuffer", config.producers, config.consumers, batch, itemsPerProducer, capacity);
+    }
+  }
+}
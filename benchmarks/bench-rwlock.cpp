@@ -0,0 +1,149 @@
+// Reader/writer lock throughput, latency and CPU usage across write ratios,
+// against the previous AtomicVector yield loop lock and std::shared_mutex.
+// Each thread runs a random mix of reads (sum a small payload) and writes
+// (increment it). Reads and writes are reported on separate rows, the cpu/wall
+// column shows how many cores were kept busy, run with more threads than cores
+// to see the cost of yield loops under oversubscription.
+// usage: avkex-bench-rwlock [opsPerThread]
+#include "avkex-utils.h"
+#include "bench-common.h"
+
+#include <cstdlib>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+struct Payload {
+  uint64_t values[8];
+};
+
+template <typename Lock>
+class LockedPayload {
+ public:
+  uint64_t read() {
+    std::shared_lock<Lock> lk{m_lock};
+    uint64_t sum = 0;
+    for (uint64_t v : m_payload.values) {
+      sum += v;
+    }
+    return sum;
+  }
+
+  void write() {
+    std::lock_guard<Lock> lk{m_lock};
+    for (uint64_t& v : m_payload.values) {
+      ++v;
+    }
+  }
+
+ private:
+  Lock m_lock;
+  Payload m_payload{};
+};
+
+class SeqLockedPayload {
+ public:
+  uint64_t read() {
+    Payload const payload = m_payload.load();
+    uint64_t sum = 0;
+    for (uint64_t v : payload.values) {
+      sum += v;
+    }
+    return sum;
+  }
+
+  void write() {
+    m_payload.update([](Payload& payload) {
+      for (uint64_t& v : payload.values) {
+        ++v;
+      }
+    });
+  }
+
+ private:
+  SeqLocked<Payload> m_payload;
+};
+
+template <typename Shared>
+void run(char const* name, uint32_t threadCount, uint32_t writePercent, uint32_t opsPerThread) {
+  Shared shared;
+  std::vector<std::vector<uint64_t>> readSamples(threadCount);
+  std::vector<std::vector<uint64_t>> writeSamples(threadCount);
+  std::atomic<uint64_t> sink = 0;
+
+  double const cpuStart = processCpuSeconds();
+  Clock::time_point const start = Clock::now();
+  std::vector<std::thread> threads;
+  threads.reserve(threadCount);
+  for (uint32_t t = 0; t < threadCount; ++t) {
+    threads.emplace_back([&, t]() {
+      std::vector<uint64_t>& reads = readSamples[t];
+      std::vector<uint64_t>& writes = writeSamples[t];
+      reads.reserve(opsPerThread);
+      writes.reserve(opsPerThread * writePercent / 100 + 64);
+      uint32_t rng = 0x9E3779B9U * (t + 1);
+      uint64_t localSum = 0;
+      for (uint32_t i = 0; i < opsPerThread; ++i) {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        bool const isWrite = rng % 100 < writePercent;
+        Clock::time_point const before = Clock::now();
+        if (isWrite) {
+          shared.write();
+        } else {
+          localSum += shared.read();
+        }
+        Clock::time_point const after = Clock::now();
+        (isWrite ? writes : reads).push_back(elapsedNs(before, after));
+      }
+      sink.fetch_add(localSum, std::memory_order_relaxed);
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  Clock::time_point const end = Clock::now();
+  double const seconds = static_cast<double>(elapsedNs(start, end)) * 1e-9;
+  double const cpuPerWall = (processCpuSeconds() - cpuStart) / seconds;
+  double const mops = static_cast<double>(threadCount) * opsPerThread / seconds * 1e-6;
+
+  auto const report = [&](char const* kind, std::vector<std::vector<uint64_t>> const& samples) {
+    std::vector<uint64_t> all;
+    for (std::vector<uint64_t> const& mine : samples) {
+      all.insert(all.end(), mine.begin(), mine.end());
+    }
+    if (all.empty())
+      return;
+    std::string const label = std::string(name) + " w" + std::to_string(writePercent) + "% " + kind;
+    printCpuLatencyRow(label.c_str(), threadCount, mops, cpuPerWall, summarize(all));
+  };
+  report("R", readSamples);
+  report("W", writeSamples);
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const opsPerThread = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 200'000;
+  uint32_t const cores = std::max(2U, std::thread::hardware_concurrency());
+  uint32_t const writePercents[] = {0, 1, 10, 50};
+  uint32_t const threadCounts[] = {cores, 2 * cores}; // second one oversubscribed
+
+  std::printf("reader/writer locks, %u ops per thread, %u cores\n", opsPerThread, cores);
+  printCpuLatencyHeader();
+  for (uint32_t threadCount : threadCounts) {
+    for (uint32_t writePercent : writePercents) {
+      run<LockedPayload<LegacyYieldRwLock>>("yield loop (legacy)", threadCount, writePercent, opsPerThread);
+      run<LockedPayload<std::shared_mutex>>("std::shared_mutex", threadCount, writePercent, opsPerThread);
+      run<LockedPayload<AdaptiveSharedMutex>>("AdaptiveSharedMutex", threadCount, writePercent, opsPerThread);
+      run<SeqLockedPayload>("SeqLocked", threadCount, writePercent, opsPerThread);
+    }
+  }
+}
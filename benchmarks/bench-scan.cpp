@@ -0,0 +1,387 @@
+// Device prefix scans and stream compaction against std::inclusive_scan and a
+// host compaction loop on one thread: GB/s of u32 and f32 inclusive sums (one
+// read and one write), u32 exclusive sum and compaction (values and flags
+// read, selected values written). Before, every type and operator is checked
+// inclusive and exclusive against std::inclusive_scan/std::exclusive_scan on
+// sizes below, at and off the tile size, a scan in place, and compact and
+// partition (n = 0 included) with the indirect dispatch they write.
+// GPU times are medians of GPU timestamps, host times medians of runs
+// usage: avkex-bench-scan [elements]
+#include "bench-gpu.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <random>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+uint32_t constexpr REPETITIONS = 7;
+uint32_t constexpr ITEMS_PER_GROUP = 64;
+
+char const* opName(EScanOp op) {
+  switch (op) {
+  case EScanOp::Add: return "add";
+  case EScanOp::Min: return "min";
+  case EScanOp::Max: return "max";
+  case EScanOp::Mul: return "mul";
+  case EScanOp::BitAnd: return "and";
+  case EScanOp::BitOr: return "or";
+  default: return "xor";
+  }
+}
+
+// the identity of scan.comp, the first value of exclusive scans
+template <typename T>
+T identity(EScanOp op) {
+  if constexpr (std::is_floating_point_v<T>) {
+    switch (op) {
+    case EScanOp::Min: return std::numeric_limits<T>::infinity();
+    case EScanOp::Max: return -std::numeric_limits<T>::infinity();
+    case EScanOp::Mul: return 1;
+    default: return 0;
+    }
+  } else {
+    switch (op) {
+    case EScanOp::Min:
+    case EScanOp::BitAnd: return std::numeric_limits<T>::max();
+    case EScanOp::Mul: return 1;
+    default: return 0;
+    }
+  }
+}
+
+// integers wrap like the device, f32 sums and products in double
+template <typename T>
+std::vector<T> hostScan(std::vector<T> const& x, EScanOp op, bool inclusive) {
+  std::vector<T> result(x.size());
+  auto const run = [&](auto const& values, auto& out, auto combine) {
+    using V = typename std::decay_t<decltype(values)>::value_type;
+    if (inclusive) {
+      std::inclusive_scan(values.begin(), values.end(), out.begin(), combine);
+    } else {
+      std::exclusive_scan(values.begin(), values.end(), out.begin(), static_cast<V>(identity<T>(op)), combine);
+    }
+  };
+  auto const min = [](auto a, auto b) { return std::min(a, b); };
+  auto const max = [](auto a, auto b) { return std::max(a, b); };
+  if constexpr (std::is_floating_point_v<T>) {
+    if (op == EScanOp::Add || op == EScanOp::Mul) {
+      std::vector<double> const wide(x.begin(), x.end());
+      std::vector<double> out(x.size());
+      if (op == EScanOp::Add) {
+        run(wide, out, std::plus<>{});
+      } else {
+        run(wide, out, std::multiplies<>{});
+      }
+      std::transform(out.begin(), out.end(), result.begin(), [](double v) { return static_cast<T>(v); });
+    } else if (op == EScanOp::Min) {
+      run(x, result, min);
+    } else {
+      run(x, result, max);
+    }
+  } else {
+    switch (op) {
+    case EScanOp::Add: run(x, result, std::plus<T>{}); break;
+    case EScanOp::Min: run(x, result, min); break;
+    case EScanOp::Max: run(x, result, max); break;
+    case EScanOp::Mul: run(x, result, std::multiplies<T>{}); break;
+    case EScanOp::BitAnd: run(x, result, std::bit_and<T>{}); break;
+    case EScanOp::BitOr: run(x, result, std::bit_or<T>{}); break;
+    case EScanOp::BitXor: run(x, result, std::bit_xor<T>{}); break;
+    }
+  }
+  return result;
+}
+
+// f32 sums: the error grows with the magnitude of what was summed so far
+bool matches(float expected, float actual, EScanOp op, double magnitude) {
+  switch (op) {
+  case EScanOp::Add: return std::abs(static_cast<double>(expected) - actual) <= 1e-5 * (magnitude + 1.0);
+  case EScanOp::Mul: return std::abs(static_cast<double>(expected) - actual) <= 1e-3 * std::abs(static_cast<double>(expected));
+  default: return expected == actual;
+  }
+}
+
+bool matches(uint32_t expected, uint32_t actual, EScanOp, double) {
+  return expected == actual;
+}
+
+template <typename T>
+bool verifyScans(GpuContext& gpu, PrefixScan& scan, EScanType type, uint32_t n) {
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  std::mt19937 rng{n};
+  DeviceBuffer src = createDeviceBuffer(dev, n * sizeof(T));
+  DeviceBuffer dst = createDeviceBuffer(dev, 2 * n * sizeof(T));
+  DeviceBuffer scratch = createDeviceBuffer(dev, scan.scratchSize(n));
+  if (!src || !dst || !scratch) {
+    return false;
+  }
+  std::vector<EScanOp> ops{EScanOp::Add, EScanOp::Min, EScanOp::Max, EScanOp::Mul};
+  if (type == EScanType::Uint32) {
+    ops.insert(ops.end(), {EScanOp::BitAnd, EScanOp::BitOr, EScanOp::BitXor});
+  }
+  bool ok = true;
+  for (EScanOp const op : ops) {
+    // products near 1 in f32, odd factors in u32: neither collapses to 0 or inf
+    std::vector<T> x(n);
+    for (T& value : x) {
+      if constexpr (std::is_floating_point_v<T>) {
+        value = op == EScanOp::Mul ? std::uniform_real_distribution<T>{0.999f, 1.001f}(rng) : std::uniform_real_distribution<T>{-1.f, 1.f}(rng);
+      } else {
+        // and/or need mostly set and mostly clear bits to stay informative
+        value = rng();
+        value = op == EScanOp::Mul ? value | 1 : (op == EScanOp::BitAnd ? value | (value << 1) | 0x80000000U : value);
+      }
+    }
+    stream.upload(src, x.data(), n * sizeof(T));
+    stream.barrier();
+    scan.inclusiveScan(stream.commandBuffer(), type, op, n, src.address, dst.address, scratch);
+    scan.exclusiveScan(stream.commandBuffer(), type, op, n, src.address, dst.address + n * sizeof(T), scratch);
+    std::vector<T> results(2 * size_t{n});
+    stream.barrier();
+    stream.download(dst, results.data(), results.size() * sizeof(T));
+    stream.submitAndWait();
+
+    for (bool const inclusive : {true, false}) {
+      std::vector<T> const expected = hostScan(x, op, inclusive);
+      T const* const actual = results.data() + (inclusive ? 0 : n);
+      double magnitude = 0;
+      for (uint32_t i = 0; i < n && ok; ++i) {
+        magnitude += inclusive ? std::abs(static_cast<double>(x[i])) : 0;
+        ok = matches(expected[i], actual[i], op, magnitude);
+        if (!ok) {
+          std::printf("mismatch: %s %s %s scan of %u, at %u: expected %g, got %g\n", type == EScanType::Uint32 ? "u32" : "f32", opName(op),
+            inclusive ? "inclusive" : "exclusive", n, i, static_cast<double>(expected[i]), static_cast<double>(actual[i]));
+        }
+        magnitude += inclusive ? 0 : std::abs(static_cast<double>(x[i]));
+      }
+    }
+  }
+  for (DeviceBuffer* buffer : {&src, &dst, &scratch}) {
+    destroyDeviceBuffer(dev, *buffer);
+  }
+  return ok;
+}
+
+// src is dst
+bool verifyInPlace(GpuContext& gpu, PrefixScan& scan, uint32_t n) {
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  std::mt19937 rng{n};
+  std::vector<uint32_t> x(n);
+  for (uint32_t& value : x) {
+    value = rng() % 1000;
+  }
+  DeviceBuffer data = createDeviceBuffer(dev, n * sizeof(uint32_t));
+  DeviceBuffer scratch = createDeviceBuffer(dev, scan.scratchSize(n));
+  if (!data || !scratch) {
+    return false;
+  }
+  std::vector<uint32_t> result(n);
+  stream.upload(data, x.data(), n * sizeof(uint32_t));
+  stream.barrier();
+  scan.inclusiveScan(stream.commandBuffer(), EScanType::Uint32, EScanOp::Add, n, data.address, data.address, scratch);
+  stream.barrier();
+  stream.download(data, result.data(), n * sizeof(uint32_t));
+  stream.submitAndWait();
+  destroyDeviceBuffer(dev, data);
+  destroyDeviceBuffer(dev, scratch);
+  if (result != hostScan(x, EScanOp::Add, true)) {
+    std::printf("mismatch: in place u32 add scan of %u\n", n);
+    return false;
+  }
+  return true;
+}
+
+// compact and partition, their CompactionCount included
+bool verifyCompaction(GpuContext& gpu, PrefixScan& scan, uint32_t n) {
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  std::mt19937 rng{n + 1};
+  std::vector<uint32_t> values(n);
+  std::vector<uint32_t> flags(n);
+  for (uint32_t i = 0; i < n; ++i) {
+    values[i] = rng();
+    // a third selected, by any nonzero flag
+    flags[i] = rng() % 3 == 0 ? rng() | 1 : 0;
+  }
+  std::vector<uint32_t> expected;
+  for (uint32_t i = 0; i < n; ++i) {
+    if (flags[i] != 0) {
+      expected.push_back(values[i]);
+    }
+  }
+  uint32_t const selected = static_cast<uint32_t>(expected.size());
+  for (uint32_t i = n; i-- > 0;) {
+    if (flags[i] == 0) {
+      expected.push_back(values[i]);
+    }
+  }
+
+  DeviceBuffer dValues = createDeviceBuffer(dev, n * sizeof(uint32_t));
+  DeviceBuffer dFlags = createDeviceBuffer(dev, n * sizeof(uint32_t));
+  DeviceBuffer dst = createDeviceBuffer(dev, 2 * n * sizeof(uint32_t));
+  DeviceBuffer counts = createDeviceBuffer(dev, 2 * sizeof(CompactionCount));
+  DeviceBuffer scratch = createDeviceBuffer(dev, scan.scratchSize(n));
+  if (!dValues || !dFlags || !dst || !counts || !scratch) {
+    return false;
+  }
+  if (n > 0) {
+    stream.upload(dValues, values.data(), n * sizeof(uint32_t));
+    stream.upload(dFlags, flags.data(), n * sizeof(uint32_t));
+  }
+  stream.barrier();
+  scan.compact(stream.commandBuffer(), n, dValues.address, dFlags.address, dst.address, counts.address, ITEMS_PER_GROUP, scratch);
+  scan.partition(stream.commandBuffer(), n, dValues.address, dFlags.address, dst.address + n * sizeof(uint32_t),
+    counts.address + sizeof(CompactionCount), ITEMS_PER_GROUP, scratch);
+  std::vector<uint32_t> results(2 * size_t{n});
+  CompactionCount written[2]{};
+  stream.barrier();
+  if (n > 0) {
+    stream.download(dst, results.data(), results.size() * sizeof(uint32_t));
+  }
+  stream.download(counts, written, sizeof(written));
+  stream.submitAndWait();
+  for (DeviceBuffer* buffer : {&dValues, &dFlags, &dst, &counts, &scratch}) {
+    destroyDeviceBuffer(dev, *buffer);
+  }
+
+  uint32_t const groups = (selected + ITEMS_PER_GROUP - 1) / ITEMS_PER_GROUP;
+  bool ok = true;
+  for (CompactionCount const& count : written) {
+    ok = ok && count.count == selected && count.dispatch.x == groups && count.dispatch.y == 1 && count.dispatch.z == 1;
+  }
+  if (!ok) {
+    std::printf("mismatch: compaction of %u, expected count %u, dispatch %u: compact %u {%u, %u, %u}, partition %u {%u, %u, %u}\n", n,
+      selected, groups, written[0].count, written[0].dispatch.x, written[0].dispatch.y, written[0].dispatch.z, written[1].count,
+      written[1].dispatch.x, written[1].dispatch.y, written[1].dispatch.z);
+    return false;
+  }
+  if (!std::equal(expected.begin(), expected.begin() + selected, results.begin()) ||
+      !std::equal(expected.begin(), expected.end(), results.begin() + n)) {
+    std::printf("mismatch: compaction of %u, values\n", n);
+    return false;
+  }
+  return true;
+}
+
+template <typename F>
+double hostMedianNs(F&& run) {
+  std::vector<double> samples;
+  for (uint32_t rep = 0; rep < REPETITIONS; ++rep) {
+    Clock::time_point const start = Clock::now();
+    run();
+    samples.push_back(static_cast<double>(elapsedNs(start, Clock::now())));
+  }
+  std::sort(samples.begin(), samples.end());
+  return samples[samples.size() / 2];
+}
+
+void printRow(char const* name, uint64_t bytes, double ns) {
+  std::printf("%-32s %12.3f %12.1f\n", name, ns / 1e6, ns > 0 ? bytes / ns : 0);
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const n = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : (1U << 26);
+  if (n == 0) {
+    return 1;
+  }
+  std::unique_ptr<GpuContext> gpu = createGpuContext();
+  if (!gpu) {
+    return 1;
+  }
+  {
+    PrefixScan scan(gpu->device.get(), gpu->shaders.get());
+    if (!scan) {
+      return 1;
+    }
+    uint32_t const tile = scan.tileSize();
+    for (uint32_t const size : {1U, tile - 1, tile, tile + 5, 37 * tile + 11, (1U << 20) + 3}) {
+      if (!verifyScans<uint32_t>(*gpu, scan, EScanType::Uint32, size) || !verifyScans<float>(*gpu, scan, EScanType::Float32, size)) {
+        return 1;
+      }
+    }
+    if (!verifyInPlace(*gpu, scan, 5 * tile + 3)) {
+      return 1;
+    }
+    for (uint32_t const size : {0U, 1U, tile + 5, (1U << 20) + 3}) {
+      if (!verifyCompaction(*gpu, scan, size)) {
+        return 1;
+      }
+    }
+    std::printf("correctness: ok, tile %u\n", tile);
+
+    std::mt19937 rng{1};
+    std::vector<uint32_t> values(n);
+    std::vector<uint32_t> flags(n);
+    std::vector<float> floats(n);
+    for (uint32_t i = 0; i < n; ++i) {
+      values[i] = rng() % 1000;
+      flags[i] = rng() % 2;
+      floats[i] = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
+    }
+    uint64_t const selected = static_cast<uint64_t>(std::count(flags.begin(), flags.end(), 1U));
+    VulkanDevice& dev = *gpu->device;
+    ComputeStream& stream = *gpu->stream;
+    DeviceBuffer dValues = createDeviceBuffer(dev, n * sizeof(uint32_t));
+    DeviceBuffer dFlags = createDeviceBuffer(dev, n * sizeof(uint32_t));
+    DeviceBuffer dFloats = createDeviceBuffer(dev, n * sizeof(float));
+    DeviceBuffer dst = createDeviceBuffer(dev, n * sizeof(uint32_t));
+    DeviceBuffer count = createDeviceBuffer(dev, sizeof(CompactionCount));
+    DeviceBuffer scratch = createDeviceBuffer(dev, scan.scratchSize(n));
+    if (!dValues || !dFlags || !dFloats || !dst || !count || !scratch) {
+      return 1;
+    }
+    stream.upload(dValues, values.data(), n * sizeof(uint32_t));
+    stream.upload(dFlags, flags.data(), n * sizeof(uint32_t));
+    stream.upload(dFloats, floats.data(), n * sizeof(float));
+    stream.submitAndWait();
+
+    uint64_t const scanBytes = 2 * uint64_t{n} * sizeof(uint32_t);
+    uint64_t const compactBytes = (2 * uint64_t{n} + selected) * sizeof(uint32_t);
+    std::printf("elements: %u\n", n);
+    std::printf("%-32s %12s %12s\n", "operation", "time (ms)", "GB/s");
+    printRow("gpu u32 inclusive add", scanBytes, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+      scan.inclusiveScan(cmd, EScanType::Uint32, EScanOp::Add, n, dValues.address, dst.address, scratch);
+    }));
+    printRow("gpu u32 exclusive add", scanBytes, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+      scan.exclusiveScan(cmd, EScanType::Uint32, EScanOp::Add, n, dValues.address, dst.address, scratch);
+    }));
+    printRow("gpu f32 inclusive add", scanBytes, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+      scan.inclusiveScan(cmd, EScanType::Float32, EScanOp::Add, n, dFloats.address, dst.address, scratch);
+    }));
+    printRow("gpu compact", compactBytes, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+      scan.compact(cmd, n, dValues.address, dFlags.address, dst.address, count.address, ITEMS_PER_GROUP, scratch);
+    }));
+
+    std::vector<uint32_t> out(n);
+    std::vector<float> floatOut(n);
+    printRow("host u32 inclusive add", scanBytes, hostMedianNs([&]() {
+      std::inclusive_scan(values.begin(), values.end(), out.begin());
+    }));
+    printRow("host f32 inclusive add", scanBytes, hostMedianNs([&]() {
+      std::inclusive_scan(floats.begin(), floats.end(), floatOut.begin());
+    }));
+    printRow("host compact", compactBytes, hostMedianNs([&]() {
+      uint32_t written = 0;
+      for (uint32_t i = 0; i < n; ++i) {
+        out[written] = values[i];
+        written += flags[i] != 0 ? 1 : 0;
+      }
+    }));
+
+    for (DeviceBuffer* buffer : {&dValues, &dFlags, &dFloats, &dst, &count, &scratch}) {
+      destroyDeviceBuffer(dev, *buffer);
+    }
+  }
+  return 0;
+}
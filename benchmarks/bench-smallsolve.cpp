@@ -0,0 +1,294 @@
+// Batched small solves against a host loop: matrices per second of LU and
+// Cholesky factorization plus a one column solve, per matrix size, next to a
+// single host thread factoring and solving the same batch. Before, every
+// factorization and solve is checked on uneven sizes through the residual
+// |A x - b| relative to |A| |x| + |b|, and a singular matrix must report it.
+// Timed runs factor in place over and over, the values don't change the work.
+// GPU times are medians of GPU timestamps, host times medians of runs
+// usage: avkex-bench-smallsolve [batch]
+#include "bench-gpu.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+uint32_t constexpr REPETITIONS = 7;
+
+enum class EKind : uint8_t { Lu = 0, Cholesky, Lower, Upper, UnitLower };
+
+// row major matrices one after the other
+std::vector<float> randomMatrices(std::mt19937& rng, EKind kind, uint32_t n, uint32_t batchCount) {
+  std::uniform_real_distribution<float> uniform{-1.f, 1.f};
+  std::vector<float> matrices(size_t{n} * n * batchCount);
+  std::vector<float> m(size_t{n} * n);
+  for (uint32_t batch = 0; batch < batchCount; ++batch) {
+    float* a = matrices.data() + size_t{batch} * n * n;
+    for (float& value : m) {
+      value = uniform(rng);
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+      for (uint32_t j = 0; j < n; ++j) {
+        float& value = a[i * n + j];
+        switch (kind) {
+        case EKind::Lu: value = m[i * n + j]; break;
+        case EKind::Cholesky: {
+          // M M^T + n I
+          float sum = i == j ? static_cast<float>(n) : 0.f;
+          for (uint32_t l = 0; l < n; ++l) {
+            sum += m[i * n + l] * m[j * n + l];
+          }
+          value = sum;
+          break;
+        }
+        // diagonal in [1, 2], the unused triangle garbage
+        case EKind::Lower:
+        case EKind::UnitLower: value = i == j ? 1.5f + 0.5f * m[i * n + j] : i > j ? m[i * n + j] / n : 1e30f; break;
+        case EKind::Upper: value = i == j ? 1.5f + 0.5f * m[i * n + j] : i < j ? m[i * n + j] / n : 1e30f; break;
+        }
+      }
+    }
+  }
+  return matrices;
+}
+
+// element e of matrix b to e * batchCount + b and back
+std::vector<float> interleave(std::vector<float> const& matrices, uint32_t elements, uint32_t batchCount, bool back = false) {
+  std::vector<float> result(matrices.size());
+  for (uint32_t batch = 0; batch < batchCount; ++batch) {
+    for (uint32_t e = 0; e < elements; ++e) {
+      size_t const contiguous = size_t{batch} * elements + e;
+      size_t const interleaved = size_t{e} * batchCount + batch;
+      if (back) {
+        result[contiguous] = matrices[interleaved];
+      } else {
+        result[interleaved] = matrices[contiguous];
+      }
+    }
+  }
+  return result;
+}
+
+bool verify(GpuContext& gpu, BatchedSolver& solver, EKind kind, uint32_t n, uint32_t nrhs) {
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  uint32_t const batchCount = 1000 + n;
+  std::mt19937 rng{n * 5 + static_cast<uint32_t>(kind)};
+  std::vector<float> a = randomMatrices(rng, kind, n, batchCount);
+  if (kind == EKind::Lu) {
+    // a zero matrix for info
+    std::fill(a.begin(), a.begin() + n * n, 0.f);
+  }
+  std::vector<float> b(size_t{n} * nrhs * batchCount);
+  std::generate(b.begin(), b.end(), [&]() { return std::uniform_real_distribution<float>{-1.f, 1.f}(rng); });
+
+  DeviceBuffer dA = createDeviceBuffer(dev, a.size() * sizeof(float));
+  DeviceBuffer dB = createDeviceBuffer(dev, b.size() * sizeof(float));
+  DeviceBuffer dPermutation = createDeviceBuffer(dev, size_t{n} * batchCount * sizeof(uint32_t));
+  DeviceBuffer dInfo = createDeviceBuffer(dev, batchCount * sizeof(uint32_t));
+  stream.upload(dA, interleave(a, n * n, batchCount).data(), a.size() * sizeof(float));
+  stream.upload(dB, interleave(b, n * nrhs, batchCount).data(), b.size() * sizeof(float));
+  stream.barrier();
+  VkCommandBuffer const cmd = stream.commandBuffer();
+  switch (kind) {
+  case EKind::Lu:
+    solver.factorLu(cmd, n, batchCount, batchCount, dA.address, dPermutation.address, dInfo.address);
+    stream.barrier();
+    solver.solveLu(cmd, n, nrhs, batchCount, batchCount, dA.address, dPermutation.address, dB.address);
+    break;
+  case EKind::Cholesky:
+    solver.factorCholesky(cmd, n, batchCount, batchCount, dA.address, dInfo.address);
+    stream.barrier();
+    solver.solveCholesky(cmd, n, nrhs, batchCount, batchCount, dA.address, dB.address);
+    break;
+  case EKind::Lower: solver.solveTriangular(cmd, ETriangle::Lower, false, n, nrhs, batchCount, batchCount, dA.address, dB.address); break;
+  case EKind::Upper: solver.solveTriangular(cmd, ETriangle::Upper, false, n, nrhs, batchCount, batchCount, dA.address, dB.address); break;
+  case EKind::UnitLower:
+    solver.solveTriangular(cmd, ETriangle::Lower, true, n, nrhs, batchCount, batchCount, dA.address, dB.address);
+    break;
+  }
+  std::vector<float> x(b.size());
+  std::vector<uint32_t> info(batchCount);
+  std::vector<uint32_t> permutation(size_t{n} * batchCount);
+  stream.barrier();
+  stream.download(dB, x.data(), x.size() * sizeof(float));
+  stream.download(dInfo, info.data(), info.size() * sizeof(uint32_t));
+  stream.download(dPermutation, permutation.data(), permutation.size() * sizeof(uint32_t));
+  stream.submitAndWait();
+  x = interleave(x, n * nrhs, batchCount, true);
+  for (DeviceBuffer* buffer : {&dA, &dB, &dPermutation, &dInfo}) {
+    destroyDeviceBuffer(dev, *buffer);
+  }
+
+  bool const factored = kind == EKind::Lu || kind == EKind::Cholesky;
+  uint32_t const first = kind == EKind::Lu ? 1 : 0;
+  if (kind == EKind::Lu && info[0] != 1) {
+    std::printf("mismatch: LU %u: singular matrix info %u\n", n, info[0]);
+    return false;
+  }
+  for (uint32_t batch = first; batch < batchCount; ++batch) {
+    float const* m = a.data() + size_t{batch} * n * n;
+    if (factored && info[batch] != 0) {
+      std::printf("mismatch: kind %u n %u matrix %u: info %u\n", static_cast<uint32_t>(kind), n, batch, info[batch]);
+      return false;
+    }
+    if (kind == EKind::Lu) {
+      std::vector<uint32_t> rows(n);
+      for (uint32_t k = 0; k < n; ++k) {
+        rows[k] = permutation[size_t{k} * batchCount + batch];
+      }
+      std::sort(rows.begin(), rows.end());
+      for (uint32_t k = 0; k < n; ++k) {
+        if (rows[k] != k) {
+          std::printf("mismatch: LU %u matrix %u: not a permutation\n", n, batch);
+          return false;
+        }
+      }
+    }
+    for (uint32_t i = 0; i < n; ++i) {
+      for (uint32_t c = 0; c < nrhs; ++c) {
+        double residual = -b[(size_t{batch} * n + i) * nrhs + c];
+        double scale = std::abs(residual);
+        for (uint32_t j = 0; j < n; ++j) {
+          double value = m[i * n + j];
+          // the triangle the kind reads
+          if ((kind == EKind::Lower || kind == EKind::UnitLower) && j > i) {
+            value = 0;
+          } else if (kind == EKind::Upper && j < i) {
+            value = 0;
+          } else if (kind == EKind::Cholesky && j > i) {
+            value = m[j * n + i];
+          } else if (kind == EKind::UnitLower && j == i) {
+            value = 1;
+          }
+          double const term = value * x[(size_t{batch} * n + j) * nrhs + c];
+          residual += term;
+          scale += std::abs(term);
+        }
+        if (!(std::abs(residual) <= 1e-5 * n * scale)) {
+          std::printf("mismatch: kind %u n %u matrix %u row %u column %u: residual %g of %g\n", static_cast<uint32_t>(kind), n, batch, i,
+            c, residual, scale);
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// partial pivoting LU and one solve per matrix, in place
+void hostLuSolve(std::vector<float>& a, std::vector<float>& b, uint32_t n, uint32_t batchCount) {
+  std::vector<uint32_t> permutation(n);
+  for (uint32_t batch = 0; batch < batchCount; ++batch) {
+    float* m = a.data() + size_t{batch} * n * n;
+    float* x = b.data() + size_t{batch} * n;
+    for (uint32_t k = 0; k < n; ++k) {
+      uint32_t pivot = k;
+      for (uint32_t i = k + 1; i < n; ++i) {
+        if (std::abs(m[i * n + k]) > std::abs(m[pivot * n + k])) {
+          pivot = i;
+        }
+      }
+      std::swap_ranges(m + k * n, m + (k + 1) * n, m + pivot * n);
+      std::swap(x[k], x[pivot]);
+      float const inverse = m[k * n + k] != 0.f ? 1.f / m[k * n + k] : 0.f;
+      for (uint32_t i = k + 1; i < n; ++i) {
+        float const l = m[i * n + k] * inverse;
+        m[i * n + k] = l;
+        for (uint32_t j = k + 1; j < n; ++j) {
+          m[i * n + j] -= l * m[k * n + j];
+        }
+        x[i] -= l * x[k];
+      }
+    }
+    for (uint32_t k = n; k-- > 0;) {
+      for (uint32_t j = k + 1; j < n; ++j) {
+        x[k] -= m[k * n + j] * x[j];
+      }
+      x[k] /= m[k * n + k];
+    }
+  }
+}
+
+void printRow(char const* name, uint32_t batchCount, double ns) {
+  std::printf("%-32s %12.3f %14.1f\n", name, ns / 1e6, ns > 0 ? batchCount / ns * 1e3 : 0);
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const batchCount = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 200000;
+  std::unique_ptr<GpuContext> gpu = createGpuContext();
+  if (!gpu) {
+    return 1;
+  }
+  {
+    BatchedSolver solver(gpu->device.get(), gpu->shaders.get());
+    if (!solver) {
+      return 1;
+    }
+    for (EKind kind : {EKind::Lu, EKind::Cholesky, EKind::Lower, EKind::Upper, EKind::UnitLower}) {
+      for (uint32_t n : {1U, 3U, 4U, 7U, 8U, 13U, 16U, 25U, 32U}) {
+        if (!verify(*gpu, solver, kind, n, n % 3 + 1)) {
+          return 1;
+        }
+      }
+    }
+    std::printf("correctness: ok\n");
+
+    VulkanDevice& dev = *gpu->device;
+    ComputeStream& stream = *gpu->stream;
+    std::mt19937 rng{1};
+    std::printf("batch: %u\n", batchCount);
+    std::printf("%-32s %12s %14s\n", "operation", "time (ms)", "kmatrices/s");
+    for (uint32_t n : {4U, 8U, 16U, 32U}) {
+      std::vector<float> a = randomMatrices(rng, EKind::Cholesky, n, batchCount);
+      std::vector<float> b(size_t{n} * batchCount, 1.f);
+      DeviceBuffer dA = createDeviceBuffer(dev, a.size() * sizeof(float));
+      DeviceBuffer dB = createDeviceBuffer(dev, b.size() * sizeof(float));
+      DeviceBuffer dPermutation = createDeviceBuffer(dev, size_t{n} * batchCount * sizeof(uint32_t));
+      if (!dA || !dB || !dPermutation) {
+        return 1;
+      }
+      stream.upload(dA, interleave(a, n * n, batchCount).data(), a.size() * sizeof(float));
+      stream.upload(dB, b.data(), b.size() * sizeof(float));
+      stream.submitAndWait();
+
+      char name[64];
+      std::snprintf(name, sizeof(name), "gpu lu + solve %ux%u", n, n);
+      printRow(name, batchCount, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+        solver.factorLu(cmd, n, batchCount, batchCount, dA.address, dPermutation.address, 0);
+        computeBarrier(dev, cmd);
+        solver.solveLu(cmd, n, 1, batchCount, batchCount, dA.address, dPermutation.address, dB.address);
+      }));
+      std::snprintf(name, sizeof(name), "gpu cholesky + solve %ux%u", n, n);
+      printRow(name, batchCount, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+        solver.factorCholesky(cmd, n, batchCount, batchCount, dA.address, 0);
+        computeBarrier(dev, cmd);
+        solver.solveCholesky(cmd, n, 1, batchCount, batchCount, dA.address, dB.address);
+      }));
+
+      std::vector<double> samples;
+      for (uint32_t rep = 0; rep < REPETITIONS; ++rep) {
+        std::vector<float> hostA = a;
+        std::vector<float> hostB = b;
+        Clock::time_point const start = Clock::now();
+        hostLuSolve(hostA, hostB, n, batchCount);
+        samples.push_back(static_cast<double>(elapsedNs(start, Clock::now())));
+      }
+      std::sort(samples.begin(), samples.end());
+      std::snprintf(name, sizeof(name), "host lu + solve %ux%u", n, n);
+      printRow(name, batchCount, samples[samples.size() / 2]);
+
+      for (DeviceBuffer* buffer : {&dA, &dB, &dPermutation}) {
+        destroyDeviceBuffer(dev, *buffer);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,250 @@
+// Sparse matrix times vector per format against a multithreaded host CSR
+// loop, on a 2D Laplacian (short regular rows), a power law graph (irregular
+// rows) and a matrix of long rows: GFLOP/s and GB/s of the matrix stream per
+// format, Auto's pick, then 20 ranking iterations reusing one analysis.
+// Before, every format is checked against the host with alpha and beta.
+// GPU times are medians of GPU timestamps, host times medians of runs
+// usage: avkex-bench-spmv [laplacian side]
+#include "bench-gpu.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+using namespace avkex;
+using namespace avkex::bench;
+
+namespace {
+
+uint32_t constexpr REPETITIONS = 7;
+uint32_t constexpr ITERATIONS = 20;
+
+char const* formatName(ESpmvFormat format) {
+  switch (format) {
+  case ESpmvFormat::CsrSubgroup: return "csr subgroup";
+  case ESpmvFormat::CsrWorkgroup: return "csr workgroup";
+  case ESpmvFormat::Sell: return "sell-c-sigma";
+  default: return "auto";
+  }
+}
+
+CsrMatrix laplacian(uint32_t side) {
+  CsrMatrix csr;
+  csr.rows = side * side;
+  csr.columns = csr.rows;
+  csr.rowOffsets.push_back(0);
+  for (uint32_t i = 0; i < side; ++i) {
+    for (uint32_t j = 0; j < side; ++j) {
+      uint32_t const row = i * side + j;
+      auto const add = [&csr](uint32_t column, float value) {
+        csr.columnIndices.push_back(column);
+        csr.values.push_back(value);
+      };
+      if (i > 0) add(row - side, -1.f);
+      if (j > 0) add(row - 1, -1.f);
+      add(row, 4.f);
+      if (j + 1 < side) add(row + 1, -1.f);
+      if (i + 1 < side) add(row + side, -1.f);
+      csr.rowOffsets.push_back(static_cast<uint32_t>(csr.columnIndices.size()));
+    }
+  }
+  return csr;
+}
+
+// rows of random length lengthOf(rng), random distinct-ish columns, values
+// normalized per row like a transition matrix
+template <typename F>
+CsrMatrix randomRows(std::mt19937& rng, uint32_t rows, uint32_t columns, F&& lengthOf) {
+  CsrMatrix csr;
+  csr.rows = rows;
+  csr.columns = columns;
+  csr.rowOffsets.push_back(0);
+  for (uint32_t row = 0; row < rows; ++row) {
+    uint32_t const length = std::min<uint32_t>(columns, static_cast<uint32_t>(lengthOf(rng)));
+    for (uint32_t k = 0; k < length; ++k) {
+      csr.columnIndices.push_back(rng() % columns);
+      csr.values.push_back(1.f / static_cast<float>(length));
+    }
+    std::sort(csr.columnIndices.end() - length, csr.columnIndices.end());
+    csr.rowOffsets.push_back(static_cast<uint32_t>(csr.columnIndices.size()));
+  }
+  return csr;
+}
+
+void hostSpmv(CsrMatrix const& csr, float const* x, float* y) {
+  uint32_t const threadCount = std::max(1U, std::thread::hardware_concurrency());
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < threadCount; ++t) {
+    threads.emplace_back([&csr, x, y, t, threadCount]() {
+      for (uint64_t row = uint64_t{csr.rows} * t / threadCount; row < uint64_t{csr.rows} * (t + 1) / threadCount; ++row) {
+        float sum = 0.f;
+        for (uint32_t e = csr.rowOffsets[row]; e < csr.rowOffsets[row + 1]; ++e) {
+          sum += csr.values[e] * x[csr.columnIndices[e]];
+        }
+        y[row] = sum;
+      }
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+}
+
+bool verify(GpuContext& gpu, Spmv& spmv, CsrMatrix const& csr, ESpmvFormat format) {
+  VulkanDevice& dev = *gpu.device;
+  ComputeStream& stream = *gpu.stream;
+  std::mt19937 rng{csr.rows};
+  std::vector<float> x(csr.columns);
+  std::vector<float> y(csr.rows);
+  for (float& value : x) {
+    value = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
+  }
+  for (float& value : y) {
+    value = std::uniform_real_distribution<float>{-1.f, 1.f}(rng);
+  }
+  float const alpha = 1.5f;
+  float const beta = 0.5f;
+  SpmvMatrix matrix = spmv.analyze(stream, csr, format);
+  DeviceBuffer dX = createDeviceBuffer(dev, x.size() * sizeof(float));
+  DeviceBuffer dY = createDeviceBuffer(dev, y.size() * sizeof(float));
+  if (!matrix || !dX || !dY) {
+    return false;
+  }
+  if (csr.rows == 0) {
+    destroyDeviceBuffer(dev, dX);
+    destroyDeviceBuffer(dev, dY);
+    return true;
+  }
+  stream.upload(dX, x.data(), x.size() * sizeof(float));
+  stream.upload(dY, y.data(), y.size() * sizeof(float));
+  stream.barrier();
+  spmv.multiply(stream.commandBuffer(), matrix, alpha, dX.address, beta, dY.address);
+  std::vector<float> result(csr.rows);
+  stream.barrier();
+  stream.download(dY, result.data(), result.size() * sizeof(float));
+  stream.submitAndWait();
+  destroyDeviceBuffer(dev, dX);
+  destroyDeviceBuffer(dev, dY);
+
+  for (uint32_t row = 0; row < csr.rows; ++row) {
+    double sum = 0;
+    double scale = std::abs(beta * y[row]);
+    for (uint32_t e = csr.rowOffsets[row]; e < csr.rowOffsets[row + 1]; ++e) {
+      double const term = double{csr.values[e]} * x[csr.columnIndices[e]];
+      sum += term;
+      scale += std::abs(alpha * term);
+    }
+    double const expected = alpha * sum + beta * y[row];
+    if (!(std::abs(expected - result[row]) <= 1e-5 * scale + 1e-30)) {
+      std::printf("mismatch: %s, %u rows, row %u: expected %g, got %g\n", formatName(matrix.format()), csr.rows, row, expected,
+        result[row]);
+      return false;
+    }
+  }
+  return true;
+}
+
+void printRow(char const* name, double flops, double bytes, double ns) {
+  std::printf("%-44s %12.3f %10.1f %10.1f\n", name, ns / 1e6, ns > 0 ? flops / ns : 0, ns > 0 ? bytes / ns : 0);
+}
+
+}
+
+int main(int argc, char** argv) {
+  uint32_t const side = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 2048;
+  std::unique_ptr<GpuContext> gpu = createGpuContext();
+  if (!gpu) {
+    return 1;
+  }
+  {
+    Spmv spmv(gpu->device.get(), gpu->shaders.get());
+    if (!spmv) {
+      return 1;
+    }
+    std::mt19937 rng{3};
+    struct Case {
+      char const* name;
+      CsrMatrix csr;
+    };
+    std::vector<Case> cases;
+    cases.push_back({"laplacian", laplacian(side)});
+    uint32_t const graphRows = side * side / 2;
+    cases.push_back({"power law", randomRows(rng, graphRows, graphRows, [](std::mt19937& r) {
+      // P(length > l) ~ 1 / l
+      double const u = std::uniform_real_distribution<double>{1e-6, 1.0}(r);
+      return static_cast<uint32_t>(std::min(4.0 / u, 1e5));
+    })});
+    cases.push_back({"long rows", randomRows(rng, 2048, side * side, [](std::mt19937& r) { return 3000 + r() % 2000; })});
+
+    // small and uneven versions first, every format
+    std::vector<CsrMatrix> checks{laplacian(37), randomRows(rng, 5000, 4000, [](std::mt19937& r) {
+      return r() % 50 == 0 ? 3000 + r() % 100 : r() % 12;
+    }), randomRows(rng, 300, 70000, [](std::mt19937& r) { return 1000 + r() % 3000; })};
+    checks.push_back({});
+    checks.back().rowOffsets.push_back(0);
+    for (CsrMatrix const& csr : checks) {
+      for (ESpmvFormat format : {ESpmvFormat::Auto, ESpmvFormat::CsrSubgroup, ESpmvFormat::CsrWorkgroup, ESpmvFormat::Sell}) {
+        if (!verify(*gpu, spmv, csr, format)) {
+          return 1;
+        }
+      }
+    }
+    std::printf("correctness: ok\n");
+
+    VulkanDevice& dev = *gpu->device;
+    ComputeStream& stream = *gpu->stream;
+    std::printf("%-44s %12s %10s %10s\n", "operation", "time (ms)", "GFLOP/s", "GB/s");
+    for (Case const& c : cases) {
+      CsrMatrix const& csr = c.csr;
+      uint64_t const nonZeros = csr.columnIndices.size();
+      double const flops = 2.0 * nonZeros;
+      std::vector<float> x(std::max(csr.rows, csr.columns), 1.f / csr.columns);
+      DeviceBuffer dX = createDeviceBuffer(dev, x.size() * sizeof(float));
+      DeviceBuffer dY = createDeviceBuffer(dev, x.size() * sizeof(float));
+      if (!dX || !dY) {
+        return 1;
+      }
+      stream.upload(dX, x.data(), x.size() * sizeof(float));
+      stream.submitAndWait();
+      std::printf("%s: %u rows, %llu non zeros\n", c.name, csr.rows, static_cast<unsigned long long>(nonZeros));
+      for (ESpmvFormat format : {ESpmvFormat::Auto, ESpmvFormat::CsrSubgroup, ESpmvFormat::CsrWorkgroup, ESpmvFormat::Sell}) {
+        SpmvMatrix matrix = spmv.analyze(stream, csr, format);
+        if (!matrix) {
+          return 1;
+        }
+        stream.submitAndWait();
+        // entries, column indices and row offsets or slice data
+        double const bytes = matrix.storedEntries() * 8.0 + csr.rows * 4.0;
+        char name[80];
+        std::snprintf(name, sizeof(name), "gpu %s%s%s (stored %.2fx)", formatName(format), format == ESpmvFormat::Auto ? ": " : "",
+          format == ESpmvFormat::Auto ? formatName(matrix.format()) : "", static_cast<double>(matrix.storedEntries()) / nonZeros);
+        printRow(name, flops, bytes, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+          spmv.multiply(cmd, matrix, 1.f, dX.address, 0.f, dY.address);
+        }));
+        if (format == ESpmvFormat::Auto && csr.rows == csr.columns) {
+          // x <- A x, ping-ponging the vectors
+          std::snprintf(name, sizeof(name), "gpu %u iterations", ITERATIONS);
+          printRow(name, flops * ITERATIONS, bytes * ITERATIONS, gpuMedianNs(stream, REPETITIONS, [&](VkCommandBuffer cmd) {
+            for (uint32_t i = 0; i < ITERATIONS; ++i) {
+              spmv.multiply(cmd, matrix, 1.f, i % 2 == 0 ? dX.address : dY.address, 0.f, i % 2 == 0 ? dY.address : dX.address);
+              computeBarrier(dev, cmd);
+            }
+          }));
+        }
+      }
+      std::vector<float> y(csr.rows);
+      std::vector<double> samples;
+      for (uint32_t rep = 0; rep < REPETITIONS; ++rep) {
+        Clock::time_point const start = Clock::now();
+        hostSpmv(csr, x.data(), y.data());
+        samples.push_back(static_cast<double>(elapsedNs(start, Clock::now())));
+      }
+      std::sort(samples.begin(), samples.end());
+      printRow("host csr, all threads", flops, nonZeros * 8.0 + csr.rows * 4.0, samples[samples.size() / 2]);
+      destroyDeviceBuffer(dev, dX);
+      destroyDeviceBuffer(dev, dY);
+    }
+  }
+  return 0;
+}
@@ -1,4 +1,4 @@
-// TODO: Translate this into SPIR-V With the Subgroup instructions
+// Warp level sketch, translated into SPIR-V with the subgroup instructions in bitonic.comp
 #include <cuda_runtime.h>
 #include <vector>
 #include <iostream>
@@ -0,0 +1,110 @@
+// Build time shader packer: reflects every SPIR-V file once and writes them,
+// with their reflection, into a single pack mapped at runtime by
+// avkex::ShaderPack.
+// usage: avkex-shaderpack <out.avkpack> <[name=]file[,DEFINE[=value]]...>...
+// the default name is the file name up to its first '.'. .spv files are
+// packed as is, .comp/.glsl (GLSL) and .hlsl (HLSL) are compiled as compute
+// shaders first, with the given defines: one source gives several kernels
+#include "avkex.h"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string readText(std::filesystem::path const& path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return {};
+  return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+std::vector<uint32_t> readSpirv(std::filesystem::path const& path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) return {};
+  std::streamsize const size = file.tellg();
+  if ((size & (sizeof(uint32_t) - 1)) != 0) return {}; // SPIR-V is 4-byte aligned
+  file.seekg(0, std::ios::beg);
+
+  std::vector<uint32_t> words(size / sizeof(uint32_t));
+  file.read(reinterpret_cast<char*>(words.data()), size);
+  if (!file || words.size() < 5) return {}; // SPIR-V header is 5 words
+  return words;
+}
+
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "usage: " << argv[0] << " <out.avkpack> <[name=]file[,DEFINE[=value]]...>..." << std::endl;
+    return 1;
+  }
+
+  // no disk cache, the build system tracks the sources. Sources compile in
+  // parallel on the compiler workers
+  avkex::ShaderCompiler compiler{std::filesystem::path{}};
+  std::vector<avkex::ShaderPack::Input> inputs(argc - 2);
+  std::vector<std::filesystem::path> paths(argc - 2);
+  std::vector<std::future<std::vector<uint32_t>>> compiled(argc - 2);
+  for (int i = 2; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    avkex::ShaderPack::Input& input = inputs[i - 2];
+    std::filesystem::path& path = paths[i - 2];
+    avkex::ShaderSource source;
+    for (size_t comma = arg.rfind(','); comma != std::string_view::npos; comma = arg.rfind(',')) {
+      std::string_view const define = arg.substr(comma + 1);
+      size_t const eq = define.find('=');
+      source.defines.emplace(source.defines.begin(), define.substr(0, eq), eq == std::string_view::npos ? std::string_view{} : define.substr(eq + 1));
+      arg = arg.substr(0, comma);
+    }
+    if (size_t const eq = arg.find('='); eq != std::string_view::npos) {
+      input.name = arg.substr(0, eq);
+      path = arg.substr(eq + 1);
+    } else {
+      path = arg;
+      std::string const fileName = path.filename().string();
+      input.name = fileName.substr(0, fileName.find('.'));
+    }
+    for (int j = 0; j < i - 2; ++j) {
+      if (inputs[j].name == input.name) {
+        LOG_ERR << "Duplicate shader name " << input.name << LOG_RST << std::endl;
+        return 1;
+      }
+    }
+
+    // absolute, the watcher matches the file it sees change
+    std::error_code ec;
+    input.source = std::filesystem::absolute(path, ec).generic_string();
+    input.defines = source.defines;
+
+    std::string const extension = path.extension().string();
+    if (extension == ".spv") {
+      input.code = readSpirv(path);
+    } else if (extension == ".comp" || extension == ".glsl" || extension == ".hlsl") {
+      source.language = extension == ".hlsl" ? avkex::EShaderLanguage::Hlsl : avkex::EShaderLanguage::Glsl;
+      source.code = readText(path);
+      if (!source.code.empty()) {
+        compiled[i - 2] = compiler.compile(std::move(source));
+      }
+    }
+  }
+
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    avkex::ShaderPack::Input& input = inputs[i];
+    if (compiled[i].valid()) {
+      input.code = compiled[i].get();
+    }
+    if (input.code.empty()) {
+      LOG_ERR << "Couldn't get SPIR-V for " << input.name << " from " << paths[i].string() << LOG_RST << std::endl;
+      return 1;
+    }
+    if (!avkex::reflectShader(input.code.data(), input.code.size() * sizeof(uint32_t), input.entryPoints)) {
+      LOG_ERR << "Couldn't reflect " << paths[i].string() << LOG_RST << std::endl;
+      return 1;
+    }
+  }
+
+  return avkex::ShaderPack::write(argv[1], inputs) ? 0 : 1;
+}